@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <atomic>
+
+/**
+ * \brief A ledger of the notes which have been sent out and not yet turned off again
+ * The notes are kept in a compact list (so going through all the sounding notes is O(sounding notes)), with an index
+ * from each channel and note into that list (so adding and removing notes is O(1)). The list itself is only touched
+ * by the jack process call, and a set of bits for each channel mirrors it for anybody else who wants to know what
+ * is currently sounding.
+ */
+class ActiveNoteLedger {
+public:
+    ActiveNoteLedger() {
+        std::fill_n(index, 2048, -1);
+    }
+    /**
+     * \brief Update the ledger with a midi message which has just been sent out
+     * @note Only call this from the jack process call
+     */
+    inline void track(const quint8 *data, quint8 size) {
+        if (size == 3) {
+            const quint8 status{quint8(data[0] & 0xF0)};
+            if (status == 0x90 && data[2] > 0) {
+                add(data[0] & 0x0F, data[1] & 0x7F);
+            } else if (status == 0x80 || status == 0x90) {
+                remove(data[0] & 0x0F, data[1] & 0x7F);
+            } else if (status == 0xB0 && (data[1] == 120 || data[1] == 123)) {
+                // All sound off and all notes off both mean nothing is sounding on that channel any longer
+                removeChannel(data[0] & 0x0F);
+            }
+        }
+    }
+    /**
+     * \brief Call the given function with a note off message for each sounding note, and empty the ledger
+     * @note Only call this from the jack process call
+     */
+    template<typename Function>
+    inline void takeNoteOffs(Function function) {
+        quint8 message[3]{0, 0, 0};
+        while (count > 0) {
+            const quint16 entry{notes[count - 1]};
+            message[0] = 0x80 + (entry >> 7);
+            message[1] = entry & 0x7F;
+            remove(entry >> 7, entry & 0x7F);
+            function(message, quint8(3));
+        }
+    }
+    /**
+     * \brief Whether the given note is currently sounding
+     * @note This is safe to call from any thread
+     */
+    inline bool isActive(int channel, int note) const {
+        return (bits[channel][note >> 6].load(std::memory_order_relaxed) >> (note & 63)) & 1;
+    }
+    /**
+     * \brief Call the given function for each sounding note, in channel and note order
+     * @note This is safe to call from any thread (though the result is only a snapshot, and may be out of date immediately)
+     */
+    template<typename Function>
+    inline void forEachActive(Function function) const {
+        for (int channel = 0; channel < 16; ++channel) {
+            for (int word = 0; word < 2; ++word) {
+                quint64 value{bits[channel][word].load(std::memory_order_relaxed)};
+                while (value) {
+                    const int bit{__builtin_ctzll(value)};
+                    function(channel, (word << 6) + bit);
+                    value &= value - 1;
+                }
+            }
+        }
+    }
+private:
+    inline void add(int channel, int note) {
+        const quint16 entry{quint16((channel << 7) + note)};
+        if (index[entry] == -1) {
+            index[entry] = qint16(count);
+            notes[count] = entry;
+            ++count;
+            bits[channel][note >> 6].fetch_or(quint64(1) << (note & 63), std::memory_order_relaxed);
+        }
+    }
+    inline void remove(int channel, int note) {
+        const quint16 entry{quint16((channel << 7) + note)};
+        const qint16 position{index[entry]};
+        if (position != -1) {
+            // Swap the last entry into the removed one's place, to keep the list compact
+            --count;
+            notes[position] = notes[count];
+            index[notes[position]] = position;
+            index[entry] = -1;
+            bits[channel][note >> 6].fetch_and(~(quint64(1) << (note & 63)), std::memory_order_relaxed);
+        }
+    }
+    inline void removeChannel(int channel) {
+        for (int word = 0; word < 2; ++word) {
+            quint64 value{bits[channel][word].load(std::memory_order_relaxed)};
+            while (value) {
+                remove(channel, (word << 6) + __builtin_ctzll(value));
+                value &= value - 1;
+            }
+        }
+    }
+    // The sounding notes, each stored as (channel << 7) + note
+    quint16 notes[2048];
+    int count{0};
+    // The position of each channel and note in the notes list, or -1 if it is not sounding
+    qint16 index[2048];
+    std::atomic<quint64> bits[16][2]{};
+};
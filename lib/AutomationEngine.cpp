@@ -0,0 +1,406 @@
+#include "AutomationEngine.h"
+#include "AutomationLaneState.h"
+#include "TimerCommand.h"
+
+#include <QDebug>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+
+// The number of lanes which can exist at once
+#define AutomationLaneCount 64
+// The largest number of times a lane can be evaluated during a single jack cycle
+#define AutomationMaximumSubdivisions 16
+// The number of changes which can be waiting for the process call to pick them up
+#define AutomationUpdateQueueSize 128
+// How often (in milliseconds) to emit the changed signals of the clips being automated
+#define AutomationClipNotificationInterval 50
+// How long (in milliseconds) to wait for the process call to pick up the removal of a clip target
+#define AutomationClipRemovalTimeout 500
+
+typedef ControlEngineUpdateQueue<AutomationLaneSettings, AutomationUpdateQueueSize> AutomationLaneUpdateQueue;
+
+class AutomationEnginePrivate {
+public:
+    AutomationEnginePrivate() {
+        for (int i = 0; i < AutomationLaneCount; ++i) {
+            allocated[i] = false;
+            values[i].store(0.0f);
+        }
+    }
+    // Only touched by the process call
+    AutomationLaneState lanes[AutomationLaneCount];
+
+    // Only touched outside the process call, with the mutex held
+    QMutex mutex;
+    bool allocated[AutomationLaneCount];
+    AutomationLaneSettings settings[AutomationLaneCount];
+    // The clips which are the target of any lane, whose changed signals need emitting every now and then
+    QList<ClipAudioSource*> automatedClips;
+    QTimer *clipNotificationTimer{nullptr};
+
+    // Written outside the process call (with the mutex held), and read by the process call
+    AutomationLaneUpdateQueue updates;
+
+    // The most recent value of each lane, for laneValue()
+    std::atomic<float> values[AutomationLaneCount];
+
+    // Call with the mutex held
+    bool enqueue(AutomationLaneUpdateQueue::Kind kind, int lane) {
+        if (updates.enqueue(kind, lane, settings[lane])) {
+            return true;
+        }
+        qWarning() << Q_FUNC_INFO << "The automation update queue is full, dropping update for lane" << lane;
+        return false;
+    }
+    // Call with the mutex held
+    void updateAutomatedClips() {
+        automatedClips.clear();
+        for (int i = 0; i < AutomationLaneCount; ++i) {
+            if (allocated[i] && settings[i].target == AutomationEngine::ClipTarget && settings[i].clip && !automatedClips.contains(settings[i].clip)) {
+                automatedClips << settings[i].clip;
+            }
+        }
+        QMetaObject::invokeMethod(clipNotificationTimer, automatedClips.isEmpty() ? "stop" : "start", Qt::QueuedConnection);
+    }
+    // Only called by the process call. Evaluate the lane for the given stretch of time, starting at the given tick position, and send its values on to its target
+    void evaluateLane(int lane, double tickPosition, double fromUsecs, double microsecondsPerTick, double lengthMicroseconds, ControlEngineEvents &events) {
+        AutomationLaneState &state = lanes[lane];
+        bool finished{false};
+        bool sent{true};
+        const AutomationLaneSettings &settings = state.settings;
+        if (settings.target == AutomationEngine::ControlChangeTarget) {
+            for (int subdivision = 0; subdivision < settings.subdivisions && !finished && sent; ++subdivision) {
+                const double offset{lengthMicroseconds * double(subdivision) / double(settings.subdivisions)};
+                const float value{state.evaluate(qMax(0.0, tickPosition + (offset / microsecondsPerTick) - state.startTick), finished)};
+                values[lane].store(value, std::memory_order_relaxed);
+                sent = ControlEngineTargets::sendControlChange(events, state.sent, settings.midiChannel, settings.control, value, fromUsecs + offset);
+            }
+        } else {
+            const float value{state.evaluate(qMax(0.0, tickPosition - state.startTick), finished)};
+            values[lane].store(value, std::memory_order_relaxed);
+            switch (settings.target) {
+                case AutomationEngine::PassthroughTarget:
+                    ControlEngineTargets::sendPassthrough(state.sent, settings.passthrough, settings.passthroughSetting, value);
+                    break;
+                case AutomationEngine::ClipTarget:
+                    if (ControlEngineTargets::valueChanged(state.sent.lastValue, value)) {
+                        settings.clip->setSettingRealtime(settings.clipSetting, settings.clipSetting == ClipAudioSource::PanSetting ? (value * 2.0f) - 1.0f : value);
+                        state.sent.lastValue = value;
+                    }
+                    break;
+                case AutomationEngine::CallbackTarget:
+                    if (ControlEngineTargets::valueChanged(state.sent.lastValue, value)) {
+                        settings.callback(value, settings.callbackUserData);
+                        state.sent.lastValue = value;
+                    }
+                    break;
+                case AutomationEngine::ControlChangeTarget:
+                case AutomationEngine::NoTarget:
+                default:
+                    break;
+            }
+        }
+        if (finished && sent) {
+            state.running = false;
+        }
+    }
+};
+
+AutomationEngine::AutomationEngine(SyncTimer *parent)
+    : QObject(parent)
+    , d(new AutomationEnginePrivate)
+{
+    d->clipNotificationTimer = new QTimer(this);
+    d->clipNotificationTimer->setInterval(AutomationClipNotificationInterval);
+    connect(d->clipNotificationTimer, &QTimer::timeout, this, [this](){
+        QMutexLocker locker(&d->mutex);
+        for (ClipAudioSource *clip : qAsConst(d->automatedClips)) {
+            clip->emitPendingChanges();
+        }
+    });
+}
+
+AutomationEngine::~AutomationEngine()
+{
+    delete d;
+}
+
+int AutomationEngine::addLane(const QList<int> &pointTicks, const QList<float> &pointValues, bool loop)
+{
+    AutomationLaneSettings settings;
+    if (!settings.setPoints(pointTicks, pointValues, loop)) {
+        return -1;
+    }
+    QMutexLocker locker(&d->mutex);
+    for (int i = 0; i < AutomationLaneCount; ++i) {
+        if (!d->allocated[i]) {
+            d->allocated[i] = true;
+            d->settings[i] = settings;
+            d->values[i].store(settings.pointValues[0]);
+            if (d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, i)) {
+                return i;
+            }
+            d->allocated[i] = false;
+            return -1;
+        }
+    }
+    qWarning() << Q_FUNC_INFO << "Attempted to add an automation lane, but all" << AutomationLaneCount << "lanes are in use";
+    return -1;
+}
+
+bool AutomationEngine::setLanePoints(int lane, const QList<int> &pointTicks, const QList<float> &pointValues, bool loop)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        if (d->settings[lane].setPoints(pointTicks, pointValues, loop)) {
+            return d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+        }
+    }
+    return false;
+}
+
+void AutomationEngine::removeLane(int lane)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        d->settings[lane] = AutomationLaneSettings();
+        if (d->enqueue(AutomationLaneUpdateQueue::RemoveUpdate, lane)) {
+            d->allocated[lane] = false;
+            d->updateAutomatedClips();
+        }
+    }
+}
+
+void AutomationEngine::setInterpolation(int lane, Interpolation interpolation)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        d->settings[lane].interpolation = interpolation;
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+    }
+}
+
+void AutomationEngine::setControlChangeTarget(int lane, int midiChannel, int control)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        AutomationLaneSettings &settings = d->settings[lane];
+        settings.target = ControlChangeTarget;
+        settings.midiChannel = std::clamp(midiChannel, 0, 15);
+        settings.control = std::clamp(control, 0, 127);
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+        d->updateAutomatedClips();
+    }
+}
+
+void AutomationEngine::setPassthroughTarget(int lane, int channel, int setting)
+{
+    JackPassthrough *passthrough{ControlEngineTargets::passthroughClient(channel, setting)};
+    if (!passthrough) {
+        return;
+    }
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        AutomationLaneSettings &settings = d->settings[lane];
+        settings.target = PassthroughTarget;
+        settings.passthrough = passthrough;
+        settings.passthroughSetting = static_cast<JackPassthrough::Setting>(setting);
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+        d->updateAutomatedClips();
+    }
+}
+
+void AutomationEngine::setClipTarget(int lane, QObject *clip, int setting)
+{
+    ClipAudioSource *clipAudioSource{qobject_cast<ClipAudioSource*>(clip)};
+    if (!clipAudioSource || setting < ClipAudioSource::VolumeAbsoluteSetting || setting > ClipAudioSource::PanSetting) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set an invalid clip target, with clip" << clip << "and setting" << setting;
+        return;
+    }
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        AutomationLaneSettings &settings = d->settings[lane];
+        settings.target = ClipTarget;
+        settings.clip = clipAudioSource;
+        settings.clipSetting = static_cast<ClipAudioSource::Setting>(setting);
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+        d->updateAutomatedClips();
+    }
+}
+
+void AutomationEngine::removeClipTargets(ClipAudioSource *clip)
+{
+    bool changed{false};
+    bool enqueued{true};
+    quint32 write{0};
+    {
+        QMutexLocker locker(&d->mutex);
+        for (int i = 0; i < AutomationLaneCount; ++i) {
+            AutomationLaneSettings &settings = d->settings[i];
+            if (d->allocated[i] && settings.target == ClipTarget && settings.clip == clip) {
+                settings.target = NoTarget;
+                settings.clip = nullptr;
+                // This update must not be dropped (or the process call would hang on to the clip), so wait for space if the queue is full
+                int waitCount{0};
+                while (!d->updates.enqueue(AutomationLaneUpdateQueue::SettingsUpdate, i, settings)) {
+                    if (waitCount > AutomationClipRemovalTimeout) {
+                        enqueued = false;
+                        break;
+                    }
+                    QThread::msleep(1);
+                    ++waitCount;
+                }
+                changed = true;
+            }
+        }
+        if (changed) {
+            d->updateAutomatedClips();
+            write = d->updates.writePosition();
+        }
+    }
+    if (changed) {
+        // Wait for the process call to pick up the change, so the clip is known to be out of use when we return
+        int waitCount{0};
+        while (enqueued && !d->updates.hasProcessed(write)) {
+            if (waitCount > AutomationClipRemovalTimeout) {
+                break;
+            }
+            QThread::msleep(1);
+            ++waitCount;
+        }
+        if (!enqueued) {
+            qCritical() << Q_FUNC_INFO << "Could not pass the removal of the targets for clip" << clip << "on to the process call, which will go on using the clip after it has been deleted";
+        } else if (!d->updates.hasProcessed(write)) {
+            // The process call picks up its updates before evaluating any lanes, so this is only a problem if it is stuck part of the way through a run
+            qCritical() << Q_FUNC_INFO << "Timed out waiting for the process call to pick up the removal of the targets for clip" << clip << "- if the process call is not stalled, it may go on using the clip after it has been deleted";
+        }
+    }
+}
+
+void AutomationEngine::setCallbackTarget(int lane, AutomationCallback callback, void *userData)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        AutomationLaneSettings &settings = d->settings[lane];
+        settings.target = callback ? CallbackTarget : NoTarget;
+        settings.callback = callback;
+        settings.callbackUserData = userData;
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+        d->updateAutomatedClips();
+    }
+}
+
+void AutomationEngine::setSubdivisions(int lane, int subdivisions)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        d->settings[lane].subdivisions = std::clamp(subdivisions, 1, AutomationMaximumSubdivisions);
+        d->enqueue(AutomationLaneUpdateQueue::SettingsUpdate, lane);
+    }
+}
+
+void AutomationEngine::startLane(int lane)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        d->enqueue(AutomationLaneUpdateQueue::StartUpdate, lane);
+    }
+}
+
+void AutomationEngine::stopLane(int lane)
+{
+    QMutexLocker locker(&d->mutex);
+    if (lane > -1 && lane < AutomationLaneCount && d->allocated[lane]) {
+        d->enqueue(AutomationLaneUpdateQueue::StopUpdate, lane);
+    }
+}
+
+void AutomationEngine::scheduleLaneStart(int lane, quint64 delay)
+{
+    if (lane > -1 && lane < AutomationLaneCount) {
+        qobject_cast<SyncTimer*>(parent())->scheduleTimerCommand(delay, TimerCommand::AutomationLaneOperation, lane, 1);
+    }
+}
+
+void AutomationEngine::scheduleLaneStop(int lane, quint64 delay)
+{
+    if (lane > -1 && lane < AutomationLaneCount) {
+        qobject_cast<SyncTimer*>(parent())->scheduleTimerCommand(delay, TimerCommand::AutomationLaneOperation, lane, 0);
+    }
+}
+
+float AutomationEngine::laneValue(int lane) const
+{
+    if (lane > -1 && lane < AutomationLaneCount) {
+        return d->values[lane].load(std::memory_order_relaxed);
+    }
+    return 0.0f;
+}
+
+int AutomationEngine::handleTimerCommand(const TimerCommand *command, double stepTick, double stepUsecs, double microsecondsPerTick, double remainingMicroseconds, unsigned char *eventData, double *eventUsecs, int maximumEvents)
+{
+    ControlEngineEvents events(eventData, eventUsecs, maximumEvents);
+    if (command->parameter > -1 && command->parameter < AutomationLaneCount) {
+        AutomationLaneState &state = d->lanes[command->parameter];
+        if (command->parameter2 == 0) {
+            state.running = false;
+        } else if (state.settings.pointCount > 0) {
+            state.running = true;
+            state.starting = false;
+            state.startTick = stepTick;
+            state.cursor = 0;
+            state.sent.forget();
+            // The lane starts on the step, not the next cycle, so it gets evaluated for what is left of this one straight away
+            d->evaluateLane(command->parameter, stepTick, stepUsecs, microsecondsPerTick, remainingMicroseconds, events);
+        }
+    }
+    return events.count;
+}
+
+int AutomationEngine::process(double tickPosition, quint64 currentUsecs, double microsecondsPerTick, double periodMicroseconds, unsigned char *eventData, double *eventUsecs, int maximumEvents)
+{
+    // First, pick up any changes made since last time
+    d->updates.process([this](const AutomationLaneUpdateQueue::Update &update){
+        AutomationLaneState &state = d->lanes[update.slot];
+        switch (update.kind) {
+            case AutomationLaneUpdateQueue::SettingsUpdate:
+                if (!state.settings.sameTarget(update.settings)) {
+                    state.sent.forget();
+                }
+                state.settings = update.settings;
+                break;
+            case AutomationLaneUpdateQueue::StartUpdate:
+                state.running = true;
+                state.starting = true;
+                state.cursor = 0;
+                break;
+            case AutomationLaneUpdateQueue::StopUpdate:
+                state.running = false;
+                break;
+            case AutomationLaneUpdateQueue::RemoveUpdate:
+                state = AutomationLaneState();
+                break;
+        }
+    });
+
+    // Then evaluate everything which is running
+    ControlEngineEvents events(eventData, eventUsecs, maximumEvents);
+    for (int i = 0; i < AutomationLaneCount; ++i) {
+        AutomationLaneState &state = d->lanes[i];
+        if (!state.running || state.settings.pointCount == 0) {
+            continue;
+        }
+        if (state.starting) {
+            // Lanes started outside the process call start at the start of this cycle
+            state.startTick = tickPosition;
+            state.starting = false;
+            state.sent.forget();
+        }
+        d->evaluateLane(i, tickPosition, double(currentUsecs), microsecondsPerTick, periodMicroseconds, events);
+    }
+    return events.count;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "SyncTimer.h"
+
+class AutomationEnginePrivate;
+/**
+ * \brief Breakpoint automation lanes, played back natively in time with SyncTimer
+ *
+ * Rather than sending every single value change from outside while playing, create a lane holding the breakpoints
+ * of the automation (each a tick position and a value between 0.0 and 1.0), give it a target, and start it (either
+ * right away, or scheduled on the timer, see scheduleLaneStart()). Between the breakpoints, the value is interpolated
+ * (or held, see setInterpolation()) and sent to the lane's target:
+ * - ControlChangeTarget: A CC message (value 0 through 127) on the given midi channel, sent out through SyncTimer
+ * - PassthroughTarget: One of the settings on one of ZLRouter's passthrough clients (see JackPassthrough::Setting),
+ *   where pan maps 0.0 through 1.0 onto -1.0 through 1.0, and muted is on for values of 0.5 and above
+ * - ClipTarget: The volume or pan of a clip as played by SamplerSynth (see ClipAudioSource::Setting), where pan maps
+ *   0.0 through 1.0 onto -1.0 through 1.0
+ * - CallbackTarget: A function you provide, for anything else (see setCallbackTarget())
+ *
+ * The lanes live in a flat, preallocated array, and are evaluated by SyncTimer's process call at the start of each
+ * jack cycle. Lanes with a CC target can also be evaluated several times during a cycle (see setSubdivisions()), in
+ * which case the messages are sent out at the position in the cycle they were evaluated for. A lane only sends
+ * something out when its target's value actually changes.
+ * The positions of breakpoints are measured in timer ticks (see SyncTimer::getMultiplier()), from the point the lane
+ * was started. Before its first breakpoint, a lane has the value of that breakpoint, and once it passes its last
+ * breakpoint, it either holds that value (and stops), or starts over (if set to loop).
+ *
+ * All the functions here are safe to call from any thread other than the jack process call. Changes are passed on
+ * to the process call through a lock-free queue, and take effect on the following jack cycle.
+ */
+class AutomationEngine : public QObject {
+    Q_OBJECT
+public:
+    static AutomationEngine* instance(SyncTimer *q = nullptr) {
+        static AutomationEngine* instance{nullptr};
+        if (!instance) {
+            instance = new AutomationEngine(q);
+        }
+        return instance;
+    };
+    explicit AutomationEngine(SyncTimer *parent = nullptr);
+    virtual ~AutomationEngine();
+
+    enum Interpolation {
+        LinearInterpolation = 0, ///< Move in a straight line from one breakpoint's value to the next
+        StepInterpolation = 1, ///< Hold each breakpoint's value until the next breakpoint is reached
+    };
+    Q_ENUM(Interpolation)
+    enum TargetType {
+        NoTarget = 0, ///< The lane runs, but sends its value nowhere
+        ControlChangeTarget = 1, ///< Send CC messages
+        PassthroughTarget = 2, ///< Set a setting on a passthrough client
+        ClipTarget = 3, ///< Set the volume or pan of a clip
+        CallbackTarget = 4, ///< Call a function with the value
+    };
+    Q_ENUM(TargetType)
+    /**
+     * \brief A function to receive the values of a lane (see setCallbackTarget())
+     * @note This is called from the jack process call, and must be realtime safe
+     * @param value The lane's value (0.0 through 1.0)
+     * @param userData The user data passed to setCallbackTarget()
+     */
+    typedef void (*AutomationCallback)(float value, void *userData);
+
+    /**
+     * \brief Create an automation lane
+     * @param pointTicks The position of each breakpoint in timer ticks, counted from the start of the lane (in ascending order, and there can be up to 64 breakpoints)
+     * @param pointValues The value of each breakpoint (0.0 through 1.0)
+     * @param loop Whether to start over once the last breakpoint is reached
+     * @return The ID of the new lane, or -1 if there are no free lanes left or the breakpoints are invalid
+     */
+    Q_INVOKABLE int addLane(const QList<int> &pointTicks, const QList<float> &pointValues, bool loop = false);
+    /**
+     * \brief Replace the breakpoints of a lane (a running lane keeps running, using the new breakpoints from its current position)
+     * @param lane The ID of the lane
+     * @param pointTicks The position of each breakpoint in timer ticks, counted from the start of the lane (in ascending order)
+     * @param pointValues The value of each breakpoint (0.0 through 1.0)
+     * @param loop Whether to start over once the last breakpoint is reached
+     * @return True if the breakpoints were valid and have been set
+     */
+    Q_INVOKABLE bool setLanePoints(int lane, const QList<int> &pointTicks, const QList<float> &pointValues, bool loop = false);
+    /**
+     * \brief Stop and remove the given lane (its ID may then be reused)
+     * @param lane The ID of the lane to remove
+     */
+    Q_INVOKABLE void removeLane(int lane);
+    /**
+     * \brief Set how the lane's value moves between breakpoints
+     * @param lane The ID of the lane
+     * @param interpolation The interpolation to use (the default is LinearInterpolation)
+     */
+    Q_INVOKABLE void setInterpolation(int lane, Interpolation interpolation);
+    /**
+     * \brief Send the lane's value as CC messages
+     * @param lane The ID of the lane
+     * @param midiChannel The midi channel to send the messages on (0 through 15)
+     * @param control The control to send (0 through 127)
+     */
+    Q_INVOKABLE void setControlChangeTarget(int lane, int midiChannel, int control);
+    /**
+     * \brief Send the lane's value to one of the settings on one of ZLRouter's passthrough clients
+     * @param lane The ID of the lane
+     * @param channel The passthrough client to change (-1 for global playback, 0 through 9 for the channels)
+     * @param setting The setting to change (see JackPassthrough::Setting)
+     */
+    Q_INVOKABLE void setPassthroughTarget(int lane, int channel, int setting);
+    /**
+     * \brief Send the lane's value to the volume or pan of a clip
+     * @param lane The ID of the lane
+     * @param clip The clip to change (a ClipAudioSource)
+     * @param setting The setting to change (see ClipAudioSource::Setting)
+     */
+    Q_INVOKABLE void setClipTarget(int lane, QObject *clip, int setting);
+    /**
+     * \brief Stop sending values to the given clip from any lane which targets it
+     * This is called by ClipAudioSource when it is destroyed, and only returns once the process call is no longer using the clip
+     * @param clip The clip which should no longer be targeted
+     */
+    void removeClipTargets(ClipAudioSource *clip);
+    /**
+     * \brief Send the lane's value to a function of your own
+     * @param lane The ID of the lane
+     * @param callback The function to call (from the jack process call) whenever the lane's value changes
+     * @param userData Passed to the callback along with the value
+     */
+    void setCallbackTarget(int lane, AutomationCallback callback, void *userData);
+    /**
+     * \brief Evaluate the lane several times during each jack cycle, rather than only at the start of it
+     * This only affects lanes with a CC target, as the other targets only pick up their values once per cycle anyway
+     * @param lane The ID of the lane
+     * @param subdivisions The number of times to evaluate the lane per jack cycle (1 through 16, the default is 1)
+     */
+    Q_INVOKABLE void setSubdivisions(int lane, int subdivisions);
+    /**
+     * \brief Start (or restart) the lane from the beginning, on the next jack cycle
+     * @param lane The ID of the lane
+     */
+    Q_INVOKABLE void startLane(int lane);
+    /**
+     * \brief Stop the lane on the next jack cycle (its target will keep the most recent value)
+     * @param lane The ID of the lane
+     */
+    Q_INVOKABLE void stopLane(int lane);
+    /**
+     * \brief Start (or restart) the lane from the beginning at a given point on the timer
+     * This schedules a TimerCommand::AutomationLaneOperation, so the lane starts on the exact step it is scheduled for
+     * @param lane The ID of the lane
+     * @param delay The number of timer ticks from now to start the lane at
+     */
+    Q_INVOKABLE void scheduleLaneStart(int lane, quint64 delay);
+    /**
+     * \brief Stop the lane at a given point on the timer (using a TimerCommand::AutomationLaneOperation)
+     * @param lane The ID of the lane
+     * @param delay The number of timer ticks from now to stop the lane at
+     */
+    Q_INVOKABLE void scheduleLaneStop(int lane, quint64 delay);
+    /**
+     * \brief The most recent value of the given lane
+     * @param lane The ID of the lane
+     * @return The value (0.0 through 1.0), or 0.0 if there is no such lane
+     */
+    Q_INVOKABLE float laneValue(int lane) const;
+protected:
+    // SyncTimer evaluates the lanes from its jack process call
+    friend class SyncTimerPrivate;
+    /**
+     * \brief Evaluate all the running lanes, and send their values on to their targets
+     * @param tickPosition The (fractional) timer tick position of the start of this jack cycle
+     * @param currentUsecs The time of the start of this jack cycle, in microseconds
+     * @param microsecondsPerTick The length of a timer tick at the current tempo
+     * @param periodMicroseconds The length of this jack cycle
+     * @param eventData Space for the midi events created for this cycle, three bytes per event
+     * @param eventUsecs Space for the time each of those events should be sent at
+     * @param maximumEvents The number of events there is space for
+     * @return The number of midi events written into eventData (and eventUsecs)
+     */
+    int process(double tickPosition, quint64 currentUsecs, double microsecondsPerTick, double periodMicroseconds, unsigned char *eventData, double *eventUsecs, int maximumEvents);
+    /**
+     * \brief Start or stop a lane as scheduled by a TimerCommand::AutomationLaneOperation
+     * A lane which is started is evaluated for the rest of the cycle straight away, so its first value goes out on
+     * the step it was scheduled for, rather than at the start of the next cycle
+     * @param command The command (parameter is the lane, parameter2 is 1 to start and 0 to stop)
+     * @param stepTick The timer tick of the step the command was scheduled on
+     * @param stepUsecs The time of that step, in microseconds
+     * @param microsecondsPerTick The length of a timer tick at the current tempo
+     * @param remainingMicroseconds The length of what is left of this jack cycle after the step
+     * @param eventData Space for the midi events created by starting the lane, three bytes per event
+     * @param eventUsecs Space for the time each of those events should be sent at
+     * @param maximumEvents The number of events there is space for
+     * @return The number of midi events written into eventData (and eventUsecs)
+     */
+    int handleTimerCommand(const TimerCommand *command, double stepTick, double stepUsecs, double microsecondsPerTick, double remainingMicroseconds, unsigned char *eventData, double *eventUsecs, int maximumEvents);
+private:
+    AutomationEnginePrivate *d{nullptr};
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "AutomationEngine.h"
+#include "ClipAudioSource.h"
+#include "ControlEngine.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+// The largest number of breakpoints a lane can have
+#define AutomationLanePointCount 64
+
+/**
+ * \brief Everything about a lane which is set from outside the process call
+ */
+struct AutomationLaneSettings {
+    quint32 pointTicks[AutomationLanePointCount];
+    float pointValues[AutomationLanePointCount];
+    int pointCount{0};
+    bool loop{false};
+    AutomationEngine::Interpolation interpolation{AutomationEngine::LinearInterpolation};
+    AutomationEngine::TargetType target{AutomationEngine::NoTarget};
+    int midiChannel{0};
+    int control{0};
+    JackPassthrough *passthrough{nullptr};
+    JackPassthrough::Setting passthroughSetting{JackPassthrough::DryAmountSetting};
+    ClipAudioSource *clip{nullptr};
+    ClipAudioSource::Setting clipSetting{ClipAudioSource::VolumeAbsoluteSetting};
+    AutomationEngine::AutomationCallback callback{nullptr};
+    void *callbackUserData{nullptr};
+    int subdivisions{1};
+
+    bool sameTarget(const AutomationLaneSettings &other) const {
+        return target == other.target && midiChannel == other.midiChannel && control == other.control && passthrough == other.passthrough && passthroughSetting == other.passthroughSetting && clip == other.clip && clipSetting == other.clipSetting && callback == other.callback;
+    }
+    /**
+     * \brief Replace the lane's breakpoints
+     * @param ticks The tick position of each breakpoint, in ascending order
+     * @param values The value of each breakpoint (clamped to 0.0 through 1.0)
+     * @param shouldLoop Whether to start over once the last breakpoint has been reached
+     * @return False (after warning about it, and leaving the settings untouched) if the breakpoints are not valid
+     */
+    bool setPoints(const QList<int> &ticks, const QList<float> &values, bool shouldLoop) {
+        if (ticks.isEmpty() || ticks.count() != values.count() || ticks.count() > AutomationLanePointCount) {
+            qWarning() << Q_FUNC_INFO << "Attempted to set an invalid set of breakpoints (there must be between 1 and" << AutomationLanePointCount << "breakpoints, with a value for each)";
+            return false;
+        }
+        for (int point = 1; point < ticks.count(); ++point) {
+            if (ticks[point] < ticks[point - 1]) {
+                qWarning() << Q_FUNC_INFO << "Attempted to set breakpoints which are not in ascending order";
+                return false;
+            }
+        }
+        pointCount = ticks.count();
+        for (int point = 0; point < pointCount; ++point) {
+            pointTicks[point] = quint32(qMax(0, ticks[point]));
+            pointValues[point] = std::clamp(values[point], 0.0f, 1.0f);
+        }
+        loop = shouldLoop;
+        return true;
+    }
+};
+
+/**
+ * \brief A lane as seen by the process call
+ */
+struct AutomationLaneState {
+    AutomationLaneSettings settings;
+    bool running{false};
+    // Set when the lane has been started outside the process call, and should start at the start of the next cycle
+    bool starting{false};
+    double startTick{0};
+    // The breakpoint most recently passed, so finding the current one does not mean going through all of them
+    int cursor{0};
+    ControlEngineSentValues sent;
+
+    /**
+     * \brief Work out the value of the lane at the given number of ticks since it was started
+     * @param elapsed The number of ticks since the lane was started
+     * @param finished Set to true if the lane has passed its last breakpoint, and will not change any further
+     */
+    float evaluate(double elapsed, bool &finished) {
+        const int lastPoint{settings.pointCount - 1};
+        const double length{double(settings.pointTicks[lastPoint])};
+        if (elapsed >= length) {
+            if (settings.loop && length > 0) {
+                elapsed = std::fmod(elapsed, length);
+            } else {
+                finished = true;
+                return settings.pointValues[lastPoint];
+            }
+        }
+        if (elapsed <= double(settings.pointTicks[0])) {
+            cursor = 0;
+            return settings.pointValues[0];
+        }
+        // Usually we are just moving forward, but looping (or new breakpoints) can take us back to the start
+        if (cursor >= lastPoint || double(settings.pointTicks[cursor]) > elapsed) {
+            cursor = 0;
+        }
+        while (cursor < lastPoint - 1 && double(settings.pointTicks[cursor + 1]) <= elapsed) {
+            ++cursor;
+        }
+        const int point{cursor};
+        const double pointLength{double(settings.pointTicks[point + 1] - settings.pointTicks[point])};
+        if (settings.interpolation == AutomationEngine::StepInterpolation || pointLength <= 0) {
+            return settings.pointValues[point];
+        }
+        const float progress{float((elapsed - double(settings.pointTicks[point])) / pointLength)};
+        return settings.pointValues[point] + (progress * (settings.pointValues[point + 1] - settings.pointValues[point]));
+    }
+};
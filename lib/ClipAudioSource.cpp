@@ -9,6 +9,7 @@
 */
 
 #include "ClipAudioSource.h"
+#include "AutomationEngine.h"
 #include "ClipAudioSourcePositionsModel.h"
 
 #include <QDateTime>
@@ -16,6 +17,9 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include "JUCEHeaders.h"
 #include "../tracktion_engine/examples/common/Utilities.h"
 #include "Helper.h"
@@ -63,10 +67,12 @@ public:
   float startPositionInSeconds = 0;
   float lengthInSeconds = -1;
   float lengthInBeats = -1;
-  float volumeAbsolute{-1.0f}; // This is a cached value
+  // These two are read by SamplerSynth's voices, and can be changed by the automation engine (see ClipAudioSource::setSettingRealtime()), so they are atomic
+  std::atomic<float> volumeAbsolute{-1.0f}; // This is a cached value
   float pitchChange = 0;
   float speedRatio = 1.0;
-  float pan{0.0f};
+  std::atomic<float> pan{0.0f};
+  std::atomic<int> pendingChanges{0};
   double currentLeveldB{-400.0};
   double prevLeveldB{-400.0};
   int id{0};
@@ -208,6 +214,7 @@ ClipAudioSource::~ClipAudioSource() {
   IF_DEBUG_CLIP cerr << "Destroying Clip" << endl;
   stop();
   SamplerSynth::instance()->unregisterClip(this);
+  AutomationEngine::instance(SyncTimer::instance())->removeClipTargets(this);
   Helper::callFunctionOnMessageThread(
     [&]() {
       d->stopTimer();
@@ -628,6 +635,36 @@ void ClipAudioSource::setPan(float pan) {
   }
 }
 
+void ClipAudioSource::setSettingRealtime(Setting setting, float value)
+{
+  switch (setting) {
+    case VolumeAbsoluteSetting:
+      d->volumeAbsolute.store(std::clamp(value, 0.0f, 1.0f), std::memory_order_relaxed);
+      break;
+    case PanSetting:
+      d->pan.store(std::clamp(value, -1.0f, 1.0f), std::memory_order_relaxed);
+      break;
+    default:
+      return;
+  }
+  d->pendingChanges.fetch_or(1 << setting, std::memory_order_release);
+}
+
+void ClipAudioSource::emitPendingChanges()
+{
+  const int pendingChanges{d->pendingChanges.exchange(0, std::memory_order_acquire)};
+  if (pendingChanges & (1 << VolumeAbsoluteSetting)) {
+    // Bring tracktion's idea of the volume in line with what we have been told
+    if (auto clip = d->getClip()) {
+      clip->edit.setMasterVolumeSliderPos(d->volumeAbsolute.load());
+    }
+    Q_EMIT volumeAbsoluteChanged();
+  }
+  if (pendingChanges & (1 << PanSetting)) {
+    Q_EMIT panChanged();
+  }
+}
+
 float ClipAudioSource::adsrAttack() const
 {
   return d->adsr.getParameters().attack;
@@ -222,6 +222,24 @@ public:
   void setPan(float pan);
   Q_SIGNAL void panChanged();
 
+  enum Setting {
+    VolumeAbsoluteSetting = 0,
+    PanSetting = 1,
+  };
+  /**
+   * \brief Change one of the settings from a realtime thread (such as the jack process call)
+   * This does not emit the setting's changed signal, as that is not realtime safe. Instead, the change is recorded,
+   * and the signal is emitted by the next call to emitPendingChanges()
+   * @param setting The setting to change
+   * @param value The new value (0.0 through 1.0 for the volume, and -1.0 through 1.0 for the pan)
+   */
+  void setSettingRealtime(Setting setting, float value);
+  /**
+   * \brief Emit the changed signals for any settings changed by setSettingRealtime() since the last call
+   * @note Do not call this from a realtime thread
+   */
+  void emitPendingChanges();
+
   float adsrAttack() const;
   void setADSRAttack(const float& newValue);
   float adsrDecay() const;
@@ -8,7 +8,7 @@ class ClipAudioSource;
  *
  * Roughly equivalent to a midi message, but for clips
  */
-struct ClipCommand {
+struct alignas(64) ClipCommand {
     ClipCommand() {};
     ClipCommand(ClipAudioSource *clip, int midiNote) : clip(clip), midiNote(midiNote) {};
     ClipAudioSource* clip{nullptr};
@@ -29,6 +29,18 @@ struct ClipCommand {
     float gainDb{0.0f};
     bool changeVolume{false};
     float volume{0.0f};
+    // How far into its step the command should take effect, in 1/65536ths of a tick (used for micro-timing of clip starts)
+    quint16 subTickOffset{0};
+
+    // Used by SyncTimer to keep track of scheduled commands - do not change these yourself
+    ClipCommand *indexPrevious{nullptr};
+    ClipCommand *indexNext{nullptr};
+    quint64 scheduledStep{0};
+    bool indexed{false};
+    bool cancelled{false};
+    // Used by SyncTimer to hold on to deleted commands for a little while before reusing them - do not change these yourself
+    ClipCommand *nextRetired{nullptr};
+    quint64 retiredAt{0};
 
     bool equivalentTo(ClipCommand *other) const {
         return clip == other->clip
@@ -74,6 +86,7 @@ struct ClipCommand {
     static void clear(ClipCommand *command) {
         command->clip = nullptr;
         command->midiNote = -1;
+        command->midiChannel = -1;
         command->startPlayback = false;
         command->stopPlayback = false;
         command->changeSlice = false;
@@ -88,5 +101,13 @@ struct ClipCommand {
         command->gainDb = 0.0f;
         command->changeVolume = false;
         command->volume = 0.0f;
+        command->subTickOffset = 0;
+        command->indexPrevious = nullptr;
+        command->indexNext = nullptr;
+        command->scheduledStep = 0;
+        command->indexed = false;
+        command->cancelled = false;
+        command->nextRetired = nullptr;
+        command->retiredAt = 0;
     }
 };
@@ -0,0 +1,17 @@
+#include "ControlEngine.h"
+#include "MidiRouter.h"
+
+JackPassthrough *ControlEngineTargets::passthroughClient(int channel, int setting)
+{
+    JackPassthrough *passthrough{nullptr};
+    if (channel == -1) {
+        passthrough = qobject_cast<JackPassthrough*>(MidiRouter::instance()->globalPlaybackClient());
+    } else if (channel > -1 && channel < MidiRouter::instance()->channelPassthroughClients().count()) {
+        passthrough = qobject_cast<JackPassthrough*>(MidiRouter::instance()->channelPassthroughClients().at(channel));
+    }
+    if (!passthrough || setting < JackPassthrough::DryAmountSetting || setting > JackPassthrough::MutedSetting) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set an invalid passthrough target, with channel" << channel << "and setting" << setting;
+        return nullptr;
+    }
+    return passthrough;
+}
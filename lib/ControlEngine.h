@@ -0,0 +1,211 @@
+#pragma once
+
+#include "JackPassthrough.h"
+
+#include <QDebug>
+
+#include <atomic>
+#include <cmath>
+
+/**
+ * \brief The plumbing shared by the engines which SyncTimer evaluates from its jack process call to generate control streams
+ *
+ * Both ModulationEngine and AutomationEngine keep a flat, preallocated array of slots (modulators and lanes
+ * respectively), whose settings are changed from outside the process call and passed on to it through a
+ * ControlEngineUpdateQueue, and both send their values on to midi and passthrough targets in the same way,
+ * using the functions in ControlEngineTargets.
+ */
+
+/**
+ * \brief A single-producer, single-consumer queue passing changes to an engine's slots on to the process call
+ * The settings are plain data, so they can be passed to the process call by copying them into the queue.
+ * There must only be a single writer at a time (the engines ensure this by only enqueueing with their mutex held),
+ * and only the process call reads from the queue.
+ */
+template<typename Settings, int Size>
+class ControlEngineUpdateQueue {
+public:
+    enum Kind {
+        SettingsUpdate,
+        StartUpdate,
+        StopUpdate,
+        RemoveUpdate,
+    };
+    struct Update {
+        Kind kind{SettingsUpdate};
+        int slot{-1};
+        Settings settings;
+    };
+
+    /**
+     * \brief Queue up a change to the given slot
+     * @param kind What sort of change this is
+     * @param slot The slot to change
+     * @param settings The slot's settings (the process call picks these up for every kind of update)
+     * @return False if the queue was full, and the update was dropped
+     */
+    bool enqueue(Kind kind, int slot, const Settings &settings) {
+        const quint32 write{writeIndex.load(std::memory_order_relaxed)};
+        if (write - readIndex.load(std::memory_order_acquire) >= Size) {
+            return false;
+        }
+        Update &update = updates[write % Size];
+        update.kind = kind;
+        update.slot = slot;
+        update.settings = settings;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * \brief The position after the most recently enqueued update (see hasProcessed())
+     */
+    quint32 writePosition() const {
+        return writeIndex.load(std::memory_order_relaxed);
+    }
+    /**
+     * \brief Whether the process call has picked up all the updates enqueued before the given position
+     * @param position A position previously returned by writePosition()
+     */
+    bool hasProcessed(quint32 position) const {
+        return qint32(readIndex.load(std::memory_order_acquire) - position) >= 0;
+    }
+    /**
+     * \brief Pass all the waiting updates to the given function, in the order they were enqueued
+     * @note Only call this from the process call
+     * @param function Something callable as function(const Update &update)
+     */
+    template<typename Function>
+    void process(Function function) {
+        const quint32 write{writeIndex.load(std::memory_order_acquire)};
+        quint32 read{readIndex.load(std::memory_order_relaxed)};
+        while (read != write) {
+            function(updates[read % Size]);
+            ++read;
+        }
+        readIndex.store(read, std::memory_order_release);
+    }
+private:
+    Update updates[Size];
+    std::atomic<quint32> writeIndex{0};
+    std::atomic<quint32> readIndex{0};
+};
+
+/**
+ * \brief The most recent values a slot sent to its target, so it only sends something out when the value changes
+ */
+struct ControlEngineSentValues {
+    // -1 for midi, and NaN for the others, when nothing has been sent yet
+    int lastMidiValue{-1};
+    float lastValue{NAN};
+    /**
+     * \brief Forget what was sent, so the next value is sent regardless (for example because the target changed, and a new target should be told about the value right away)
+     */
+    void forget() {
+        lastMidiValue = -1;
+        lastValue = NAN;
+    }
+};
+
+/**
+ * \brief Space for the midi events an engine creates during a single jack cycle, three bytes per event
+ */
+struct ControlEngineEvents {
+    ControlEngineEvents(unsigned char *data, double *usecs, int maximum)
+        : data(data)
+        , usecs(usecs)
+        , maximum(maximum)
+    {}
+    /**
+     * \brief Add a three byte midi event
+     * @param eventUsecs When the event should be sent (only stored if the events have a time each)
+     * @return False if there was no space left, in which case the caller should try again on the next cycle
+     */
+    bool add(unsigned char byte0, unsigned char byte1, unsigned char byte2, double eventUsecs = 0) {
+        if (count < maximum) {
+            unsigned char *event = data + (count * 3);
+            event[0] = byte0;
+            event[1] = byte1;
+            event[2] = byte2;
+            if (usecs) {
+                usecs[count] = eventUsecs;
+            }
+            ++count;
+            return true;
+        }
+        return false;
+    }
+    unsigned char *data{nullptr};
+    double *usecs{nullptr};
+    int maximum{0};
+    int count{0};
+};
+
+// The smallest change in a passthrough (or other non-midi) setting which will be passed on to the target
+#define ControlEngineValueThreshold 0.0001f
+
+/**
+ * \brief Sending values (0.0 through 1.0) on to the targets the engines share
+ */
+struct ControlEngineTargets {
+    /**
+     * \brief Find one of ZLRouter's passthrough clients, for use as a target
+     * @param channel The passthrough client (-1 for global playback, 0 through 9 for the channels)
+     * @param setting The setting to change (see JackPassthrough::Setting)
+     * @return The client, or nullptr (after warning about it) if either the channel or the setting is invalid
+     */
+    static JackPassthrough *passthroughClient(int channel, int setting);
+    /**
+     * \brief Whether a value is different enough from the one sent most recently that it should be sent on
+     */
+    static inline bool valueChanged(float lastValue, float value) {
+        return std::isnan(lastValue) || std::fabs(value - lastValue) > ControlEngineValueThreshold;
+    }
+    /**
+     * \brief Map a value onto a passthrough setting's range (pan goes from -1.0 through 1.0, and muted is on for values of 0.5 and above)
+     */
+    static inline float passthroughValue(JackPassthrough::Setting setting, float value) {
+        if (setting == JackPassthrough::PanAmountSetting) {
+            return (value * 2.0f) - 1.0f;
+        } else if (setting == JackPassthrough::MutedSetting) {
+            return value >= 0.5f ? 1.0f : 0.0f;
+        }
+        return value;
+    }
+    /**
+     * \brief Add a CC message for the value, if it is different from the one sent most recently
+     * @return False if the message could not be added (see ControlEngineEvents::add())
+     */
+    static inline bool sendControlChange(ControlEngineEvents &events, ControlEngineSentValues &sent, int midiChannel, int control, float value, double eventUsecs = 0) {
+        const int midiValue{int(std::lround(value * 127.0f))};
+        if (midiValue != sent.lastMidiValue) {
+            if (!events.add(0xB0 | midiChannel, control, midiValue, eventUsecs)) {
+                return false;
+            }
+            sent.lastMidiValue = midiValue;
+        }
+        return true;
+    }
+    /**
+     * \brief Add a pitch bend message for the value (0.5 being the centre), if it is different from the one sent most recently
+     * @return False if the message could not be added (see ControlEngineEvents::add())
+     */
+    static inline bool sendPitchBend(ControlEngineEvents &events, ControlEngineSentValues &sent, int midiChannel, float value, double eventUsecs = 0) {
+        const int midiValue{int(std::lround(value * 16383.0f))};
+        if (midiValue != sent.lastMidiValue) {
+            if (!events.add(0xE0 | midiChannel, midiValue & 0x7F, (midiValue >> 7) & 0x7F, eventUsecs)) {
+                return false;
+            }
+            sent.lastMidiValue = midiValue;
+        }
+        return true;
+    }
+    /**
+     * \brief Set the value on a passthrough client, if it is different enough from the one sent most recently
+     */
+    static inline void sendPassthrough(ControlEngineSentValues &sent, JackPassthrough *passthrough, JackPassthrough::Setting setting, float value) {
+        if (valueChanged(sent.lastValue, value)) {
+            passthrough->setSettingRealtime(setting, passthroughValue(setting, value));
+            sent.lastValue = value;
+        }
+    }
+};
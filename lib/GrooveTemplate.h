@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+
+// The number of ticks a groove covers (one bar, which SyncTimer checks against its own bar length)
+#define GrooveTemplateTickCount 384
+// The resolution of a groove's displacements, in parts of a tick (which SyncTimer checks against its own sub-tick offset resolution)
+#define GrooveTemplateDisplacementResolution 65536.0
+
+/**
+ * \brief A table of timing displacements and velocity scales for each tick in a bar, applied to events as they are played
+ */
+struct GrooveTemplate {
+    static void clear(GrooveTemplate *groove) {
+        std::fill_n(groove->displacement, GrooveTemplateTickCount, 0);
+        std::fill_n(groove->velocityScale, GrooveTemplateTickCount, 1.0f);
+    }
+    /**
+     * \brief Whether a groove with the given number of entries can be spread evenly over the bar
+     */
+    static bool isValidLength(int length) {
+        return length > 0 && length <= GrooveTemplateTickCount && GrooveTemplateTickCount % length == 0;
+    }
+    /**
+     * \brief Spread the given entries out over the whole bar, so playback can look up any tick directly
+     * Displacements are clamped to lie between 0 and a full bar, and velocity scales to be no less than 0.
+     * @param tickDisplacements How far after its tick an event should be played, in ticks, for each entry (null means no displacement)
+     * @param velocityScales The amount to scale note on velocities by, for each entry (null means leave velocities alone)
+     * @param length The number of entries (this must be valid, see isValidLength())
+     */
+    void spread(const double *tickDisplacements, const float *velocityScales, int length) {
+        const int ticksPerEntry{GrooveTemplateTickCount / length};
+        for (int tick = 0; tick < GrooveTemplateTickCount; ++tick) {
+            const int entry{tick / ticksPerEntry};
+            displacement[tick] = tickDisplacements ? qint32(std::llround(std::clamp<double>(tickDisplacements[entry], 0, GrooveTemplateTickCount) * GrooveTemplateDisplacementResolution)) : 0;
+            velocityScale[tick] = velocityScales ? std::max(0.0f, velocityScales[entry]) : 1.0f;
+        }
+    }
+    /**
+     * \brief The velocity a note on on the given tick should be sent with (never lower than 1, so it stays a note on)
+     * @param tick The tick within the bar
+     * @param velocity The note on's original velocity
+     */
+    inline quint8 scaledVelocity(int tick, quint8 velocity) const {
+        return quint8(std::clamp<int>(int(std::lround(float(velocity) * velocityScale[tick])), 1, 127));
+    }
+    qint32 displacement[GrooveTemplateTickCount]; ///< How much later than its tick an event should be played, in 1/65536ths of a tick
+    float velocityScale[GrooveTemplateTickCount]; ///< The amount to scale the velocity of note on events by
+};
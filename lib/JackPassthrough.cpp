@@ -15,6 +15,8 @@
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include <atomic>
+
 class JackPassthroughPrivate {
 public:
     JackPassthroughPrivate(const QString &clientName);
@@ -24,11 +26,14 @@ public:
         }
     }
     QString clientName;
-    float dryAmount{1.0f};
-    float wetFx1Amount{1.0f};
-    float wetFx2Amount{1.0f};
-    float panAmount{0.0f};
-    bool muted{false};
+    // The settings can be changed from other realtime threads (see JackPassthrough::setSettingRealtime()), so they are atomic
+    std::atomic<float> dryAmount{1.0f};
+    std::atomic<float> wetFx1Amount{1.0f};
+    std::atomic<float> wetFx2Amount{1.0f};
+    std::atomic<float> panAmount{0.0f};
+    std::atomic<bool> muted{false};
+    // A bit for each setting (see JackPassthrough::Setting) which has been changed without its signal being emitted
+    std::atomic<int> pendingChanges{0};
     jack_default_audio_sample_t channelSampleLeft;
     jack_default_audio_sample_t channelSampleRight;
 
@@ -51,8 +56,13 @@ public:
         jack_default_audio_sample_t *wetOutFx1RightBuffer = (jack_default_audio_sample_t *)jack_port_get_buffer(wetOutFx1Right, nframes);
         jack_default_audio_sample_t *wetOutFx2LeftBuffer = (jack_default_audio_sample_t *)jack_port_get_buffer(wetOutFx2Left, nframes);
         jack_default_audio_sample_t *wetOutFx2RightBuffer = (jack_default_audio_sample_t *)jack_port_get_buffer(wetOutFx2Right, nframes);
+        // Read the settings once, so they stay the same for the whole period
+        const float dryAmount{this->dryAmount.load(std::memory_order_relaxed)};
+        const float wetFx1Amount{this->wetFx1Amount.load(std::memory_order_relaxed)};
+        const float wetFx2Amount{this->wetFx2Amount.load(std::memory_order_relaxed)};
+        const float panAmount{this->panAmount.load(std::memory_order_relaxed)};
 
-        if (muted) {
+        if (muted.load(std::memory_order_relaxed)) {
             memset(dryOutLeftBuffer, 0, nframes * sizeof(jack_default_audio_sample_t));
             memset(dryOutRightBuffer, 0, nframes * sizeof(jack_default_audio_sample_t));
             memset(wetOutFx1LeftBuffer, 0, nframes * sizeof(jack_default_audio_sample_t));
@@ -226,3 +236,47 @@ void JackPassthrough::setMuted(const bool &newValue)
         Q_EMIT mutedChanged();
     }
 }
+
+void JackPassthrough::setSettingRealtime(Setting setting, float value)
+{
+    switch (setting) {
+        case DryAmountSetting:
+            d->dryAmount.store(value, std::memory_order_relaxed);
+            break;
+        case WetFx1AmountSetting:
+            d->wetFx1Amount.store(value, std::memory_order_relaxed);
+            break;
+        case WetFx2AmountSetting:
+            d->wetFx2Amount.store(value, std::memory_order_relaxed);
+            break;
+        case PanAmountSetting:
+            d->panAmount.store(value, std::memory_order_relaxed);
+            break;
+        case MutedSetting:
+            d->muted.store(value != 0, std::memory_order_relaxed);
+            break;
+        default:
+            return;
+    }
+    d->pendingChanges.fetch_or(1 << setting, std::memory_order_release);
+}
+
+void JackPassthrough::emitPendingChanges()
+{
+    const int pendingChanges{d->pendingChanges.exchange(0, std::memory_order_acquire)};
+    if (pendingChanges & (1 << DryAmountSetting)) {
+        Q_EMIT dryAmountChanged();
+    }
+    if (pendingChanges & (1 << WetFx1AmountSetting)) {
+        Q_EMIT wetFx1AmountChanged();
+    }
+    if (pendingChanges & (1 << WetFx2AmountSetting)) {
+        Q_EMIT wetFx2AmountChanged();
+    }
+    if (pendingChanges & (1 << PanAmountSetting)) {
+        Q_EMIT panAmountChanged();
+    }
+    if (pendingChanges & (1 << MutedSetting)) {
+        Q_EMIT mutedChanged();
+    }
+}
@@ -53,6 +53,27 @@ public:
     bool muted() const;
     void setMuted(const bool& newValue);
     Q_SIGNAL void mutedChanged();
+
+    enum Setting {
+        DryAmountSetting = 0,
+        WetFx1AmountSetting = 1,
+        WetFx2AmountSetting = 2,
+        PanAmountSetting = 3,
+        MutedSetting = 4,
+    };
+    /**
+     * \brief Change one of the settings from a realtime thread (such as the jack process call)
+     * This does not emit the setting's changed signal, as that is not realtime safe. Instead, the change is recorded,
+     * and the signal is emitted by the next call to emitPendingChanges()
+     * @param setting The setting to change
+     * @param value The new value (for MutedSetting, anything other than 0 is muted)
+     */
+    void setSettingRealtime(Setting setting, float value);
+    /**
+     * \brief Emit the changed signals for any settings changed by setSettingRealtime() since the last call
+     * @note Do not call this from a realtime thread
+     */
+    void emitPendingChanges();
 private:
     JackPassthroughPrivate *d{nullptr};
 };
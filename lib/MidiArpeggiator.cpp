@@ -0,0 +1,231 @@
+#include "MidiArpeggiator.h"
+
+#include <algorithm>
+#include <atomic>
+
+// The largest number of held notes the arpeggiator keeps track of (any further notes are ignored)
+#define ArpeggiatorHeldNoteCount 16
+// The largest number of octaves an arpeggio can span
+#define ArpeggiatorMaximumOctaves 4
+
+class MidiArpeggiatorPrivate {
+public:
+    MidiArpeggiatorPrivate() {}
+    std::atomic<MidiArpeggiator::ArpeggiatorMode> mode{MidiArpeggiator::UpMode};
+    std::atomic<int> stepTicks{24};
+    std::atomic<int> octaves{1};
+    std::atomic<float> gate{0.5f};
+
+    // Everything below is only touched by the jack process call
+    // The held notes in the order they were pressed, and sorted from lowest to highest
+    unsigned char heldNotes[ArpeggiatorHeldNoteCount];
+    unsigned char heldVelocities[ArpeggiatorHeldNoteCount];
+    unsigned char sortedNotes[ArpeggiatorHeldNoteCount];
+    unsigned char sortedVelocities[ArpeggiatorHeldNoteCount];
+    int heldCount{0};
+    // The notes we have turned on, and not yet turned off (and their channel status byte)
+    unsigned char soundingNotes[ArpeggiatorHeldNoteCount];
+    int soundingCount{0};
+    unsigned char soundingChannel{0};
+    quint64 soundingOffTick{0};
+    // The position in the arpeggio of the next step
+    int position{0};
+    // The next tick we have not yet handled (so a tick is never played twice, should two cycles overlap)
+    quint64 nextTick{0};
+    quint32 randomState{0x2545F491};
+
+    void sortHeldNotes() {
+        for (int i = 0; i < heldCount; ++i) {
+            sortedNotes[i] = heldNotes[i];
+            sortedVelocities[i] = heldVelocities[i];
+            int index{i};
+            while (index > 0 && sortedNotes[index - 1] > sortedNotes[index]) {
+                std::swap(sortedNotes[index - 1], sortedNotes[index]);
+                std::swap(sortedVelocities[index - 1], sortedVelocities[index]);
+                --index;
+            }
+        }
+    }
+    void turnOffSounding(jack_nframes_t frame, MidiGeneratorOutput &output) {
+        for (int i = 0; i < soundingCount; ++i) {
+            output.write(frame, 0x80 | soundingChannel, soundingNotes[i], 0);
+        }
+        soundingCount = 0;
+    }
+    void turnOn(jack_nframes_t frame, int note, unsigned char velocity, MidiGeneratorOutput &output) {
+        if (note < 128 && soundingCount < ArpeggiatorHeldNoteCount && output.write(frame, 0x90 | soundingChannel, note, velocity)) {
+            soundingNotes[soundingCount] = note;
+            ++soundingCount;
+        }
+    }
+    void playStep(quint64 tick, jack_nframes_t frame, MidiGeneratorOutput &output) {
+        const MidiArpeggiator::ArpeggiatorMode currentMode{mode.load(std::memory_order_relaxed)};
+        const int currentStepTicks{stepTicks.load(std::memory_order_relaxed)};
+        if (currentMode == MidiArpeggiator::RepeatMode) {
+            for (int i = 0; i < heldCount; ++i) {
+                turnOn(frame, heldNotes[i], heldVelocities[i], output);
+            }
+        } else {
+            const int length{heldCount * octaves.load(std::memory_order_relaxed)};
+            int index{0};
+            switch (currentMode) {
+                case MidiArpeggiator::DownMode:
+                    index = length - 1 - (position % length);
+                    break;
+                case MidiArpeggiator::UpDownMode:
+                    if (length > 1) {
+                        const int cycle{position % ((length * 2) - 2)};
+                        index = cycle < length ? cycle : ((length * 2) - 2) - cycle;
+                    }
+                    break;
+                case MidiArpeggiator::RandomMode:
+                    randomState ^= randomState << 13;
+                    randomState ^= randomState >> 17;
+                    randomState ^= randomState << 5;
+                    index = int(randomState % quint32(length));
+                    break;
+                case MidiArpeggiator::UpMode:
+                case MidiArpeggiator::PlayedMode:
+                default:
+                    index = position % length;
+                    break;
+            }
+            const bool played{currentMode == MidiArpeggiator::PlayedMode};
+            const int noteIndex{index % heldCount};
+            const int note{(played ? heldNotes[noteIndex] : sortedNotes[noteIndex]) + (12 * (index / heldCount))};
+            turnOn(frame, note, played ? heldVelocities[noteIndex] : sortedVelocities[noteIndex], output);
+        }
+        ++position;
+        soundingOffTick = tick + quint64(qMax(1, int(std::lround(gate.load(std::memory_order_relaxed) * float(currentStepTicks)))));
+    }
+};
+
+MidiArpeggiator::MidiArpeggiator(QObject *parent)
+    : MidiGenerator(parent)
+    , d(new MidiArpeggiatorPrivate)
+{
+}
+
+MidiArpeggiator::~MidiArpeggiator()
+{
+    delete d;
+}
+
+MidiArpeggiator::ArpeggiatorMode MidiArpeggiator::mode() const
+{
+    return d->mode;
+}
+
+void MidiArpeggiator::setMode(const ArpeggiatorMode &mode)
+{
+    if (d->mode != mode) {
+        d->mode = mode;
+        Q_EMIT modeChanged();
+    }
+}
+
+int MidiArpeggiator::stepTicks() const
+{
+    return d->stepTicks;
+}
+
+void MidiArpeggiator::setStepTicks(const int &stepTicks)
+{
+    const int adjusted{qMax(1, stepTicks)};
+    if (d->stepTicks != adjusted) {
+        d->stepTicks = adjusted;
+        Q_EMIT stepTicksChanged();
+    }
+}
+
+int MidiArpeggiator::octaves() const
+{
+    return d->octaves;
+}
+
+void MidiArpeggiator::setOctaves(const int &octaves)
+{
+    const int adjusted{std::clamp(octaves, 1, ArpeggiatorMaximumOctaves)};
+    if (d->octaves != adjusted) {
+        d->octaves = adjusted;
+        Q_EMIT octavesChanged();
+    }
+}
+
+float MidiArpeggiator::gate() const
+{
+    return d->gate;
+}
+
+void MidiArpeggiator::setGate(const float &gate)
+{
+    const float adjusted{std::clamp(gate, 0.0f, 1.0f)};
+    if (d->gate != adjusted) {
+        d->gate = adjusted;
+        Q_EMIT gateChanged();
+    }
+}
+
+void MidiArpeggiator::handleEvent(const unsigned char *data, size_t size, jack_nframes_t frame, MidiGeneratorOutput &output)
+{
+    const unsigned char type{static_cast<unsigned char>(data[0] & 0xF0)};
+    if (size == 3 && (type == 0x80 || type == 0x90)) {
+        if (type == 0x90 && data[2] > 0) {
+            if (d->heldCount == 0) {
+                // A fresh arpeggio starts from the beginning
+                d->position = 0;
+            }
+            if (d->heldCount < ArpeggiatorHeldNoteCount) {
+                d->heldNotes[d->heldCount] = data[1];
+                d->heldVelocities[d->heldCount] = data[2];
+                ++d->heldCount;
+                d->sortHeldNotes();
+            }
+            d->soundingChannel = data[0] & 0x0F;
+        } else {
+            for (int i = 0; i < d->heldCount; ++i) {
+                if (d->heldNotes[i] == data[1]) {
+                    for (int j = i + 1; j < d->heldCount; ++j) {
+                        d->heldNotes[j - 1] = d->heldNotes[j];
+                        d->heldVelocities[j - 1] = d->heldVelocities[j];
+                    }
+                    --d->heldCount;
+                    d->sortHeldNotes();
+                    break;
+                }
+            }
+        }
+    } else {
+        output.write(frame, data, size);
+    }
+}
+
+void MidiArpeggiator::process(const MidiGeneratorTickGrid &grid, MidiGeneratorOutput &output)
+{
+    quint64 tick{grid.firstWholeTick()};
+    // If the timer has moved backwards (say, playback was restarted), pick up from where it is now
+    if (d->nextTick > tick + quint64(double(grid.nframes) / grid.framesPerTick) + 1) {
+        d->nextTick = tick;
+        d->soundingOffTick = qMin(d->soundingOffTick, tick);
+    }
+    tick = qMax(tick, d->nextTick);
+    const quint64 currentStepTicks{quint64(d->stepTicks.load(std::memory_order_relaxed))};
+    while (grid.containsTick(tick)) {
+        const jack_nframes_t frame{grid.frameForTick(tick)};
+        if (d->soundingCount > 0 && tick >= d->soundingOffTick) {
+            d->turnOffSounding(frame, output);
+        }
+        if (tick % currentStepTicks == 0 && d->heldCount > 0) {
+            d->turnOffSounding(frame, output);
+            d->playStep(tick, frame, output);
+        }
+        ++tick;
+    }
+    d->nextTick = tick;
+}
+
+void MidiArpeggiator::stop(MidiGeneratorOutput &output)
+{
+    d->turnOffSounding(0, output);
+    d->heldCount = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MidiGenerator.h"
+
+class MidiArpeggiatorPrivate;
+/**
+ * \brief An arpeggiator which plays the notes being held down, one step at a time, on the timer's tick grid
+ *
+ * While notes are held, a new step is played on every tick which is a multiple of stepTicks, so the arpeggio stays
+ * in time with SyncTimer (and in phase with the bar, while the timer is playing). Messages other than notes are
+ * passed straight through.
+ * @see MidiRouter::setChannelGenerator()
+ */
+class MidiArpeggiator : public MidiGenerator {
+    Q_OBJECT
+    /**
+     * \brief The order in which the held notes are played
+     * @default UpMode
+     */
+    Q_PROPERTY(ArpeggiatorMode mode READ mode WRITE setMode NOTIFY modeChanged)
+    /**
+     * \brief The length of each step in timer ticks (for example 24 for sixteenth notes at the default multiplier)
+     * @default 24
+     */
+    Q_PROPERTY(int stepTicks READ stepTicks WRITE setStepTicks NOTIFY stepTicksChanged)
+    /**
+     * \brief The number of octaves the arpeggio spans (1 through 4), with the held notes repeated an octave up for each
+     * @default 1
+     */
+    Q_PROPERTY(int octaves READ octaves WRITE setOctaves NOTIFY octavesChanged)
+    /**
+     * \brief How much of each step a note sounds for (0.0 through 1.0, where 1.0 is legato)
+     * @default 0.5
+     */
+    Q_PROPERTY(float gate READ gate WRITE setGate NOTIFY gateChanged)
+public:
+    explicit MidiArpeggiator(QObject *parent = nullptr);
+    ~MidiArpeggiator() override;
+
+    enum ArpeggiatorMode {
+        UpMode = 0, ///< From the lowest note to the highest
+        DownMode = 1, ///< From the highest note to the lowest
+        UpDownMode = 2, ///< Up and then back down, without repeating the top and bottom notes
+        PlayedMode = 3, ///< In the order the notes were pressed
+        RandomMode = 4, ///< A random held note on each step
+        RepeatMode = 5, ///< All the held notes together on every step (a note repeat)
+    };
+    Q_ENUM(ArpeggiatorMode)
+
+    ArpeggiatorMode mode() const;
+    void setMode(const ArpeggiatorMode &mode);
+    Q_SIGNAL void modeChanged();
+
+    int stepTicks() const;
+    void setStepTicks(const int &stepTicks);
+    Q_SIGNAL void stepTicksChanged();
+
+    int octaves() const;
+    void setOctaves(const int &octaves);
+    Q_SIGNAL void octavesChanged();
+
+    float gate() const;
+    void setGate(const float &gate);
+    Q_SIGNAL void gateChanged();
+
+    void handleEvent(const unsigned char *data, size_t size, jack_nframes_t frame, MidiGeneratorOutput &output) override;
+    void process(const MidiGeneratorTickGrid &grid, MidiGeneratorOutput &output) override;
+    void stop(MidiGeneratorOutput &output) override;
+private:
+    MidiArpeggiatorPrivate *d{nullptr};
+};
@@ -0,0 +1,124 @@
+#include "MidiChordGenerator.h"
+
+#include <QDebug>
+
+#include <atomic>
+
+// The largest number of intervals a chord can have
+#define ChordGeneratorMaximumIntervals 8
+
+class MidiChordGeneratorPrivate {
+public:
+    MidiChordGeneratorPrivate() {
+        intervals[0] = 4;
+        intervals[1] = 7;
+    }
+    std::atomic<int> intervals[ChordGeneratorMaximumIntervals];
+    std::atomic<int> intervalCount{2};
+    std::atomic<bool> includeRoot{true};
+
+    // Everything below is only touched by the jack process call
+    // The notes played for each incoming note (and the channel status byte they were played on)
+    unsigned char chordNotes[128][ChordGeneratorMaximumIntervals + 1];
+    int chordNoteCount[128]{};
+    unsigned char chordChannel[128]{};
+
+    void releaseChord(int note, jack_nframes_t frame, MidiGeneratorOutput &output) {
+        for (int i = 0; i < chordNoteCount[note]; ++i) {
+            output.write(frame, 0x80 | chordChannel[note], chordNotes[note][i], 0);
+        }
+        chordNoteCount[note] = 0;
+    }
+};
+
+MidiChordGenerator::MidiChordGenerator(QObject *parent)
+    : MidiGenerator(parent)
+    , d(new MidiChordGeneratorPrivate)
+{
+}
+
+MidiChordGenerator::~MidiChordGenerator()
+{
+    delete d;
+}
+
+QList<int> MidiChordGenerator::intervals() const
+{
+    QList<int> intervals;
+    const int count{d->intervalCount};
+    for (int i = 0; i < count; ++i) {
+        intervals << d->intervals[i];
+    }
+    return intervals;
+}
+
+void MidiChordGenerator::setIntervals(const QList<int> &intervals)
+{
+    if (this->intervals() != intervals) {
+        if (intervals.count() > ChordGeneratorMaximumIntervals) {
+            qWarning() << Q_FUNC_INFO << "Attempted to set" << intervals.count() << "intervals, but a chord can only have" << ChordGeneratorMaximumIntervals << "- the rest will be ignored";
+        }
+        const int count{qMin(intervals.count(), ChordGeneratorMaximumIntervals)};
+        // Shorten the chord before changing the intervals, and lengthen it after, so the process call never sees an interval that was not set
+        d->intervalCount = qMin(count, d->intervalCount.load());
+        for (int i = 0; i < count; ++i) {
+            d->intervals[i] = intervals[i];
+        }
+        d->intervalCount = count;
+        Q_EMIT intervalsChanged();
+    }
+}
+
+bool MidiChordGenerator::includeRoot() const
+{
+    return d->includeRoot;
+}
+
+void MidiChordGenerator::setIncludeRoot(const bool &includeRoot)
+{
+    if (d->includeRoot != includeRoot) {
+        d->includeRoot = includeRoot;
+        Q_EMIT includeRootChanged();
+    }
+}
+
+void MidiChordGenerator::handleEvent(const unsigned char *data, size_t size, jack_nframes_t frame, MidiGeneratorOutput &output)
+{
+    const unsigned char type{static_cast<unsigned char>(data[0] & 0xF0)};
+    if (size == 3 && (type == 0x80 || type == 0x90)) {
+        const int note{data[1] & 0x7F};
+        // Whether this is a new note or a release, any chord already playing for the note should stop
+        d->releaseChord(note, frame, output);
+        if (type == 0x90 && data[2] > 0) {
+            d->chordChannel[note] = data[0] & 0x0F;
+            if (d->includeRoot.load(std::memory_order_relaxed)) {
+                if (output.write(frame, data, size)) {
+                    d->chordNotes[note][d->chordNoteCount[note]] = note;
+                    ++d->chordNoteCount[note];
+                }
+            }
+            const int count{d->intervalCount.load(std::memory_order_acquire)};
+            for (int i = 0; i < count; ++i) {
+                const int chordNote{note + d->intervals[i].load(std::memory_order_relaxed)};
+                if (-1 < chordNote && chordNote < 128 && output.write(frame, data[0], chordNote, data[2])) {
+                    d->chordNotes[note][d->chordNoteCount[note]] = chordNote;
+                    ++d->chordNoteCount[note];
+                }
+            }
+        }
+    } else {
+        output.write(frame, data, size);
+    }
+}
+
+void MidiChordGenerator::process(const MidiGeneratorTickGrid &/*grid*/, MidiGeneratorOutput &/*output*/)
+{
+    // Chords are played as the notes arrive, so there is nothing to do on the tick grid
+}
+
+void MidiChordGenerator::stop(MidiGeneratorOutput &output)
+{
+    for (int note = 0; note < 128; ++note) {
+        d->releaseChord(note, 0, output);
+    }
+}
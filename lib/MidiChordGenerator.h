@@ -0,0 +1,44 @@
+#pragma once
+
+#include "MidiGenerator.h"
+
+class MidiChordGeneratorPrivate;
+/**
+ * \brief A chord generator, which plays a chord built on each incoming note
+ *
+ * Each note that arrives is played along with a note for each of the intervals. The chord is remembered, so
+ * the whole chord is released when the note is released, even if the intervals were changed while it was held.
+ * Messages other than notes are passed straight through.
+ * @see MidiRouter::setChannelGenerator()
+ */
+class MidiChordGenerator : public MidiGenerator {
+    Q_OBJECT
+    /**
+     * \brief The intervals (in semitones from the played note) of the notes added to the played note
+     * There can be up to 8 intervals, and notes which end up outside the midi range are left out
+     * @default A major triad (4 and 7)
+     */
+    Q_PROPERTY(QList<int> intervals READ intervals WRITE setIntervals NOTIFY intervalsChanged)
+    /**
+     * \brief Whether to also play the incoming note itself
+     * @default true
+     */
+    Q_PROPERTY(bool includeRoot READ includeRoot WRITE setIncludeRoot NOTIFY includeRootChanged)
+public:
+    explicit MidiChordGenerator(QObject *parent = nullptr);
+    ~MidiChordGenerator() override;
+
+    QList<int> intervals() const;
+    void setIntervals(const QList<int> &intervals);
+    Q_SIGNAL void intervalsChanged();
+
+    bool includeRoot() const;
+    void setIncludeRoot(const bool &includeRoot);
+    Q_SIGNAL void includeRootChanged();
+
+    void handleEvent(const unsigned char *data, size_t size, jack_nframes_t frame, MidiGeneratorOutput &output) override;
+    void process(const MidiGeneratorTickGrid &grid, MidiGeneratorOutput &output) override;
+    void stop(MidiGeneratorOutput &output) override;
+private:
+    MidiChordGeneratorPrivate *d{nullptr};
+};
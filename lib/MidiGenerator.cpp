@@ -0,0 +1,8 @@
+#include "MidiGenerator.h"
+
+MidiGenerator::MidiGenerator(QObject *parent)
+    : QObject(parent)
+{
+}
+
+MidiGenerator::~MidiGenerator() = default;
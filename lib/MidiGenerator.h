@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QObject>
+#include <jack/types.h>
+
+#include <cmath>
+
+/**
+ * \brief The timer's tick grid for a single jack cycle, as given to MidiGenerator::process()
+ */
+struct MidiGeneratorTickGrid {
+    double firstTick{0}; ///< The (fractional) timer tick at the first frame of this cycle
+    double framesPerTick{1}; ///< The number of frames in a single timer tick
+    jack_nframes_t nframes{0}; ///< The number of frames in this cycle
+    /**
+     * \brief The first whole tick which falls inside this cycle
+     */
+    inline quint64 firstWholeTick() const {
+        return quint64(std::ceil(firstTick));
+    }
+    /**
+     * \brief Whether the given whole tick falls inside this cycle
+     */
+    inline bool containsTick(quint64 tick) const {
+        return double(tick) >= firstTick && frameForTick(tick) < nframes;
+    }
+    /**
+     * \brief The frame inside this cycle at which the given tick falls (only meaningful if containsTick() is true)
+     */
+    inline jack_nframes_t frameForTick(quint64 tick) const {
+        return jack_nframes_t((double(tick) - firstTick) * framesPerTick);
+    }
+};
+
+/**
+ * \brief A fixed-size list of midi events written by a MidiGenerator during a single jack cycle
+ */
+class MidiGeneratorOutput {
+public:
+    static constexpr int Capacity{256};
+    struct Event {
+        jack_nframes_t frame{0};
+        unsigned char data[3]{0, 0, 0};
+        unsigned char size{0};
+    };
+    /**
+     * \brief Add an event to the output
+     * @param frame The frame in the current cycle the event should be sent at
+     * @param data The event's bytes
+     * @param size The number of bytes in the event (1 through 3)
+     * @return False if there was no space left for the event (it will then be dropped)
+     */
+    inline bool write(jack_nframes_t frame, const unsigned char *data, size_t size) {
+        if (eventCount < Capacity && size > 0 && size < 4) {
+            Event &event = events[eventCount];
+            event.frame = frame;
+            event.size = size;
+            for (size_t i = 0; i < size; ++i) {
+                event.data[i] = data[i];
+            }
+            ++eventCount;
+            return true;
+        }
+        return false;
+    }
+    inline bool write(jack_nframes_t frame, unsigned char byte1, unsigned char byte2, unsigned char byte3) {
+        const unsigned char data[3]{byte1, byte2, byte3};
+        return write(frame, data, 3);
+    }
+    inline void clear() {
+        eventCount = 0;
+    }
+    Event events[Capacity];
+    int eventCount{0};
+};
+
+/**
+ * \brief The base class for realtime midi generators, which transform live input inside ZLRouter's jack process call
+ *
+ * A generator is set on one of ZLRouter's channels (see MidiRouter::setChannelGenerator()). From then on, all the
+ * channel messages arriving from hardware input for that channel are handed to the generator instead of being sent
+ * on, and whatever the generator writes to its output is sent on in their place, in the same jack cycle. This makes
+ * things like arpeggiators and chord generators possible without the round trip through the listener ports and
+ * SyncTimer's schedule.
+ *
+ * All three of the functions below are called from the jack process call, and must be realtime safe (no allocations,
+ * no locks, no Qt signals). Any settings should be stored in a way that is safe to read from there (such as atomics).
+ * The channel of the events written to the output is ignored, and replaced with the channel the generator is set on.
+ */
+class MidiGenerator : public QObject {
+    Q_OBJECT
+public:
+    explicit MidiGenerator(QObject *parent = nullptr);
+    ~MidiGenerator() override;
+
+    /**
+     * \brief Handle an event from the hardware input
+     * @param data The event's bytes
+     * @param size The number of bytes in the event
+     * @param frame The frame in the current cycle the event arrived at
+     * @param output Where to write any events the generator wants to send out
+     */
+    virtual void handleEvent(const unsigned char *data, size_t size, jack_nframes_t frame, MidiGeneratorOutput &output) = 0;
+    /**
+     * \brief Called once per jack cycle, after all the cycle's input has been handed to handleEvent()
+     * @param grid The timer's tick grid for this cycle
+     * @param output Where to write any events the generator wants to send out
+     */
+    virtual void process(const MidiGeneratorTickGrid &grid, MidiGeneratorOutput &output) = 0;
+    /**
+     * \brief Called when the generator is removed from its channel, to turn off anything it has left sounding
+     * @param output Where to write the note off events
+     */
+    virtual void stop(MidiGeneratorOutput &output) = 0;
+};
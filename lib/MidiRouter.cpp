@@ -1,17 +1,21 @@
 #include "MidiRouter.h"
 #include "JackPassthrough.h"
 #include "SyncTimer.h"
+#include "TimerCommand.h"
 #include "libzl.h"
 #include "DeviceMessageTranslations.h"
 #include "TransportManager.h"
+#include "MidiGenerator.h"
 
 #include <QDebug>
+#include <QMutex>
 #include <QProcessEnvironment>
 #include <QTimer>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include <atomic>
 #include <chrono>
 
 // Set this to true to emit a bunch more debug output when the router is operating
@@ -189,6 +193,16 @@ MidiRouterWatchdog::MidiRouterWatchdog()
 
 #define OUTPUT_CHANNEL_COUNT 16
 #define MAX_INPUT_DEVICES 32
+// The number of routing destinations (see MidiRouter::RoutingDestination)
+#define DESTINATION_COUNT 4
+// How often to measure the destination latencies, in iterations of the listener loop (which sleeps for 5ms each time)
+#define LATENCY_MEASUREMENT_INTERVAL 200
+// How long (in milliseconds) to wait for the process call to pick up a change of generator on a channel
+#define GENERATOR_CHANGE_TIMEOUT 500
+// How often (in milliseconds) to check whether the process call has let go of generators which are waiting to be deleted
+#define GENERATOR_DELETION_INTERVAL 100
+// The largest number of hardware input and generator events which can be sent out during a single jack cycle
+#define MAX_PENDING_EVENTS 8192
 jack_time_t expected_next_usecs{0};
 class MidiRouterPrivate {
 public:
@@ -201,6 +215,9 @@ public:
         }
         for (int i = 0; i < OUTPUT_CHANNEL_COUNT; ++i) {
             outputs[i] = nullptr;
+            requestedGenerators[i] = nullptr;
+            generators[i] = nullptr;
+            acknowledgedGenerators[i] = nullptr;
         }
         passthroughListener.identifier = MidiRouter::PassthroughPort;
         passthroughListener.waitTime = 1;
@@ -215,6 +232,10 @@ public:
         externalOutListener.waitTime = 5;
         listenerPorts[3] = &externalOutListener;
         syncTimer = qobject_cast<SyncTimer*>(SyncTimer_instance());
+        for (int i = 0; i < DESTINATION_COUNT; ++i) {
+            manualDestinationLatency[i] = -1;
+            measuredDestinationLatency[i] = 0;
+        }
     };
     ~MidiRouterPrivate() {
         if (jackClient) {
@@ -224,6 +245,8 @@ public:
             delete output;
         }
         qDeleteAll(hardwareInputs);
+        // With the jack client closed, nothing can be using these any longer
+        qDeleteAll(generatorsPendingDeletion);
         delete watchdog;
         for (int i = 0; i < 128; ++i) {
             if (device_translations_cc_presonus_atom_sq[i].size > 0) {
@@ -247,6 +270,132 @@ public:
     int currentChannel{0};
     jack_client_t* jackClient{nullptr};
     jack_port_t *syncTimerMidiInPort{nullptr};
+    // Whether SyncTimer runs inside our process call, rather than in its own jack client (see SyncTimer::isFused())
+    bool syncTimerFused{false};
+    void attachFusedSyncTimer() {
+        syncTimerFused = syncTimer->isFused();
+        if (syncTimerFused) {
+            syncTimer->attachToFusedClient(jackClient, zynthianOutputPort->port);
+        }
+    }
+
+    // The latency of each destination in microseconds, as measured, and as set manually (-1 when not set, see MidiRouter::setDestinationLatency())
+    std::atomic<quint64> measuredDestinationLatency[DESTINATION_COUNT];
+    std::atomic<int> manualDestinationLatency[DESTINATION_COUNT];
+    // Set when something has changed which means the latency compensation needs working out again
+    std::atomic<bool> latencyCompensationDirty{true};
+    int latencyMeasurementCountdown{0};
+    static quint64 measurePortLatency(jack_port_t *port, jack_nframes_t sampleRate) {
+        if (port && sampleRate > 0) {
+            jack_latency_range_t range;
+            jack_port_get_latency_range(port, JackPlaybackLatency, &range);
+            return (quint64(range.max) * 1000000) / sampleRate;
+        }
+        return 0;
+    }
+    inline quint64 destinationLatency(MidiRouter::RoutingDestination destination) const {
+        const int manualLatency{manualDestinationLatency[destination]};
+        return manualLatency > -1 ? quint64(manualLatency) : measuredDestinationLatency[destination].load();
+    }
+    /**
+     * \brief Measure how long each destination takes to sound, and tell SyncTimer how long to delay each one by
+     * Everything is delayed to line up with the slowest destination in use. SamplerSynth is always counted as in
+     * use, as clip commands go to it directly, and not through any of the midi channels.
+     * @note Do not call this from the jack process call
+     */
+    void updateLatencyCompensation() {
+        if (!jackClient) {
+            return;
+        }
+        const jack_nframes_t sampleRate{jack_get_sample_rate(jackClient)};
+        bool changed{false};
+        auto setMeasured = [this, &changed](MidiRouter::RoutingDestination destination, quint64 latency) {
+            if (measuredDestinationLatency[destination].exchange(latency) != latency) {
+                changed = true;
+            }
+        };
+        setMeasured(MidiRouter::ZynthianDestination, measurePortLatency(zynthianOutputPort ? zynthianOutputPort->port : nullptr, sampleRate));
+        setMeasured(MidiRouter::ExternalDestination, measurePortLatency(externalOutputPort ? externalOutputPort->port : nullptr, sampleRate));
+        setMeasured(MidiRouter::SamplerDestination, measurePortLatency(jack_port_by_name(jackClient, "SamplerSynth-global-uneffected:left_out"), sampleRate));
+        if (changed || latencyCompensationDirty.exchange(false)) {
+            quint64 slowest{destinationLatency(MidiRouter::SamplerDestination)};
+            for (const ChannelOutput *output : outputs) {
+                if (output && output->destination != MidiRouter::NoDestination) {
+                    slowest = qMax(slowest, destinationLatency(output->destination));
+                }
+            }
+            for (int channel = 0; channel < OUTPUT_CHANNEL_COUNT; ++channel) {
+                const ChannelOutput *output{outputs[channel]};
+                if (output && output->destination != MidiRouter::NoDestination) {
+                    syncTimer->setMidiChannelLatencyCompensation(channel, slowest - destinationLatency(output->destination));
+                } else {
+                    syncTimer->setMidiChannelLatencyCompensation(channel, 0);
+                }
+            }
+            syncTimer->setSamplerLatencyCompensation(slowest - destinationLatency(MidiRouter::SamplerDestination));
+            Q_EMIT q->destinationLatenciesChanged();
+        }
+    }
+
+    // The generator set on each channel (see MidiRouter::setChannelGenerator()), as requested, as currently in use by
+    // the process call, and as acknowledged by the process call (so the setter knows when the old one is out of use)
+    std::atomic<MidiGenerator*> requestedGenerators[OUTPUT_CHANNEL_COUNT];
+    MidiGenerator *generators[OUTPUT_CHANNEL_COUNT];
+    std::atomic<MidiGenerator*> acknowledgedGenerators[OUTPUT_CHANNEL_COUNT];
+    MidiGeneratorOutput generatorOutputs[OUTPUT_CHANNEL_COUNT];
+    // Generators which have been asked to be deleted while the process call was still using them (see MidiRouter::deleteGenerator())
+    QMutex generatorsPendingDeletionMutex;
+    QList<MidiGenerator*> generatorsPendingDeletion;
+    QTimer *generatorDeleter{nullptr};
+    /**
+     * \brief Whether the given generator is set on any channel, or the process call might still be using it
+     */
+    bool generatorInUse(MidiGenerator *generator) const {
+        for (int channel = 0; channel < OUTPUT_CHANNEL_COUNT; ++channel) {
+            if (requestedGenerators[channel].load(std::memory_order_acquire) == generator || acknowledgedGenerators[channel].load(std::memory_order_acquire) == generator) {
+                return true;
+            }
+        }
+        return false;
+    }
+    /**
+     * \brief Delete any generators waiting to be deleted, which the process call has now let go of
+     */
+    void deletePendingGenerators() {
+        QMutexLocker locker(&generatorsPendingDeletionMutex);
+        QMutableListIterator<MidiGenerator*> iterator(generatorsPendingDeletion);
+        while (iterator.hasNext()) {
+            MidiGenerator *generator = iterator.next();
+            if (!generatorInUse(generator)) {
+                delete generator;
+                iterator.remove();
+            }
+        }
+        if (generatorsPendingDeletion.isEmpty()) {
+            generatorDeleter->stop();
+        }
+    }
+    // An event from the hardware input or a generator, held until it can be sent out in order with the SyncTimer's events
+    struct PendingEvent {
+        enum Routing {
+            RouteToOutput, ///< Send to wherever the output wants it to go
+            PassthroughOnly, ///< Send only to the passthrough port
+            ExternalAndPassthrough, ///< Send to the external and passthrough ports (for system messages)
+        };
+        jack_nframes_t time{0};
+        size_t size{0};
+        jack_midi_data_t *buffer{nullptr};
+        jack_midi_data_t data[3];
+        Routing routing{RouteToOutput};
+        ChannelOutput *output{nullptr};
+        int channel{0};
+        bool isNoteMessage{false};
+    };
+    PendingEvent pendingEvents[MAX_PENDING_EVENTS];
+    int pendingEventCount{0};
+    // Our own tick position for the generators, which follows the timer's playhead while it is moving, and keeps going while it is not
+    double generatorTickPosition{0};
+    quint64 previousJackPlayhead{0};
 
     QList<InputDevice*> hardwareInputs;
     InputDevice* enabledInputs[MAX_INPUT_DEVICES];
@@ -332,6 +481,7 @@ public:
         float period_usecs;
         jack_get_cycle_times(jackClient, &current_frames, &current_usecs, &next_usecs, &period_usecs);
         const quint64 microsecondsPerFrame = (next_usecs - current_usecs) / nframes;
+        const double preciseMicrosecondsPerFrame{next_usecs > current_usecs ? double(next_usecs - current_usecs) / double(nframes) : 1.0};
 
         // TODO Maybe what we should do is reissue all of the previous run's events at immediate time
         // instead, so they all happen /now/ instead of offset by, effectively, nframes samples
@@ -375,19 +525,273 @@ public:
         inputBuffer = jack_port_get_buffer(syncTimerMidiInPort, nframes);
         quint64 subbeatLengthInMicroseconds{0};
         quint64 currentJackPlayhead{0};
-        syncTimer->process(nframes, inputBuffer, &currentJackPlayhead, &subbeatLengthInMicroseconds);
+        // When fused, SyncTimer runs right here, and hands us its events directly (anything arriving on the input port is then only from TransportManager)
+        jack_midi_event_t *fusedEvents{nullptr};
+        uint32_t fusedEventCount{0};
+        if (syncTimerFused) {
+            syncTimer->processFused(nframes, &fusedEvents, &fusedEventCount, &currentJackPlayhead, &subbeatLengthInMicroseconds);
+        } else {
+            syncTimer->process(nframes, inputBuffer, &currentJackPlayhead, &subbeatLengthInMicroseconds);
+        }
+
+        // Send an event from the hardware input (or from a generator) on to where the given output wants it to go
+        auto routeHardwareEvent = [&](jack_midi_event_t &event, ChannelOutput *currentOutput, int adjustedCurrentChannel, bool isNoteMessage) {
+            const double timestamp = currentJackPlayhead + (event.time * microsecondsPerFrame / subbeatLengthInMicroseconds);
+            switch (currentOutput->destination) {
+                case MidiRouter::ZynthianDestination:
+                    if (isNoteMessage) {
+                        addMessage(passthroughListener, timestamp, event);
+                    }
+                    for (const int &zynthianChannel : currentOutput->zynthianChannels) {
+                        if (zynthianChannel == -1) {
+                            break;
+                        }
+                        writeEventToBuffer(event, zynthianOutputBuffer, adjustedCurrentChannel, &zynthianMostRecentTime, zynthianOutputPort, zynthianChannel);
+                    }
+                    writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
+                    break;
+                case MidiRouter::SamplerDestination:
+                    if (isNoteMessage) {
+                        addMessage(passthroughListener, timestamp, event);
+                    }
+                    writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
+                    break;
+                case MidiRouter::ExternalDestination:
+                {
+                    int externalChannel = (currentOutput->externalChannel == -1) ? currentOutput->inputChannel : currentOutput->externalChannel;
+                    if (isNoteMessage) {
+                        addMessage(passthroughListener, timestamp, event);
+                        addMessage(externalOutListener, timestamp, event);
+                    }
+                    writeEventToBuffer(event, externalOutputBuffer, adjustedCurrentChannel, &externalMostRecentTime, externalOutputPort, externalChannel);
+                    writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
+                }
+                case MidiRouter::NoDestination:
+                default:
+                    // Do nothing here
+                    break;
+            }
+            if (isNoteMessage) {
+                addMessage(hardwareInListener, timestamp, event);
+            }
+        };
+
+        // Hold on to an event from the hardware input (or from a generator), to be sent out in order with everything else
+        auto holdEvent = [&](const jack_midi_event_t &event, PendingEvent::Routing routing, ChannelOutput *currentOutput, int channel, bool isNoteMessage) {
+            if (pendingEventCount < MAX_PENDING_EVENTS) {
+                PendingEvent &pendingEvent = pendingEvents[pendingEventCount];
+                pendingEvent.time = event.time;
+                pendingEvent.size = event.size;
+                pendingEvent.buffer = event.buffer;
+                for (size_t i = 0; i < event.size && i < 3; ++i) {
+                    pendingEvent.data[i] = event.buffer[i];
+                }
+                pendingEvent.routing = routing;
+                pendingEvent.output = currentOutput;
+                pendingEvent.channel = channel;
+                pendingEvent.isNoteMessage = isNoteMessage;
+                ++pendingEventCount;
+            } else {
+                qWarning() << "ZLRouter: Ran out of space for holding hardware and generator events, dropping event at time" << event.time;
+            }
+        };
+        auto sendPendingEvent = [&](PendingEvent &pendingEvent) {
+            jack_midi_event_t pending;
+            pending.time = pendingEvent.time;
+            pending.size = pendingEvent.size;
+            // Short events were copied, so they are unaffected by the channel rewriting done to any later event sharing their buffer
+            pending.buffer = pendingEvent.size <= 3 ? pendingEvent.data : pendingEvent.buffer;
+            switch (pendingEvent.routing) {
+                case PendingEvent::RouteToOutput:
+                    routeHardwareEvent(pending, pendingEvent.output, pendingEvent.channel, pendingEvent.isNoteMessage);
+                    break;
+                case PendingEvent::ExternalAndPassthrough:
+                    writeEventToBuffer(pending, externalOutputBuffer, pendingEvent.channel, &externalMostRecentTime, externalOutputPort);
+                    writeEventToBuffer(pending, passthroughOutputBuffer, pendingEvent.channel, &passthroughOutputMostRecentTime, passthroughOutputPort);
+                    break;
+                case PendingEvent::PassthroughOnly:
+                default:
+                    writeEventToBuffer(pending, passthroughOutputBuffer, pendingEvent.channel, &passthroughOutputMostRecentTime, passthroughOutputPort);
+                    break;
+            }
+        };
+
+        // Pick up any changes to the channels' generators (letting the outgoing ones turn off whatever they left sounding).
+        // This is done whether or not we are otherwise ready to go, as whoever changed the generator is waiting for us to
+        // let go of the old one before deleting it.
+        for (int channel = 0; channel < OUTPUT_CHANNEL_COUNT; ++channel) {
+            generatorOutputs[channel].clear();
+            MidiGenerator *requestedGenerator{requestedGenerators[channel].load(std::memory_order_acquire)};
+            if (generators[channel] != requestedGenerator) {
+                if (generators[channel]) {
+                    generators[channel]->stop(generatorOutputs[channel]);
+                }
+                generators[channel] = requestedGenerator;
+                acknowledgedGenerators[channel].store(requestedGenerator, std::memory_order_release);
+            }
+        }
 
         // A quick bit of sanity checking - usually everything's fine, but occasionally we might get events while
         // starting up, and we kind of need to settle down before then, and a good indicator something went wrong
         // is that the subbeatLengthInMicroseconds variable is zero, and so we can use that to make sure things are
         // reasonably sane before trying to do anything.
         if (subbeatLengthInMicroseconds > 0) {
+            // Handle all the hardware input - magic for the ones we want to direct to external ports, and straight passthrough for ones aimed at zynthian
+            // This is done before sending out anything at all, as the generators need their input before they can make
+            // their output, and the events are held until everything is sent out in frame order further down
+            pendingEventCount = 0;
+            if (currentChannel > -1 && currentChannel < OUTPUT_CHANNEL_COUNT) {
+                int adjustedCurrentChannel{currentChannel};
+                int currentEnabledInputIndex = 0;
+                for (InputDevice *device : enabledInputs) {
+                    if (currentEnabledInputIndex == enabledInputsCount) {
+                        break;
+                    }
+                    void *deviceBuffer = jack_port_get_buffer(device->port, nframes);
+                    output = outputs[currentChannel];
+                    uint32_t eventIndex{0};
+                    ChannelOutput *currentOutput{nullptr};
+                    while (true) {
+                        currentOutput = output;
+                        if (int err = jack_midi_event_get(&event, deviceBuffer, eventIndex)) {
+                            if (err != -ENOBUFS) {
+                                qWarning() << "ZLRouter: jack_midi_event_get failed, received note lost! Attempted to fetch at index" << eventIndex << "and the error code is" << err;
+                            }
+                            break;
+                        } else {
+                            if (event.buffer[0] < 0xf0) {
+                                // Check whether we've got any message translation to do
+                                if (event.buffer[0] > 0xAF && event.buffer[0] < 0xC0) {
+                                    // Then it's a CC thing, and maybe we want to do a thing?
+                                    const jack_midi_event_t &otherEvent = device->device_translations_cc[event.buffer[1]];
+                                    if (otherEvent.size > 0) {
+                                        event.size = otherEvent.size;
+                                        event.buffer = otherEvent.buffer;
+                                        // leave the time code intact
+                                    }
+                                }
+                                eventChannel = (event.buffer[0] & 0xf);
+                                if (eventChannel > -1 && eventChannel < OUTPUT_CHANNEL_COUNT) {
+                                    // Make sure we're using the correct output
+                                    // This is done to ensure that if we have any note-on events happen on some
+                                    // output, then all the following commands associated with that note should
+                                    // go to the same output (so any further ons, and any matching offs)
+                                    const unsigned char &byte1 = event.buffer[0];
+                                    bool isNoteMessage{false};
+                                    if (0x7F < byte1 && byte1 < 0xA0) {
+                                        const int &midiNote = event.buffer[1];
+                                        isNoteMessage = true;
+                                        int &noteActivation = device->noteActivations[midiNote];
+                                        if ((byte1 >= 0x90)) { // this is a note on message
+                                            ++noteActivation;
+                                            if (noteActivation == 1) {
+                                                device->activeNoteChannel[midiNote] = currentChannel;
+                                            }
+                                        } else {
+                                            noteActivation = 0;
+                                        }
+                                        adjustedCurrentChannel = device->activeNoteChannel[midiNote];
+                                        currentOutput = outputs[adjustedCurrentChannel];
+                                        if (currentChannel == adjustedCurrentChannel) {
+                                            event.buffer[0] = event.buffer[0] - eventChannel + currentChannel;
+                                        } else {
+                                            event.buffer[0] = event.buffer[0] - eventChannel + adjustedCurrentChannel;
+                                        }
+                                    }
+
+                                    const int generatorChannel{isNoteMessage ? adjustedCurrentChannel : currentChannel};
+                                    if (generators[generatorChannel]) {
+                                        // The channel has a generator, so it gets the event, and what it makes of it is sent on below
+                                        generators[generatorChannel]->handleEvent(event.buffer, event.size, event.time, generatorOutputs[generatorChannel]);
+                                    } else {
+                                        holdEvent(event, PendingEvent::RouteToOutput, currentOutput, adjustedCurrentChannel, isNoteMessage);
+                                    }
+                                } else if (event.size == 1 || event.size == 2) {
+                                    holdEvent(event, PendingEvent::PassthroughOnly, nullptr, adjustedCurrentChannel, false);
+                                } else {
+                                    qWarning() << "ZLRouter: Something's badly wrong and we've ended up with a message supposedly on channel" << eventChannel;
+                                }
+                            } else if (event.buffer[0] == 0xf0) {
+                                // We don't know what to do with sysex messages, so (for now) we're just ignoring them entirely
+                                // Likely want to pass them through directly to any connected midi output devices, though
+                            } else {
+                                holdEvent(event, PendingEvent::ExternalAndPassthrough, nullptr, currentChannel, false);
+                            }
+                        }
+                        ++eventIndex;
+                    }
+                    ++currentEnabledInputIndex;
+                }
+            }
+
+            // Let the generators do their work on the timer's tick grid, and hold on to what they made (along with what they made of the hardware input)
+            if (currentJackPlayhead != previousJackPlayhead) {
+                generatorTickPosition = double(currentJackPlayhead);
+                previousJackPlayhead = currentJackPlayhead;
+            }
+            MidiGeneratorTickGrid generatorGrid;
+            generatorGrid.firstTick = generatorTickPosition;
+            generatorGrid.framesPerTick = double(subbeatLengthInMicroseconds) / preciseMicrosecondsPerFrame;
+            generatorGrid.nframes = nframes;
+            generatorTickPosition += double(nframes) / generatorGrid.framesPerTick;
+            for (int channel = 0; channel < OUTPUT_CHANNEL_COUNT; ++channel) {
+                MidiGeneratorOutput &generatorOutput = generatorOutputs[channel];
+                if (generators[channel]) {
+                    generators[channel]->process(generatorGrid, generatorOutput);
+                }
+                for (int i = 0; i < generatorOutput.eventCount; ++i) {
+                    MidiGeneratorOutput::Event &generatedEvent = generatorOutput.events[i];
+                    jack_midi_event_t generated;
+                    generated.time = qMin(generatedEvent.frame, nframes - 1);
+                    generated.size = generatedEvent.size;
+                    generated.buffer = generatedEvent.data;
+                    if (generated.buffer[0] < 0xf0) {
+                        generated.buffer[0] = (generated.buffer[0] & 0xf0) | channel;
+                        holdEvent(generated, PendingEvent::RouteToOutput, outputs[channel], channel, (0x7F < generated.buffer[0] && generated.buffer[0] < 0xA0));
+                    } else {
+                        holdEvent(generated, PendingEvent::PassthroughOnly, nullptr, channel, false);
+                    }
+                }
+            }
+            // The held events come from several devices and generators, each in their own order, so sort them (stably) by frame
+            for (int i = 1; i < pendingEventCount; ++i) {
+                int index{i};
+                while (index > 0 && pendingEvents[index - 1].time > pendingEvents[index].time) {
+                    std::swap(pendingEvents[index - 1], pendingEvents[index]);
+                    --index;
+                }
+            }
+            int sentPendingEvents{0};
+
             eventIndex = 0;
-            const uint32_t eventCount = jack_midi_get_event_count(inputBuffer);
+            const uint32_t portEventCount = jack_midi_get_event_count(inputBuffer);
+            const uint32_t eventCount = portEventCount + fusedEventCount;
+            uint32_t portEventIndex{0};
+            uint32_t fusedEventIndex{0};
             uint32_t nonEmittedEvents{unclearedMessages};
             while (eventIndex < eventCount) {
-                if (int err = jack_midi_event_get(&event, inputBuffer, eventIndex)) {
-                    qWarning() << "ZLRouter: jack_midi_event_get, received note lost! We were supposed to have" << eventCount << "events, attempted to fetch at index" << eventIndex << "and the error code is" << err;
+                // Take whichever is earlier of the next event on the input port and the next fused event (if there are any)
+                bool fromPort{portEventIndex < portEventCount};
+                int err{0};
+                if (fromPort) {
+                    err = jack_midi_event_get(&event, inputBuffer, portEventIndex);
+                    fromPort = (err != 0 || fusedEventIndex == fusedEventCount || event.time <= fusedEvents[fusedEventIndex].time);
+                }
+                if (fromPort) {
+                    ++portEventIndex;
+                } else {
+                    event = fusedEvents[fusedEventIndex];
+                    ++fusedEventIndex;
+                }
+                if (err == 0 || !fromPort) {
+                    // Send out any held events which are due before this one, so each output gets its events in frame order
+                    while (sentPendingEvents < pendingEventCount && pendingEvents[sentPendingEvents].time < event.time) {
+                        sendPendingEvent(pendingEvents[sentPendingEvents]);
+                        ++sentPendingEvents;
+                    }
+                }
+                if (err != 0 && fromPort) {
+                    qWarning() << "ZLRouter: jack_midi_event_get, received note lost! We were supposed to have" << portEventCount << "events, attempted to fetch at index" << portEventIndex - 1 << "and the error code is" << err;
                 } else {
                     if (event.buffer[0] < 0xf0) {
                         eventChannel = (event.buffer[0] & 0xf);
@@ -453,8 +857,14 @@ public:
                 }
                 ++eventIndex;
             }
+            // And then whatever is left of the held events, which are all due after the SyncTimer's events
+            while (sentPendingEvents < pendingEventCount) {
+                sendPendingEvent(pendingEvents[sentPendingEvents]);
+                ++sentPendingEvents;
+            }
     #if DebugZLRouter
-            if (eventCount > 0) {
+            // The held events are sent out in among the SyncTimer's, so this only adds up when there were none
+            if (eventCount > 0 && pendingEventCount == 0) {
                 uint32_t totalEvents{nonEmittedEvents};
                 const uint32_t zynthianEventCount{jack_midi_get_event_count(zynthianOutputBuffer)};
                 totalEvents += zynthianEventCount;
@@ -466,122 +876,6 @@ public:
             }
     #endif
 
-            // Handle all the hardware input - magic for the ones we want to direct to external ports, and straight passthrough for ones aimed at zynthian
-            if (currentChannel > -1 && currentChannel < OUTPUT_CHANNEL_COUNT) {
-                int adjustedCurrentChannel{currentChannel};
-                int currentEnabledInputIndex = 0;
-                for (InputDevice *device : enabledInputs) {
-                    if (currentEnabledInputIndex == enabledInputsCount) {
-                        break;
-                    }
-                    inputBuffer = jack_port_get_buffer(device->port, nframes);
-                    output = outputs[currentChannel];
-                    uint32_t eventIndex{0};
-                    ChannelOutput *currentOutput{nullptr};
-                    while (true) {
-                        currentOutput = output;
-                        if (int err = jack_midi_event_get(&event, inputBuffer, eventIndex)) {
-                            if (err != -ENOBUFS) {
-                                qWarning() << "ZLRouter: jack_midi_event_get failed, received note lost! Attempted to fetch at index" << eventIndex << "and the error code is" << err;
-                            }
-                            break;
-                        } else {
-                            if (event.buffer[0] < 0xf0) {
-                                // Check whether we've got any message translation to do
-                                if (event.buffer[0] > 0xAF && event.buffer[0] < 0xC0) {
-                                    // Then it's a CC thing, and maybe we want to do a thing?
-                                    const jack_midi_event_t &otherEvent = device->device_translations_cc[event.buffer[1]];
-                                    if (otherEvent.size > 0) {
-                                        event.size = otherEvent.size;
-                                        event.buffer = otherEvent.buffer;
-                                        // leave the time code intact
-                                    }
-                                }
-                                eventChannel = (event.buffer[0] & 0xf);
-                                if (eventChannel > -1 && eventChannel < OUTPUT_CHANNEL_COUNT) {
-                                    // Make sure we're using the correct output
-                                    // This is done to ensure that if we have any note-on events happen on some
-                                    // output, then all the following commands associated with that note should
-                                    // go to the same output (so any further ons, and any matching offs)
-                                    const unsigned char &byte1 = event.buffer[0];
-                                    bool isNoteMessage{false};
-                                    if (0x7F < byte1 && byte1 < 0xA0) {
-                                        const int &midiNote = event.buffer[1];
-                                        isNoteMessage = true;
-                                        int &noteActivation = device->noteActivations[midiNote];
-                                        if ((byte1 >= 0x90)) { // this is a note on message
-                                            ++noteActivation;
-                                            if (noteActivation == 1) {
-                                                device->activeNoteChannel[midiNote] = currentChannel;
-                                            }
-                                        } else {
-                                            noteActivation = 0;
-                                        }
-                                        adjustedCurrentChannel = device->activeNoteChannel[midiNote];
-                                        currentOutput = outputs[adjustedCurrentChannel];
-                                        if (currentChannel == adjustedCurrentChannel) {
-                                            event.buffer[0] = event.buffer[0] - eventChannel + currentChannel;
-                                        } else {
-                                            event.buffer[0] = event.buffer[0] - eventChannel + adjustedCurrentChannel;
-                                        }
-                                    }
-
-                                    const double timestamp = currentJackPlayhead + (event.time * microsecondsPerFrame / subbeatLengthInMicroseconds);
-                                    switch (currentOutput->destination) {
-                                        case MidiRouter::ZynthianDestination:
-                                            if (isNoteMessage) {
-                                                addMessage(passthroughListener, timestamp, event);
-                                            }
-                                            for (const int &zynthianChannel : currentOutput->zynthianChannels) {
-                                                if (zynthianChannel == -1) {
-                                                    break;
-                                                }
-                                                writeEventToBuffer(event, zynthianOutputBuffer, adjustedCurrentChannel, &zynthianMostRecentTime, zynthianOutputPort, zynthianChannel);
-                                            }
-                                            writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
-                                            break;
-                                        case MidiRouter::SamplerDestination:
-                                            if (isNoteMessage) {
-                                                addMessage(passthroughListener, timestamp, event);
-                                            }
-                                            writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
-                                            break;
-                                        case MidiRouter::ExternalDestination:
-                                        {
-                                            int externalChannel = (currentOutput->externalChannel == -1) ? currentOutput->inputChannel : currentOutput->externalChannel;
-                                            if (isNoteMessage) {
-                                                addMessage(passthroughListener, timestamp, event);
-                                                addMessage(externalOutListener, timestamp, event);
-                                            }
-                                            writeEventToBuffer(event, externalOutputBuffer, adjustedCurrentChannel, &externalMostRecentTime, externalOutputPort, externalChannel);
-                                            writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
-                                        }
-                                        case MidiRouter::NoDestination:
-                                        default:
-                                            // Do nothing here
-                                            break;
-                                    }
-                                    if (isNoteMessage) {
-                                        addMessage(hardwareInListener, timestamp, event);
-                                    }
-                                } else if (event.size == 1 || event.size == 2) {
-                                    writeEventToBuffer(event, passthroughOutputBuffer, adjustedCurrentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
-                                } else {
-                                    qWarning() << "ZLRouter: Something's badly wrong and we've ended up with a message supposedly on channel" << eventChannel;
-                                }
-                            } else if (event.buffer[0] == 0xf0) {
-                                // We don't know what to do with sysex messages, so (for now) we're just ignoring them entirely
-                                // Likely want to pass them through directly to any connected midi output devices, though
-                            } else {
-                                writeEventToBuffer(event, externalOutputBuffer, eventChannel, &externalMostRecentTime, externalOutputPort);
-                                writeEventToBuffer(event, passthroughOutputBuffer, currentChannel, &passthroughOutputMostRecentTime, passthroughOutputPort);
-                            }
-                        }
-                        ++eventIndex;
-                    }
-                    ++currentEnabledInputIndex;
-                }
-            }
 #if ZLROUTER_WATCHDOG
             mostRecentEventsForZynthian = jack_midi_get_event_count(zynthianOutputBuffer);
 #endif
@@ -797,6 +1091,9 @@ MidiRouter::MidiRouter(QObject *parent)
     , d(new MidiRouterPrivate(this))
 {
     qRegisterMetaType<MidiRouter::ListenerPort>();
+    d->generatorDeleter = new QTimer(this);
+    d->generatorDeleter->setInterval(GENERATOR_DELETION_INTERVAL);
+    connect(d->generatorDeleter, &QTimer::timeout, this, [this](){ d->deletePendingGenerators(); });
     // First, load up our configuration (TODO: also remember to reload it when the config changes)
     reloadConfiguration();
     TransportManager::instance(d->syncTimer)->initialize();
@@ -847,6 +1144,8 @@ MidiRouter::MidiRouter(QObject *parent)
 
                 jack_set_port_registration_callback(d->jackClient, client_port_registration, static_cast<void*>(d));
                 jack_set_client_registration_callback(d->jackClient, client_registration, static_cast<void*>(d));
+                // If SyncTimer is fused into us, it needs our client set up before it's activated
+                d->attachFusedSyncTimer();
                 // Activate the client.
                 if (jack_activate(d->jackClient) == 0) {
                     qInfo() << "ZLRouter: Successfully created and set up the ZLRouter's Jack client";
@@ -854,7 +1153,9 @@ MidiRouter::MidiRouter(QObject *parent)
 //                         d->connectPorts(QString("ZLRouter:%1").arg(output->portName), zmrPort);
 //                     }
                     d->connectPorts(QString("ZLRouter:%1").arg(d->zynthianOutputPort->portName), zmrPort);
-                    d->connectPorts(QLatin1String{"SyncTimer:midi_out"}, QLatin1String{"ZLRouter:SyncTimerIn"});
+                    if (!d->syncTimerFused) {
+                        d->connectPorts(QLatin1String{"SyncTimer:midi_out"}, QLatin1String{"ZLRouter:SyncTimerIn"});
+                    }
 
                     d->connectPorts(QLatin1String{"ZLRouter:PassthroughOut"}, QLatin1String{"TransportManager:midi_in"});
                     d->connectPorts(QLatin1String{"TransportManager:midi_out"}, QLatin1String{"ZLRouter:SyncTimerIn"});
@@ -881,6 +1182,20 @@ MidiRouter::MidiRouter(QObject *parent)
     for (int i=0; i<10; ++i) {
         d->channelEffectsPassthroughClients << new JackPassthrough(QString("FXPassthrough-Channel%1").arg(i+1), this);
     }
+    // Handle passthrough client changes scheduled on the timer (see TimerCommand::PassthroughClientOperation)
+    SyncTimer::instance()->registerTimerCommandHandler(TimerCommand::PassthroughClientOperation, [](TimerCommand *command, quint64 /*playhead*/, quint64 /*usecs*/, void *userData){
+        MidiRouterPrivate *d = static_cast<MidiRouterPrivate*>(userData);
+        JackPassthrough *client{nullptr};
+        if (command->parameter == -1) {
+            client = d->globalPlayback;
+        } else if (command->parameter > -1 && command->parameter < d->channelEffectsPassthroughClients.count()) {
+            client = d->channelEffectsPassthroughClients[command->parameter];
+        }
+        if (client && command->parameter2 >= JackPassthrough::DryAmountSetting && command->parameter2 <= JackPassthrough::MutedSetting) {
+            // The clients only have the one value for each setting, so parameter4 (the right value) is not used
+            client->setSettingRealtime(static_cast<JackPassthrough::Setting>(command->parameter2), float(command->parameter3) / 100.0f);
+        }
+    }, d);
 
     d->constructing = false;
     start();
@@ -888,6 +1203,7 @@ MidiRouter::MidiRouter(QObject *parent)
 
 MidiRouter::~MidiRouter()
 {
+    SyncTimer::instance()->unregisterTimerCommandHandler(TimerCommand::PassthroughClientOperation);
     delete d;
 }
 
@@ -913,6 +1229,17 @@ void MidiRouter::run() {
                 message = listenerPort->readHead;
             }
         }
+        // Keep the latency compensation up to date (the graph can change underneath us, so measure every now and then)
+        if (d->latencyMeasurementCountdown == 0 || d->latencyCompensationDirty) {
+            d->updateLatencyCompensation();
+            d->latencyMeasurementCountdown = LATENCY_MEASUREMENT_INTERVAL;
+        }
+        --d->latencyMeasurementCountdown;
+        // Let everybody know about any passthrough client changes made by the timer
+        d->globalPlayback->emitPendingChanges();
+        for (JackPassthrough *client : qAsConst(d->channelEffectsPassthroughClients)) {
+            client->emitPendingChanges();
+        }
         msleep(5);
     }
 }
@@ -930,6 +1257,7 @@ void MidiRouter::setChannelDestination(int channel, MidiRouter::RoutingDestinati
             d->disconnectFromOutputs(output);
             output->destination = destination;
             d->connectToOutputs(output);
+            d->latencyCompensationDirty = true;
         }
     }
 }
@@ -1042,3 +1370,75 @@ QObject * MidiRouter::globalPlaybackClient() const
 {
     return d->globalPlayback;
 }
+
+void MidiRouter::setDestinationLatency(MidiRouter::RoutingDestination destination, int usecs)
+{
+    if (destination > NoDestination && destination < DESTINATION_COUNT) {
+        d->manualDestinationLatency[destination] = qMax(-1, usecs);
+        d->latencyCompensationDirty = true;
+    }
+}
+
+bool MidiRouter::setChannelGenerator(int channel, MidiGenerator *generator)
+{
+    if (channel > -1 && channel < OUTPUT_CHANNEL_COUNT) {
+        if (d->requestedGenerators[channel].exchange(generator) != generator && d->jackClient) {
+            // Wait for the process call to pick up the change, so the old generator is known to be out of use when we return
+            int waitCount{0};
+            while (d->acknowledgedGenerators[channel].load(std::memory_order_acquire) != generator) {
+                if (waitCount > GENERATOR_CHANGE_TIMEOUT) {
+                    qWarning() << Q_FUNC_INFO << "Timed out waiting for the process call to pick up the new generator for channel" << channel << "- the previous generator may still be in use, and must not be deleted yet";
+                    return false;
+                }
+                QThread::msleep(1);
+                ++waitCount;
+            }
+        }
+        return true;
+    }
+    qWarning() << Q_FUNC_INFO << "Attempted to set a generator on channel" << channel << "which is outside the valid range of 0 through 15";
+    return false;
+}
+
+void MidiRouter::deleteGenerator(MidiGenerator *generator)
+{
+    if (generator) {
+        for (int channel = 0; channel < OUTPUT_CHANNEL_COUNT; ++channel) {
+            if (d->requestedGenerators[channel].load(std::memory_order_acquire) == generator) {
+                setChannelGenerator(channel, nullptr);
+            }
+        }
+        if (!d->jackClient || !d->generatorInUse(generator)) {
+            delete generator;
+        } else {
+            qWarning() << Q_FUNC_INFO << "The process call has not yet let go of the generator" << generator << "- deleting it once it has";
+            QMutexLocker locker(&d->generatorsPendingDeletionMutex);
+            d->generatorsPendingDeletion << generator;
+            QMetaObject::invokeMethod(d->generatorDeleter, "start", Qt::QueuedConnection);
+        }
+    }
+}
+
+MidiGenerator *MidiRouter::channelGenerator(int channel) const
+{
+    if (channel > -1 && channel < OUTPUT_CHANNEL_COUNT) {
+        return d->requestedGenerators[channel];
+    }
+    return nullptr;
+}
+
+quint64 MidiRouter::measuredDestinationLatency(MidiRouter::RoutingDestination destination) const
+{
+    if (destination > NoDestination && destination < DESTINATION_COUNT) {
+        return d->measuredDestinationLatency[destination];
+    }
+    return 0;
+}
+
+quint64 MidiRouter::destinationLatency(MidiRouter::RoutingDestination destination) const
+{
+    if (destination > NoDestination && destination < DESTINATION_COUNT) {
+        return d->destinationLatency(destination);
+    }
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <QCoreApplication>
 #include <QThread>
 
+class MidiGenerator;
 class MidiRouterPrivate;
 /**
  * \brief System for routing midi messages from one jack input port (ZLRouter:MidiIn) to a set of output ports (ZLRouter::Channel0 through 15) based on their input channel settings
@@ -54,6 +55,7 @@ public:
         ExternalDestination = 2, // Route all events to the enabled external ports
         SamplerDestination = 3, // Route all events only to passthrough (which is then handled elsewhere for distribution to the sampler)
     };
+    Q_ENUM( RoutingDestination )
     /**
      * \brief Where notes on a specific midi channel should be routed
      * @note Logically, in zynthbox, we really only have ten channels (corresponding to a channel each), but we might
@@ -65,6 +67,59 @@ public:
      */
     void setChannelDestination(int channel, RoutingDestination destination, int externalChannel = -1);
 
+    /**
+     * \brief Set a realtime midi generator (such as an arpeggiator) on a channel
+     * Once set, the channel's hardware input is handed to the generator, rather than being routed directly, and the
+     * events the generator writes are routed in its place (see MidiGenerator for details).
+     * The router does not take ownership of the generator, and you must unset it before deleting it (or use
+     * deleteGenerator(), which does both). When this function returns true, the previous generator is no longer in use
+     * by the router, and is safe to delete.
+     * @param channel The midi channel (0 through 15)
+     * @param generator The generator to use for the channel, or nullptr to route the channel's input directly again
+     * @return False if the channel is invalid, or if the process call did not pick up the change in time (in which case
+     *         the previous generator may still be in use, and must not be deleted)
+     */
+    bool setChannelGenerator(int channel, MidiGenerator *generator);
+    /**
+     * \brief Remove a generator from any channel it is set on, and delete it
+     * If the process call has not let go of the generator by the time it has been removed from its channels, it is
+     * deleted later, once it has (so it is never deleted while still in use).
+     * @param generator The generator to delete
+     */
+    void deleteGenerator(MidiGenerator *generator);
+    /**
+     * \brief The generator currently set on a channel
+     * @param channel The midi channel (0 through 15)
+     * @return The channel's generator, or nullptr if there is none
+     */
+    MidiGenerator *channelGenerator(int channel) const;
+
+    /**
+     * \brief Set the latency of a destination manually, rather than measuring it
+     * The events SyncTimer sends out are delayed per channel, so that all destinations in use sound together (see
+     * SyncTimer::midiChannelLatencyCompensation()). By default the latency of each destination is measured from
+     * the jack graph, but that is only as good as what the clients in the graph report, so it can be set manually.
+     * @param destination The destination to set the latency for
+     * @param usecs The destination's latency in microseconds, or -1 to go back to using the measured latency
+     */
+    Q_INVOKABLE void setDestinationLatency(RoutingDestination destination, int usecs);
+    /**
+     * \brief The latency of the given destination, as measured from the jack graph
+     * @param destination The destination to get the latency for
+     * @return The destination's measured latency in microseconds
+     */
+    Q_INVOKABLE quint64 measuredDestinationLatency(RoutingDestination destination) const;
+    /**
+     * \brief The latency used for the given destination (either the measured one, or the one set manually)
+     * @param destination The destination to get the latency for
+     * @return The destination's latency in microseconds
+     */
+    Q_INVOKABLE quint64 destinationLatency(RoutingDestination destination) const;
+    /**
+     * \brief Fired whenever the measured or manual latency of any destination changes, or the channels' destinations change
+     */
+    Q_SIGNAL void destinationLatenciesChanged();
+
     void setCurrentChannel(int currentChannel);
     int currentChannel() const;
     Q_SIGNAL void currentChannelChanged();
@@ -0,0 +1,266 @@
+#include "ModulationEngine.h"
+#include "ModulatorState.h"
+
+#include <QDebug>
+#include <QMutex>
+
+#include <algorithm>
+#include <cmath>
+
+// The number of modulators which can exist at once
+#define ModulatorCount 64
+// The number of changes which can be waiting for the process call to pick them up
+#define ModulatorUpdateQueueSize 256
+
+typedef ControlEngineUpdateQueue<ModulatorSettings, ModulatorUpdateQueueSize> ModulatorUpdateQueue;
+
+class ModulationEnginePrivate {
+public:
+    ModulationEnginePrivate() {
+        for (int i = 0; i < ModulatorCount; ++i) {
+            allocated[i] = false;
+            values[i].store(0.0f);
+        }
+    }
+    // Only touched by the process call
+    ModulatorState modulators[ModulatorCount];
+    ModulatorRandom random;
+
+    // Only touched outside the process call, with the mutex held
+    QMutex mutex;
+    bool allocated[ModulatorCount];
+    ModulatorSettings settings[ModulatorCount];
+
+    // Written outside the process call (with the mutex held), and read by the process call
+    ModulatorUpdateQueue updates;
+
+    // The most recent value of each modulator, for modulatorValue()
+    std::atomic<float> values[ModulatorCount];
+
+    // Call with the mutex held
+    bool enqueue(ModulatorUpdateQueue::Kind kind, int modulator) {
+        if (updates.enqueue(kind, modulator, settings[modulator])) {
+            return true;
+        }
+        qWarning() << Q_FUNC_INFO << "The modulation update queue is full, dropping update for modulator" << modulator;
+        return false;
+    }
+    // Call with the mutex held
+    int allocate(const ModulatorSettings &newSettings) {
+        for (int i = 0; i < ModulatorCount; ++i) {
+            if (!allocated[i]) {
+                allocated[i] = true;
+                settings[i] = newSettings;
+                values[i].store(newSettings.minimum);
+                if (enqueue(ModulatorUpdateQueue::SettingsUpdate, i)) {
+                    return i;
+                }
+                allocated[i] = false;
+                return -1;
+            }
+        }
+        qWarning() << Q_FUNC_INFO << "Attempted to add a modulator, but all" << ModulatorCount << "modulators are in use";
+        return -1;
+    }
+};
+
+ModulationEngine::ModulationEngine(SyncTimer *parent)
+    : QObject(parent)
+    , d(new ModulationEnginePrivate)
+{
+}
+
+ModulationEngine::~ModulationEngine()
+{
+    delete d;
+}
+
+int ModulationEngine::addLfo(LfoShape shape, quint64 periodTicks, float minimum, float maximum)
+{
+    if (periodTicks == 0) {
+        qWarning() << Q_FUNC_INFO << "Attempted to add an LFO with a period of zero ticks";
+        return -1;
+    }
+    ModulatorSettings settings;
+    settings.type = LfoModulator;
+    settings.shape = shape;
+    settings.periodTicks = periodTicks;
+    settings.minimum = std::clamp(minimum, 0.0f, 1.0f);
+    settings.maximum = std::clamp(maximum, 0.0f, 1.0f);
+    QMutexLocker locker(&d->mutex);
+    return d->allocate(settings);
+}
+
+int ModulationEngine::addEnvelope(const QList<int> &segmentTicks, const QList<float> &segmentLevels, bool loop, float minimum, float maximum)
+{
+    if (segmentTicks.isEmpty() || segmentTicks.count() != segmentLevels.count() || segmentTicks.count() > ModulatorSegmentCount) {
+        qWarning() << Q_FUNC_INFO << "Attempted to add an envelope with an invalid set of segments (there must be between 1 and" << ModulatorSegmentCount << "segments, with a level for each)";
+        return -1;
+    }
+    ModulatorSettings settings;
+    settings.type = EnvelopeModulator;
+    settings.segmentCount = segmentTicks.count();
+    for (int segment = 0; segment < settings.segmentCount; ++segment) {
+        settings.segmentTicks[segment] = quint32(qMax(0, segmentTicks[segment]));
+        settings.segmentLevels[segment] = std::clamp(segmentLevels[segment], 0.0f, 1.0f);
+        settings.envelopeLength += settings.segmentTicks[segment];
+    }
+    settings.loop = loop;
+    settings.minimum = std::clamp(minimum, 0.0f, 1.0f);
+    settings.maximum = std::clamp(maximum, 0.0f, 1.0f);
+    QMutexLocker locker(&d->mutex);
+    return d->allocate(settings);
+}
+
+void ModulationEngine::removeModulator(int modulator)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        d->settings[modulator] = ModulatorSettings();
+        if (d->enqueue(ModulatorUpdateQueue::RemoveUpdate, modulator)) {
+            d->allocated[modulator] = false;
+        }
+    }
+}
+
+void ModulationEngine::setControlChangeTarget(int modulator, int midiChannel, int control)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        ModulatorSettings &settings = d->settings[modulator];
+        settings.target = ControlChangeTarget;
+        settings.midiChannel = std::clamp(midiChannel, 0, 15);
+        settings.control = std::clamp(control, 0, 127);
+        d->enqueue(ModulatorUpdateQueue::SettingsUpdate, modulator);
+    }
+}
+
+void ModulationEngine::setPitchBendTarget(int modulator, int midiChannel)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        ModulatorSettings &settings = d->settings[modulator];
+        settings.target = PitchBendTarget;
+        settings.midiChannel = std::clamp(midiChannel, 0, 15);
+        d->enqueue(ModulatorUpdateQueue::SettingsUpdate, modulator);
+    }
+}
+
+void ModulationEngine::setPassthroughTarget(int modulator, int channel, int setting)
+{
+    JackPassthrough *passthrough{ControlEngineTargets::passthroughClient(channel, setting)};
+    if (!passthrough) {
+        return;
+    }
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        ModulatorSettings &settings = d->settings[modulator];
+        settings.target = PassthroughTarget;
+        settings.passthrough = passthrough;
+        settings.passthroughSetting = static_cast<JackPassthrough::Setting>(setting);
+        d->enqueue(ModulatorUpdateQueue::SettingsUpdate, modulator);
+    }
+}
+
+void ModulationEngine::setDecimation(int modulator, int cycles)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        d->settings[modulator].decimation = qMax(1, cycles);
+        d->enqueue(ModulatorUpdateQueue::SettingsUpdate, modulator);
+    }
+}
+
+void ModulationEngine::startModulator(int modulator)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        d->enqueue(ModulatorUpdateQueue::StartUpdate, modulator);
+    }
+}
+
+void ModulationEngine::stopModulator(int modulator)
+{
+    QMutexLocker locker(&d->mutex);
+    if (modulator > -1 && modulator < ModulatorCount && d->allocated[modulator]) {
+        d->enqueue(ModulatorUpdateQueue::StopUpdate, modulator);
+    }
+}
+
+float ModulationEngine::modulatorValue(int modulator) const
+{
+    if (modulator > -1 && modulator < ModulatorCount) {
+        return d->values[modulator].load(std::memory_order_relaxed);
+    }
+    return 0.0f;
+}
+
+int ModulationEngine::process(double tickPosition, unsigned char *eventData, int maximumEvents)
+{
+    // First, pick up any changes made since last time
+    d->updates.process([this](const ModulatorUpdateQueue::Update &update){
+        ModulatorState &state = d->modulators[update.slot];
+        switch (update.kind) {
+            case ModulatorUpdateQueue::SettingsUpdate:
+                if (!state.settings.sameTarget(update.settings)) {
+                    state.sent.forget();
+                }
+                state.settings = update.settings;
+                break;
+            case ModulatorUpdateQueue::StartUpdate:
+                state.running = true;
+                state.starting = true;
+                state.cyclesUntilEvaluation = 0;
+                state.randomPeriod = -1;
+                state.sent.forget();
+                break;
+            case ModulatorUpdateQueue::StopUpdate:
+                state.running = false;
+                break;
+            case ModulatorUpdateQueue::RemoveUpdate:
+                state = ModulatorState();
+                break;
+        }
+    });
+
+    // Then evaluate everything which is running
+    ControlEngineEvents events(eventData, nullptr, maximumEvents);
+    for (int i = 0; i < ModulatorCount; ++i) {
+        ModulatorState &state = d->modulators[i];
+        if (!state.running || state.settings.type == NoModulator) {
+            continue;
+        }
+        if (state.starting) {
+            state.startTick = tickPosition;
+            state.starting = false;
+        }
+        if (state.cyclesUntilEvaluation > 0) {
+            --state.cyclesUntilEvaluation;
+            continue;
+        }
+        state.cyclesUntilEvaluation = state.settings.decimation - 1;
+        bool finished{false};
+        const float level{state.evaluate(qMax(0.0, tickPosition - state.startTick), finished, d->random)};
+        const float value{state.settings.minimum + (level * (state.settings.maximum - state.settings.minimum))};
+        d->values[i].store(value, std::memory_order_relaxed);
+        bool sent{true};
+        switch (state.settings.target) {
+            case ControlChangeTarget:
+                sent = ControlEngineTargets::sendControlChange(events, state.sent, state.settings.midiChannel, state.settings.control, value);
+                break;
+            case PitchBendTarget:
+                sent = ControlEngineTargets::sendPitchBend(events, state.sent, state.settings.midiChannel, value);
+                break;
+            case PassthroughTarget:
+                ControlEngineTargets::sendPassthrough(state.sent, state.settings.passthrough, state.settings.passthroughSetting, value);
+                break;
+            case NoTarget:
+            default:
+                break;
+        }
+        if (finished && sent) {
+            state.running = false;
+        }
+    }
+    return events.count;
+}
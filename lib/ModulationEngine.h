@@ -0,0 +1,137 @@
+#pragma once
+
+#include "SyncTimer.h"
+
+class ModulationEnginePrivate;
+/**
+ * \brief Tempo-synced LFOs and envelopes which generate control streams, evaluated natively once per jack cycle
+ *
+ * Rather than scheduling a flood of CC messages from outside to fake filter sweeps and volume LFOs, create a
+ * modulator here and give it a target. Each modulator produces a value between 0.0 and 1.0 (scaled to its
+ * minimum and maximum), which is sent to its target:
+ * - ControlChangeTarget: A CC message (value 0 through 127) on the given midi channel, sent out through SyncTimer
+ * - PitchBendTarget: A pitch bend message (0.5 being the centre) on the given midi channel, sent out through SyncTimer
+ * - PassthroughTarget: One of the settings on one of ZLRouter's passthrough clients (see JackPassthrough::Setting),
+ *   where pan maps 0.0 through 1.0 onto -1.0 through 1.0, and muted is on for values of 0.5 and above
+ *
+ * The modulators live in a flat, preallocated array, and are evaluated by SyncTimer's process call once per jack
+ * cycle, at the tick position of the start of that cycle. A modulator only sends something out when its target's
+ * value actually changes, and can be told to only be evaluated every so many cycles (see setDecimation()).
+ * The timing of modulators is measured in timer ticks (see SyncTimer::getMultiplier()), from the point they are started.
+ *
+ * All the functions here are safe to call from any thread other than the jack process call. Changes are passed on
+ * to the process call through a lock-free queue, and take effect on the following jack cycle.
+ */
+class ModulationEngine : public QObject {
+    Q_OBJECT
+public:
+    static ModulationEngine* instance(SyncTimer *q = nullptr) {
+        static ModulationEngine* instance{nullptr};
+        if (!instance) {
+            instance = new ModulationEngine(q);
+        }
+        return instance;
+    };
+    explicit ModulationEngine(SyncTimer *parent = nullptr);
+    virtual ~ModulationEngine();
+
+    enum LfoShape {
+        SineShape = 0, ///< A sine wave, starting at the centre and moving up
+        TriangleShape = 1, ///< A triangle wave, starting at the bottom
+        SawShape = 2, ///< A rising saw wave, starting at the bottom
+        SquareShape = 3, ///< A square wave, high for the first half of each period
+        RandomShape = 4, ///< A new random value at the start of every period (sample and hold)
+    };
+    Q_ENUM(LfoShape)
+    enum TargetType {
+        NoTarget = 0, ///< The modulator runs, but sends its value nowhere
+        ControlChangeTarget = 1, ///< Send CC messages
+        PitchBendTarget = 2, ///< Send pitch bend messages
+        PassthroughTarget = 3, ///< Set a setting on a passthrough client
+    };
+    Q_ENUM(TargetType)
+
+    /**
+     * \brief Create a tempo-synced LFO
+     * @param shape The shape of the LFO's wave
+     * @param periodTicks The length of one cycle of the wave, in timer ticks (for example 384 for a bar at the default multiplier)
+     * @param minimum The value the lowest point of the wave is scaled to (0.0 through 1.0)
+     * @param maximum The value the highest point of the wave is scaled to (0.0 through 1.0)
+     * @return The ID of the new modulator, or -1 if there are no free modulators left
+     */
+    Q_INVOKABLE int addLfo(LfoShape shape, quint64 periodTicks, float minimum = 0.0f, float maximum = 1.0f);
+    /**
+     * \brief Create a multi-segment envelope
+     * The envelope starts at 0.0, and moves in a straight line to the level of each segment over the length of that
+     * segment. Once it reaches the end of the last segment, it either holds that level (and stops), or starts over.
+     * @param segmentTicks The length of each segment in timer ticks (there can be up to 16 segments)
+     * @param segmentLevels The level at the end of each segment (0.0 through 1.0, before being scaled to the minimum and maximum)
+     * @param loop Whether to start over at the end of the last segment
+     * @param minimum The value a level of 0.0 is scaled to
+     * @param maximum The value a level of 1.0 is scaled to
+     * @return The ID of the new modulator, or -1 if there are no free modulators left or the segments are invalid
+     */
+    Q_INVOKABLE int addEnvelope(const QList<int> &segmentTicks, const QList<float> &segmentLevels, bool loop = false, float minimum = 0.0f, float maximum = 1.0f);
+    /**
+     * \brief Stop and remove the given modulator (its ID may then be reused)
+     * @param modulator The ID of the modulator to remove
+     */
+    Q_INVOKABLE void removeModulator(int modulator);
+    /**
+     * \brief Send the modulator's value as CC messages
+     * @param modulator The ID of the modulator
+     * @param midiChannel The midi channel to send the messages on (0 through 15)
+     * @param control The control to send (0 through 127)
+     */
+    Q_INVOKABLE void setControlChangeTarget(int modulator, int midiChannel, int control);
+    /**
+     * \brief Send the modulator's value as pitch bend messages
+     * @param modulator The ID of the modulator
+     * @param midiChannel The midi channel to send the messages on (0 through 15)
+     */
+    Q_INVOKABLE void setPitchBendTarget(int modulator, int midiChannel);
+    /**
+     * \brief Send the modulator's value to one of the settings on one of ZLRouter's passthrough clients
+     * @param modulator The ID of the modulator
+     * @param channel The passthrough client to change (-1 for global playback, 0 through 9 for the channels)
+     * @param setting The setting to change (see JackPassthrough::Setting)
+     */
+    Q_INVOKABLE void setPassthroughTarget(int modulator, int channel, int setting);
+    /**
+     * \brief Only evaluate the modulator every so many jack cycles
+     * This is useful for slow modulation of targets which are costly to change (or where a high rate of messages
+     * would swamp the receiver). A modulator still only sends something out when its target's value changes.
+     * @param modulator The ID of the modulator
+     * @param cycles The number of jack cycles between each evaluation (1 means every cycle)
+     */
+    Q_INVOKABLE void setDecimation(int modulator, int cycles);
+    /**
+     * \brief Start (or restart) the modulator from the beginning
+     * @param modulator The ID of the modulator
+     */
+    Q_INVOKABLE void startModulator(int modulator);
+    /**
+     * \brief Stop the modulator (it will hold its most recent value)
+     * @param modulator The ID of the modulator
+     */
+    Q_INVOKABLE void stopModulator(int modulator);
+    /**
+     * \brief The most recent value of the given modulator (after scaling to its minimum and maximum)
+     * @param modulator The ID of the modulator
+     * @return The value, or 0.0 if there is no such modulator
+     */
+    Q_INVOKABLE float modulatorValue(int modulator) const;
+protected:
+    // SyncTimer evaluates the modulators from its jack process call
+    friend class SyncTimerPrivate;
+    /**
+     * \brief Evaluate all the running modulators, and send their values on to their targets
+     * @param tickPosition The (fractional) timer tick position of the start of this jack cycle
+     * @param eventData Space for the midi events created for this cycle, three bytes per event
+     * @param maximumEvents The number of events there is space for
+     * @return The number of midi events written into eventData
+     */
+    int process(double tickPosition, unsigned char *eventData, int maximumEvents);
+private:
+    ModulationEnginePrivate *d{nullptr};
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "ControlEngine.h"
+#include "ModulationEngine.h"
+
+#include <cmath>
+#include <limits>
+
+// The largest number of segments an envelope can have
+#define ModulatorSegmentCount 16
+
+enum ModulatorType {
+    NoModulator = 0,
+    LfoModulator = 1,
+    EnvelopeModulator = 2,
+};
+
+/**
+ * \brief Everything about a modulator which is set from outside the process call
+ */
+struct ModulatorSettings {
+    ModulatorType type{NoModulator};
+    ModulationEngine::LfoShape shape{ModulationEngine::SineShape};
+    quint64 periodTicks{384};
+    quint32 segmentTicks[ModulatorSegmentCount];
+    float segmentLevels[ModulatorSegmentCount];
+    int segmentCount{0};
+    quint64 envelopeLength{0};
+    bool loop{false};
+    float minimum{0.0f};
+    float maximum{1.0f};
+    ModulationEngine::TargetType target{ModulationEngine::NoTarget};
+    int midiChannel{0};
+    int control{0};
+    JackPassthrough *passthrough{nullptr};
+    JackPassthrough::Setting passthroughSetting{JackPassthrough::DryAmountSetting};
+    int decimation{1};
+
+    bool sameTarget(const ModulatorSettings &other) const {
+        return target == other.target && midiChannel == other.midiChannel && control == other.control && passthrough == other.passthrough && passthroughSetting == other.passthroughSetting;
+    }
+};
+
+/**
+ * \brief The source of the random LFO shape's values
+ * This is xorshift32, which is plenty random for modulation purposes, and realtime safe
+ */
+struct ModulatorRandom {
+    quint32 state{0x9E3779B9};
+    inline float next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return float(state) / float(std::numeric_limits<quint32>::max());
+    }
+};
+
+/**
+ * \brief A modulator as seen by the process call
+ */
+struct ModulatorState {
+    ModulatorSettings settings;
+    bool running{false};
+    // Set when the modulator has been started, and its start tick should be taken from the next evaluation
+    bool starting{false};
+    double startTick{0};
+    int cyclesUntilEvaluation{0};
+    ControlEngineSentValues sent;
+    qint64 randomPeriod{-1};
+    float randomValue{0.5f};
+
+    /**
+     * \brief Work out the value (0.0 through 1.0, before scaling) of the modulator at the given number of ticks since it was started
+     * @param elapsed The number of ticks since the modulator was started
+     * @param finished Set to true if the modulator has reached its end, and will not change any further
+     * @param random Where to get a new value from when the random shape moves on to a new period
+     */
+    float evaluate(double elapsed, bool &finished, ModulatorRandom &random) {
+        if (settings.type == LfoModulator) {
+            const double period{double(settings.periodTicks)};
+            const double phase{std::fmod(elapsed, period) / period};
+            switch (settings.shape) {
+                case ModulationEngine::SineShape:
+                    return float(0.5 + 0.5 * std::sin(2.0 * M_PI * phase));
+                case ModulationEngine::TriangleShape:
+                    return float(phase < 0.5 ? 2.0 * phase : 2.0 - (2.0 * phase));
+                case ModulationEngine::SawShape:
+                    return float(phase);
+                case ModulationEngine::SquareShape:
+                    return phase < 0.5 ? 1.0f : 0.0f;
+                case ModulationEngine::RandomShape:
+                    {
+                        const qint64 periodIndex{qint64(elapsed / period)};
+                        if (periodIndex != randomPeriod) {
+                            randomPeriod = periodIndex;
+                            randomValue = random.next();
+                        }
+                        return randomValue;
+                    }
+            }
+        } else if (settings.type == EnvelopeModulator && settings.segmentCount > 0) {
+            if (elapsed >= double(settings.envelopeLength)) {
+                if (settings.loop && settings.envelopeLength > 0) {
+                    elapsed = std::fmod(elapsed, double(settings.envelopeLength));
+                } else {
+                    finished = true;
+                    return settings.segmentLevels[settings.segmentCount - 1];
+                }
+            }
+            float previousLevel{0.0f};
+            for (int segment = 0; segment < settings.segmentCount; ++segment) {
+                const double segmentLength{double(settings.segmentTicks[segment])};
+                if (elapsed < segmentLength) {
+                    const float progress{float(elapsed / segmentLength)};
+                    return previousLevel + (progress * (settings.segmentLevels[segment] - previousLevel));
+                }
+                elapsed -= segmentLength;
+                previousLevel = settings.segmentLevels[segment];
+            }
+            return previousLevel;
+        }
+        return 0.0f;
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QDebug>
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstring>
+
+/**
+ * \brief A fixed-size, lock-free pool of preallocated objects
+ *
+ * The objects live in a single array (which is locked into memory), and the free ones are kept
+ * in a stack of array indices (a Treiber stack). The stack's head carries a tag which changes on
+ * every update, so a thread which was interrupted between reading the head and swapping it out
+ * cannot mistake an entry which was taken and returned in the meantime for the one it read.
+ * Acquiring and releasing objects are both O(1), and safe to do from any thread (including the
+ * jack process call), with no need for an event loop to refill the pool.
+ * Should the pool run dry, acquire() will allocate a new object rather than fail (and count that
+ * it had to do so), and release() will delete those objects again rather than keep them.
+ */
+template<typename T, quint32 Size>
+class ObjectPool {
+public:
+    explicit ObjectPool(void (*clearFunction)(T*))
+        : clearFunction(clearFunction)
+    {
+        objects = new T[Size];
+        int result = mlock(objects, sizeof(T) * Size);
+        if (result == 0) {
+            lockedMemorySize = sizeof(T) * Size;
+        } else {
+            qDebug() << Q_FUNC_INFO << "Error locking object pool memory" << strerror(result);
+        }
+        for (quint32 i = 0; i < Size; ++i) {
+            nextFree[i].store(i + 1 < Size ? i + 1 : EmptyIndex, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_release);
+    }
+    ~ObjectPool() {
+        delete[] objects;
+    }
+    /**
+     * \brief Fetch a fresh object from the pool
+     * @return A cleared object (if the pool is exhausted, this will be a newly allocated object)
+     */
+    T *acquire() {
+        // Count the object as used before taking it (and release only after returning it), so the high-water mark never under-reports
+        const quint32 nowInUse = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        quint32 currentHighWaterMark = highWaterMark.load(std::memory_order_relaxed);
+        while (nowInUse > currentHighWaterMark && !highWaterMark.compare_exchange_weak(currentHighWaterMark, nowInUse, std::memory_order_relaxed)) { }
+        T *object{nullptr};
+        quint64 current = head.load(std::memory_order_acquire);
+        while (true) {
+            const quint32 index = quint32(current);
+            if (index == EmptyIndex) {
+                ++exhaustionCount;
+                object = new T;
+                break;
+            }
+            const quint64 next = (((current >> 32) + 1) << 32) | nextFree[index].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(current, next, std::memory_order_acquire, std::memory_order_acquire)) {
+                object = &objects[index];
+                break;
+            }
+        }
+        return object;
+    }
+    /**
+     * \brief Clear the given object and return it to the pool
+     * @param object An object previously retrieved using acquire()
+     */
+    void release(T *object) {
+        if (object < objects || object >= objects + Size) {
+            delete object;
+            inUse.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+        clearFunction(object);
+        const quint32 index = quint32(object - objects);
+        quint64 current = head.load(std::memory_order_relaxed);
+        while (true) {
+            nextFree[index].store(quint32(current), std::memory_order_relaxed);
+            const quint64 next = (((current >> 32) + 1) << 32) | index;
+            if (head.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        inUse.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // The largest number of objects which have been in use at the same time
+    std::atomic<quint32> highWaterMark{0};
+    // The number of times acquire() has been called with no free objects left in the pool
+    std::atomic<quint64> exhaustionCount{0};
+    // The amount of memory locked for the pool's objects
+    quint64 lockedMemorySize{0};
+private:
+    static constexpr quint32 EmptyIndex{0xFFFFFFFF};
+    void (*clearFunction)(T*){nullptr};
+    T *objects{nullptr};
+    std::atomic<quint32> nextFree[Size];
+    alignas(64) std::atomic<quint64> head{0};
+    alignas(64) std::atomic<quint32> inUse{0};
+};
@@ -8,27 +8,177 @@
 #include "ClipCommand.h"
 #include "libzl.h"
 #include "SyncTimer.h"
+#include "TimerCommand.h"
 
 #include <QDebug>
 #include <QHash>
 #include <QMutex>
+#include <QPointer>
 #include <QThread>
 #include <QTimer>
 
 #include <jack/jack.h>
 #include <jack/statistics.h>
 
+#include <atomic>
+#include <memory>
+
 using namespace juce;
 
 #define SAMPLER_CHANNEL_VOICE_COUNT 8
 
 struct SamplerCommand {
     quint64 timestamp;
+    quint64 startUsecs{0};
     ClipCommand* clipCommand{nullptr};
     SamplerCommand* next{nullptr};
     SamplerCommand* previous{nullptr};
 };
 
+// The number of metronome clicks which can be waiting to be picked up by the metronome at once
+#define MetronomeClickQueueSize 16
+// The number of metronome clicks which can be sounding at once (a click is usually over long before the next one)
+#define MetronomeVoiceCount 4
+// The length of the built-in click sounds, in seconds
+#define MetronomeBuiltInClickLength 0.03
+// The longest click sound the metronome will load, in seconds (anything longer is cut off)
+#define MetronomeMaximumClickLength 2.0
+
+/**
+ * \brief The sounds used by the metronome for normal and accented clicks
+ */
+struct MetronomeSounds {
+    juce::AudioBuffer<float> tick;
+    double tickSampleRate{48000};
+    juce::AudioBuffer<float> accent;
+    double accentSampleRate{48000};
+};
+
+/**
+ * \brief Renders metronome clicks straight into the global uneffected sampler channel's output
+ * Clicks are queued by SyncTimer's process call (with the exact jack time they should sound at), and rendered
+ * by the global uneffected channel's process call, so a click does not use any clip commands, voices, or signals.
+ * The queue has a single producer (SyncTimer) and a single consumer (the sampler channel), and is lock-free.
+ */
+class MetronomeGenerator
+{
+public:
+    ~MetronomeGenerator() {
+        qDeleteAll(allSounds);
+    }
+    /**
+     * \brief Queue up a click
+     * @note Only call this from SyncTimer's process call
+     */
+    inline void queueClick(quint64 usecs, bool accent, float volume) {
+        const quint32 write{writeIndex.load(std::memory_order_relaxed)};
+        if (write - readIndex.load(std::memory_order_acquire) < MetronomeClickQueueSize) {
+            Click &click = queue[write % MetronomeClickQueueSize];
+            click.usecs = usecs;
+            click.accent = accent;
+            click.volume = volume;
+            writeIndex.store(write + 1, std::memory_order_release);
+        }
+    }
+    /**
+     * \brief Switch to a new set of sounds
+     * The sounds are kept until the generator is destroyed, as the jack process call might still be playing from the
+     * previous ones, and sounds are only changed a handful of times at most, so this keeps things simple and safe.
+     * @note Call this from the main thread
+     */
+    void setSounds(MetronomeSounds *newSounds) {
+        allSounds << newSounds;
+        sounds.store(newSounds, std::memory_order_release);
+    }
+    /**
+     * \brief Forget all the queued clicks, and silence any which are sounding
+     * This keeps clicks from piling up while the channel is disabled, and then all playing late when it is enabled again
+     * @note Only call this from the global uneffected channel's process call
+     */
+    void discard() {
+        readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+        for (Voice &voice : voices) {
+            voice.active = false;
+        }
+    }
+    /**
+     * \brief Render any clicks which sound during this period into the given buffers
+     * @note Only call this from the global uneffected channel's process call
+     */
+    void process(float *leftBuffer, float *rightBuffer, jack_nframes_t nframes, jack_time_t currentUsecs, jack_time_t nextUsecs, double sampleRate) {
+        const MetronomeSounds *currentSounds{sounds.load(std::memory_order_acquire)};
+        const quint32 write{writeIndex.load(std::memory_order_acquire)};
+        quint32 read{readIndex.load(std::memory_order_relaxed)};
+        while (read != write) {
+            const Click &click = queue[read % MetronomeClickQueueSize];
+            if (currentSounds) {
+                // Take over the voice which has been playing the longest, if they're all busy
+                Voice *voice{&voices[0]};
+                for (Voice &candidate : voices) {
+                    if (!candidate.active) {
+                        voice = &candidate;
+                        break;
+                    } else if (candidate.position > voice->position) {
+                        voice = &candidate;
+                    }
+                }
+                voice->buffer = click.accent ? &currentSounds->accent : &currentSounds->tick;
+                voice->increment = (click.accent ? currentSounds->accentSampleRate : currentSounds->tickSampleRate) / sampleRate;
+                voice->position = 0;
+                voice->volume = click.volume;
+                voice->startUsecs = click.usecs;
+                voice->active = true;
+            }
+            ++read;
+        }
+        readIndex.store(read, std::memory_order_release);
+        const double microsecondsPerFrame{double(nextUsecs - currentUsecs) / double(nframes)};
+        for (Voice &voice : voices) {
+            if (voice.active && voice.startUsecs < nextUsecs) {
+                jack_nframes_t frame{0};
+                if (voice.startUsecs > currentUsecs) {
+                    frame = qMin(jack_nframes_t(double(voice.startUsecs - currentUsecs) / microsecondsPerFrame), nframes - 1);
+                }
+                voice.startUsecs = 0;
+                const int sampleCount{voice.buffer->getNumSamples()};
+                const float *left{voice.buffer->getReadPointer(0)};
+                const float *right{voice.buffer->getNumChannels() > 1 ? voice.buffer->getReadPointer(1) : left};
+                for (; frame < nframes; ++frame) {
+                    const int index{int(voice.position)};
+                    if (index + 1 >= sampleCount) {
+                        voice.active = false;
+                        break;
+                    }
+                    const float fraction{float(voice.position - double(index))};
+                    leftBuffer[frame] += voice.volume * (left[index] + (fraction * (left[index + 1] - left[index])));
+                    rightBuffer[frame] += voice.volume * (right[index] + (fraction * (right[index + 1] - right[index])));
+                    voice.position += voice.increment;
+                }
+            }
+        }
+    }
+private:
+    struct Click {
+        quint64 usecs{0};
+        float volume{1.0f};
+        bool accent{false};
+    };
+    struct Voice {
+        const juce::AudioBuffer<float> *buffer{nullptr};
+        double position{0};
+        double increment{1};
+        quint64 startUsecs{0};
+        float volume{1.0f};
+        bool active{false};
+    };
+    Click queue[MetronomeClickQueueSize];
+    std::atomic<quint32> writeIndex{0};
+    std::atomic<quint32> readIndex{0};
+    Voice voices[MetronomeVoiceCount];
+    std::atomic<MetronomeSounds*> sounds{nullptr};
+    QList<MetronomeSounds*> allSounds;
+};
+
 #define CommandQueueSize 256
 class SamplerChannel
 {
@@ -40,7 +190,7 @@ public:
         }
     }
     int process(jack_nframes_t nframes);
-    inline void handleCommand(ClipCommand *clipCommand, quint64 currentTick);
+    inline void handleCommand(ClipCommand *clipCommand, quint64 currentTick, quint64 startUsecs);
     SamplerCommand commandRing[CommandQueueSize];
     SamplerCommand *readHead{nullptr};
     SamplerCommand *writeHead{nullptr};
@@ -52,12 +202,16 @@ public:
     jack_port_t *rightPort{nullptr};
     QString portNameRight{"right_out"};
     jack_port_t *midiInPort{nullptr};
+    double sampleRate{48000};
     SamplerSynthVoice* voices[SAMPLER_CHANNEL_VOICE_COUNT];
     SamplerSynthPrivate* d{nullptr};
+    // Only set for the global uneffected channel, which is where the metronome is played
+    MetronomeGenerator *metronome{nullptr};
     int midiChannel{-1};
     float cpuLoad{0.0f};
 
-    bool enabled{true};
+    // Set from SyncTimer's process call (see SamplerSynth::setChannelEnabled()) and read by our own
+    std::atomic<bool> enabled{true};
 };
 
 static int client_process(jack_nframes_t nframes, void* arg) {
@@ -96,6 +250,7 @@ SamplerChannel::SamplerChannel(const QString &clientName)
             midiInPort = jack_port_register(jackClient, "midiIn", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
             leftPort = jack_port_register(jackClient, portNameLeft.toUtf8(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
             rightPort = jack_port_register(jackClient, portNameRight.toUtf8(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+            sampleRate = jack_get_sample_rate(jackClient);
             // Activate the client.
             if (jack_activate(jackClient) == 0) {
                 jackConnect(jackClient, QString("%1:%2").arg(clientName).arg(portNameLeft).toUtf8(), QLatin1String{"system:playback_1"});
@@ -116,7 +271,7 @@ SamplerChannel::SamplerChannel(const QString &clientName)
 int SamplerChannel::process(jack_nframes_t nframes) {
     // First handle any queued up commands (starting, stopping, changes to voice state, that sort of stuff)
     while (readHead->clipCommand) {
-        handleCommand(readHead->clipCommand, readHead->timestamp);
+        handleCommand(readHead->clipCommand, readHead->timestamp, readHead->startUsecs);
         readHead->clipCommand = nullptr;
         readHead = readHead->next;
     }
@@ -138,11 +293,16 @@ int SamplerChannel::process(jack_nframes_t nframes) {
                     voice->process(leftBuffer, rightBuffer, nframes, current_frames, current_usecs, next_usecs, period_usecs);
                 }
             }
+            if (metronome) {
+                metronome->process(leftBuffer, rightBuffer, nframes, current_usecs, next_usecs, sampleRate);
+            }
         }
         // Micro-hackery - -2 is the first item in the list of channels, so might as well just go with that
         if (midiChannel == -2) {
             cpuLoad = jack_cpu_load(jackClient);
         }
+    } else if (metronome) {
+        metronome->discard();
     }
     return 0;
 }
@@ -155,8 +315,10 @@ public:
     }
     ~SamplerSynthPrivate() {
         qDeleteAll(channels);
+        delete metronome;
     }
-    SyncTimer* syncTimer{nullptr};
+    // Guarded, as the timer is usually destroyed before we are when the application shuts down
+    QPointer<SyncTimer> syncTimer;
     QMutex synthMutex;
     bool syncLocked{false};
     SamplerSynthImpl *synth{nullptr};
@@ -173,6 +335,26 @@ public:
     // ...
     // Channel 10 (midi channel 9)
     QList<SamplerChannel *> channels;
+    MetronomeGenerator *metronome{nullptr};
+    /**
+     * \brief Create the built-in click sounds (short, decaying sine bursts, with the accent pitched up a fifth)
+     */
+    static MetronomeSounds *builtInMetronomeSounds(double sampleRate) {
+        MetronomeSounds *sounds = new MetronomeSounds;
+        const int sampleCount{int(sampleRate * MetronomeBuiltInClickLength)};
+        auto fill = [sampleRate, sampleCount](juce::AudioBuffer<float> &buffer, double frequency){
+            buffer.setSize(1, sampleCount);
+            float *samples = buffer.getWritePointer(0);
+            for (int sample = 0; sample < sampleCount; ++sample) {
+                const double time{double(sample) / sampleRate};
+                samples[sample] = float(0.8 * std::sin(2.0 * M_PI * frequency * time) * std::exp(-time * 200.0));
+            }
+        };
+        fill(sounds->tick, 1000.0);
+        fill(sounds->accent, 1500.0);
+        sounds->tickSampleRate = sounds->accentSampleRate = sampleRate;
+        return sounds;
+    }
 };
 
 class SamplerSynthImpl : public juce::Synthesiser {
@@ -184,7 +366,7 @@ public:
     SamplerSynthPrivate *d{nullptr};
 };
 
-void SamplerChannel::handleCommand(ClipCommand *clipCommand, quint64 currentTick)
+void SamplerChannel::handleCommand(ClipCommand *clipCommand, quint64 currentTick, quint64 startUsecs)
 {
     SamplerSynthSound *sound = d->clipSounds[clipCommand->clip];
     if (clipCommand->stopPlayback || clipCommand->startPlayback) {
@@ -207,6 +389,7 @@ void SamplerChannel::handleCommand(ClipCommand *clipCommand, quint64 currentTick
                     if (!voice->isPlaying) {
                         voice->setCurrentCommand(clipCommand);
                         voice->setStartTick(currentTick);
+                        voice->setStartUsecs(startUsecs);
                         d->synth->startVoiceImpl(voice, sound, clipCommand->midiChannel, clipCommand->midiNote, clipCommand->volume);
                         break;
                     }
@@ -247,6 +430,9 @@ SamplerSynth::SamplerSynth(QObject *parent)
 
 SamplerSynth::~SamplerSynth()
 {
+    if (d->syncTimer && !d->channels.isEmpty()) {
+        d->syncTimer->unregisterTimerCommandHandler(TimerCommand::SamplerChannelEnabledStateOperation);
+    }
     delete d->synth;
     delete d;
 }
@@ -273,8 +459,17 @@ void SamplerSynth::initialize(tracktion_engine::Engine *engine)
         for (SamplerSynthVoice *voice : qAsConst(channel->voices)) {
             d->synth->addVoice(voice);
         }
+        if (channel->midiChannel == -2) {
+            d->metronome = new MetronomeGenerator;
+            d->metronome->setSounds(SamplerSynthPrivate::builtInMetronomeSounds(sampleRate));
+            channel->metronome = d->metronome;
+        }
         d->channels << channel;
     }
+    // Handle channel enabled state changes scheduled on the timer (see TimerCommand::SamplerChannelEnabledStateOperation)
+    d->syncTimer->registerTimerCommandHandler(TimerCommand::SamplerChannelEnabledStateOperation, [](TimerCommand *command, quint64 /*playhead*/, quint64 /*usecs*/, void *userData){
+        static_cast<SamplerSynth*>(userData)->setChannelEnabled(command->parameter, command->parameter2);
+    }, this);
 }
 
 tracktion_engine::Engine *SamplerSynth::engine() const
@@ -325,7 +520,7 @@ float SamplerSynth::cpuLoad() const
     return d->channels[0]->cpuLoad;
 }
 
-void SamplerSynth::handleClipCommand(ClipCommand *clipCommand, quint64 currentTick)
+void SamplerSynth::handleClipCommand(ClipCommand *clipCommand, quint64 currentTick, quint64 startUsecs)
 {
     if (d->clipSounds.contains(clipCommand->clip) && clipCommand->midiChannel + 2 < d->channels.count()) {
         SamplerChannel *channel = d->channels[clipCommand->midiChannel + 2];
@@ -336,16 +531,58 @@ void SamplerSynth::handleClipCommand(ClipCommand *clipCommand, quint64 currentTi
             channel->writeHead = channel->writeHead->next;
             ringPosition->clipCommand = clipCommand;
             ringPosition->timestamp = currentTick;
+            ringPosition->startUsecs = startUsecs;
         }
     }
 }
 
+bool SamplerSynth::setMetronomeSounds(const QString &tickFile, const QString &accentFile)
+{
+    if (!d->metronome) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set the metronome sounds before SamplerSynth was initialized";
+        return false;
+    }
+    const double sampleRate{d->channels[0]->sampleRate};
+    if (tickFile.isEmpty() && accentFile.isEmpty()) {
+        d->metronome->setSounds(SamplerSynthPrivate::builtInMetronomeSounds(sampleRate));
+        return true;
+    }
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    auto load = [&formatManager](const QString &fileName, juce::AudioBuffer<float> &buffer, double &bufferSampleRate){
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(juce::File(fileName.toStdString())));
+        if (!reader) {
+            qWarning() << "SamplerSynth: Failed to load metronome sound" << fileName;
+            return false;
+        }
+        const int sampleCount{int(qMin(reader->lengthInSamples, qint64(reader->sampleRate * MetronomeMaximumClickLength)))};
+        buffer.setSize(int(qMin(reader->numChannels, 2u)), sampleCount);
+        reader->read(&buffer, 0, sampleCount, 0, true, true);
+        bufferSampleRate = reader->sampleRate;
+        return true;
+    };
+    MetronomeSounds *sounds = new MetronomeSounds;
+    const QString &actualTickFile{tickFile.isEmpty() ? accentFile : tickFile};
+    const QString &actualAccentFile{accentFile.isEmpty() ? tickFile : accentFile};
+    if (!load(actualTickFile, sounds->tick, sounds->tickSampleRate) || !load(actualAccentFile, sounds->accent, sounds->accentSampleRate)) {
+        delete sounds;
+        return false;
+    }
+    d->metronome->setSounds(sounds);
+    return true;
+}
+
+void SamplerSynth::queueMetronomeClick(quint64 usecs, bool accent, float volume)
+{
+    if (d->metronome) {
+        d->metronome->queueClick(usecs, accent, volume);
+    }
+}
+
 void SamplerSynth::setChannelEnabled(const int &channel, const bool &enabled) const
 {
     if (channel > -3 && channel < 10) {
-        if (d->channels[channel + 2]->enabled != enabled) {
-            qDebug() << "Setting SamplerSynth channel" << channel << "to" << enabled;
-            d->channels[channel + 2]->enabled = enabled;
-        }
+        // This is called from SyncTimer's process call when scheduled on the timer, so no logging here
+        d->channels[channel + 2]->enabled = enabled;
     }
 }
@@ -40,9 +40,23 @@ public:
      * @return a float, from 0 through 1, describing the current CPU load
      */
     float cpuLoad() const;
+
+    /**
+     * \brief Set the sounds used by the metronome
+     * The metronome renders its clicks directly into the global uneffected channel (see SyncTimer::metronomeEnabled).
+     * By default it uses a built-in click. Sounds longer than two seconds are cut off.
+     * @param tickFile The audio file to use for normal clicks (if empty, the accent sound is used)
+     * @param accentFile The audio file to use for accented clicks (if empty, the tick sound is used)
+     * @note Pass two empty strings to go back to the built-in click sounds
+     * @return True if the sounds were loaded successfully
+     */
+    Q_INVOKABLE bool setMetronomeSounds(const QString &tickFile, const QString &accentFile);
 protected:
     // Some stuff to ensure SyncTimer can operate with sufficient speed
-    void handleClipCommand(ClipCommand* clipCommand, quint64 currentTick);
+    // The start time is the jack time at which the command should take effect (0, or anything in the past, means as soon as possible)
+    void handleClipCommand(ClipCommand* clipCommand, quint64 currentTick, quint64 startUsecs = 0);
+    // Play a metronome click at the given jack time (only call this from SyncTimer's process call)
+    void queueMetronomeClick(quint64 usecs, bool accent, float volume);
 
     /**
      * \brief Set a given samplersynth channel as enabled (or not) for processing
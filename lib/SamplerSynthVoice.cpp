@@ -28,6 +28,7 @@ public:
     ClipAudioSource *clip{nullptr};
     qint64 clipPositionId{-1};
     quint64 startTick{0};
+    quint64 startUsecs{0};
     quint64 nextLoopTick{0};
     quint64 nextLoopUsecs{0};
     double maxSampleDeviation{0.0};
@@ -107,6 +108,11 @@ void SamplerSynthVoice::setStartTick(quint64 startTick)
     d->startTick = startTick;
 }
 
+void SamplerSynthVoice::setStartUsecs(quint64 startUsecs)
+{
+    d->startUsecs = startUsecs;
+}
+
 void SamplerSynthVoice::startNote (int midiNoteNumber, float velocity, SynthesiserSound* s, int /*currentPitchWheelPosition*/)
 {
     if (auto* sound = dynamic_cast<const SamplerSynthSound*> (s))
@@ -165,6 +171,7 @@ void SamplerSynthVoice::stopNote (float /*velocity*/, bool allowTailOff)
         }
         d->nextLoopTick = 0;
         d->nextLoopUsecs = 0;
+        d->startUsecs = 0;
     }
 }
 
@@ -177,10 +184,20 @@ void SamplerSynthVoice::process(jack_default_audio_sample_t *leftBuffer, jack_de
     {
         if (playingSound->isValid() && d->clipCommand) {
             if (d->nextLoopUsecs == 0) {
-                const quint64 differenceToPlayhead = d->nextLoopTick - d->syncTimer->jackPlayhead();
-                d->nextLoopUsecs = d->syncTimer->jackPlayheadUsecs() + (differenceToPlayhead * d->syncTimer->jackSubbeatLengthInMicroseconds());
+                d->nextLoopUsecs = d->syncTimer->jackPlayheadUsecsForTick(d->nextLoopTick);
             }
             const double microsecondsPerFrame = (next_usecs - current_usecs) / nframes;
+            // If the note is supposed to start part of the way into this period (or in a later one), leave the frames before that alone
+            jack_nframes_t firstFrame{0};
+            if (d->startUsecs > current_usecs) {
+                if (d->startUsecs >= next_usecs) {
+                    return;
+                }
+                firstFrame = std::min<jack_nframes_t>(jack_nframes_t(double(d->startUsecs - current_usecs) / microsecondsPerFrame), nframes - 1);
+                leftBuffer += firstFrame;
+                rightBuffer += firstFrame;
+            }
+            d->startUsecs = 0;
             float peakGain{0.0f};
             auto& data = *playingSound->audioData();
             const float* const inL = data.getReadPointer (0);
@@ -194,7 +211,7 @@ void SamplerSynthVoice::process(jack_default_audio_sample_t *leftBuffer, jack_de
             const float rPan = 0.5 * (1.0 - pan);
             const double sourceSampleRate = playingSound->sourceSampleRate();
             const bool isLooping = d->clipCommand->looping;
-            for(jack_nframes_t frame = 0; frame < nframes; ++frame) {
+            for(jack_nframes_t frame = firstFrame; frame < nframes; ++frame) {
                 const int pos = (int) d->sourceSamplePosition;
                 const float alpha = (float) (d->sourceSamplePosition - pos);
                 const float invAlpha = 1.0f - alpha;
@@ -233,9 +250,8 @@ void SamplerSynthVoice::process(jack_default_audio_sample_t *leftBuffer, jack_de
                             // Work out the position of the next loop, based on the most recent beat tick position, not the current position, as that might be slightly incorrect
                             const quint64 lengthInTicks = d->clip->getLengthInBeats() * d->syncTimer->getMultiplier();
                             d->nextLoopTick = d->nextLoopTick + lengthInTicks;
-                            const quint64 differenceToPlayhead = d->nextLoopTick - d->syncTimer->jackPlayhead();
-                            d->nextLoopUsecs = d->syncTimer->jackPlayheadUsecs() + (differenceToPlayhead * d->syncTimer->jackSubbeatLengthInMicroseconds());
-//                             qDebug() << "Resetting - next tick" << d->nextLoopTick << "next usecs" << d->nextLoopUsecs << "difference to playhead" << differenceToPlayhead;
+                            d->nextLoopUsecs = d->syncTimer->jackPlayheadUsecsForTick(d->nextLoopTick);
+//                             qDebug() << "Resetting - next tick" << d->nextLoopTick << "next usecs" << d->nextLoopUsecs;
 
                             // Reset the sample playback position back to the start point
                             d->sourceSamplePosition = (int) (d->clip->getStartPosition(d->clipCommand->slice) * sourceSampleRate);
@@ -19,6 +19,12 @@ public:
     ClipCommand *currentCommand() const;
 
     void setStartTick(quint64 startTick);
+    /**
+     * \brief Set the jack time at which the next note should start playing
+     * Anything in the past (including 0) means the note starts at the beginning of the next process call
+     * @param startUsecs The jack time (in microseconds) at which to start playing
+     */
+    void setStartUsecs(quint64 startUsecs);
 
     void startNote (int midiNoteNumber, float velocity, SynthesiserSound*, int pitchWheel) override;
     void stopNote (float velocity, bool allowTailOff) override;
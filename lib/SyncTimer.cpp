@@ -1,14 +1,24 @@
+#include <errno.h>
+#include <pthread.h>
 #include <sched.h>
+#include <semaphore.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include "SyncTimer.h"
 #include "ClipAudioSource.h"
 #include "ClipCommand.h"
+#include "GrooveTemplate.h"
 #include "libzl.h"
 #include "Helper.h"
 #include "MidiRouter.h"
+#include "ActiveNoteLedger.h"
+#include "AutomationEngine.h"
+#include "ModulationEngine.h"
+#include "ObjectPool.h"
 #include "SamplerSynth.h"
 #include "TimerCommand.h"
+#include "TimingWheel.h"
 #include "TransportManager.h"
 
 #include <QDebug>
@@ -23,6 +33,8 @@
 #include <jack/statistics.h>
 #include <jack/midiport.h>
 
+#include <atomic>
+
 #include "JUCEHeaders.h"
 
 #define BPM_MINIMUM 50
@@ -40,32 +52,273 @@
 using namespace std;
 using namespace juce;
 
+// The number of midi events which fit in a single block of step storage
+#define StepChunkMidiEventCount 8
+// The number of clip commands, and the number of timer commands, which fit in a single block of step storage
+#define StepChunkCommandCount 4
+// Set in StepChunk::midiFlags for events which should be sent before all other events on the step (used for note offs)
+#define StepChunkEarlyFlag 0x80
+// The bits in StepChunk::midiFlags which hold the size of the event
+#define StepChunkSizeMask 0x03
+// The number of sub-tick offset units in a single tick (see StepChunk::midiOffset)
+#define SubTickOffsetResolution 65536.0
+
+/**
+ * \brief A fixed-size block of storage for the contents of a step
+ *
+ * The midi events are kept as a struct of arrays (one for each byte of the event, plus one for the size and flags),
+ * so reading through them is a linear walk through a couple of cache lines. Every step holds one of these inline,
+ * and if that fills up, more are fetched from a shared slab and chained onto it.
+ */
+struct alignas(64) StepChunk {
+    quint8 midiByte0[StepChunkMidiEventCount];
+    quint8 midiByte1[StepChunkMidiEventCount];
+    quint8 midiByte2[StepChunkMidiEventCount];
+    quint8 midiFlags[StepChunkMidiEventCount];
+    // How far into the step each event should be sent, in 1/65536ths of a tick
+    quint16 midiOffset[StepChunkMidiEventCount];
+    ClipCommand *clipCommands[StepChunkCommandCount];
+    TimerCommand *timerCommands[StepChunkCommandCount];
+    quint8 midiCount{0};
+    quint8 clipCommandCount{0};
+    quint8 timerCommandCount{0};
+    StepChunk *next{nullptr};
+};
+
+/**
+ * \brief The shared storage for step chunks used when a step has more things on it than fit inline
+ * @note This is only used from the jack process call, and so is not thread-safe
+ */
+class StepChunkSlab {
+public:
+    StepChunkSlab() {}
+    ~StepChunkSlab() {
+        delete[] chunks;
+    }
+    void allocate(quint64 chunkCount) {
+        count = chunkCount;
+        chunks = new StepChunk[count];
+        for (quint64 i = 0; i < count - 1; ++i) {
+            chunks[i].next = &chunks[i + 1];
+        }
+        freeChunks = chunks;
+    }
+    StepChunk *acquire() {
+        StepChunk *chunk{freeChunks};
+        if (chunk) {
+            freeChunks = chunk->next;
+            chunk->next = nullptr;
+        }
+        return chunk;
+    }
+    // Release the given chunk, and all chunks chained onto it
+    void release(StepChunk *chunk) {
+        while (chunk) {
+            StepChunk *next{chunk->next};
+            chunk->midiCount = chunk->clipCommandCount = chunk->timerCommandCount = 0;
+            chunk->next = freeChunks;
+            freeChunks = chunk;
+            chunk = next;
+        }
+    }
+    StepChunk *chunks{nullptr};
+    quint64 count{0};
+private:
+    StepChunk *freeChunks{nullptr};
+};
+
 struct alignas(64) StepData {
     StepData() { }
-    ~StepData() {
-        qDeleteAll(timerCommands);
-        qDeleteAll(clipCommands);
-    }
     // Call this before accessing the data to ensure that it is fresh
-    void ensureFresh() {
+    void ensureFresh(StepChunkSlab *slab) {
         if (played) {
             played = false;
-            // It's our job to delete the timer commands, so do that first
-            for (TimerCommand* command : timerCommands) {
-                delete command;
+            reset(slab);
+        }
+    }
+    // Empty out the step, and return any extra storage to the slab
+    void reset(StepChunkSlab *slab) {
+        // It's our job to delete the timer commands, so do that first
+        forEachTimerCommand([](TimerCommand *command){
+            SyncTimer::instance()->deleteTimerCommand(command);
+        });
+        // The clip commands, once sent out, become owned by SampelerSynth, so leave them alone
+        slab->release(storage.next);
+        storage.next = nullptr;
+        storage.midiCount = storage.clipCommandCount = storage.timerCommandCount = 0;
+        hasMidiOffsets = false;
+    }
+    /**
+     * \brief Add a midi event to the step
+     * @param slab The slab to fetch more storage from, if needed
+     * @param data The event's data
+     * @param size The size of the event (must be 1 through 3)
+     * @param early Whether the event should be sent before all non-early events on the step
+     * @param offset How far into the step the event should be sent, in 1/65536ths of a tick
+     * @return False if there was no space left for the event
+     */
+    bool addMidiEvent(StepChunkSlab *slab, const quint8 *data, quint8 size, bool early, quint16 offset = 0) {
+        StepChunk *chunk = chunkWithSpace(slab, [](const StepChunk *chunk){ return chunk->midiCount < StepChunkMidiEventCount; });
+        if (chunk) {
+            const int index{chunk->midiCount};
+            chunk->midiByte0[index] = data[0];
+            chunk->midiByte1[index] = size > 1 ? data[1] : 0;
+            chunk->midiByte2[index] = size > 2 ? data[2] : 0;
+            chunk->midiFlags[index] = (size & StepChunkSizeMask) | (early ? StepChunkEarlyFlag : 0);
+            chunk->midiOffset[index] = offset;
+            if (offset > 0) {
+                hasMidiOffsets = true;
+            }
+            ++chunk->midiCount;
+            return true;
+        }
+        return false;
+    }
+    bool addClipCommand(StepChunkSlab *slab, ClipCommand *command) {
+        StepChunk *chunk = chunkWithSpace(slab, [](const StepChunk *chunk){ return chunk->clipCommandCount < StepChunkCommandCount; });
+        if (chunk) {
+            chunk->clipCommands[chunk->clipCommandCount] = command;
+            ++chunk->clipCommandCount;
+            return true;
+        }
+        return false;
+    }
+    bool addTimerCommand(StepChunkSlab *slab, TimerCommand *command) {
+        StepChunk *chunk = chunkWithSpace(slab, [](const StepChunk *chunk){ return chunk->timerCommandCount < StepChunkCommandCount; });
+        if (chunk) {
+            chunk->timerCommands[chunk->timerCommandCount] = command;
+            ++chunk->timerCommandCount;
+            return true;
+        }
+        return false;
+    }
+    /**
+     * \brief Call the given function for each midi event on the step, with the early events first
+     * @param function A function taking a pointer to three bytes of event data, and the event's size
+     */
+    template<typename Function>
+    void forEachMidiEvent(Function function) const {
+        for (const quint8 earlyState : {quint8(StepChunkEarlyFlag), quint8(0)}) {
+            for (const StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+                for (int index = 0; index < chunk->midiCount; ++index) {
+                    if ((chunk->midiFlags[index] & StepChunkEarlyFlag) == earlyState) {
+                        const quint8 data[3]{chunk->midiByte0[index], chunk->midiByte1[index], chunk->midiByte2[index]};
+                        function(data, quint8(chunk->midiFlags[index] & StepChunkSizeMask));
+                    }
+                }
+            }
+        }
+    }
+    /**
+     * \brief Call the given function for each midi event on the step, with the early events first, including the event's sub-tick offset
+     * @param function A function taking a pointer to three bytes of event data, the event's size, and the event's offset
+     */
+    template<typename Function>
+    void forEachMidiEventWithOffset(Function function) const {
+        for (const quint8 earlyState : {quint8(StepChunkEarlyFlag), quint8(0)}) {
+            for (const StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+                for (int index = 0; index < chunk->midiCount; ++index) {
+                    if ((chunk->midiFlags[index] & StepChunkEarlyFlag) == earlyState) {
+                        const quint8 data[3]{chunk->midiByte0[index], chunk->midiByte1[index], chunk->midiByte2[index]};
+                        function(data, quint8(chunk->midiFlags[index] & StepChunkSizeMask), chunk->midiOffset[index]);
+                    }
+                }
+            }
+        }
+    }
+    template<typename Function>
+    void forEachClipCommand(Function function) const {
+        for (const StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+            for (int index = 0; index < chunk->clipCommandCount; ++index) {
+                function(chunk->clipCommands[index]);
+            }
+        }
+    }
+    template<typename Function>
+    void forEachTimerCommand(Function function) const {
+        for (const StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+            for (int index = 0; index < chunk->timerCommandCount; ++index) {
+                function(chunk->timerCommands[index]);
+            }
+        }
+    }
+    /**
+     * \brief Remove all midi events from the step for which the given function returns false (keeping the order of the rest)
+     * @param keep A function taking a pointer to three bytes of event data, and the event's size, returning whether to keep the event
+     */
+    template<typename Function>
+    void retainMidiEvents(Function keep) {
+        StepChunk *writeChunk{&storage};
+        int writeIndex{0};
+        for (StepChunk *readChunk = &storage; readChunk; readChunk = readChunk->next) {
+            for (int readIndex = 0; readIndex < readChunk->midiCount; ++readIndex) {
+                const quint8 data[3]{readChunk->midiByte0[readIndex], readChunk->midiByte1[readIndex], readChunk->midiByte2[readIndex]};
+                if (keep(data, quint8(readChunk->midiFlags[readIndex] & StepChunkSizeMask))) {
+                    if (writeIndex == StepChunkMidiEventCount) {
+                        writeChunk->midiCount = writeIndex;
+                        writeChunk = writeChunk->next;
+                        writeIndex = 0;
+                    }
+                    writeChunk->midiByte0[writeIndex] = data[0];
+                    writeChunk->midiByte1[writeIndex] = data[1];
+                    writeChunk->midiByte2[writeIndex] = data[2];
+                    writeChunk->midiFlags[writeIndex] = readChunk->midiFlags[readIndex];
+                    writeChunk->midiOffset[writeIndex] = readChunk->midiOffset[readIndex];
+                    ++writeIndex;
+                }
+            }
+        }
+        writeChunk->midiCount = writeIndex;
+        for (StepChunk *chunk = writeChunk->next; chunk; chunk = chunk->next) {
+            chunk->midiCount = 0;
+        }
+    }
+    /**
+     * \brief Remove all clip commands from the step for which the given function returns false (keeping the order of the rest)
+     * @param keep A function taking a clip command, returning whether to keep it
+     */
+    template<typename Function>
+    void retainClipCommands(Function keep) {
+        StepChunk *writeChunk{&storage};
+        int writeIndex{0};
+        for (StepChunk *readChunk = &storage; readChunk; readChunk = readChunk->next) {
+            for (int readIndex = 0; readIndex < readChunk->clipCommandCount; ++readIndex) {
+                ClipCommand *command{readChunk->clipCommands[readIndex]};
+                if (keep(command)) {
+                    if (writeIndex == StepChunkCommandCount) {
+                        writeChunk->clipCommandCount = writeIndex;
+                        writeChunk = writeChunk->next;
+                        writeIndex = 0;
+                    }
+                    writeChunk->clipCommands[writeIndex] = command;
+                    ++writeIndex;
+                }
             }
-            // The clip commands, once sent out, become owned by SampelerSynth, so leave them alone
-            timerCommands.clear();
-            clipCommands.clear();
-            midiBuffer.clear();
+        }
+        writeChunk->clipCommandCount = writeIndex;
+        for (StepChunk *chunk = writeChunk->next; chunk; chunk = chunk->next) {
+            chunk->clipCommandCount = 0;
+        }
+    }
+    void clearMidiEvents() {
+        for (StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+            chunk->midiCount = 0;
+        }
+    }
+    void clearClipCommands() {
+        for (StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+            chunk->clipCommandCount = 0;
         }
     }
-    void insertMidiBuffer(const juce::MidiBuffer &buffer) {
-        midiBuffer.addEvents(buffer, 0, -1, midiBuffer.getLastEventTime());
+    void clearTimerCommands() {
+        for (StepChunk *chunk = &storage; chunk; chunk = chunk->next) {
+            chunk->timerCommandCount = 0;
+        }
     }
-    juce::MidiBuffer midiBuffer;
-    QList<ClipCommand*> clipCommands;
-    QList<TimerCommand*> timerCommands;
+
+    StepChunk storage;
+    // Whether any of the step's midi events have a sub-tick offset (see forEachMidiEventWithOffset())
+    bool hasMidiOffsets{false};
 
     StepData *previous{nullptr};
     StepData *next{nullptr};
@@ -76,10 +329,164 @@ struct alignas(64) StepData {
     // Conceptually, a step starts out having been played (meaning it is not interesting to the process call),
     // and it is set to false by ensureFresh above, which is called any time just before adding anything to a step.
     bool played{true};
+private:
+    // Find the first chunk which has space according to the given function (chunks always fill up in order, so this will be the last one in use)
+    template<typename Function>
+    StepChunk *chunkWithSpace(StepChunkSlab *slab, Function hasSpace) {
+        StepChunk *chunk{&storage};
+        while (!hasSpace(chunk)) {
+            if (!chunk->next) {
+                chunk->next = slab->acquire();
+                if (!chunk->next) {
+                    return nullptr;
+                }
+            }
+            chunk = chunk->next;
+        }
+        return chunk;
+    }
+};
+
+/**
+ * \brief A single fixed-size scheduling instruction, as written by the scheduling functions and read by the jack process call
+ */
+struct ScheduleRecord {
+    enum Type : quint8 {
+        InvalidType = 0,
+        MidiEventType = 1, ///@< A midi event of up to three bytes, stored in midiBytes
+        ClipCommandType = 2, ///@< A ClipCommand (in pointer), which will be merged with any equivalent command on the step
+        AppendClipCommandType = 3, ///@< A ClipCommand (in pointer), which will be added to the step without merging
+        TimerCommandType = 4, ///@< A TimerCommand (in pointer)
+        StopClipCommandType = 5, ///@< A stopping ClipCommand (in pointer), which removes any other pending command for the same clip before being added to the step
+        FlushType = 6, ///@< Empty out the schedule, sending any pending note offs and (silenced) clip commands out on the current step (step is ignored)
+        CancelClipCommandsType = 7, ///@< Cancel all scheduled commands for a clip (in pointer) on a midi channel (in parameter, or AnyMidiChannel for all channels) (step is ignored)
+        TempoRampType = 8, ///@< A TempoRamp (in pointer), which replaces any ramp which has not yet finished (step is ignored, as the ramp holds its own start position)
+        PhaseAdjustmentType = 9, ///@< Move playback earlier by the number of microseconds in parameter (or later, if negative) (step is ignored)
+        GrooveType = 10, ///@< A GrooveTemplate (in pointer, or null to remove the groove) for the midi channel in parameter (step is ignored)
+        PartType = 11, ///@< A PartPattern (in pointer, or null to unregister the part) for the part slot in parameter (step is ignored)
+    };
+    enum MidiOrder : quint8 {
+        FirstMidiOrder = 0, ///@< Put the event before any other events on the step (used for note offs)
+        NoteMidiOrder = 1, ///@< Put the event after the note offs on the step (used for note ons)
+        AppendMidiOrder = 2, ///@< Put the event after everything else on the step
+    };
+    // The absolute step position (that is, not wrapped to fit in the step ring) the record should be put on
+    quint64 step{0};
+    void *pointer{nullptr};
+    Type type{InvalidType};
+    MidiOrder midiOrder{AppendMidiOrder};
+    quint8 midiSize{0};
+    quint8 midiBytes[3]{0, 0, 0};
+    // How far into the step a midi event should be sent, in 1/65536ths of a tick
+    quint16 subTickOffset{0};
+    // An extra value used by some types of record
+    qint32 parameter{0};
+};
+// Used by CancelClipCommandsType records to cancel commands on all midi channels
+#define AnyMidiChannel -1000
+
+// This must be a power of two
+#define ScheduleQueueSize 8192
+/**
+ * \brief A bounded lock-free multi-producer, single-consumer queue of ScheduleRecord instances
+ *
+ * Any thread can enqueue records without taking a lock, and only the jack process call dequeues them
+ * (which then puts them into the step ring). The implementation is Dmitry Vyukov's bounded queue, in
+ * which each cell carries a sequence number that tells producers and the consumer whose turn it is.
+ */
+class ScheduleQueue {
+public:
+    ScheduleQueue() {
+        for (quint64 i = 0; i < ScheduleQueueSize; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    /**
+     * \brief Add a record to the queue (safe to call from any thread)
+     * @param record The record to copy into the queue
+     * @return False if the queue is full (in which case the record has not been added)
+     */
+    bool enqueue(const ScheduleRecord &record) {
+        Cell *cell{nullptr};
+        quint64 position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[position & (ScheduleQueueSize - 1)];
+            const quint64 sequence = cell->sequence.load(std::memory_order_acquire);
+            const qint64 difference = qint64(sequence) - qint64(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = record;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * \brief Add two records to the queue, either both of them or neither (safe to call from any thread)
+     * This claims two neighbouring cells in one go, so the records are never split up by the queue filling up
+     * in between them (for example a note on and its note off)
+     * @param first The first record to copy into the queue
+     * @param second The second record to copy into the queue
+     * @return False if the queue does not have space for both (in which case neither has been added)
+     */
+    bool enqueuePair(const ScheduleRecord &first, const ScheduleRecord &second) {
+        quint64 position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            const qint64 firstDifference = qint64(cells[position & (ScheduleQueueSize - 1)].sequence.load(std::memory_order_acquire)) - qint64(position);
+            const qint64 secondDifference = qint64(cells[(position + 1) & (ScheduleQueueSize - 1)].sequence.load(std::memory_order_acquire)) - qint64(position + 1);
+            if (firstDifference == 0 && secondDifference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 2, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (firstDifference < 0 || (firstDifference == 0 && secondDifference < 0)) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        Cell *firstCell = &cells[position & (ScheduleQueueSize - 1)];
+        Cell *secondCell = &cells[(position + 1) & (ScheduleQueueSize - 1)];
+        firstCell->record = first;
+        secondCell->record = second;
+        firstCell->sequence.store(position + 1, std::memory_order_release);
+        secondCell->sequence.store(position + 2, std::memory_order_release);
+        return true;
+    }
+    /**
+     * \brief Fetch the oldest record from the queue
+     * @note Only call this from the consumer (that is, the jack process call)
+     * @param record The record to copy the queue's oldest entry into
+     * @return False if the queue is empty
+     */
+    bool dequeue(ScheduleRecord &record) {
+        Cell *cell = &cells[dequeuePosition & (ScheduleQueueSize - 1)];
+        if (cell->sequence.load(std::memory_order_acquire) == dequeuePosition + 1) {
+            record = cell->record;
+            cell->sequence.store(dequeuePosition + ScheduleQueueSize, std::memory_order_release);
+            ++dequeuePosition;
+            return true;
+        }
+        return false;
+    }
+private:
+    struct alignas(64) Cell {
+        std::atomic<quint64> sequence{0};
+        ScheduleRecord record;
+    };
+    Cell cells[ScheduleQueueSize];
+    alignas(64) std::atomic<quint64> enqueuePosition{0};
+    alignas(64) quint64 dequeuePosition{0};
 };
 
 struct alignas(32) ClipCommandRingEntry {
     ClipCommand *clipCommand{nullptr};
+    quint64 tick{0};
     ClipCommandRingEntry *previous{nullptr};
     ClipCommandRingEntry *next{nullptr};
 };
@@ -99,12 +506,108 @@ using frame_clock = std::conditional_t<
 static const jack_midi_data_t jackMidiBeatMessage{0xF8};
 // There's BeatsPerBar * BeatSubdivisions ticks per bar
 #define TicksPerBar 384
+// The number of buckets in the timer's tick interval histogram (the first bucket holds deviations below one microsecond,
+// bucket n holds deviations from 2^(n-1) up to 2^n microseconds, and the last bucket also holds anything larger than that)
+#define TimingHistogramBucketCount 16
+// How often (in milliseconds) SyncTimer::timingStatisticsChanged is emitted while the timer is running
+#define TimingStatisticsNotificationInterval 1000
+/**
+ * \brief Always-on statistics about how well the timer keeps time
+ * All the recording functions are lock-free and cheap enough to call on every tick. The interval and lateness
+ * values are recorded by the timer thread alone, adjustments can be recorded from anywhere, and the whole block
+ * can be read and reset from any thread (a snapshot taken while recording is happening may be very slightly
+ * inconsistent between fields, which is fine for what this is used for)
+ */
+struct TimingStatistics {
+    TimingStatistics() {
+        reset();
+    }
+    void reset() {
+        for (int bucket = 0; bucket < TimingHistogramBucketCount; ++bucket) {
+            intervalHistogram[bucket].store(0, std::memory_order_relaxed);
+        }
+        intervalCount.store(0, std::memory_order_relaxed);
+        intervalLateMaximum.store(0, std::memory_order_relaxed);
+        intervalEarlyMaximum.store(0, std::memory_order_relaxed);
+        latenessMaximum.store(0, std::memory_order_relaxed);
+        latenessTotal.store(0, std::memory_order_relaxed);
+        callbackCount.store(0, std::memory_order_relaxed);
+        adjustmentCount.store(0, std::memory_order_relaxed);
+        adjustmentTotal.store(0, std::memory_order_relaxed);
+        playheadLag.store(0, std::memory_order_relaxed);
+        playheadLagMaximum.store(0, std::memory_order_relaxed);
+    }
+    static inline void storeMaximum(std::atomic<quint64> &maximum, quint64 value) {
+        quint64 current{maximum.load(std::memory_order_relaxed)};
+        while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+    /**
+     * \brief Record a run of the timer callback
+     * @param actual The time at which the callback ran
+     * @param ideal The time at which the callback should have run (if the timer were perfect)
+     * @param lag How many ticks the timer was behind where it needs to be at the start of the callback
+     */
+    void recordCallback(const frame_clock::time_point &actual, const frame_clock::time_point &ideal, qint64 lag) {
+        if (hasPreviousRound) {
+            const qint64 deviation{std::chrono::duration_cast<std::chrono::nanoseconds>((actual - previousActual) - (ideal - previousIdeal)).count()};
+            const quint64 magnitude = deviation < 0 ? quint64(-deviation) : quint64(deviation);
+            const quint64 microseconds{magnitude / 1000};
+            const int bucket = microseconds == 0 ? 0 : qMin(TimingHistogramBucketCount - 1, 64 - __builtin_clzll(microseconds));
+            intervalHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+            intervalCount.fetch_add(1, std::memory_order_relaxed);
+            storeMaximum(deviation < 0 ? intervalEarlyMaximum : intervalLateMaximum, magnitude);
+        }
+        previousActual = actual;
+        previousIdeal = ideal;
+        hasPreviousRound = true;
+        const qint64 lateness{std::chrono::duration_cast<std::chrono::nanoseconds>(actual - ideal).count()};
+        if (lateness > 0) {
+            storeMaximum(latenessMaximum, quint64(lateness));
+            latenessTotal.fetch_add(quint64(lateness), std::memory_order_relaxed);
+        }
+        callbackCount.fetch_add(1, std::memory_order_relaxed);
+        playheadLag.store(lag, std::memory_order_relaxed);
+        if (lag > 0) {
+            storeMaximum(playheadLagMaximum, quint64(lag));
+        }
+    }
+    void recordAdjustment(qint64 microseconds) {
+        adjustmentCount.fetch_add(1, std::memory_order_relaxed);
+        adjustmentTotal.fetch_add(microseconds, std::memory_order_relaxed);
+    }
+    std::atomic<quint64> intervalHistogram[TimingHistogramBucketCount];
+    std::atomic<quint64> intervalCount{0};
+    std::atomic<quint64> intervalLateMaximum{0};
+    std::atomic<quint64> intervalEarlyMaximum{0};
+    std::atomic<quint64> latenessMaximum{0};
+    std::atomic<quint64> latenessTotal{0};
+    std::atomic<quint64> callbackCount{0};
+    std::atomic<quint64> adjustmentCount{0};
+    std::atomic<qint64> adjustmentTotal{0};
+    std::atomic<qint64> playheadLag{0};
+    std::atomic<quint64> playheadLagMaximum{0};
+    // Only touched by the timer thread
+    frame_clock::time_point previousActual;
+    frame_clock::time_point previousIdeal;
+    bool hasPreviousRound{false};
+};
+
+// The realtime priority used by the timer thread when it is not spinning (it spends nearly all its time asleep,
+// so there is no need for it to compete with jack's own realtime threads)
+#define SyncTimerThreadSleepingPriority 10
+// How long the jack cycle mode waits for a wakeup before checking whether it should be doing something else
+#define JackCycleWaitTimeout 50000000
 class SyncTimerThread : public QThread {
     Q_OBJECT
 public:
     SyncTimerThread(SyncTimer *q)
         : QThread(q)
-    {}
+    {
+        sem_init(&jackCycleSemaphore, 0, 0);
+    }
+    ~SyncTimerThread() {
+        sem_destroy(&jackCycleSemaphore);
+    }
 
     void waitTill(frame_clock::time_point till) {
         //spinTimeMs is used to adjust for scheduler inaccuracies. default is 2.1 milliseconds. anything lower makes fps jump around
@@ -118,9 +621,89 @@ public:
         while (till > frame_clock::now()) {
             //spin till actual timepoint
         }
+        registerWakeLateness(frame_clock::now() - till);
+    }
+
+    /**
+     * \brief Sleep until the given point in time without spinning
+     * frame_clock is a steady clock, which on linux means CLOCK_MONOTONIC, so we can hand the deadline to the kernel directly
+     */
+    void sleepTill(frame_clock::time_point till) {
+        const std::chrono::nanoseconds sinceEpoch{std::chrono::duration_cast<std::chrono::nanoseconds>(till.time_since_epoch())};
+        struct timespec deadline;
+        deadline.tv_sec = sinceEpoch.count() / NanosecondsPerSecond;
+        deadline.tv_nsec = sinceEpoch.count() % NanosecondsPerSecond;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+            // Interrupted by a signal, go back to sleep
+        }
+        registerWakeLateness(frame_clock::now() - till);
+    }
+
+    /**
+     * \brief Wait until the jack process call tells us it has run (or until we time out)
+     * @return True if we were woken by the jack process call, false if we timed out
+     */
+    bool waitForJackCycle() {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += JackCycleWaitTimeout;
+        if (deadline.tv_nsec >= NanosecondsPerSecond) {
+            deadline.tv_nsec -= NanosecondsPerSecond;
+            ++deadline.tv_sec;
+        }
+        int result{0};
+        while ((result = sem_timedwait(&jackCycleSemaphore, &deadline)) == -1 && errno == EINTR) {
+            // Interrupted by a signal, go back to waiting
+        }
+        if (result == 0) {
+            registerWakeLateness(frame_clock::now() - frame_clock::time_point(frame_clock::duration(jackCyclePostedAt.load(std::memory_order_acquire))));
+            // Collapse any further posts into this wakeup, as the callback catches up on all pending ticks anyway
+            while (sem_trywait(&jackCycleSemaphore) == 0) {}
+            return true;
+        }
+        return false;
+    }
+    /**
+     * \brief Called at the end of the jack process call to wake the timer in JackCycleTimerMode
+     * @note This is realtime safe (sem_post does not block), and does nothing in other modes
+     */
+    inline void notifyJackCycle() {
+        if (timerMode.load(std::memory_order_relaxed) == SyncTimer::JackCycleTimerMode) {
+            int value{0};
+            sem_getvalue(&jackCycleSemaphore, &value);
+            if (value < 1) {
+                jackCyclePostedAt.store(frame_clock::now().time_since_epoch().count(), std::memory_order_release);
+                sem_post(&jackCycleSemaphore);
+            }
+        }
+    }
+
+    void setTimerMode(SyncTimer::TimerMode mode) {
+        timerMode.store(mode, std::memory_order_relaxed);
+        resetWakeStatistics();
+        // Make sure a thread waiting for the jack cycle gets a chance to notice the change
+        jackCyclePostedAt.store(frame_clock::now().time_since_epoch().count(), std::memory_order_release);
+        sem_post(&jackCycleSemaphore);
+    }
+    inline SyncTimer::TimerMode getTimerMode() const {
+        return SyncTimer::TimerMode(timerMode.load(std::memory_order_relaxed));
+    }
+
+    void applySchedulingPolicy(SyncTimer::TimerMode mode) {
+        struct sched_param param;
+        if (mode == SyncTimer::SpinningTimerMode) {
+            // Set thread policy to SCHED_FIFO with maximum possible priority
+            param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+        } else {
+            param.sched_priority = qBound(sched_get_priority_min(SCHED_FIFO), SyncTimerThreadSleepingPriority, sched_get_priority_max(SCHED_FIFO));
+        }
+        sched_setscheduler(0, SCHED_FIFO, &param);
+        appliedTimerMode = mode;
     }
 
     void run() override {
+        threadId = pthread_self();
+        hasThreadId = true;
         startTime = frame_clock::now();
         std::chrono::time_point< std::chrono::_V2::steady_clock, std::chrono::duration< long long unsigned int, std::ratio< 1, NanosecondsPerSecond > > > nextMinute;
         while (true) {
@@ -128,7 +711,7 @@ public:
                 break;
             }
             nextMinute = startTime + ((minuteCount + 1) * nanosecondsPerMinute);
-            while (count < bpm * BeatSubdivisions) {
+            while (count < ticksPerMinute()) {
                 mutex.lock();
                 if (paused)
                 {
@@ -136,10 +719,10 @@ public:
                     waitCondition.wait(&mutex);
                     qDebug() << "Unpaused, let's goooo!";
 
-                    // Set thread policy to SCHED_FIFO with maximum possible priority
-                    struct sched_param param;
-                    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
-                    sched_setscheduler(0, SCHED_FIFO, &param);
+                    applySchedulingPolicy(getTimerMode());
+                    while (sem_trywait(&jackCycleSemaphore) == 0) {}
+                    // Don't count the time spent paused as a (very long) tick interval
+                    timingStatistics.hasPreviousRound = false;
 
                     nextExtraTickAt = 0;
                     adjustment = 0;
@@ -148,15 +731,48 @@ public:
                     minuteCount = 0;
                     startTime = frame_clock::now();
                     nextMinute = startTime + nanosecondsPerMinute;
+                    hasAbsoluteDeadline = false;
                 }
                 mutex.unlock();
                 if (aborted) {
                     break;
                 }
-                Q_EMIT timeout(); // Do the thing!
-                ++count;
-                ++cumulativeCount;
-                waitTill(frame_clock::now() + frame_clock::duration(subbeatCountToNanoseconds(bpm, 1)));
+                const SyncTimer::TimerMode mode{getTimerMode()};
+                if (mode != appliedTimerMode) {
+                    applySchedulingPolicy(mode);
+                }
+                if (mode != SyncTimer::AbsoluteSleepTimerMode) {
+                    // Start counting the deadlines afresh if we get switched (back) to the absolute sleep mode
+                    hasAbsoluteDeadline = false;
+                }
+                if (mode == SyncTimer::JackCycleTimerMode) {
+                    if (waitForJackCycle() && !paused) {
+                        Q_EMIT timeout(); // Do the thing!
+                    }
+                    // Keep the counters in step with the passing of time, so the runtime functions below stay accurate
+                    const quint64 elapsedTicks = quint64((frame_clock::now() - (startTime + (minuteCount * nanosecondsPerMinute))) / interval);
+                    if (elapsedTicks > count) {
+                        cumulativeCount += qMin(elapsedTicks, ticksPerMinute()) - count;
+                        count = qMin(elapsedTicks, ticksPerMinute());
+                    }
+                } else {
+                    Q_EMIT timeout(); // Do the thing!
+                    ++count;
+                    ++cumulativeCount;
+                    if (mode == SyncTimer::AbsoluteSleepTimerMode) {
+                        // Sleep against absolute deadlines, so the time spent in the callback does not accumulate as drift
+                        // The deadline moves on by the current interval each tick (rather than being worked out from the
+                        // start time), so a change of bpm only affects the ticks after it
+                        if (!hasAbsoluteDeadline) {
+                            nextAbsoluteDeadline = frame_clock::now();
+                            hasAbsoluteDeadline = true;
+                        }
+                        nextAbsoluteDeadline += interval;
+                        sleepTill(nextAbsoluteDeadline);
+                    } else {
+                        waitTill(frame_clock::now() + interval);
+                    }
+                }
             }
 #ifdef DEBUG_SYNCTIMER_TIMING
             qDebug() << "Sync timer reached minute:" << minuteCount << "with interval" << interval.count();
@@ -167,23 +783,70 @@ public:
         }
     }
 
+    /**
+     * \brief The amount of cpu time used by the timer thread since it was started
+     * @return The thread's cpu time in nanoseconds (or 0 if the thread has not yet started)
+     */
+    quint64 cpuTime() const {
+        quint64 nanoseconds{0};
+        clockid_t clockId;
+        if (hasThreadId && pthread_getcpuclockid(threadId, &clockId) == 0) {
+            struct timespec time;
+            if (clock_gettime(clockId, &time) == 0) {
+                nanoseconds = (quint64(time.tv_sec) * NanosecondsPerSecond) + quint64(time.tv_nsec);
+            }
+        }
+        return nanoseconds;
+    }
+    void registerWakeLateness(frame_clock::duration lateness) {
+        const quint64 nanoseconds = lateness.count() > 0 ? quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(lateness).count()) : 0;
+        if (nanoseconds > wakeLatenessMaximum.load(std::memory_order_relaxed)) {
+            wakeLatenessMaximum.store(nanoseconds, std::memory_order_relaxed);
+        }
+        wakeLatenessTotal.fetch_add(nanoseconds, std::memory_order_relaxed);
+        wakeCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void resetWakeStatistics() {
+        wakeLatenessMaximum.store(0, std::memory_order_relaxed);
+        wakeLatenessTotal.store(0, std::memory_order_relaxed);
+        wakeCount.store(0, std::memory_order_relaxed);
+    }
+    std::atomic<quint64> wakeLatenessMaximum{0};
+    std::atomic<quint64> wakeLatenessTotal{0};
+    std::atomic<quint64> wakeCount{0};
+    TimingStatistics timingStatistics;
+
     Q_SIGNAL void timeout();
 
-    void setBPM(quint64 bpm) {
+    void setBPM(double bpm) {
         this->bpm = bpm;
         interval = frame_clock::duration(subbeatCountToNanoseconds(bpm, 1));
     }
-    inline const quint64 getBpm() const {
+    /**
+     * \brief Set the bpm along with an already known tick interval (to avoid calculating it again)
+     */
+    void setBPM(double bpm, const std::chrono::nanoseconds &interval) {
+        this->bpm = bpm;
+        this->interval = interval;
+    }
+    inline const double getBpm() const {
         return bpm;
     }
+    inline quint64 ticksPerMinute() const {
+        return quint64(bpm * BeatSubdivisions);
+    }
 
-    static inline quint64 subbeatCountToNanoseconds(const quint64 &bpm, const quint64 &subBeatCount)
+    static inline quint64 subbeatCountToNanoseconds(const double &bpm, const quint64 &subBeatCount)
+    {
+        return quint64(std::llround((double(subBeatCount) * double(NanosecondsPerMinute)) / (bpm * BeatSubdivisions)));
+    };
+    static inline float nanosecondsToSubbeatCount(const double &bpm, const quint64 &nanoseconds)
     {
-        return (subBeatCount * NanosecondsPerMinute) / (bpm * BeatSubdivisions);
+        return nanoseconds / (double(NanosecondsPerMinute) / (bpm * BeatSubdivisions));
     };
-    static inline float nanosecondsToSubbeatCount(const quint64 &bpm, const quint64 &nanoseconds)
+    static inline double subbeatLengthInMicroseconds(const double &bpm)
     {
-        return nanoseconds / (NanosecondsPerMinute / (bpm * BeatSubdivisions));
+        return double(NanosecondsPerMinute / 1000) / (bpm * BeatSubdivisions);
     };
     void requestAbort() {
         aborted = true;
@@ -205,6 +868,7 @@ public:
     Q_SIGNAL void pausedChanged();
 
     void addAdjustmentByMicroseconds(qint64 microSeconds) {
+        timingStatistics.recordAdjustment(microSeconds);
         mutex.lock();
         if (adjustment == 0) {
             currentExtraTick = 0;
@@ -241,14 +905,17 @@ public:
 private:
     qint64 nextExtraTickAt{0};
     quint64 currentExtraTick{0};
+    // The point in time the next tick is due at in AbsoluteSleepTimerMode (only valid while hasAbsoluteDeadline is set)
+    frame_clock::time_point nextAbsoluteDeadline;
+    bool hasAbsoluteDeadline{false};
     qint64 adjustment{0};
     quint64 count{0};
     quint64 cumulativeCount{0};
     quint64 minuteCount{0};
     frame_clock::time_point startTime;
 
-    quint64 bpm{120};
-    std::chrono::nanoseconds interval;
+    double bpm{120};
+    std::chrono::nanoseconds interval{NanosecondsPerMinute / (120 * BeatSubdivisions)};
 
     QMutex mutex;
     QWaitCondition waitCondition;
@@ -259,33 +926,385 @@ private:
 
     bool aborted{false};
     bool paused{true};
+
+    std::atomic<int> timerMode{SyncTimer::SpinningTimerMode};
+    SyncTimer::TimerMode appliedTimerMode{SyncTimer::SpinningTimerMode};
+    sem_t jackCycleSemaphore;
+    std::atomic<qint64> jackCyclePostedAt{0};
+    pthread_t threadId;
+    std::atomic<bool> hasThreadId{false};
 };
 
 using TimerCallback = void(*)(int);
 #define CallbackSpaces 16
 
+/**
+ * \brief A subscriber registered using SyncTimer::addTickCallback()
+ */
+struct TickSubscriber {
+    SyncTimer::TickCallback callback{nullptr};
+    void *userData{nullptr};
+    quint64 divisor{1};
+    bool useWorkerThread{false};
+    std::atomic<bool> active{false};
+    // Set when the subscriber was removed from the timer thread while the worker was delivering ticks to it, and the
+    // slot should be cleared out once the worker is done with it (see SyncTimerCallbackWorker::reclaimRetiredSubscribers())
+    std::atomic<bool> retired{false};
+};
+
+/**
+ * \brief A subscriber registered using SyncTimer::addClipCommandsSentCallback()
+ */
+struct ClipCommandsSentSubscriber {
+    SyncTimer::ClipCommandsSentCallback callback{nullptr};
+    void *userData{nullptr};
+    std::atomic<bool> active{false};
+};
+// The largest number of sent clip commands handed to the subscribers in one go
+#define SentClipCommandBatchSize 256
+
+// The number of ticks which can be waiting for the callback worker at any one time
+#define TickWorkerRingSize 1024
+// The largest number of ticks the worker will hand to a callback in one go
+#define TickWorkerBatchSize 256
+/**
+ * \brief Delivers ticks to the subscribers which asked for it, away from the timer thread
+ *
+ * The timer thread pushes ticks into a single-producer/single-consumer ring and posts a semaphore once per
+ * timer callback, and this thread then hands each subscriber all the ticks it wants in a single call.
+ * If a subscriber is too slow to keep up, the ring fills up and ticks are dropped (and counted), rather
+ * than the timer thread being held up.
+ */
+class SyncTimerCallbackWorker : public QThread {
+public:
+    SyncTimerCallbackWorker(TickSubscriber *subscribers, QObject *parent)
+        : QThread(parent)
+        , subscribers(subscribers)
+    {
+        sem_init(&semaphore, 0, 0);
+    }
+    ~SyncTimerCallbackWorker() {
+        sem_destroy(&semaphore);
+    }
+    /**
+     * \brief Add a tick to the ring (only call this from the timer thread)
+     */
+    inline void push(const SyncTimer_Tick &tick) {
+        const quint64 writeIndex{writePosition.load(std::memory_order_relaxed)};
+        if (writeIndex - readPosition.load(std::memory_order_acquire) < TickWorkerRingSize) {
+            ring[writeIndex & (TickWorkerRingSize - 1)] = tick;
+            writePosition.store(writeIndex + 1, std::memory_order_release);
+            hasPushed = true;
+        } else {
+            droppedTickCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    /**
+     * \brief Wake the worker if anything has been pushed since the last time (only call this from the timer thread)
+     */
+    inline void notify() {
+        if (hasPushed) {
+            hasPushed = false;
+            sem_post(&semaphore);
+        }
+    }
+    void requestAbort() {
+        aborted = true;
+        sem_post(&semaphore);
+    }
+    void run() override {
+        SyncTimer_Tick ticks[TickWorkerBatchSize];
+        SyncTimer_Tick subscriberTicks[TickWorkerBatchSize];
+        while (!aborted) {
+            sem_wait(&semaphore);
+            const quint64 writeIndex{writePosition.load(std::memory_order_acquire)};
+            quint64 readIndex{readPosition.load(std::memory_order_relaxed)};
+            while (readIndex < writeIndex && !aborted) {
+                int count{0};
+                while (readIndex < writeIndex && count < TickWorkerBatchSize) {
+                    ticks[count] = ring[readIndex & (TickWorkerRingSize - 1)];
+                    ++readIndex;
+                    ++count;
+                }
+                readPosition.store(readIndex, std::memory_order_release);
+                deliveryMutex.lock();
+                for (int i = 0; i < CallbackSpaces; ++i) {
+                    const TickSubscriber &subscriber = subscribers[i];
+                    if (subscriber.useWorkerThread && subscriber.active.load(std::memory_order_acquire)) {
+                        int subscriberCount{0};
+                        for (int tick = 0; tick < count; ++tick) {
+                            if (ticks[tick].cumulativeBeat % subscriber.divisor == 0) {
+                                subscriberTicks[subscriberCount] = ticks[tick];
+                                ++subscriberCount;
+                            }
+                        }
+                        if (subscriberCount > 0) {
+                            subscriber.callback(subscriberTicks, subscriberCount, subscriber.userData);
+                        }
+                    }
+                }
+                reclaimRetiredSubscribers();
+                deliveryMutex.unlock();
+            }
+        }
+    }
+    /**
+     * \brief Clear out the slots of any subscribers which were removed from the timer thread while ticks were being delivered to them
+     * @note Only call this with the delivery mutex held
+     */
+    void reclaimRetiredSubscribers() {
+        for (int i = 0; i < CallbackSpaces; ++i) {
+            TickSubscriber &subscriber = subscribers[i];
+            if (subscriber.retired.load(std::memory_order_acquire)) {
+                subscriber.callback = nullptr;
+                subscriber.userData = nullptr;
+                subscriber.retired.store(false, std::memory_order_release);
+            }
+        }
+    }
+    // Held while delivering ticks, so removing a subscriber can wait until the worker is done with it
+    QMutex deliveryMutex;
+    std::atomic<quint64> droppedTickCount{0};
+private:
+    TickSubscriber *subscribers{nullptr};
+    SyncTimer_Tick ring[TickWorkerRingSize];
+    std::atomic<quint64> writePosition{0};
+    std::atomic<quint64> readPosition{0};
+    bool hasPushed{false};
+    sem_t semaphore;
+    std::atomic<bool> aborted{false};
+};
+
 #define FreshCommandStashSize 4096
-#define StepRingCount 32768
+// How long (in microseconds) a deleted clip command is held on to before it can be handed out again, so anything still
+// looking at it (such as a queued clipCommandSent receiver, or a SamplerSynth voice finishing up) is done with it first
+#define ClipCommandReleaseGracePeriod 50000
+// The default number of steps in the step ring (override using the ZYNTHBOX_STEP_RING_SIZE environment variable)
+#define StepRingDefaultCount 32768
+// The default number of chunks in the step storage slab (override using the ZYNTHBOX_STEP_SLAB_SIZE environment variable)
+#define StepChunkSlabDefaultCount 4096
+// The number of outer levels in the timing wheel (with the step ring being the innermost, each level is 64 times coarser than the one inside it)
+#define WheelLevelCount 2
+// The number of records which can be held in the timing wheel's outer levels at any one time
+#define DeferredRecordCount 16384
+// The number of buckets in the index of scheduled clip commands (this must be a power of two)
+#define ClipIndexBucketCount 1024
+// The number of midi events which can be held back to be sent part of the way into a step (because of a sub-tick offset or a groove)
+#define HeldMidiEventCount 1024
+// The number of midi events which can be sent out in a single process call when running fused into ZLRouter (see SyncTimer::isFused())
+#define FusedMidiEventCount 4096
+// The space for the data of the midi events longer than three bytes which can be sent out in a single process call when running fused
+#define FusedLongMidiDataSize 8192
+// The largest midi message (such as a sysex message) which can be scheduled
+#define LongMidiMessageSize 512
+// The number of midi messages longer than three bytes which can be scheduled at once (more will be allocated, should that run out)
+#define LongMidiMessagePoolSize 64
+// The largest number of steps a tempo ramp can cover (at 96 steps per beat, that is a little over 85 beats)
+#define TempoRampMaximumStepCount 8192
+// The number of tempo ramps which can exist at once (one playing, one waiting to play, and some being prepared)
+#define TempoRampPoolSize 4
+// The number of midi channels which can have a groove template
+#define GrooveChannelCount 16
+// The number of groove templates which can exist at once (one for each channel, and some waiting to replace those)
+#define GroovePoolSize 48
+// The largest number of midi events the modulation engine can send out in a single process call
+#define ModulationEventCount 256
+// The largest number of midi events the automation engine can send out in a single process call
+#define AutomationEventCount 256
+// The number of timer command operations which can have a handler registered (see SyncTimer::registerTimerCommandHandler())
+#define TimerCommandHandlerCount 256
+// The number of channels, tracks on each channel, and parts on each track which can have a part registered for native playback
+#define PartChannelCount 10
+#define PartTrackCount 10
+#define PartsPerTrack 5
+#define PartSlotCount (PartChannelCount * PartTrackCount * PartsPerTrack)
+// The largest number of items a single registered part can hold
+#define PartItemCount 512
+// The number of parts which can exist at once (the registered ones, and some waiting to replace those)
+#define PartPoolSize 128
+// The number of starts and stops which can be waiting to happen for each part slot
+#define PartTransitionCount 16
+// When following the jack transport, a difference of more than this many ticks between our playhead and the transport's is treated as a relocation
+#define TransportFollowerRelocationThreshold TicksPerBar
+/**
+ * \brief A midi message longer than the three bytes a step can hold inline (such as a sysex message)
+ * These are scheduled as a TimerCommand::SendLongMidiMessageOperation command holding the message in its dataParameter,
+ * and go back to their pool along with that command (see SyncTimer::deleteTimerCommand())
+ */
+struct LongMidiMessage {
+    quint8 data[LongMidiMessageSize];
+    int size{0};
+    static void clear(LongMidiMessage *message) {
+        message->size = 0;
+    }
+};
+
+/**
+ * \brief A precomputed tempo map for a gradual change of bpm over a number of steps
+ * All the per-step values are calculated when the ramp is scheduled, so the jack process call only needs to look them up
+ */
+struct TempoRamp {
+    static void clear(TempoRamp *ramp) {
+        ramp->startPosition = 0;
+        ramp->stepCount = 0;
+        ramp->nextRetired = nullptr;
+    }
+    /**
+     * \brief Fill in the tempo map for a ramp
+     * The bpm changes linearly from startBpm on the first step, reaching endBpm on the step following the last step in the ramp
+     */
+    void calculate(double startBpm, double endBpm, quint64 stepCount) {
+        this->stepCount = stepCount;
+        this->endBpm = endBpm;
+        endStepLength = SyncTimerThread::subbeatLengthInMicroseconds(endBpm);
+        stepOffset[0] = 0;
+        for (quint64 step = 0; step < stepCount; ++step) {
+            bpm[step] = startBpm + ((endBpm - startBpm) * double(step) / double(stepCount));
+            stepOffset[step + 1] = stepOffset[step] + SyncTimerThread::subbeatLengthInMicroseconds(bpm[step]);
+        }
+    }
+    inline double stepLength(quint64 step) const {
+        return stepOffset[step + 1] - stepOffset[step];
+    }
+    /**
+     * \brief The time from the start of the ramp until the start of the given step
+     * @param step The step, relative to the start of the ramp (negative for steps before the ramp starts)
+     * @param lengthBefore The length of the steps before the ramp starts
+     * @return The number of microseconds between the start of the ramp and the given step
+     */
+    inline double timeAtStep(qint64 step, double lengthBefore) const {
+        if (step <= 0) {
+            return double(step) * lengthBefore;
+        } else if (quint64(step) <= stepCount) {
+            return stepOffset[step];
+        }
+        return stepOffset[stepCount] + (double(quint64(step) - stepCount) * endStepLength);
+    }
+    quint64 startPosition{0}; ///< The absolute step position of the first step in the ramp
+    TempoRamp *nextRetired{nullptr}; ///< The next ramp waiting to be released (see SyncTimerPrivate::retireTempoRamp())
+    quint64 stepCount{0};
+    double endBpm{0};
+    double endStepLength{0};
+    double bpm[TempoRampMaximumStepCount];
+    double stepOffset[TempoRampMaximumStepCount + 1]; ///< The time in microseconds from the start of the ramp until the start of each step
+};
+
+static_assert(GrooveTemplateTickCount == TicksPerBar, "A groove must cover exactly one bar");
+static_assert(GrooveTemplateDisplacementResolution == SubTickOffsetResolution, "A groove's displacements must use the same resolution as sub-tick offsets");
+
+/**
+ * \brief A single note, midi message, or clip command in a registered part, in a compact form
+ */
+struct PartItem {
+    ClipAudioSource *clip{nullptr}; ///< For clips, the clip to start or stop
+    quint32 step{0}; ///< The step inside the part the item should be played on
+    quint32 duration{0}; ///< For note ons, the number of steps until the matching note off (0 for no note off)
+    float volume{1.0f}; ///< For clips which are being started, the volume to play at
+    quint16 subTickOffset{0}; ///< How far into the step to play the item, in 1/65536ths of a tick
+    quint8 type{0}; ///< One of SyncTimer_ScheduleItemType
+    qint8 channel{0}; ///< For clips, the sampler channel
+    quint8 midiBytes[3]{0, 0, 0}; ///< For notes and midi messages, the message (for clips, the note is in the second byte)
+    quint8 midiSize{0}; ///< For notes and midi messages, how many of the midi bytes to use
+    bool setOn{false}; ///< For clips, whether to start playback (otherwise playback is stopped)
+    bool looping{false}; ///< For clips which are being started, whether to loop the clip
+};
+
+/**
+ * \brief A part registered for native playback, which is played on a loop of length steps while started
+ */
+struct PartPattern {
+    static void clear(PartPattern *part) {
+        part->length = 0;
+        part->itemCount = 0;
+    }
+    quint64 length{0}; ///< The number of steps in a single loop of the part
+    int itemCount{0};
+    PartItem items[PartItemCount]; ///< The part's items, ordered by step
+};
+
+/**
+ * \brief A start or stop of a part which is waiting to happen
+ */
+struct PartTransition {
+    quint64 position{0}; ///< The absolute step position the transition should happen on
+    bool start{false}; ///< Whether to start playback (otherwise playback is stopped)
+};
+
+/**
+ * \brief The playback state of a single part slot (only touched by the jack process call)
+ */
+struct PartPlayback {
+    PartPattern *pattern{nullptr};
+    quint64 origin{0}; ///< The absolute step position playback was started on
+    PartTransition transitions[PartTransitionCount]; ///< The starts and stops waiting to happen, ordered by position
+    int transitionCount{0};
+    bool playing{false};
+};
+
+using ScheduleWheel = TimingWheel<ScheduleRecord, WheelLevelCount, DeferredRecordCount>;
+
 SyncTimerThread *timerThread{nullptr};
 class SyncTimerPrivate {
 public:
     SyncTimerPrivate(SyncTimer *q)
         : q(q)
+        , clipCommandPool(&ClipCommand::clear)
+        , timerCommandPool(&TimerCommand::clear)
+        , longMidiMessagePool(&LongMidiMessage::clear)
+        , tempoRampPool(&TempoRamp::clear)
+        , groovePool(&GrooveTemplate::clear)
+        , partPool(&PartPattern::clear)
     {
+        for (std::atomic<TimerCommandHandlerEntry*> &entry : timerCommandHandlers) {
+            entry.store(nullptr);
+        }
+        for (std::atomic<quint32> &compensation : midiChannelLatencyCompensation) {
+            compensation.store(0);
+        }
         transportManager = TransportManager::instance(q);
+        modulationEngine = ModulationEngine::instance(q);
+        automationEngine = AutomationEngine::instance(q);
         timerThread = new SyncTimerThread(q);
-        int result = mlock(stepRing, sizeof(StepData) * StepRingCount);
-        if (result != 0) {
-            qDebug() << Q_FUNC_INFO << "Error locking step ring memory" << strerror(result);
+        // Which way the timer thread should wait between ticks (spin, sleep, or jack) - see SyncTimer::TimerMode
+        const QString timerModeEnvVar = qgetenv("ZYNTHBOX_SYNCTIMER_MODE");
+        if (timerModeEnvVar == "jack") {
+            timerThread->setTimerMode(SyncTimer::JackCycleTimerMode);
+        } else if (timerModeEnvVar == "sleep") {
+            timerThread->setTimerMode(SyncTimer::AbsoluteSleepTimerMode);
+        } else if (!timerModeEnvVar.isEmpty() && timerModeEnvVar != "spin") {
+            qWarning() << Q_FUNC_INFO << "Unknown timer mode" << timerModeEnvVar << "requested in ZYNTHBOX_SYNCTIMER_MODE, expected one of spin, sleep, or jack - using spin";
         }
-        StepData* previous{&stepRing[StepRingCount - 1]};
-        for (quint64 i = 0; i < StepRingCount; ++i) {
+        // Whether to run inside ZLRouter's jack client, rather than in our own (see SyncTimer::isFused())
+        const QString fusedEnvVar = qgetenv("ZYNTHBOX_SYNCTIMER_FUSED");
+        fused = (fusedEnvVar == "1" || fusedEnvVar == "true");
+        // The step ring size must be a power of two (so that it fits evenly into the timing wheel's outer levels)
+        stepRingCount = qBound(quint64(1024), readSizeFromEnvironment("ZYNTHBOX_STEP_RING_SIZE", StepRingDefaultCount), quint64(1048576));
+        while ((stepRingCount & (stepRingCount - 1)) != 0) {
+            stepRingCount = (stepRingCount | (stepRingCount - 1)) + 1;
+        }
+        stepRing = new StepData[stepRingCount];
+        stepOccupancy = new quint64[stepRingCount / 64]();
+        stepChunkSlab.allocate(qMax(quint64(1), readSizeFromEnvironment("ZYNTHBOX_STEP_SLAB_SIZE", StepChunkSlabDefaultCount)));
+        lockMemory(stepRing, sizeof(StepData) * stepRingCount, "step ring");
+        lockMemory(stepOccupancy, sizeof(quint64) * (stepRingCount / 64), "step occupancy");
+        lockMemory(stepChunkSlab.chunks, sizeof(StepChunk) * stepChunkSlab.count, "step storage slab");
+        lockMemory(&scheduleQueue, sizeof(ScheduleQueue), "schedule queue");
+        lockedMemorySize += clipCommandPool.lockedMemorySize + timerCommandPool.lockedMemorySize + longMidiMessagePool.lockedMemorySize + tempoRampPool.lockedMemorySize + groovePool.lockedMemorySize + partPool.lockedMemorySize;
+        qDebug() << Q_FUNC_INFO << "Using a step ring of" << stepRingCount << "steps, and" << stepChunkSlab.count << "chunks of extra step storage, with a total of" << lockedMemorySize << "bytes of memory locked";
+        StepData* previous{&stepRing[stepRingCount - 1]};
+        for (quint64 i = 0; i < stepRingCount; ++i) {
             stepRing[i].index = i;
             previous->next = &stepRing[i];
             stepRing[i].previous = previous;
             previous = &stepRing[i];
         }
         stepReadHead = stepRing;
+        stepReadHeadPosition = 0;
+        for (quint64 i = 0; i < ClipIndexBucketCount; ++i) {
+            clipIndex[i] = nullptr;
+        }
+        lockMemory(&wheel, sizeof(ScheduleWheel), "timing wheel");
+        wheel.setInnermostSpan(stepRingCount);
 
         ClipCommandRingEntry* clipPrevious{&sentOutClipsRing[FreshCommandStashSize - 1]};
         for (quint64 i = 0; i < FreshCommandStashSize; ++i) {
@@ -295,94 +1314,1294 @@ public:
         }
         sentOutClipsReadHead = sentOutClipsWriteHead = sentOutClipsRing;
 
-        for (int i = 0; i < FreshCommandStashSize; ++i) {
-            freshClipCommands << new ClipCommand;
-            freshTimerCommands << new TimerCommand;
-        }
         samplerSynth = SamplerSynth::instance();
         // Dangerzone - direct connection from another thread. Yes, dangerous, but also we need the precision, so we need to dill whit it
         QObject::connect(timerThread, &SyncTimerThread::timeout, q, [this](){ hiResTimerCallback(); }, Qt::DirectConnection);
         QObject::connect(timerThread, &QThread::started, q, [q](){ Q_EMIT q->timerRunningChanged(); });
         QObject::connect(timerThread, &QThread::finished, q, [q](){ Q_EMIT q->timerRunningChanged(); });
         QObject::connect(timerThread, &SyncTimerThread::pausedChanged, q, [q](){ q->timerRunningChanged(); });
-        timerThread->start();
-
-        objectGarbageHandler.setInterval(50);
-        objectGarbageHandler.setSingleShot(true);
-        QObject::connect(&objectGarbageHandler, &QTimer::timeout, q, [this](){
-            // Stuff any commands we've been asked to delete back into the list, at a reasonable location, and cleaned up
-            QMutableListIterator<TimerCommand*> freshTimerCommandsIterator(freshTimerCommands);
-            while (freshTimerCommandsIterator.hasNext() && timerCommandsToDelete.count() > 0) {
-                TimerCommand *value = freshTimerCommandsIterator.next();
-                if (value == nullptr) {
-                    TimerCommand* refreshedCommand = timerCommandsToDelete.takeFirst();
-                    TimerCommand::clear(refreshedCommand);
-                    freshTimerCommandsIterator.setValue(refreshedCommand);
-                }
-            }
-            QMutableListIterator<ClipCommand*> freshClipCommandsIterator(freshClipCommands);
-            while (freshClipCommandsIterator.hasNext() && clipCommandsToDelete.count() > 0) {
-                ClipCommand *value = freshClipCommandsIterator.next();
-                if (value == nullptr) {
-                    ClipCommand *refreshedCommand = clipCommandsToDelete.takeFirst();
-                    ClipCommand::clear(refreshedCommand);
-                    freshClipCommandsIterator.setValue(refreshedCommand);
-                }
+        // The statistics change all the time while the timer runs, so rather than notifying on every tick, let people know every now and then
+        timingStatisticsTimer = new QTimer(q);
+        timingStatisticsTimer->setInterval(TimingStatisticsNotificationInterval);
+        QObject::connect(timingStatisticsTimer, &QTimer::timeout, q, &SyncTimer::timingStatisticsChanged);
+        QObject::connect(timerThread, &SyncTimerThread::pausedChanged, timingStatisticsTimer, [this](){
+            if (timerThread->isPaused()) {
+                timingStatisticsTimer->stop();
+                Q_EMIT this->q->timingStatisticsChanged();
+            } else {
+                timingStatisticsTimer->start();
             }
         });
+        timerThread->start();
+        callbackWorker = new SyncTimerCallbackWorker(tickSubscribers, q);
+        callbackWorker->start();
     }
     ~SyncTimerPrivate() {
         timerThread->requestAbort();
         timerThread->wait();
-        if (jackClient) {
+        callbackWorker->requestAbort();
+        callbackWorker->wait();
+        // When fused, the client belongs to ZLRouter, which will close it itself
+        if (jackClient && !fused) {
             jack_client_close(jackClient);
         }
+        delete[] stepRing;
+        delete[] stepOccupancy;
+        for (std::atomic<TimerCommandHandlerEntry*> &entry : timerCommandHandlers) {
+            delete entry.load();
+        }
+        qDeleteAll(retiredTimerCommandHandlers);
+    }
+    static quint64 readSizeFromEnvironment(const char *name, quint64 defaultValue) {
+        const QString envVar = qgetenv(name);
+        bool ok{false};
+        const quint64 value{envVar.toULongLong(&ok)};
+        if (envVar.isEmpty() || !ok || value == 0) {
+            return defaultValue;
+        }
+        return value;
+    }
+    void lockMemory(void *memory, quint64 size, const char *description) {
+        int result = mlock(memory, size);
+        if (result == 0) {
+            lockedMemorySize += size;
+        } else {
+            qDebug() << Q_FUNC_INFO << "Error locking" << description << "memory" << strerror(result);
+        }
     }
+    // The total amount of memory we have locked (so it will not be paged out)
+    quint64 lockedMemorySize{0};
     SyncTimer *q{nullptr};
+    QTimer *timingStatisticsTimer{nullptr};
     SamplerSynth *samplerSynth{nullptr};
     TransportManager *transportManager{nullptr};
+    ModulationEngine *modulationEngine{nullptr};
+    // The number of steps the process call has gone through since we were started (paused or not), which drives the modulation engine
+    quint64 modulationStepCount{0};
+    unsigned char modulationEvents[ModulationEventCount * 3];
+    AutomationEngine *automationEngine{nullptr};
+    // A tempo measured from an external midi clock, waiting to be picked up by the process call (0 when there is none, see SyncTimer::setBpmFromExternalClock())
+    std::atomic<double> pendingExternalClockBpm{0};
+    unsigned char automationEvents[AutomationEventCount * 3];
+    double automationEventUsecs[AutomationEventCount];
     int playingClipsCount = 0;
     int beat = 0;
     quint64 cumulativeBeat = 0;
     int callbackCount{0};
     TimerCallback callbacks[CallbackSpaces];
+    TickSubscriber tickSubscribers[CallbackSpaces];
+    SyncTimerCallbackWorker *callbackWorker{nullptr};
+    // Set while the timer thread is calling tick subscribers, so removing a subscriber can wait until it is done with it
+    std::atomic<bool> dispatchingTicks{false};
+    /**
+     * \brief Hand the current tick to any subscribers which want it
+     * Subscribers who asked for delivery on the timer thread are called right away, and the tick is
+     * passed on to the callback worker if any other subscribers want it
+     */
+    void dispatchTick() {
+        SyncTimer_Tick tick;
+        tick.beat = beat;
+        tick.cumulativeBeat = cumulativeBeat;
+        tick.jackUsecs = 0;
+        bool hasUsecs{false};
+        bool wantedByWorker{false};
+        dispatchingTicks.store(true, std::memory_order_seq_cst);
+        for (int i = 0; i < CallbackSpaces; ++i) {
+            const TickSubscriber &subscriber = tickSubscribers[i];
+            if (subscriber.active.load(std::memory_order_seq_cst) && cumulativeBeat % subscriber.divisor == 0) {
+                if (!hasUsecs) {
+                    tick.jackUsecs = q->jackPlayheadUsecsForTick(cumulativeBeat);
+                    hasUsecs = true;
+                }
+                if (subscriber.useWorkerThread) {
+                    wantedByWorker = true;
+                } else {
+                    subscriber.callback(&tick, 1, subscriber.userData);
+                }
+            }
+        }
+        dispatchingTicks.store(false, std::memory_order_seq_cst);
+        if (wantedByWorker) {
+            callbackWorker->push(tick);
+        }
+    }
 
     ClipCommandRingEntry sentOutClipsRing[FreshCommandStashSize];
     ClipCommandRingEntry *sentOutClipsReadHead{nullptr};
     ClipCommandRingEntry *sentOutClipsWriteHead{nullptr};
+    ClipCommandsSentSubscriber clipCommandsSentSubscribers[CallbackSpaces];
+    // The number of threads currently handing sent clip commands to the subscribers, so removing a subscriber can wait until they are done with it
+    std::atomic<int> dispatchingSentClipCommands{0};
+    // Set on a thread while it is handing sent clip commands to the subscribers (so a subscriber can remove itself from inside its callback)
+    static inline thread_local bool isDispatchingSentClipCommands{false};
+    // Held while reading the sent clip commands and picking out the subscribers to hand them to, as both the timer thread and
+    // SyncTimer::stop() do so (never taken by the jack process call, and never held while calling the subscribers)
+    QMutex sentClipCommandsMutex;
+    // Whether to also emit SyncTimer::clipCommandSent for each sent clip command (see SyncTimer::emitClipCommandSent)
+    std::atomic<bool> emitClipCommandSent{false};
+    /**
+     * \brief Record that a clip command has been sent to SamplerSynth, so it can be announced by the timer thread
+     * @note Only call this from the jack process call
+     */
+    inline void markClipCommandSent(ClipCommand *clipCommand) {
+        sentOutClipsWriteHead->tick = jackPlayhead;
+        sentOutClipsWriteHead->clipCommand = clipCommand;
+        sentOutClipsWriteHead = sentOutClipsWriteHead->next;
+    }
+    /**
+     * \brief Announce all the clip commands sent out since the last time
+     * The subscribers get them in batches (usually just the one per call), and the per-command signal is only
+     * emitted if explicitly asked for
+     * @note You must not delete the commands themselves here, as SamplerSynth takes ownership of them
+     */
+    void notifySentClipCommands() {
+        struct Recipient {
+            SyncTimer::ClipCommandsSentCallback callback;
+            void *userData;
+        };
+        SyncTimer_SentClipCommand batch[SentClipCommandBatchSize];
+        Recipient recipients[CallbackSpaces];
+        while (true) {
+            int count{0};
+            int recipientCount{0};
+            sentClipCommandsMutex.lock();
+            while (sentOutClipsReadHead->clipCommand && count < SentClipCommandBatchSize) {
+                batch[count].clipCommand = sentOutClipsReadHead->clipCommand;
+                batch[count].tick = sentOutClipsReadHead->tick;
+                ++count;
+                sentOutClipsReadHead->clipCommand = nullptr;
+                sentOutClipsReadHead = sentOutClipsReadHead->next;
+            }
+            if (count > 0) {
+                // Announce that we are dispatching before looking at who is active (see SyncTimer::removeClipCommandsSentCallback())
+                dispatchingSentClipCommands.fetch_add(1, std::memory_order_seq_cst);
+                for (int i = 0; i < CallbackSpaces; ++i) {
+                    const ClipCommandsSentSubscriber &subscriber = clipCommandsSentSubscribers[i];
+                    if (subscriber.active.load(std::memory_order_seq_cst)) {
+                        recipients[recipientCount] = {subscriber.callback, subscriber.userData};
+                        ++recipientCount;
+                    }
+                }
+            }
+            sentClipCommandsMutex.unlock();
+            if (count == 0) {
+                break;
+            }
+            isDispatchingSentClipCommands = true;
+            for (int i = 0; i < recipientCount; ++i) {
+                recipients[i].callback(batch, count, recipients[i].userData);
+            }
+            isDispatchingSentClipCommands = false;
+            dispatchingSentClipCommands.fetch_sub(1, std::memory_order_seq_cst);
+            if (emitClipCommandSent) {
+                for (int i = 0; i < count; ++i) {
+                    Q_EMIT q->clipCommandSent(static_cast<ClipCommand*>(batch[i].clipCommand));
+                }
+            }
+        }
+    }
 
-    StepData stepRing[StepRingCount];
+    /**
+     * The schedule is a hierarchical timing wheel (see TimingWheel). The innermost level is the step ring, which
+     * holds the steps in the same stepRingCount sized block as the read head, and anything further into the future
+     * is held in one of the wheel's outer levels until the read head gets closer to it.
+     * The step ring has an occupancy bitmap, just like the outer levels, so going through everything that is
+     * currently scheduled only touches the steps and slots which actually contain something.
+     */
+    StepData *stepRing{nullptr};
+    quint64 stepRingCount{StepRingDefaultCount};
+    // One bit per step in the step ring, set when the step has not yet been played
+    quint64 *stepOccupancy{nullptr};
+    // Extra storage for steps which have more on them than fits in their inline storage
+    StepChunkSlab stepChunkSlab;
+    ScheduleWheel wheel;
     // The next step to be read in the step ring
     StepData* stepReadHead{nullptr};
+    // The absolute position of stepReadHead (that is, the number of steps read since we were created, and not wrapped to the ring size)
+    quint64 stepReadHeadPosition{0};
     quint64 stepNextPlaybackPosition{0};
+    double stepNextPlaybackPositionPrecise{0};
     /**
-     * \brief Get the ring buffer position based on the given delay from the current playback position (cumulativeBeat if playing, or stepReadHead if not playing)
+     * \brief Get the absolute step position based on the given delay from the current playback position (cumulativeBeat if playing, or stepReadHead if not playing)
+     * @note The position is not wrapped to fit inside the step ring, use stepForPosition() to fetch the step itself
      * @param delay The delay of the position to use
-     * @param ensureFresh Set this to false to disable the freshness insurance
-     * @return The stepRing position to use for the given delay
+     * @return The absolute step position to use for the given delay
      */
-    inline StepData* delayedStep(quint64 delay, bool ensureFresh = true) {
-        quint64 step{0};
+    inline quint64 delayedStepPosition(quint64 delay) const {
         if (isPaused) {
             // If paused, base the delay on the current stepReadHead
-            step = (stepReadHead->index + delay + 1) % StepRingCount;
+            return stepReadHeadPosition + delay + 1;
+        }
+        // If running, base the delay on the current cumulativeBeat (adjusted to at least stepReadHead, just in case)
+        return stepReadHeadOnStart + qMax(cumulativeBeat + delay, jackPlayhead + 1);
+    }
+    /**
+     * \brief Get the step for the given absolute step position, ready for adding things to
+     * @note Only call this from the jack process call
+     * @param position An absolute step position (anything before the current read head will be put on the read head)
+     * @return The step to add things to for the given position
+     */
+    inline StepData* stepForPosition(quint64 position) {
+        const quint64 index{qMax(position, stepReadHeadPosition) % stepRingCount};
+        StepData *stepData = &stepRing[index];
+        stepData->ensureFresh(&stepChunkSlab);
+        stepOccupancy[index / 64] |= (quint64(1) << (index % 64));
+        return stepData;
+    }
+    /**
+     * \brief Add a midi event to the given step (counting it as dropped if there is no space left for it)
+     */
+    inline void addMidiEvent(StepData *stepData, const quint8 *data, quint8 size, bool early, quint16 offset = 0) {
+        if (!stepData->addMidiEvent(&stepChunkSlab, data, size, early, offset)) {
+            ++scheduleQueueOverflowCount;
+        }
+    }
+    /**
+     * \brief Add a clip command to the given step (deleting it, and counting it as dropped, if there is no space left for it)
+     */
+    inline void addClipCommand(StepData *stepData, ClipCommand *command) {
+        if (!stepData->addClipCommand(&stepChunkSlab, command)) {
+            ++scheduleQueueOverflowCount;
+            unindexClipCommand(command);
+            q->deleteClipCommand(command);
+        }
+    }
+    /**
+     * \brief Add a timer command to the given step (deleting it, and counting it as dropped, if there is no space left for it)
+     */
+    inline void addTimerCommand(StepData *stepData, TimerCommand *command) {
+        if (!stepData->addTimerCommand(&stepChunkSlab, command)) {
+            ++scheduleQueueOverflowCount;
+            q->deleteTimerCommand(command);
+        }
+    }
+    /**
+     * \brief Mark the given step as having been played (and no longer occupied)
+     * @param stepData The step to mark as played
+     */
+    inline void markPlayed(StepData *stepData) {
+        stepData->played = true;
+        stepOccupancy[stepData->index / 64] &= ~(quint64(1) << (stepData->index % 64));
+    }
+    /**
+     * \brief Call the given function for each step in the step ring which has something on it, in playback order
+     * @note All occupied steps are in the same block as the read head, which means ring order is playback order
+     * @param function The function to call for each step
+     */
+    template<typename Function>
+    inline void forEachOccupiedStep(Function function) {
+        for (quint64 word = 0; word < stepRingCount / 64; ++word) {
+            quint64 bits = stepOccupancy[word];
+            while (bits) {
+                const int bit = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                function(&stepRing[word * 64 + bit]);
+            }
+        }
+    }
+    /**
+     * \brief Move records inwards from any outer level slot which starts at the current read head position
+     * @note Call this whenever the read head has moved forward
+     */
+    inline void advanceWheel() {
+        wheel.advance(stepReadHeadPosition, [this](const ScheduleRecord &record){
+            insertRecord(record);
+        });
+    }
+
+    ScheduleQueue scheduleQueue;
+    std::atomic<quint64> scheduleQueueOverflowCount{0};
+    std::atomic<quint64> scheduleQueueRejectedCount{0};
+    /**
+     * \brief Add a record to the schedule queue, and handle the record's data if there is no space for it
+     * @param record The record to add
+     * @return True if the record was added, false if it was not (at which point the data has been released)
+     */
+    bool enqueue(const ScheduleRecord &record) {
+        if (scheduleQueue.enqueue(record)) {
+            return true;
+        }
+        ++scheduleQueueOverflowCount;
+        releaseRecord(record);
+        return false;
+    }
+    /**
+     * \brief Add two records to the schedule queue, either both or neither (see ScheduleQueue::enqueuePair())
+     * @return True if both records were added, false if neither was (at which point the data of both has been released)
+     */
+    bool enqueuePair(const ScheduleRecord &first, const ScheduleRecord &second) {
+        if (scheduleQueue.enqueuePair(first, second)) {
+            return true;
+        }
+        ++scheduleQueueOverflowCount;
+        releaseRecord(first);
+        releaseRecord(second);
+        return false;
+    }
+    /**
+     * \brief Release any commands held by the given record
+     * @param record The record to release the data of
+     */
+    void releaseRecord(const ScheduleRecord &record) {
+        switch (record.type) {
+            case ScheduleRecord::ClipCommandType:
+            case ScheduleRecord::AppendClipCommandType:
+            case ScheduleRecord::StopClipCommandType:
+                q->deleteClipCommand(static_cast<ClipCommand*>(record.pointer));
+                break;
+            case ScheduleRecord::TimerCommandType:
+                q->deleteTimerCommand(static_cast<TimerCommand*>(record.pointer));
+                break;
+            case ScheduleRecord::TempoRampType:
+                tempoRampPool.release(static_cast<TempoRamp*>(record.pointer));
+                break;
+            case ScheduleRecord::GrooveType:
+                if (record.pointer) {
+                    groovePool.release(static_cast<GrooveTemplate*>(record.pointer));
+                }
+                break;
+            case ScheduleRecord::PartType:
+                if (record.pointer) {
+                    partPool.release(static_cast<PartPattern*>(record.pointer));
+                }
+                break;
+            case ScheduleRecord::MidiEventType:
+            case ScheduleRecord::PhaseAdjustmentType:
+            case ScheduleRecord::FlushType:
+            case ScheduleRecord::CancelClipCommandsType:
+            case ScheduleRecord::InvalidType:
+            default:
+                break;
+        }
+    }
+    /**
+     * \brief Add a midi event to the schedule queue
+     * @param position The absolute step position to put the event on
+     * @param data The event data
+     * @param size The size of the event (only events of up to three bytes are accepted)
+     * @param midiOrder Where on the step the event should be placed
+     * @param subTickOffset How far into the step the event should be sent, in 1/65536ths of a tick
+     * @return True if the event was added to the queue
+     */
+    bool enqueueMidiEvent(quint64 position, const unsigned char *data, int size, ScheduleRecord::MidiOrder midiOrder, quint16 subTickOffset = 0) {
+        if (size < 1 || size > 3) {
+            ++scheduleQueueRejectedCount;
+            return false;
+        }
+        return enqueue(midiEventRecord(position, data, size, midiOrder, subTickOffset));
+    }
+    static inline ScheduleRecord midiEventRecord(quint64 position, const unsigned char *data, int size, ScheduleRecord::MidiOrder midiOrder, quint16 subTickOffset) {
+        ScheduleRecord record;
+        record.step = position;
+        record.type = ScheduleRecord::MidiEventType;
+        record.midiOrder = midiOrder;
+        record.midiSize = quint8(size);
+        record.subTickOffset = subTickOffset;
+        for (int i = 0; i < size; ++i) {
+            record.midiBytes[i] = data[i];
+        }
+        return record;
+    }
+    /**
+     * \brief Add a note on and its matching note off to the schedule queue, either both or neither
+     * This way a note on never goes out without the note off which ends it
+     * @param onPosition The absolute step position of the note on
+     * @param onOffset The sub-tick offset of the note on
+     * @param offPosition The absolute step position of the note off
+     * @param offOffset The sub-tick offset of the note off
+     * @return True if both were added
+     */
+    bool enqueueNotePair(quint64 onPosition, quint16 onOffset, quint64 offPosition, quint16 offOffset, unsigned char midiChannel, unsigned char midiNote, unsigned char velocity) {
+        const unsigned char noteOn[3]{static_cast<unsigned char>(0x90 + midiChannel), midiNote, velocity};
+        const unsigned char noteOff[3]{static_cast<unsigned char>(0x80 + midiChannel), midiNote, 64};
+        return enqueuePair(midiEventRecord(onPosition, noteOn, 3, ScheduleRecord::NoteMidiOrder, onOffset), midiEventRecord(offPosition, noteOff, 3, ScheduleRecord::FirstMidiOrder, offOffset));
+    }
+    /**
+     * \brief Add a midi message longer than three bytes (such as a sysex message) to the schedule queue
+     * The message is sent at the start of the step, after the step's other midi events
+     * @param position The absolute step position to put the message on
+     * @param data The message data
+     * @param size The size of the message (up to LongMidiMessageSize bytes)
+     * @return True if the message was added to the queue
+     */
+    bool enqueueLongMidiEvent(quint64 position, const unsigned char *data, int size) {
+        if (size > LongMidiMessageSize) {
+            qWarning() << Q_FUNC_INFO << "Attempted to schedule a midi message of" << size << "bytes, but the largest message which can be scheduled is" << LongMidiMessageSize << "bytes";
+            ++scheduleQueueRejectedCount;
+            return false;
+        }
+        LongMidiMessage *message = longMidiMessagePool.acquire();
+        std::copy_n(data, size, message->data);
+        message->size = size;
+        TimerCommand *command = q->getTimerCommand();
+        command->operation = TimerCommand::SendLongMidiMessageOperation;
+        command->dataParameter = message;
+        return enqueuePointer(position, ScheduleRecord::TimerCommandType, command);
+    }
+    bool enqueueMidiBuffer(quint64 position, const juce::MidiBuffer &buffer, quint16 subTickOffset = 0) {
+        bool allAdded{true};
+        for (const juce::MidiMessageMetadata &message : buffer) {
+            const bool added{message.numBytes > 3
+                ? enqueueLongMidiEvent(position, message.data, message.numBytes)
+                : enqueueMidiEvent(position, message.data, message.numBytes, ScheduleRecord::AppendMidiOrder, subTickOffset)};
+            if (!added) {
+                allAdded = false;
+            }
+        }
+        return allAdded;
+    }
+    /**
+     * \brief What happened to the items of a batch (see enqueueBatch())
+     */
+    struct BatchOutcome {
+        int accepted{0}; ///< The number of items which were added to the queue
+        int late{0}; ///< The number of items which were due before the earliest position, and were moved onto it
+        quint64 latenessTicks{0}; ///< How many ticks late the latest of those items was
+        quint32 latenessOffset{0}; ///< The sub-tick part of that lateness, in 1/65536ths of a tick
+    };
+    /**
+     * \brief Add a batch of items to the schedule queue
+     * Each item is placed at its own position, and any item which would be before earliestPosition is moved onto it
+     * (and counted as late), so the items which are still in time keep their timing in relation to each other
+     * @param position The absolute step position the items' delays are counted from
+     * @param subTickOffset How far into the step the items' offsets are counted from, in 1/65536ths of a tick
+     * @param items The items to schedule
+     * @param count The number of items
+     * @param earliestPosition The earliest step any item can be put on (usually the next step to be played)
+     * @return What happened to the items
+     */
+    BatchOutcome enqueueBatch(quint64 position, quint16 subTickOffset, const SyncTimer_ScheduleItem *items, int count, quint64 earliestPosition = 0) {
+        BatchOutcome outcome;
+        for (int index = 0; index < count; ++index) {
+            const SyncTimer_ScheduleItem &item = items[index];
+            // The item's own offset is on top of the batch's offset, and may carry over into the next tick
+            const quint32 itemOffset{quint32(subTickOffset) + quint32(item.subTickOffset)};
+            const quint64 requestedPosition{position + item.delay + (itemOffset >> 16)};
+            const quint16 requestedOffset{quint16(itemOffset & 0xFFFF)};
+            quint64 itemPosition{requestedPosition};
+            quint16 offset{requestedOffset};
+            const bool late{requestedPosition < earliestPosition};
+            if (late) {
+                // Anything late goes on the next step to be played, as soon as possible (which is also what the process call would do with it)
+                itemPosition = earliestPosition;
+                offset = 0;
+            }
+            bool accepted{false};
+            switch (item.type) {
+                case SyncTimer_NoteItem:
+                    if (item.midiChannel >= 0 && item.midiChannel < 16 && item.midiNote >= 0 && item.midiNote < 128 && item.velocity >= 0 && item.velocity < 128) {
+                        if (item.setOn && item.duration > 0) {
+                            // The note off stays where it was asked to be, unless that would be before (or on the same step as) the note on, which it has to follow
+                            quint64 offPosition{requestedPosition + item.duration};
+                            quint16 offOffset{requestedOffset};
+                            if (offPosition <= itemPosition) {
+                                offPosition = itemPosition + 1;
+                                offOffset = 0;
+                            }
+                            accepted = enqueueNotePair(itemPosition, offset, offPosition, offOffset, item.midiChannel, item.midiNote, item.velocity);
+                        } else {
+                            unsigned char note[3];
+                            note[0] = (item.setOn ? 0x90 : 0x80) + item.midiChannel;
+                            note[1] = item.midiNote;
+                            note[2] = item.velocity;
+                            accepted = enqueueMidiEvent(itemPosition, note, 3, item.setOn ? ScheduleRecord::NoteMidiOrder : ScheduleRecord::FirstMidiOrder, offset);
+                        }
+                    }
+                    break;
+                case SyncTimer_MidiMessageItem:
+                    accepted = enqueueMidiEvent(itemPosition, item.midiBytes, item.midiSize, ScheduleRecord::AppendMidiOrder, offset);
+                    break;
+                case SyncTimer_ClipItem:
+                    // Clips play on sampler channels, so that is what midiChannel means here (-2 through 9)
+                    if (item.clip && item.midiChannel >= -2 && item.midiChannel < 10 && item.midiNote >= 0 && item.midiNote < 128) {
+                        ClipCommand *command = ClipCommand::channelCommand(item.clip, item.midiChannel);
+                        command->midiNote = item.midiNote;
+                        command->subTickOffset = offset;
+                        if (item.setOn) {
+                            command->changeVolume = true;
+                            command->volume = item.volume;
+                            command->looping = item.looping;
+                            if (item.looping) {
+                                command->stopPlayback = true; // this stops any current loop plays, and immediately starts a new one
+                            }
+                            command->startPlayback = true;
+                        } else {
+                            command->stopPlayback = true;
+                        }
+                        accepted = enqueuePointer(itemPosition, ScheduleRecord::ClipCommandType, command);
+                    }
+                    break;
+                case SyncTimer_TimerCommandItem:
+                    // Only operations which can be described by the integer parameters can be scheduled this way (so none which need dataParameter)
+                    if (item.operation > TimerCommand::InvalidOperation && item.operation < TimerCommandHandlerCount && item.operation != TimerCommand::ClipCommandOperation) {
+                        TimerCommand *command = q->getTimerCommand();
+                        command->operation = static_cast<TimerCommand::Operation>(item.operation);
+                        command->parameter = item.parameter1;
+                        command->parameter2 = item.parameter2;
+                        command->parameter3 = item.parameter3;
+                        command->parameter4 = item.parameter4;
+                        accepted = enqueuePointer(itemPosition, ScheduleRecord::TimerCommandType, command);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (accepted) {
+                ++outcome.accepted;
+                if (late) {
+                    ++outcome.late;
+                    const quint64 lateness{((earliestPosition - requestedPosition) << 16) - requestedOffset};
+                    if ((lateness >> 16) > outcome.latenessTicks || ((lateness >> 16) == outcome.latenessTicks && quint32(lateness & 0xFFFF) > outcome.latenessOffset)) {
+                        outcome.latenessTicks = lateness >> 16;
+                        outcome.latenessOffset = quint32(lateness & 0xFFFF);
+                    }
+                }
+            }
+        }
+        return outcome;
+    }
+    bool enqueuePointer(quint64 position, ScheduleRecord::Type type, void *pointer) {
+        ScheduleRecord record;
+        record.step = position;
+        record.type = type;
+        record.pointer = pointer;
+        return enqueue(record);
+    }
+
+    /**
+     * \brief Move everything in the schedule queue into the timing wheel
+     * @note Only call this from the jack process call (and do so at the start, before reading any steps)
+     */
+    void drainScheduleQueue() {
+        ScheduleRecord record;
+        while (scheduleQueue.dequeue(record)) {
+            if (record.type == ScheduleRecord::TimerCommandType) {
+                const TimerCommand *command = static_cast<TimerCommand*>(record.pointer);
+                if (command->operation == TimerCommand::StartPartOperation || command->operation == TimerCommand::StopPartOperation) {
+                    schedulePartTransition(command, qMax(record.step, stepReadHeadPosition));
+                }
+            }
+            insertRecord(record);
+        }
+    }
+    /**
+     * \brief Put the given record into the timing wheel
+     * If the record's position is in the same block as the read head, it is put straight into the step ring,
+     * and otherwise it is held in the appropriate outer level until the read head gets closer to it.
+     * @note Only call this from the jack process call
+     * @param record The record to put into the wheel
+     */
+    void insertRecord(const ScheduleRecord &record) {
+        if (record.type == ScheduleRecord::FlushType) {
+            flushSchedule();
+            return;
+        } else if (record.type == ScheduleRecord::CancelClipCommandsType) {
+            cancelClipCommands(static_cast<ClipAudioSource*>(record.pointer), record.parameter);
+            return;
+        } else if (record.type == ScheduleRecord::PhaseAdjustmentType) {
+            // Moving the upcoming step positions shifts the whole of playback (the steps are laid out relative to the previous one)
+            stepNextPlaybackPositionPrecise -= double(record.parameter);
+            stepNextPlaybackPosition = jack_time_t(stepNextPlaybackPositionPrecise);
+            if (!isPaused) {
+                jackNextPlaybackPositionPrecise -= double(record.parameter);
+                jackNextPlaybackPosition = jack_time_t(jackNextPlaybackPositionPrecise);
+            }
+            return;
+        } else if (record.type == ScheduleRecord::TempoRampType) {
+            TempoRamp *previousPendingRamp{pendingTempoRamp};
+            TempoRamp *previousActiveRamp{activeTempoRamp};
+            pendingTempoRamp = static_cast<TempoRamp*>(record.pointer);
+            activeTempoRamp = nullptr;
+            tempoMapRamp.store(pendingTempoRamp);
+            if (previousPendingRamp) {
+                retireTempoRamp(previousPendingRamp);
+            }
+            if (previousActiveRamp) {
+                retireTempoRamp(previousActiveRamp);
+            }
+            return;
+        } else if (record.type == ScheduleRecord::GrooveType) {
+            if (grooves[record.parameter]) {
+                groovePool.release(grooves[record.parameter]);
+            }
+            grooves[record.parameter] = static_cast<GrooveTemplate*>(record.pointer);
+            if (record.pointer) {
+                grooveChannelMask |= quint16(1 << record.parameter);
+            } else {
+                grooveChannelMask &= quint16(~(1 << record.parameter));
+            }
+            return;
+        } else if (record.type == ScheduleRecord::PartType) {
+            // Replacing a part keeps its playback going (picking up at the same point in the new part), and unregistering it stops it
+            PartPlayback &playback = partPlayback[record.parameter];
+            if (playback.pattern) {
+                if (!record.pointer && playback.playing) {
+                    stopPartClips(playback, stepReadHeadPosition);
+                }
+                partPool.release(playback.pattern);
+            }
+            playback.pattern = static_cast<PartPattern*>(record.pointer);
+            if (!playback.pattern) {
+                playback.playing = false;
+                playback.transitionCount = 0;
+            }
+            return;
+        }
+        const quint64 position{qMax(record.step, stepReadHeadPosition)};
+        if (record.type == ScheduleRecord::ClipCommandType || record.type == ScheduleRecord::AppendClipCommandType || record.type == ScheduleRecord::StopClipCommandType) {
+            ClipCommand *command = static_cast<ClipCommand*>(record.pointer);
+            // This might be a command coming in from an outer level of the wheel, so make sure it's not already in the index
+            unindexClipCommand(command);
+            if (command->cancelled) {
+                q->deleteClipCommand(command);
+                return;
+            }
+            if (record.type == ScheduleRecord::StopClipCommandType) {
+                cancelClipCommands(command->clip, AnyMidiChannel);
+            }
+            if (!indexClipCommand(command, position, record.type == ScheduleRecord::ClipCommandType)) {
+                // The command was merged into an equivalent one which is already scheduled, so we're done
+                return;
+            }
+        }
+        if (position / stepRingCount == stepReadHeadPosition / stepRingCount) {
+            StepData *stepData = stepForPosition(position);
+            switch (record.type) {
+                case ScheduleRecord::MidiEventType:
+                    addMidiEvent(stepData, record.midiBytes, record.midiSize, record.midiOrder == ScheduleRecord::FirstMidiOrder, record.subTickOffset);
+                    break;
+                case ScheduleRecord::ClipCommandType:
+                case ScheduleRecord::AppendClipCommandType:
+                case ScheduleRecord::StopClipCommandType:
+                    addClipCommand(stepData, static_cast<ClipCommand*>(record.pointer));
+                    break;
+                case ScheduleRecord::TimerCommandType:
+                    addTimerCommand(stepData, static_cast<TimerCommand*>(record.pointer));
+                    break;
+                case ScheduleRecord::FlushType:
+                case ScheduleRecord::CancelClipCommandsType:
+                case ScheduleRecord::InvalidType:
+                default:
+                    break;
+            }
         } else {
-            // If running, base the delay on the current cumulativeBeat (adjusted to at least stepReadHead, just in case)
-            step = (stepReadHeadOnStart + qMax(cumulativeBeat + delay, jackPlayhead + 1)) % StepRingCount;
+            if (wheel.add(record, position, stepReadHeadPosition)) {
+                return;
+            }
+            // Either we've run out of space for deferred records, or this is further into the future than the wheel reaches
+            ++scheduleQueueOverflowCount;
+            if (record.type == ScheduleRecord::ClipCommandType || record.type == ScheduleRecord::AppendClipCommandType || record.type == ScheduleRecord::StopClipCommandType) {
+                unindexClipCommand(static_cast<ClipCommand*>(record.pointer));
+            }
+            releaseRecord(record);
+        }
+    }
+    /**
+     * \brief Empty out everything that is currently scheduled
+     * All scheduled and held midi messages are dropped, and instead a note off is sent out for each note which
+     * is actually sounding (see ActiveNoteLedger), so the cost of silencing things depends on how many notes are
+     * sounding, not on how much was scheduled. Any clip commands are run on the current step, but with the volume
+     * set to 0, so we end up in a clean state, without any noise, and timer commands are deleted.
+     * @note Only call this from the jack process call
+     */
+    void flushSchedule() {
+        StepData *target = stepForPosition(stepReadHeadPosition);
+        forEachOccupiedStep([this, target](StepData *stepData){
+            stepData->retainClipCommands([this](ClipCommand *clipCommand){
+                if (clipCommand->cancelled) {
+                    q->deleteClipCommand(clipCommand);
+                    return false;
+                }
+                clipCommand->changeVolume = true;
+                clipCommand->volume = 0;
+                return true;
+            });
+            stepData->forEachTimerCommand([this](TimerCommand *timerCommand){
+                q->deleteTimerCommand(timerCommand);
+            });
+            stepData->clearTimerCommands();
+            stepData->clearMidiEvents();
+            if (stepData != target) {
+                stepData->forEachClipCommand([this, target](ClipCommand *clipCommand){
+                    unindexClipCommand(clipCommand);
+                    if (indexClipCommand(clipCommand, stepReadHeadPosition, true)) {
+                        addClipCommand(target, clipCommand);
+                    }
+                });
+                stepData->clearClipCommands();
+                markPlayed(stepData);
+            }
+        });
+        wheel.forEach([this, target](const ScheduleRecord &record){
+            switch (record.type) {
+                case ScheduleRecord::ClipCommandType:
+                case ScheduleRecord::AppendClipCommandType:
+                case ScheduleRecord::StopClipCommandType:
+                    {
+                        ClipCommand *clipCommand = static_cast<ClipCommand*>(record.pointer);
+                        unindexClipCommand(clipCommand);
+                        if (clipCommand->cancelled) {
+                            q->deleteClipCommand(clipCommand);
+                        } else {
+                            clipCommand->changeVolume = true;
+                            clipCommand->volume = 0;
+                            if (indexClipCommand(clipCommand, stepReadHeadPosition, true)) {
+                                addClipCommand(target, clipCommand);
+                            }
+                        }
+                    }
+                    break;
+                default:
+                    releaseRecord(record);
+                    break;
+            }
+            return true;
+        });
+        heldMidiEventCount = 0;
+        noteOffsRequested = true;
+        resetPartPlayback();
+    }
+    /**
+     * The index of scheduled clip commands, used to find the commands for a specific clip without having to
+     * look through the schedule. Each bucket is a list of all the scheduled commands (both in the step ring
+     * and the outer levels of the timing wheel) for the clips which hash to that bucket, which means that
+     * finding the commands for a clip (matched further on channel and note or slice) is O(commands for that clip).
+     * The list links are stored on the commands themselves, so maintaining the index never allocates.
+     * @note The index is only ever touched from the jack process call
+     */
+    ClipCommand *clipIndex[ClipIndexBucketCount];
+    static inline quint64 clipIndexBucket(const ClipAudioSource *clip) {
+        return (((quintptr(clip) >> 4) * 0x9E3779B97F4A7C15ull) >> 32) & (ClipIndexBucketCount - 1);
+    }
+    /**
+     * \brief Add the given command to the index of scheduled clip commands
+     * @param command The command to add to the index
+     * @param position The absolute step position the command is scheduled for
+     * @param mergeEquivalent If true, and an equivalent command is already scheduled on the same position, the new command's changes will be merged into that one instead
+     * @return False if the command was merged into an existing one (and has been deleted), otherwise true
+     */
+    bool indexClipCommand(ClipCommand *command, quint64 position, bool mergeEquivalent) {
+        ClipCommand *&bucket = clipIndex[clipIndexBucket(command->clip)];
+        if (mergeEquivalent) {
+            for (ClipCommand *existingCommand = bucket; existingCommand; existingCommand = existingCommand->indexNext) {
+                if (existingCommand->scheduledStep == position && existingCommand->equivalentTo(command)) {
+                    if (command->changeLooping) {
+                        existingCommand->looping = command->looping;
+                        existingCommand->changeLooping = true;
+                    }
+                    if (command->changePitch) {
+                        existingCommand->pitchChange = command->pitchChange;
+                        existingCommand->changePitch = true;
+                    }
+                    if (command->changeSpeed) {
+                        existingCommand->speedRatio = command->speedRatio;
+                        existingCommand->changeSpeed = true;
+                    }
+                    if (command->changeGainDb) {
+                        existingCommand->gainDb = command->gainDb;
+                        existingCommand->changeGainDb = true;
+                    }
+                    if (command->changeVolume) {
+                        existingCommand->volume = command->volume;
+                        existingCommand->changeVolume = true;
+                    }
+                    if (command->startPlayback) {
+                        existingCommand->startPlayback = true;
+                    }
+                    q->deleteClipCommand(command);
+                    return false;
+                }
+            }
         }
-        StepData *stepData = &stepRing[step];
-        if (ensureFresh) {
-            stepData->ensureFresh();
+        command->scheduledStep = position;
+        command->indexPrevious = nullptr;
+        command->indexNext = bucket;
+        if (bucket) {
+            bucket->indexPrevious = command;
+        }
+        bucket = command;
+        command->indexed = true;
+        return true;
+    }
+    /**
+     * \brief Remove the given command from the index of scheduled clip commands (if it is in it)
+     * @param command The command to remove from the index
+     */
+    void unindexClipCommand(ClipCommand *command) {
+        if (command->indexed) {
+            if (command->indexPrevious) {
+                command->indexPrevious->indexNext = command->indexNext;
+            } else {
+                clipIndex[clipIndexBucket(command->clip)] = command->indexNext;
+            }
+            if (command->indexNext) {
+                command->indexNext->indexPrevious = command->indexPrevious;
+            }
+            command->indexPrevious = command->indexNext = nullptr;
+            command->indexed = false;
+        }
+    }
+    /**
+     * \brief Cancel all scheduled commands for the given clip on the given midi channel
+     * The commands are marked as cancelled and removed from the index, and will be deleted
+     * rather than run once the schedule reaches them.
+     * @param clip The clip to cancel commands for
+     * @param midiChannel The midi channel to cancel commands on (or AnyMidiChannel for all channels)
+     */
+    void cancelClipCommands(ClipAudioSource *clip, int midiChannel) {
+        ClipCommand *command = clipIndex[clipIndexBucket(clip)];
+        while (command) {
+            ClipCommand *next = command->indexNext;
+            if (command->clip == clip && (midiChannel == AnyMidiChannel || command->midiChannel == midiChannel)) {
+                unindexClipCommand(command);
+                command->cancelled = true;
+            }
+            command = next;
+        }
+    }
+
+    ObjectPool<ClipCommand, FreshCommandStashSize> clipCommandPool;
+    // Deleted clip commands, pushed from any thread and picked up by the process call (see SyncTimer::deleteClipCommand())
+    std::atomic<ClipCommand*> newlyRetiredClipCommands{nullptr};
+    // The retired clip commands picked up by the process call, oldest first, waiting for their grace period to end (only touched by the process call)
+    ClipCommand *retiredClipCommandsFirst{nullptr};
+    ClipCommand *retiredClipCommandsLast{nullptr};
+    /**
+     * \brief Hold on to a deleted clip command until ClipCommandReleaseGracePeriod has passed, before returning it to the pool
+     * @note This is safe to call from any thread (including the jack process call)
+     */
+    void retireClipCommand(ClipCommand *command) {
+        command->retiredAt = jack_get_time();
+        ClipCommand *head{newlyRetiredClipCommands.load(std::memory_order_relaxed)};
+        do {
+            command->nextRetired = head;
+        } while (!newlyRetiredClipCommands.compare_exchange_weak(head, command, std::memory_order_release, std::memory_order_relaxed));
+    }
+    /**
+     * \brief Return the retired clip commands whose grace period has ended to the pool
+     * @note Only call this from the process call
+     * @param now The current jack time
+     */
+    void releaseRetiredClipCommands(quint64 now) {
+        // The newly retired commands are newest first, so turn them around before adding them to the end of the list
+        ClipCommand *newlyRetired{newlyRetiredClipCommands.exchange(nullptr, std::memory_order_acquire)};
+        ClipCommand *newestRetired{newlyRetired};
+        ClipCommand *reversed{nullptr};
+        while (newlyRetired) {
+            ClipCommand *next{newlyRetired->nextRetired};
+            newlyRetired->nextRetired = reversed;
+            reversed = newlyRetired;
+            newlyRetired = next;
+        }
+        if (reversed) {
+            if (retiredClipCommandsLast) {
+                retiredClipCommandsLast->nextRetired = reversed;
+            } else {
+                retiredClipCommandsFirst = reversed;
+            }
+            retiredClipCommandsLast = newestRetired;
+        }
+        while (retiredClipCommandsFirst && retiredClipCommandsFirst->retiredAt + ClipCommandReleaseGracePeriod <= now) {
+            ClipCommand *command{retiredClipCommandsFirst};
+            retiredClipCommandsFirst = command->nextRetired;
+            clipCommandPool.release(command);
+        }
+        if (!retiredClipCommandsFirst) {
+            retiredClipCommandsLast = nullptr;
+        }
+    }
+    ObjectPool<TimerCommand, FreshCommandStashSize> timerCommandPool;
+    ObjectPool<LongMidiMessage, LongMidiMessagePoolSize> longMidiMessagePool;
+    // The registered timer command handlers, indexed by operation (see SyncTimer::registerTimerCommandHandler())
+    // Replaced entries are kept until we are destroyed, as the process call might still be using them
+    struct TimerCommandHandlerEntry {
+        TimerCommandHandler handler{nullptr};
+        void *userData{nullptr};
+    };
+    std::atomic<TimerCommandHandlerEntry*> timerCommandHandlers[TimerCommandHandlerCount];
+    QList<TimerCommandHandlerEntry*> retiredTimerCommandHandlers;
+    QMutex timerCommandHandlersMutex;
+    static bool isBuiltInTimerCommand(int operation) {
+        switch (operation) {
+            case TimerCommand::StartPlaybackOperation:
+            case TimerCommand::StopPlaybackOperation:
+            case TimerCommand::StartPartOperation:
+            case TimerCommand::StopPartOperation:
+            case TimerCommand::StartClipLoopOperation:
+            case TimerCommand::StopClipLoopOperation:
+            case TimerCommand::ClipCommandOperation:
+            case TimerCommand::SetBpmOperation:
+            case TimerCommand::RegisterCASOperation:
+            case TimerCommand::UnregisterCASOperation:
+            case TimerCommand::SendLongMidiMessageOperation:
+            case TimerCommand::AutomationLaneOperation:
+                return true;
+            default:
+                return false;
+        }
+    }
+    ObjectPool<TempoRamp, TempoRampPoolSize> tempoRampPool;
+    ObjectPool<GrooveTemplate, GroovePoolSize> groovePool;
+    // The groove template for each midi channel (only touched by the jack process call)
+    GrooveTemplate *grooves[GrooveChannelCount]{};
+    // A bit for each midi channel which has a groove template, so playback can skip all the groove work when there are none
+    quint16 grooveChannelMask{0};
+    // The groove displacement of the most recent note on for each channel and note, which its note off is displaced by as well
+    qint32 grooveNoteOnDisplacement[16][128]{};
+    // The time the most recent note on for each channel and note was sent (or held) for, so its note off is never sent before it
+    double noteOnUsecs[16][128]{};
+
+    ObjectPool<PartPattern, PartPoolSize> partPool;
+    // The registered part and playback state for each part slot (only touched by the jack process call)
+    PartPlayback partPlayback[PartSlotCount];
+    // A bit for each part slot which is playing, or waiting to start or stop, so playback only has to look at those
+    quint64 activePartSlots[(PartSlotCount + 63) / 64]{};
+    static inline int partSlot(int channel, int track, int part) {
+        if (channel < 0 || channel >= PartChannelCount || track < 0 || track >= PartTrackCount || part < 0 || part >= PartsPerTrack) {
+            return -1;
+        }
+        return (((channel * PartTrackCount) + track) * PartsPerTrack) + part;
+    }
+    /**
+     * \brief Handle a part start or stop timer command, as it comes in from the schedule queue
+     * This is done as the command is scheduled (rather than when it is played) so that the part's first step is
+     * expanded before it is played, which is what makes starting and stopping exact to the step.
+     * Each part slot holds on to a number of transitions (see PartTransitionCount), so several starts and stops can
+     * be scheduled ahead of time. Transitions on the same step happen in the order they were scheduled.
+     * @note Only call this from the jack process call
+     */
+    void schedulePartTransition(const TimerCommand *command, quint64 position) {
+        const int slot{partSlot(command->parameter, command->parameter2, command->parameter3)};
+        if (slot > -1) {
+            PartPlayback &playback = partPlayback[slot];
+            if (playback.transitionCount == PartTransitionCount) {
+                // There is no more space for this part's transitions, so this one is dropped
+                ++scheduleQueueOverflowCount;
+                return;
+            }
+            int index{playback.transitionCount};
+            while (index > 0 && playback.transitions[index - 1].position > position) {
+                playback.transitions[index] = playback.transitions[index - 1];
+                --index;
+            }
+            playback.transitions[index].position = position;
+            playback.transitions[index].start = (command->operation == TimerCommand::StartPartOperation);
+            ++playback.transitionCount;
+            activePartSlots[slot / 64] |= (quint64(1) << (slot % 64));
+        }
+    }
+    /**
+     * \brief Stop playback of all parts, and forget any pending starts and stops
+     * @note Only call this from the jack process call
+     */
+    void resetPartPlayback() {
+        for (PartPlayback &playback : partPlayback) {
+            playback.playing = false;
+            playback.transitionCount = 0;
+        }
+        std::fill_n(activePartSlots, (PartSlotCount + 63) / 64, 0);
+    }
+    /**
+     * \brief Put the items for all playing parts which belong on the given step into the schedule
+     * @note Only call this from the jack process call, before the step at the given position is read
+     * @param position The absolute step position about to be played
+     */
+    void expandParts(quint64 position) {
+        for (int word = 0; word < (PartSlotCount + 63) / 64; ++word) {
+            quint64 bits{activePartSlots[word]};
+            while (bits) {
+                const int slot{(word * 64) + __builtin_ctzll(bits)};
+                bits &= bits - 1;
+                PartPlayback &playback = partPlayback[slot];
+                int handledTransitions{0};
+                while (handledTransitions < playback.transitionCount && playback.transitions[handledTransitions].position <= position) {
+                    if (playback.transitions[handledTransitions].start) {
+                        playback.playing = true;
+                        playback.origin = position;
+                    } else {
+                        if (playback.playing) {
+                            stopPartClips(playback, position);
+                        }
+                        playback.playing = false;
+                    }
+                    ++handledTransitions;
+                }
+                if (handledTransitions > 0) {
+                    std::copy(playback.transitions + handledTransitions, playback.transitions + playback.transitionCount, playback.transitions);
+                    playback.transitionCount -= handledTransitions;
+                }
+                if (playback.playing && playback.pattern && playback.pattern->length > 0) {
+                    const PartPattern *pattern{playback.pattern};
+                    const quint32 partStep{quint32((position - playback.origin) % pattern->length)};
+                    const PartItem *item{std::lower_bound(pattern->items, pattern->items + pattern->itemCount, partStep, [](const PartItem &item, quint32 step){ return item.step < step; })};
+                    for (; item != pattern->items + pattern->itemCount && item->step == partStep; ++item) {
+                        expandPartItem(*item, position);
+                    }
+                } else if (!playback.playing && playback.transitionCount == 0) {
+                    activePartSlots[word] &= ~(quint64(1) << (slot % 64));
+                }
+            }
+        }
+    }
+    void expandPartItem(const PartItem &item, quint64 position) {
+        ScheduleRecord record;
+        record.step = position;
+        record.subTickOffset = item.subTickOffset;
+        switch (item.type) {
+            case SyncTimer_NoteItem:
+                record.type = ScheduleRecord::MidiEventType;
+                record.midiSize = 3;
+                std::copy_n(item.midiBytes, 3, record.midiBytes);
+                record.midiOrder = (item.midiBytes[0] & 0xF0) == 0x90 ? ScheduleRecord::NoteMidiOrder : ScheduleRecord::FirstMidiOrder;
+                insertRecord(record);
+                if (item.duration > 0) {
+                    record.step = position + item.duration;
+                    record.midiBytes[0] = 0x80 + (item.midiBytes[0] & 0x0F);
+                    record.midiBytes[2] = 64;
+                    record.midiOrder = ScheduleRecord::FirstMidiOrder;
+                    insertRecord(record);
+                }
+                break;
+            case SyncTimer_MidiMessageItem:
+                record.type = ScheduleRecord::MidiEventType;
+                record.midiSize = item.midiSize;
+                std::copy_n(item.midiBytes, 3, record.midiBytes);
+                record.midiOrder = ScheduleRecord::AppendMidiOrder;
+                insertRecord(record);
+                break;
+            case SyncTimer_ClipItem:
+                {
+                    ClipCommand *command = ClipCommand::channelCommand(item.clip, item.channel);
+                    command->midiNote = item.midiBytes[1];
+                    command->subTickOffset = item.subTickOffset;
+                    if (item.setOn) {
+                        command->changeVolume = true;
+                        command->volume = item.volume;
+                        command->looping = item.looping;
+                        if (item.looping) {
+                            command->stopPlayback = true; // this stops any current loop plays, and immediately starts a new one
+                        }
+                        command->startPlayback = true;
+                    } else {
+                        command->stopPlayback = true;
+                    }
+                    record.type = ScheduleRecord::ClipCommandType;
+                    record.pointer = command;
+                    insertRecord(record);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    // Stop any looping clips the part has started, as they would otherwise keep playing after the part has stopped
+    void stopPartClips(const PartPlayback &playback, quint64 position) {
+        if (playback.pattern) {
+            for (int index = 0; index < playback.pattern->itemCount; ++index) {
+                const PartItem &item = playback.pattern->items[index];
+                if (item.type == SyncTimer_ClipItem && item.setOn && item.looping) {
+                    ClipCommand *command = ClipCommand::channelCommand(item.clip, item.channel);
+                    command->midiNote = item.midiBytes[1];
+                    command->stopPlayback = true;
+                    ScheduleRecord record;
+                    record.step = position;
+                    record.type = ScheduleRecord::ClipCommandType;
+                    record.pointer = command;
+                    insertRecord(record);
+                }
+            }
+        }
+    }
+
+    // The tempo ramp waiting to start (only touched by the jack process call)
+    TempoRamp *pendingTempoRamp{nullptr};
+    // The tempo ramp currently playing (only touched by the jack process call)
+    TempoRamp *activeTempoRamp{nullptr};
+    // Whichever of the two above is the most relevant for working out future step times (this is for reading outside the jack process call)
+    std::atomic<TempoRamp*> tempoMapRamp{nullptr};
+    // The number of threads currently reading the ramp in tempoMapRamp (see tempoMapDuration())
+    mutable std::atomic<int> tempoMapReaders{0};
+    // Ramps which are no longer in tempoMapRamp, but which might still be being read (only touched by the jack process call)
+    TempoRamp *retiredTempoRamps{nullptr};
+    /**
+     * \brief Hand a ramp back to the pool once nobody can be reading it any longer
+     * Call this only after the ramp has been replaced in tempoMapRamp. A reader which started after that will only
+     * see the new ramp, so once there are no readers left, the retired ramps can safely be reused.
+     * @param ramp The ramp to release
+     */
+    void retireTempoRamp(TempoRamp *ramp) {
+        ramp->nextRetired = retiredTempoRamps;
+        retiredTempoRamps = ramp;
+        releaseRetiredTempoRamps();
+    }
+    // Release the retired ramps, if there is nobody reading the tempo map right now (otherwise we try again next cycle)
+    void releaseRetiredTempoRamps() {
+        if (retiredTempoRamps && tempoMapReaders.load() == 0) {
+            while (retiredTempoRamps) {
+                TempoRamp *ramp{retiredTempoRamps};
+                retiredTempoRamps = ramp->nextRetired;
+                tempoRampPool.release(ramp);
+            }
+        }
+    }
+    // The length of a step in microseconds at the current bpm (outside of any tempo ramp)
+    double currentSubbeatLengthInMicroseconds{SyncTimerThread::subbeatLengthInMicroseconds(120)};
+    /**
+     * \brief The amount of time between the start of two steps, according to the current tempo map
+     * @param fromPosition The absolute position of the first step
+     * @param toPosition The absolute position of the second step
+     * @return The number of microseconds between the two steps (negative if toPosition is before fromPosition)
+     */
+    double tempoMapDuration(quint64 fromPosition, quint64 toPosition) const {
+        // Registering as a reader before picking up the ramp keeps the process call from reusing it while we read it (see retireTempoRamp())
+        ++tempoMapReaders;
+        double duration{(double(toPosition) - double(fromPosition)) * currentSubbeatLengthInMicroseconds};
+        const TempoRamp *ramp = tempoMapRamp.load();
+        if (ramp) {
+            duration = ramp->timeAtStep(qint64(toPosition - ramp->startPosition), currentSubbeatLengthInMicroseconds) - ramp->timeAtStep(qint64(fromPosition - ramp->startPosition), currentSubbeatLengthInMicroseconds);
+        }
+        --tempoMapReaders;
+        return duration;
+    }
+    // Whether we are following the jack transport (see SyncTimer::jackTransportFollower)
+    std::atomic<bool> jackTransportFollower{false};
+    // The metronome settings (see SyncTimer::metronomeEnabled and friends)
+    std::atomic<bool> metronomeEnabled{false};
+    std::atomic<float> metronomeVolume{1.0f};
+    std::atomic<bool> metronomeAccent{true};
+    std::atomic<int> metronomeOpeningBars{0};
+    // The bar at which the opening bars of the current playback session end (only touched by the process call)
+    int32_t metronomeOpeningEndBar{0};
+    // How long to delay events for each midi channel, and clip commands for SamplerSynth, so that all the destinations
+    // sound together, in microseconds (see SyncTimer::setMidiChannelLatencyCompensation())
+    std::atomic<quint32> midiChannelLatencyCompensation[16];
+    std::atomic<quint32> samplerLatencyCompensation{0};
+    // A bit for each midi channel which has a compensation, so steps without any can skip holding their events
+    std::atomic<quint16> midiChannelLatencyCompensationMask{0};
+    // Set once we have asked for playback to start (or stop) to match the jack transport, until the timer has done so
+    // (touched by both the jack process call and the transport's sync callback, which may run on different threads)
+    std::atomic<bool> followerStartRequested{false};
+    std::atomic<bool> followerStopRequested{false};
+    // The most recent bpm we told the world about while following the jack transport
+    double followerNotifiedBpm{0};
+    /**
+     * \brief The position of the jack transport, in timer ticks
+     * @param position A jack transport position
+     * @return The number of ticks since the start of the song (including any fraction of a tick)
+     */
+    double transportTick(const jack_position_t &position) const {
+        if ((position.valid & JackPositionBBT) && position.ticks_per_beat > 0 && position.bar > 0) {
+            // The transport's bars may not be the same length as ours, so count the beats, and work out ticks from that
+            const double beats{(double(position.bar - 1) * double(position.beats_per_bar)) + double(position.beat - 1) + (double(position.tick) / position.ticks_per_beat)};
+            return beats * BeatSubdivisions;
+        } else if (position.frame_rate > 0) {
+            // Without bar/beat/tick information, all we can do is work out where the frame would be at our own bpm
+            return (double(position.frame) * 1000000.0) / (double(position.frame_rate) * currentSubbeatLengthInMicroseconds);
+        }
+        return 0;
+    }
+    /**
+     * \brief Match our bpm and playback position to the jack transport's, for this process cycle
+     * @param currentUsecs The time at which the current process cycle starts
+     * @param nextUsecs The time at which the next process cycle starts
+     * @param stepBpm Set to the transport's bpm, if it has one
+     * @param stepLength Set to the length of a step at the transport's bpm, if it has one
+     */
+    void followJackTransport(jack_time_t currentUsecs, jack_time_t nextUsecs, double &stepBpm, double &stepLength) {
+        jack_position_t position;
+        const jack_transport_state_t state = jack_transport_query(jackClient, &position);
+        if ((position.valid & JackPositionBBT) && position.beats_per_minute > 0) {
+            const double transportBpm{std::clamp<double>(position.beats_per_minute, BPM_MINIMUM, BPM_MAXIMUM)};
+            if (transportBpm != jackPlayheadBpm) {
+                jackPlayheadBpm = stepBpm = transportBpm;
+                stepLength = currentSubbeatLengthInMicroseconds = SyncTimerThread::subbeatLengthInMicroseconds(transportBpm);
+                // The transport might well be ramping its tempo, so only tell the world when the change is noticeable
+                const bool notify{std::abs(transportBpm - followerNotifiedBpm) >= 0.01};
+                if (notify) {
+                    followerNotifiedBpm = transportBpm;
+                }
+                updateBpmFromProcess(transportBpm, stepLength, notify);
+            }
+        }
+        if (isPaused) {
+            followerStopRequested = false;
+            if (state == JackTransportRolling && followerStartRequested.exchange(true) == false) {
+                // The transport is already rolling (otherwise our sync callback would have started us), so join in on the beat after next
+                const double tick{transportTick(position)};
+                relocatedStartPosition = (quint64(tick / BeatSubdivisions) + 2) * BeatSubdivisions;
+                Q_EMIT q->pleaseStartPlayback();
+            }
+        } else {
+            followerStartRequested = false;
+            const double tick{transportTick(position)};
+            const double difference{double(jackPlayhead) - tick};
+            double nextPlaybackPosition{0};
+            if (state == JackTransportRolling && std::abs(difference) <= TransportFollowerRelocationThreshold) {
+                // Our next step should be played when the transport gets to it
+                nextPlaybackPosition = double(currentUsecs) + (difference * stepLength);
+            } else {
+                if ((state == JackTransportStopped || std::abs(difference) > TransportFollowerRelocationThreshold) && followerStopRequested.exchange(true) == false) {
+                    // Either the transport has stopped, or it has been moved somewhere else while rolling (in which case
+                    // we will be started again once stopped, at the new position)
+                    Q_EMIT q->pleaseStopPlayback();
+                }
+                // Hold the playhead where it is until the transport is rolling again
+                nextPlaybackPosition = double(nextUsecs) + qMax(0.0, difference * stepLength);
+            }
+            const double adjustment{nextPlaybackPosition - jackNextPlaybackPositionPrecise};
+            jackNextPlaybackPositionPrecise += adjustment;
+            jackNextPlaybackPosition = jack_time_t(jackNextPlaybackPositionPrecise);
+            stepNextPlaybackPositionPrecise += adjustment;
+            stepNextPlaybackPosition = jack_time_t(stepNextPlaybackPositionPrecise);
+        }
+    }
+    /**
+     * \brief Update the timer's bpm from inside the jack process call
+     * @param bpm The new bpm
+     * @param subbeatLength The length of a step at the new bpm, in microseconds
+     * @param notify Whether to update the schedule ahead amount and let listeners know the bpm has changed
+     */
+    void updateBpmFromProcess(double bpm, double subbeatLength, bool notify) {
+        timerThread->setBPM(bpm, std::chrono::nanoseconds(std::llround(subbeatLength * 1000.0)));
+        jackSubbeatLengthInMicroseconds = quint64(subbeatLength);
+        if (notify) {
+            updateScheduleAheadAmount();
+            QMetaObject::invokeMethod(q, "bpmChanged", Qt::QueuedConnection);
+        }
+    }
+    /**
+     * \brief Look up the tempo for the given step in the tempo ramps, if there are any
+     * @param position The absolute position of the step
+     * @param stepBpm Set to the step's bpm if the step is part of a tempo ramp
+     * @param stepLength Set to the step's length in microseconds if the step is part of a tempo ramp
+     * @return True if the step's tempo was set by a tempo ramp
+     */
+    bool applyTempoRamp(quint64 position, double &stepBpm, double &stepLength) {
+        if (pendingTempoRamp && pendingTempoRamp->startPosition <= position) {
+            activeTempoRamp = pendingTempoRamp;
+            pendingTempoRamp = nullptr;
+        }
+        if (activeTempoRamp) {
+            const quint64 rampStep{position - activeTempoRamp->startPosition};
+            if (rampStep < activeTempoRamp->stepCount) {
+                stepBpm = activeTempoRamp->bpm[rampStep];
+                stepLength = activeTempoRamp->stepLength(rampStep);
+                // Only tell the world about the change once per beat, as the tempo is changing on every step
+                updateBpmFromProcess(stepBpm, stepLength, rampStep % BeatSubdivisions == 0);
+            } else {
+                stepBpm = activeTempoRamp->endBpm;
+                stepLength = activeTempoRamp->endStepLength;
+                currentSubbeatLengthInMicroseconds = stepLength;
+                tempoMapRamp.store(pendingTempoRamp);
+                retireTempoRamp(activeTempoRamp);
+                activeTempoRamp = nullptr;
+                updateBpmFromProcess(stepBpm, stepLength, true);
+            }
+            return true;
         }
-        return stepData;
+        return false;
     }
 
-    QList<TimerCommand*> timerCommandsToDelete;
-    QList<TimerCommand*> freshTimerCommands;
-    QList<ClipCommand*> clipCommandsToDelete;
-    QList<ClipCommand*> freshClipCommands;
-    QTimer objectGarbageHandler;
-
     #ifdef DEBUG_SYNCTIMER_TIMING
     frame_clock::time_point lastRound;
     QList<long> intervals;
@@ -394,11 +2613,17 @@ public:
         intervals << (thisRound - lastRound).count();
         lastRound = thisRound;
 #endif
+        // The extra rounds queued up by adjustments run on whichever thread the timer thread object lives on, and the
+        // callback statistics keep state between rounds which only the timer thread may touch, so only record those
+        if (QThread::currentThread() == timerThread) {
+            timerThread->timingStatistics.recordCallback(frame_clock::now(), timerThread->adjustedCumulativeRuntime(), qint64(jackPlayhead + (scheduleAheadAmount * 2)) - qint64(cumulativeBeat));
+        }
         while (cumulativeBeat < (jackPlayhead + (scheduleAheadAmount * 2))) {
             // Call any callbacks registered to us
             for (int i = 0; i < callbackCount; ++i) {
                 callbacks[i](beat);
             }
+            dispatchTick();
 
             // Spit out a touch of useful information on beat zero
             if (beat == 0 && samplerSynth->engine()) {
@@ -411,16 +2636,50 @@ public:
         }
 
         // Finally, notify any listeners that commands have been sent out
-        // You must not delete the commands themselves here, as SamplerSynth takes ownership of them
-        while (sentOutClipsReadHead->clipCommand) {
-            Q_EMIT q->clipCommandSent(sentOutClipsReadHead->clipCommand);
-            sentOutClipsReadHead->clipCommand = nullptr;
-            sentOutClipsReadHead = sentOutClipsReadHead->next;
-        }
+        notifySentClipCommands();
+        callbackWorker->notify();
     }
 
     jack_client_t* jackClient{nullptr};
     jack_port_t* jackPort{nullptr};
+    // The port we base our latency on (our own output port, or when fused, the port ZLRouter tells us to use)
+    jack_port_t* latencyPort{nullptr};
+    // When fused, our events are written here instead of into a jack port buffer, and ZLRouter reads them straight from here
+    bool fused{false};
+    jack_midi_event_t fusedEvents[FusedMidiEventCount];
+    quint8 fusedEventData[FusedMidiEventCount][3];
+    uint32_t fusedEventCount{0};
+    // The data of the fused events which are longer than three bytes, filled from the start during each process call
+    quint8 fusedLongEventData[FusedLongMidiDataSize];
+    size_t fusedLongEventDataSize{0};
+    /**
+     * \brief Write a midi event into the output buffer (or, when fused, into the in-memory event list)
+     * @note Only call this from the jack process call
+     * @return 0 on success, -ENOBUFS if there was no more space, or -EINVAL if the event was invalid (including out of order), the same as jack_midi_event_write()
+     */
+    inline int writeMidiEvent(void *buffer, jack_nframes_t frame, const quint8 *data, size_t size) {
+        if (fused) {
+            if (size == 0 || (fusedEventCount > 0 && frame < fusedEvents[fusedEventCount - 1].time)) {
+                return -EINVAL;
+            }
+            if (fusedEventCount == FusedMidiEventCount || (size > 3 && fusedLongEventDataSize + size > FusedLongMidiDataSize)) {
+                return -ENOBUFS;
+            }
+            jack_midi_event_t &event = fusedEvents[fusedEventCount];
+            if (size > 3) {
+                event.buffer = fusedLongEventData + fusedLongEventDataSize;
+                fusedLongEventDataSize += size;
+            } else {
+                event.buffer = fusedEventData[fusedEventCount];
+            }
+            std::copy_n(data, size, event.buffer);
+            event.time = frame;
+            event.size = size;
+            ++fusedEventCount;
+            return 0;
+        }
+        return jack_midi_event_write(buffer, frame, data, size);
+    }
     quint64 jackPlayhead{0};
     // Used to calculate the quantized block rate BPM for the jack transport position's beats_per_minute field (jackBeatsPerMinute)
     double jackPlayheadBpm{120};
@@ -432,13 +2691,59 @@ public:
     int32_t jackMidiBeatTick{0};
     double jackBeatsPerMinute{0.0};
     quint64 stepReadHeadOnStart{0};
+    // The position the next playback session will start at (see SyncTimer::relocate()), set from the main thread,
+    // the jack transport's sync callback, and (when following the transport) the jack process call
+    std::atomic<quint64> relocatedStartPosition{0};
+    // Set when playback is started, and cleared by the first jack process call after that
+    std::atomic<bool> playbackStarting{false};
     jack_time_t jackMostRecentNextUsecs{0};
     jack_time_t jackStartTime{0};
     quint64 jackNextPlaybackPosition{0};
+    double jackNextPlaybackPositionPrecise{0};
     quint64 jackSubbeatLengthInMicroseconds{0};
     quint64 jackLatency{0};
     bool isPaused{true};
 
+    // A snapshot of where the process call left playback, published at the end of each run, so that other threads can
+    // tell where the next step will be played without racing the process call (see readPlaybackSnapshot())
+    std::atomic<quint64> snapshotSequence{0};
+    std::atomic<quint64> snapshotStep{0};
+    std::atomic<quint64> snapshotStepOffset{0};
+    std::atomic<double> snapshotStepUsecs{0};
+    std::atomic<double> snapshotStepLength{0};
+    /**
+     * \brief Publish the playback snapshot
+     * @note Only call this from the jack process call
+     */
+    inline void publishPlaybackSnapshot(double stepLength) {
+        snapshotSequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        snapshotStep.store(stepReadHeadPosition, std::memory_order_relaxed);
+        snapshotStepOffset.store(stepReadHeadOnStart, std::memory_order_relaxed);
+        snapshotStepUsecs.store(stepNextPlaybackPositionPrecise, std::memory_order_relaxed);
+        snapshotStepLength.store(stepLength, std::memory_order_relaxed);
+        snapshotSequence.fetch_add(1, std::memory_order_release);
+    }
+    /**
+     * \brief Read a consistent copy of the most recently published playback snapshot
+     * @note This is safe to call from any thread
+     * @param step Will be set to the absolute position of the next step the process call will play
+     * @param stepOffset Will be set to the absolute position of the first step of the current playback session
+     * @param stepUsecs Will be set to the jack time at which the next step will be played
+     * @param stepLength Will be set to the length of the most recently played step, in microseconds
+     */
+    inline void readPlaybackSnapshot(quint64 &step, quint64 &stepOffset, double &stepUsecs, double &stepLength) const {
+        quint64 sequence{0};
+        do {
+            sequence = snapshotSequence.load(std::memory_order_acquire);
+            step = snapshotStep.load(std::memory_order_relaxed);
+            stepOffset = snapshotStepOffset.load(std::memory_order_relaxed);
+            stepUsecs = snapshotStepUsecs.load(std::memory_order_relaxed);
+            stepLength = snapshotStepLength.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) || sequence != snapshotSequence.load(std::memory_order_relaxed));
+    }
+
     quint64 jackPlayheadReturn{0};
     quint64 jackSubbeatLengthInMicrosecondsReturn{0};
 
@@ -446,13 +2751,117 @@ public:
 //     int process(jack_nframes_t nframes, void *buffer, quint64 *jackPlayheadReturn, quint64 *jackSubbeatLengthInMicrosecondsReturn) {
 // Clear the buffer that MidiRouter gives us, because we want to be sure we've got a blank slate to work with
 
-    juce::MidiBuffer missingBitsBufferInstance;
-    // This looks like a Jack process call, but it is in fact called explicitly by MidiRouter for insurance purposes (doing it like
-    // this means we've got tighter control, and we really don't need to pass it through jack anyway)
+    // The notes which have been sent out and not yet turned off
+    ActiveNoteLedger activeNotes;
+    // Set to have the next jack process call send note offs for every sounding note (see SyncTimer::panic())
+    std::atomic<bool> noteOffsRequested{false};
+    /**
+     * \brief Send out a note off for every sounding note, and drop any held notes which have not been sent yet
+     * @note Only call this from the jack process call
+     */
+    void sendActiveNoteOffs(void *buffer) {
+        int kept{0};
+        for (int index = 0; index < heldMidiEventCount; ++index) {
+            const quint8 status{quint8(heldMidiEvents[index].data[0] & 0xF0)};
+            if (status != 0x80 && status != 0x90) {
+                heldMidiEvents[kept] = heldMidiEvents[index];
+                ++kept;
+            }
+        }
+        heldMidiEventCount = kept;
+        activeNotes.takeNoteOffs([this, buffer](const quint8 *data, quint8 size){
+            const int errorCode = writeMidiEvent(buffer, 0, data, size_t(size));
+            if (errorCode != 0) {
+                qWarning() << Q_FUNC_INFO << "Error writing note off:" << -errorCode << strerror(-errorCode);
+            }
+        });
+    }
+    // Holds any events which did not fit into the jack buffer, until they can be put on the next step
+    StepData missingBitsStep;
+    /**
+     * \brief A midi event which should be sent part of the way into its step (because of a sub-tick offset or a groove)
+     */
+    struct HeldMidiEvent {
+        double usecs{0};
+        quint8 data[3]{0, 0, 0};
+        quint8 size{0};
+    };
+    // The held events, ordered by the time they should be sent at (only touched by the jack process call)
+    HeldMidiEvent heldMidiEvents[HeldMidiEventCount];
+    int heldMidiEventCount{0};
+    /**
+     * \brief Hold on to a midi event until the time it should be sent at
+     * Events are kept in time order, with events for the same time in the order they were held. As most events
+     * are held for a similar amount of time, they mostly end up at the end of the list, so this is usually cheap.
+     * @return False if there was no space to hold the event
+     */
+    bool holdMidiEvent(double usecs, const quint8 *data, quint8 size) {
+        if (heldMidiEventCount < HeldMidiEventCount) {
+            int index{heldMidiEventCount};
+            while (index > 0 && heldMidiEvents[index - 1].usecs > usecs) {
+                heldMidiEvents[index] = heldMidiEvents[index - 1];
+                --index;
+            }
+            HeldMidiEvent &event = heldMidiEvents[index];
+            event.usecs = usecs;
+            event.data[0] = data[0];
+            event.data[1] = data[1];
+            event.data[2] = data[2];
+            event.size = size;
+            ++heldMidiEventCount;
+            return true;
+        }
+        return false;
+    }
+    /**
+     * \brief Send out all the held midi events which should be sent before the given time
+     * @return The frame of the last event sent (or firstAvailableFrame, if none were sent)
+     */
+    jack_nframes_t sendHeldMidiEvents(void *buffer, jack_nframes_t nframes, jack_time_t currentUsecs, double untilUsecs, double microsecondsPerFrame, jack_nframes_t firstAvailableFrame) {
+        int sentCount{0};
+        while (sentCount < heldMidiEventCount && heldMidiEvents[sentCount].usecs < untilUsecs) {
+            const HeldMidiEvent &event = heldMidiEvents[sentCount];
+            if (event.usecs > double(currentUsecs)) {
+                firstAvailableFrame = std::clamp<jack_nframes_t>(jack_nframes_t((event.usecs - double(currentUsecs)) / microsecondsPerFrame), firstAvailableFrame, nframes - 1);
+            }
+            const int errorCode = writeMidiEvent(buffer, firstAvailableFrame, event.data, size_t(event.size));
+            if (errorCode == 0) {
+                activeNotes.track(event.data, event.size);
+            } else {
+                qWarning() << Q_FUNC_INFO << "Error writing held midi event:" << -errorCode << strerror(-errorCode);
+            }
+            ++sentCount;
+        }
+        if (sentCount > 0) {
+            for (int index = sentCount; index < heldMidiEventCount; ++index) {
+                heldMidiEvents[index - sentCount] = heldMidiEvents[index];
+            }
+            heldMidiEventCount -= sentCount;
+        }
+        return firstAvailableFrame;
+    }
+    // This is our jack process call, or when fused, it is called explicitly by MidiRouter at the start of its own process call
+    // (in which case the events end up in fusedEvents rather than in a port buffer, and ZLRouter reads them from there in the same cycle)
     int process(jack_nframes_t nframes) {
         // const std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
-        void *buffer = jack_port_get_buffer(jackPort, nframes);
-        jack_midi_clear_buffer(buffer);
+        void *buffer{nullptr};
+        if (fused) {
+            fusedEventCount = 0;
+            fusedLongEventDataSize = 0;
+        } else {
+            buffer = jack_port_get_buffer(jackPort, nframes);
+            jack_midi_clear_buffer(buffer);
+        }
+        // Before doing anything else, pull everything that's been scheduled since last time into the step ring
+        drainScheduleQueue();
+        // Hand back any tempo ramps which were still being read when they were replaced
+        releaseRetiredTempoRamps();
+        // Hand back any clip commands which were deleted long enough ago that nobody should be using them any longer
+        releaseRetiredClipCommands(jack_get_time());
+        // If we've been asked to (by a panic, or by stopping playback), silence everything which is currently sounding
+        if (noteOffsRequested.exchange(false)) {
+            sendActiveNoteOffs(buffer);
+        }
 #ifdef DEBUG_SYNCTIMER_JACK
         quint64 stepCount = 0;
         QList<int> commandValues;
@@ -469,42 +2878,92 @@ public:
         float period_usecs;
         jack_get_cycle_times(jackClient, &current_frames, &current_usecs, &next_usecs, &period_usecs);
         const quint64 microsecondsPerFrame = (next_usecs - current_usecs) / nframes;
+        // Used for placing things with sub-tick offsets, where the rounding above would be noticeable
+        const double preciseMicrosecondsPerFrame = double(next_usecs - current_usecs) / double(nframes);
+        // Read the latency compensation once per period, so a change does not reorder events inside it
+        const quint16 compensatedMidiChannels{midiChannelLatencyCompensationMask.load(std::memory_order_relaxed)};
+        const quint32 samplerCompensation{samplerLatencyCompensation.load(std::memory_order_relaxed)};
 
         double thisStepBpm{jackPlayheadBpm};
-        double thisStepSubbeatLengthInMicroseconds{double(timerThread->subbeatCountToNanoseconds(jackPlayheadBpm, 1)) / 1000.0};
+        double thisStepSubbeatLengthInMicroseconds{currentSubbeatLengthInMicroseconds};
 
         // Setting here because we need the this-process value, not the next-process
         jackPlayheadReturn = jackPlayhead;
         jackSubbeatLengthInMicrosecondsReturn = thisStepSubbeatLengthInMicroseconds;
 
         if (!isPaused) {
-            if (jackPlayhead == 0) {
+            if (playbackStarting.exchange(false)) {
                 // first run for this playback session, let's do a touch of setup
                 jackNextPlaybackPosition = current_usecs;
-                jackBar = jackBeat = jackBeatTick = jackTick = 0;
+                jackNextPlaybackPositionPrecise = double(current_usecs);
+                // Playback might have been relocated to somewhere other than the start (see SyncTimer::relocate())
+                jackTick = int32_t(jackPlayhead);
+                jackBar = jackTick / TicksPerBar;
+                jackBeat = (jackTick / BeatSubdivisions) % BeatsPerBar;
+                jackBeatTick = jackTick % BeatSubdivisions;
+                jackBarStartTick = jackBar * TicksPerBar;
+                metronomeOpeningEndBar = jackBar + metronomeOpeningBars.load();
                 // We need to send out a beat clock tick on the first position as well, so let's make sure we do that
                 jackMidiBeatTick = TicksPerMidiBeatClock - 1;
-                transportManager->restartTransport();
+                // When following the jack transport, it is the transport which starts us, not the other way around
+                if (jackTransportFollower == false) {
+                    transportManager->restartTransport();
+                }
             }
             jackMostRecentNextUsecs = next_usecs;
         }
         if (stepNextPlaybackPosition == 0) {
             stepNextPlaybackPosition = current_usecs;
+            stepNextPlaybackPositionPrecise = double(current_usecs);
+        }
+        if (jackTransportFollower) {
+            followJackTransport(current_usecs, next_usecs, thisStepBpm, thisStepSubbeatLengthInMicroseconds);
+        }
+
+        // Pick up any tempo measured from an external midi clock
+        const double externalClockBpm{pendingExternalClockBpm.exchange(0, std::memory_order_acquire)};
+        if (externalClockBpm > 0) {
+            thisStepBpm = externalClockBpm;
+            updateBpmFromProcess(externalClockBpm, SyncTimerThread::subbeatLengthInMicroseconds(externalClockBpm), true);
+        }
+
+        // Evaluate the modulators at the tick position of the start of this period, and send out what they produce first thing
+        const int modulationEventCount{modulationEngine->process(double(modulationStepCount) - ((stepNextPlaybackPositionPrecise - double(current_usecs)) / thisStepSubbeatLengthInMicroseconds), modulationEvents, ModulationEventCount)};
+        for (int i = 0; i < modulationEventCount; ++i) {
+            writeMidiEvent(buffer, 0, modulationEvents + (i * 3), 3);
+        }
+        // Evaluate the automation lanes in the same way, except their events are held, as they can fall part of the way into the period
+        const int automationEventCount{automationEngine->process(double(modulationStepCount) - ((stepNextPlaybackPositionPrecise - double(current_usecs)) / thisStepSubbeatLengthInMicroseconds), current_usecs, thisStepSubbeatLengthInMicroseconds, double(period_usecs), automationEvents, automationEventUsecs, AutomationEventCount)};
+        for (int i = 0; i < automationEventCount; ++i) {
+            if (!holdMidiEvent(automationEventUsecs[i], automationEvents + (i * 3), 3)) {
+                writeMidiEvent(buffer, 0, automationEvents + (i * 3), 3);
+            }
         }
 
-        jack_time_t currentStepUsecsStart{0};
-        jack_time_t currentStepUsecsEnd = qMin(period_usecs, float(stepNextPlaybackPosition - current_usecs));
+        double currentStepUsecsStart{0};
+        double currentStepUsecsEnd = qMin(double(period_usecs), stepNextPlaybackPositionPrecise - double(current_usecs));
         double updatedJackBeatsPerMinute{0};
         jack_nframes_t firstAvailableFrame{0};
         jack_nframes_t relativePosition{0};
         int errorCode{0};
-        juce::MidiBuffer *missingBitsBuffer{nullptr};
+        bool hasMissingBits{false};
         // As long as the next playback position is before this period is supposed to end, and we have frames for it, let's post some events
         while (stepNextPlaybackPosition < next_usecs && firstAvailableFrame < nframes) {
+            // Put anything the registered parts want on this step into it, before we read it
+            expandParts(stepReadHeadPosition);
+            const quint64 stepDataPosition{stepReadHeadPosition};
             StepData *stepData = stepReadHead;
             // Next roll for next time (also do it now, as we're reading out of it)
             stepReadHead = stepReadHead->next;
+            ++stepReadHeadPosition;
+            advanceWheel();
             // If the notes are in the past, they need to be scheduled as soon as we can, so just put those on position 0, and if we are here, that means that ending up in the future is a rounding error, so clamp that
+            // If there is a tempo ramp going on, the step's tempo comes out of its tempo map (for the step we are reading, not the one the read head has moved on to)
+            bool tempoFromRamp{applyTempoRamp(stepDataPosition, thisStepBpm, thisStepSubbeatLengthInMicroseconds)};
+            // Any held events which should happen before this step go out first
+            if (heldMidiEventCount > 0) {
+                firstAvailableFrame = sendHeldMidiEvents(buffer, nframes, current_usecs, stepNextPlaybackPositionPrecise, preciseMicrosecondsPerFrame, firstAvailableFrame);
+            }
             if (stepNextPlaybackPosition <= current_usecs) {
                 relativePosition = firstAvailableFrame;
                 ++firstAvailableFrame;
@@ -515,52 +2974,123 @@ public:
             // Make sure there's a midi beat pulse going out if one is needed
             ++jackMidiBeatTick;
             if (jackMidiBeatTick == TicksPerMidiBeatClock) {
-                jack_midi_event_write(buffer, relativePosition, &jackMidiBeatMessage, 1);
+                writeMidiEvent(buffer, relativePosition, &jackMidiBeatMessage, 1);
                 jackMidiBeatTick = 0;
             }
             // In case we're cycling through stuff we've already played, let's just... not do anything with that
             // Basically that just means nobody else has attempted to do stuff with the step since we last played it
             if (!stepData->played) {
                 // First, let's get the midi messages sent out
-                for (const juce::MidiMessageMetadata &juceMessage : qAsConst(stepData->midiBuffer)) {
-                    if (firstAvailableFrame >= nframes) {
-                        qWarning() << "First available frame is in the future - that's a problem";
-                        break;
+                bool outOfFrames{false};
+                auto sendMidiEvent = [&](jack_nframes_t frame, const quint8 *data, quint8 size){
+                    if (outOfFrames || firstAvailableFrame >= nframes) {
+                        if (!outOfFrames) {
+                            qWarning() << "First available frame is in the future - that's a problem";
+                            outOfFrames = true;
+                        }
+                        return;
                     }
-                    errorCode = jack_midi_event_write(buffer, relativePosition,
-                        const_cast<jack_midi_data_t*>(juceMessage.data), // this might seems odd, but it's really only because juce's internal store is const here, and the data types are otherwise the same
-                        size_t(juceMessage.numBytes) // this changes signedness, but from a lesser space (int) to a larger one (unsigned long)
+                    errorCode = writeMidiEvent(buffer, frame,
+                        data, // jack_midi_data_t is an unsigned char, same as our storage
+                        size_t(size)
                     );
-                    if (errorCode == ENOBUFS) {
+                    if (errorCode == -ENOBUFS) {
                         qWarning() << "Ran out of space while writing events - scheduling the event there's not enough space for to be fired first next round";
-                        if (!missingBitsBuffer) {
-                            missingBitsBuffer = &missingBitsBufferInstance;
-                        }
-                        // Schedule the rest of the buffer for immediate dispatch on next go-around
-                        missingBitsBuffer->addEvent(juceMessage.getMessage(), 0);
+                        // Schedule the rest of the step's events for immediate dispatch on next go-around
+                        missingBitsStep.addMidiEvent(&stepChunkSlab, data, size, true);
+                        hasMissingBits = true;
                     } else {
-                        if (errorCode != 0) {
+                        if (errorCode == 0) {
+                            activeNotes.track(data, size);
+                        } else {
                             qWarning() << Q_FUNC_INFO << "Error writing midi event:" << -errorCode << strerror(-errorCode);
                         }
 #ifdef DEBUG_SYNCTIMER_JACK
                         ++eventCount;
-                        commandValues << juceMessage.data[0]; noteValues << juceMessage.data[1]; velocities << juceMessage.data[2];
+                        commandValues << data[0]; noteValues << data[1]; velocities << data[2];
 #endif
                     }
+                };
+                // Grooves are laid out over the bar, so they only make sense while playing
+                const GrooveTemplate *const *stepGrooves{(grooveChannelMask != 0 && !isPaused) ? grooves : nullptr};
+                const int barTick{int(jackPlayhead % TicksPerBar)};
+                // While anything is held, a note off might belong to a note on which has not been sent yet, so also go through the held path then
+                if (stepData->hasMidiOffsets || stepGrooves || compensatedMidiChannels || heldMidiEventCount > 0) {
+                    // Events which should be sent after the start of the step are held, and sent in time order along with the other held events
+                    stepData->forEachMidiEventWithOffset([&](const quint8 *data, quint8 size, quint16 offset){
+                        qint64 displacement{offset};
+                        double compensation{0};
+                        quint8 eventData[3]{data[0], data[1], data[2]};
+                        const quint8 status{quint8(data[0] & 0xF0)};
+                        const bool isNoteOn{size == 3 && status == 0x90 && data[2] > 0};
+                        const bool isNoteOff{size == 3 && (status == 0x80 || (status == 0x90 && data[2] == 0))};
+                        const int channel{data[0] & 0x0F};
+                        const int note{data[1] & 0x7F};
+                        if (data[0] >= 0x80 && data[0] < 0xF0) {
+                            if (isNoteOff) {
+                                // A note off moves along with its note on, rather than with the groove of its own step (which could otherwise send it before the note on)
+                                displacement += grooveNoteOnDisplacement[channel][note];
+                                grooveNoteOnDisplacement[channel][note] = 0;
+                            } else if (stepGrooves && stepGrooves[channel]) {
+                                const GrooveTemplate *groove{stepGrooves[channel]};
+                                displacement += groove->displacement[barTick];
+                                if (isNoteOn) {
+                                    eventData[2] = groove->scaledVelocity(barTick, data[2]);
+                                    grooveNoteOnDisplacement[channel][note] = groove->displacement[barTick];
+                                }
+                            } else if (isNoteOn) {
+                                grooveNoteOnDisplacement[channel][note] = 0;
+                            }
+                            if (compensatedMidiChannels & (1 << channel)) {
+                                compensation = double(midiChannelLatencyCompensation[channel].load(std::memory_order_relaxed));
+                            }
+                        }
+                        double eventUsecs{stepNextPlaybackPositionPrecise + (double(displacement) * thisStepSubbeatLengthInMicroseconds / SubTickOffsetResolution) + compensation};
+                        if (isNoteOn) {
+                            noteOnUsecs[channel][note] = eventUsecs;
+                        } else if (isNoteOff) {
+                            // Whatever else happens, never send a note off before its note on
+                            eventUsecs = qMax(eventUsecs, noteOnUsecs[channel][note]);
+                        }
+                        if (eventUsecs > stepNextPlaybackPositionPrecise && holdMidiEvent(eventUsecs, eventData, size)) {
+                            return;
+                        }
+                        sendMidiEvent(relativePosition, eventData, size);
+                    });
+                } else {
+                    stepData->forEachMidiEvent([&](const quint8 *data, quint8 size){
+                        if (size == 3 && (data[0] & 0xF0) == 0x90) {
+                            // This note is not displaced, so neither should its note off be
+                            grooveNoteOnDisplacement[data[0] & 0x0F][data[1] & 0x7F] = 0;
+                        }
+                        sendMidiEvent(relativePosition, data, size);
+                    });
                 }
 
                 // Then do direct-control samplersynth things
-                for (ClipCommand *clipCommand : qAsConst(stepData->clipCommands)) {
+                stepData->forEachClipCommand([&](ClipCommand *clipCommand){
+                    unindexClipCommand(clipCommand);
+                    if (clipCommand->cancelled) {
+                        q->deleteClipCommand(clipCommand);
+                        return;
+                    }
                     // Using the protected function, which only we (and SamplerSynth) can use, to ensure less locking
-                    samplerSynth->handleClipCommand(clipCommand, jackPlayhead);
-                    sentOutClipsWriteHead->clipCommand = clipCommand;
-                    sentOutClipsWriteHead = sentOutClipsWriteHead->next;
-                }
+                    qint64 displacement{clipCommand->subTickOffset};
+                    if (stepGrooves && clipCommand->midiChannel >= 0 && clipCommand->midiChannel < GrooveChannelCount && stepGrooves[clipCommand->midiChannel]) {
+                        const GrooveTemplate *groove{stepGrooves[clipCommand->midiChannel]};
+                        displacement += groove->displacement[barTick];
+                        if (clipCommand->changeVolume) {
+                            clipCommand->volume = clipCommand->volume * groove->velocityScale[barTick];
+                        }
+                    }
+                    samplerSynth->handleClipCommand(clipCommand, jackPlayhead, jack_time_t(stepNextPlaybackPositionPrecise + (double(displacement) * thisStepSubbeatLengthInMicroseconds / SubTickOffsetResolution)) + samplerCompensation);
+                    markClipCommandSent(clipCommand);
+                });
 
                 // Do playback control things as the last thing, otherwise we might end up affecting things
                 // currently happening (like, if we stop playback on the last step of a thing, we still want
                 // notes on that step to have been played and so on)
-                for (TimerCommand *command : qAsConst(stepData->timerCommands)) {
+                stepData->forEachTimerCommand([&](TimerCommand *command){
                     Q_EMIT q->timerCommand(command);
                     switch (command->operation) {
                         case TimerCommand::StartPlaybackOperation:
@@ -571,28 +3101,12 @@ public:
                             break;
                         case TimerCommand::StartClipLoopOperation:
                         case TimerCommand::StopClipLoopOperation:
-                            {
-                                ClipCommand *clipCommand = static_cast<ClipCommand *>(command->variantParameter.value<void*>());
-                                if (clipCommand) {
-                                    samplerSynth->handleClipCommand(clipCommand, jackPlayhead);
-                                    sentOutClipsWriteHead->clipCommand = clipCommand;
-                                    sentOutClipsWriteHead = sentOutClipsWriteHead->next;
-                                } else {
-                                    qWarning() << Q_FUNC_INFO << "Failed to retrieve clip command from clip based timer command";
-                                }
-                                command->variantParameter.clear();
-                            }
-                            break;
-                        case TimerCommand::SamplerChannelEnabledStateOperation:
-                            samplerSynth->setChannelEnabled(command->parameter, command->parameter2);
-                            break;
                         case TimerCommand::ClipCommandOperation:
                             {
                                 ClipCommand *clipCommand = static_cast<ClipCommand *>(command->dataParameter);
                                 if (clipCommand) {
-                                    samplerSynth->handleClipCommand(clipCommand, jackPlayhead);
-                                    sentOutClipsWriteHead->clipCommand = clipCommand;
-                                    sentOutClipsWriteHead = sentOutClipsWriteHead->next;
+                                    samplerSynth->handleClipCommand(clipCommand, jackPlayhead, stepNextPlaybackPosition + samplerCompensation);
+                                    markClipCommandSent(clipCommand);
                                 } else {
                                     qWarning() << Q_FUNC_INFO << "Failed to retrieve clip command from clip based timer command";
                                 }
@@ -601,9 +3115,19 @@ public:
                             break;
                         case TimerCommand::SetBpmOperation:
                             {
-                                const quint64 newBpm{std::clamp<quint64>(quint64(command->parameter), 50, 200)};
-                                q->setBpm(newBpm);
+                                // An explicit change of bpm takes over from any tempo ramp which is currently playing
+                                if (activeTempoRamp) {
+                                    tempoMapRamp.store(pendingTempoRamp);
+                                    retireTempoRamp(activeTempoRamp);
+                                    activeTempoRamp = nullptr;
+                                }
+                                // The precise bpm is in the payload, and the integer parameters are for commands scheduled by anything other than SyncTimer::setPreciseBpm()
+                                const double requestedBpm{command->payload.doubleValues[0] > 0 ? command->payload.doubleValues[0] : double(command->parameter) + (double(command->parameter2) / 1000.0)};
+                                const double newBpm{std::clamp<double>(requestedBpm, BPM_MINIMUM, BPM_MAXIMUM)};
+                                // If this came from SyncTimer::setPreciseBpm(), the timer thread already has the new bpm and everybody has been told about it
+                                updateBpmFromProcess(newBpm, SyncTimerThread::subbeatLengthInMicroseconds(newBpm), timerThread->getBpm() != newBpm);
                                 thisStepBpm = newBpm;
+                                tempoFromRamp = false;
                             }
                             break;
                         case TimerCommand::RegisterCASOperation:
@@ -621,31 +3145,68 @@ public:
                                 }
                             }
                             break;
+                        case TimerCommand::SendLongMidiMessageOperation:
+                            {
+                                // Messages too long to fit on the step inline (see enqueueLongMidiEvent()) go out after the step's other events
+                                const LongMidiMessage *message = static_cast<const LongMidiMessage*>(command->dataParameter);
+                                if (message && firstAvailableFrame < nframes) {
+                                    errorCode = writeMidiEvent(buffer, relativePosition, message->data, size_t(message->size));
+                                    if (errorCode != 0) {
+                                        qWarning() << Q_FUNC_INFO << "Error writing midi message of" << message->size << "bytes:" << -errorCode << strerror(-errorCode);
+                                    }
+                                }
+                            }
+                            break;
+                        case TimerCommand::AutomationLaneOperation:
+                            {
+                                // A lane starting on this step sends out its first values from this step, rather than at the start of the next cycle
+                                const int laneEventCount{automationEngine->handleTimerCommand(command, double(modulationStepCount), stepNextPlaybackPositionPrecise, thisStepSubbeatLengthInMicroseconds, double(next_usecs) - stepNextPlaybackPositionPrecise, automationEvents, automationEventUsecs, AutomationEventCount)};
+                                for (int i = 0; i < laneEventCount; ++i) {
+                                    if (!holdMidiEvent(automationEventUsecs[i], automationEvents + (i * 3), 3) && firstAvailableFrame < nframes) {
+                                        writeMidiEvent(buffer, relativePosition, automationEvents + (i * 3), 3);
+                                    }
+                                }
+                            }
+                            break;
                         case TimerCommand::StartPartOperation:
                         case TimerCommand::StopPartOperation:
+                            // These are handled as they are scheduled (see schedulePartTransition())
                         case TimerCommand::InvalidOperation:
-                        case TimerCommand::AutomationOperation:
-                        case TimerCommand::PassthroughClientOperation:
+                            break;
                         default:
+                            // Anything else goes to whatever handler has been registered for it (see SyncTimer::registerTimerCommandHandler())
+                            if (command->operation >= 0 && command->operation < TimerCommandHandlerCount) {
+                                const TimerCommandHandlerEntry *entry{timerCommandHandlers[command->operation].load(std::memory_order_acquire)};
+                                if (entry) {
+                                    entry->handler(command, jackPlayhead, stepNextPlaybackPosition, entry->userData);
+                                }
+                            }
                             break;
                     }
-                }
-                stepData->played = true;
+                });
+                markPlayed(stepData);
+            }
+            // Click the metronome on every beat (the jack timecode is still that of the step we just played)
+            if (!isPaused && jackBeatTick == 0 && (metronomeEnabled || jackBar < metronomeOpeningEndBar)) {
+                samplerSynth->queueMetronomeClick(jack_time_t(stepNextPlaybackPositionPrecise) + samplerCompensation, metronomeAccent && jackBeat == 0, metronomeVolume);
             }
             // Update our internal BPM state, based on what we had on the previous step
             if (jackPlayheadBpm != thisStepBpm) {
                 // update the playhead's BPM
                 jackPlayheadBpm = thisStepBpm;
-                // update the subbeat length in ms
-                thisStepSubbeatLengthInMicroseconds = timerThread->subbeatCountToNanoseconds(jackPlayheadBpm, 1) / 1000;
+                // update the subbeat length in ms (tempo ramps have this precomputed for us)
+                if (!tempoFromRamp) {
+                    thisStepSubbeatLengthInMicroseconds = currentSubbeatLengthInMicroseconds = timerThread->subbeatLengthInMicroseconds(jackPlayheadBpm);
+                }
             }
             // Add the amount of the BPM value appropriate to this step's duration inside the current period
             updatedJackBeatsPerMinute += jackPlayheadBpm * double(currentStepUsecsEnd - currentStepUsecsStart) / period_usecs;
             // qDebug() << Q_FUNC_INFO << "After a step between" << currentStepUsecsStart << "and" << currentStepUsecsEnd << "the updated jack bpm is" << updatedJackBeatsPerMinute;
-            const quint64 nextStepUsecsEnd = qMin(float(currentStepUsecsEnd + thisStepSubbeatLengthInMicroseconds), period_usecs);
+            const double nextStepUsecsEnd = qMin(currentStepUsecsEnd + thisStepSubbeatLengthInMicroseconds, double(period_usecs));
             currentStepUsecsStart = currentStepUsecsEnd;
             currentStepUsecsEnd = nextStepUsecsEnd;
             // Update our timecode data
+            ++modulationStepCount;
             ++jackTick;
             ++jackBeatTick;
             if (jackBeatTick == BeatSubdivisions) {
@@ -660,29 +3221,39 @@ public:
             if (!isPaused) {
                 // Next roll for next time
                 ++jackPlayhead;
-                jackNextPlaybackPosition += thisStepSubbeatLengthInMicroseconds;
+                // Keep the running position in full precision, so the rounding doesn't accumulate into drift
+                jackNextPlaybackPositionPrecise += thisStepSubbeatLengthInMicroseconds;
+                jackNextPlaybackPosition = jack_time_t(jackNextPlaybackPositionPrecise);
 #ifdef DEBUG_SYNCTIMER_JACK
                     ++stepCount;
 #endif
             }
             // Now roll to the next step's playback position
-            stepNextPlaybackPosition += thisStepSubbeatLengthInMicroseconds;
+            stepNextPlaybackPositionPrecise += thisStepSubbeatLengthInMicroseconds;
+            stepNextPlaybackPosition = jack_time_t(stepNextPlaybackPositionPrecise);
         }
+        // Send out any held events which belong in this period, but after its last step
+        if (heldMidiEventCount > 0) {
+            sendHeldMidiEvents(buffer, nframes, current_usecs, double(next_usecs), preciseMicrosecondsPerFrame, firstAvailableFrame);
+        }
+        publishPlaybackSnapshot(thisStepSubbeatLengthInMicroseconds);
         // Finally, update with whatever is left
         updatedJackBeatsPerMinute += jackPlayheadBpm * double(currentStepUsecsEnd - currentStepUsecsStart) / period_usecs;
-        jackBeatsPerMinute = std::round(updatedJackBeatsPerMinute * 100.0) / 100.0; // Round to within the nearest two decimal points - otherwise we run into precision issues
+        jackBeatsPerMinute = std::round(updatedJackBeatsPerMinute * 10000.0) / 10000.0; // Round to within the nearest four decimal points, to get rid of any floating point noise
         // qDebug() << Q_FUNC_INFO << "Final updated jack beats per minute:" << jackBeatsPerMinute;
         // If we've had anything added to the buffer for missing bits, make sure we append that for next time 'round.
         // As a note, this is most likely to be an extremely rare situation (that's kind of a lot of events), but just
         // in case, it's good to cover this base.
-        if (missingBitsBuffer) {
-            q->sendMidiBufferImmediately(*missingBitsBuffer);
-            missingBitsBuffer->clear();
-            missingBitsBuffer = nullptr;
+        if (hasMissingBits) {
+            StepData *nextStep = stepForPosition(stepReadHeadPosition);
+            missingBitsStep.forEachMidiEvent([this, nextStep](const quint8 *data, quint8 size){
+                addMidiEvent(nextStep, data, size, true);
+            });
+            missingBitsStep.reset(&stepChunkSlab);
         }
 #ifdef DEBUG_SYNCTIMER_JACK
         if (eventCount > 0) {
-            if (uint32_t lost = jack_midi_get_lost_event_count(buffer)) {
+            if (uint32_t lost = (buffer ? jack_midi_get_lost_event_count(buffer) : 0)) {
                 qDebug() << "Lost some notes:" << lost;
             }
             qDebug() << "We advanced jack playback by" << stepCount << "steps, and are now at position" << jackPlayhead << "and we filled up jack with" << eventCount << "events" << nframes << jackSubbeatLengthInMicroseconds << frameSteps << framePositions << commandValues << noteValues << velocities;
@@ -698,6 +3269,8 @@ public:
         //     ++belowThreshold;
         // }
 
+        // Now that jack's playhead has moved on, wake up the timer thread if it is waiting for us to do so
+        timerThread->notifyJackCycle();
         return 0;
     }
     int belowThreshold{0};
@@ -728,7 +3301,7 @@ void client_latency_callback(jack_latency_callback_mode_t mode, void *arg)
     if (mode == JackPlaybackLatency) {
         SyncTimerPrivate *d = static_cast<SyncTimerPrivate*>(arg);
         jack_latency_range_t range;
-        jack_port_get_latency_range (d->jackPort, JackPlaybackLatency, &range);
+        jack_port_get_latency_range (d->latencyPort, JackPlaybackLatency, &range);
         if (range.max != d->jackLatency) {
             jack_nframes_t bufferSize = jack_get_buffer_size(d->jackClient);
             jack_nframes_t sampleRate = jack_get_sample_rate(d->jackClient);
@@ -750,39 +3323,45 @@ SyncTimer::SyncTimer(QObject *parent)
     connect(timerThread, &SyncTimerThread::pausedChanged, this, [this](){
         d->isPaused = timerThread->isPaused();
     });
-    // Open the client.
-    jack_status_t real_jack_status{};
-    d->jackClient = jack_client_open("SyncTimer", JackNullOption, &real_jack_status);
-    if (d->jackClient) {
-        // Register the MIDI output port.
-        d->jackPort = jack_port_register(d->jackClient, "midi_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
-        if (d->jackPort) {
-            // Set the process callback.
-            if (jack_set_process_callback(d->jackClient, client_process, static_cast<void*>(d)) == 0) {
-                jack_set_xrun_callback(d->jackClient, client_xrun, static_cast<void*>(d));
-                jack_set_latency_callback (d->jackClient, client_latency_callback, static_cast<void*>(d));
-                // Activate the client.
-                if (jack_activate(d->jackClient) == 0) {
-                    qInfo() << "Successfully created and set up the SyncTimer's Jack client";
-                    jack_latency_range_t range;
-                    jack_port_get_latency_range (d->jackPort, JackPlaybackLatency, &range);
-                    jack_nframes_t bufferSize = jack_get_buffer_size(d->jackClient);
-                    jack_nframes_t sampleRate = jack_get_sample_rate(d->jackClient);
-                    d->jackLatency = (1000 * (double)qMax(bufferSize, range.max)) / (double)sampleRate;
-                    d->updateScheduleAheadAmount();
-                    qDebug() << "SyncTimer: Buffer size is supposed to be" << bufferSize << "but our maximum latency is" << range.max << "and we should be using that one to calculate how far out things should go, as that should include the amount of extra buffers alsa might (and likely does) use.";
-                    qDebug() << "SyncTimer: However, as that is sometimes zero, we use the highest of the two. That means we will now suggest scheduling things" << scheduleAheadAmount() << "steps into the future";
+    if (d->fused) {
+        // When fused, we don't have a client of our own, and instead get hooked up to ZLRouter's (see attachToFusedClient())
+        qInfo() << "SyncTimer: Running fused into ZLRouter's Jack client";
+    } else {
+        // Open the client.
+        jack_status_t real_jack_status{};
+        d->jackClient = jack_client_open("SyncTimer", JackNullOption, &real_jack_status);
+        if (d->jackClient) {
+            // Register the MIDI output port.
+            d->jackPort = jack_port_register(d->jackClient, "midi_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+            d->latencyPort = d->jackPort;
+            if (d->jackPort) {
+                // Set the process callback.
+                if (jack_set_process_callback(d->jackClient, client_process, static_cast<void*>(d)) == 0) {
+                    jack_set_xrun_callback(d->jackClient, client_xrun, static_cast<void*>(d));
+                    jack_set_latency_callback (d->jackClient, client_latency_callback, static_cast<void*>(d));
+                    // Activate the client.
+                    if (jack_activate(d->jackClient) == 0) {
+                        qInfo() << "Successfully created and set up the SyncTimer's Jack client";
+                        jack_latency_range_t range;
+                        jack_port_get_latency_range (d->jackPort, JackPlaybackLatency, &range);
+                        jack_nframes_t bufferSize = jack_get_buffer_size(d->jackClient);
+                        jack_nframes_t sampleRate = jack_get_sample_rate(d->jackClient);
+                        d->jackLatency = (1000 * (double)qMax(bufferSize, range.max)) / (double)sampleRate;
+                        d->updateScheduleAheadAmount();
+                        qDebug() << "SyncTimer: Buffer size is supposed to be" << bufferSize << "but our maximum latency is" << range.max << "and we should be using that one to calculate how far out things should go, as that should include the amount of extra buffers alsa might (and likely does) use.";
+                        qDebug() << "SyncTimer: However, as that is sometimes zero, we use the highest of the two. That means we will now suggest scheduling things" << scheduleAheadAmount() << "steps into the future";
+                    } else {
+                        qWarning() << "SyncTimer: Failed to activate SyncTimer Jack client";
+                    }
                 } else {
-                    qWarning() << "SyncTimer: Failed to activate SyncTimer Jack client";
+                    qWarning() << "SyncTimer: Failed to set the SyncTimer Jack processing callback";
                 }
             } else {
-                qWarning() << "SyncTimer: Failed to set the SyncTimer Jack processing callback";
+                qWarning() << "SyncTimer: Could not register SyncTimer Jack output port";
             }
         } else {
-            qWarning() << "SyncTimer: Could not register SyncTimer Jack output port";
+            qWarning() << "SyncTimer: Could not create SyncTimer Jack client.";
         }
-    } else {
-        qWarning() << "SyncTimer: Could not create SyncTimer Jack client.";
     }
 }
 
@@ -810,9 +3389,132 @@ void SyncTimer::removeCallback(void (*functionPtr)(int)) {
             }
         }
     }
+    if (foundCallback) {
+        d->callbackCount--;
+    }
     qDebug() << Q_FUNC_INFO << "Removing callback" << functionPtr << " - found it to remove:" << foundCallback;
 }
 
+bool SyncTimer::addClipCommandsSentCallback(ClipCommandsSentCallback callback, void* userData)
+{
+    for (int i = 0; i < CallbackSpaces; ++i) {
+        ClipCommandsSentSubscriber &subscriber = d->clipCommandsSentSubscribers[i];
+        if (!subscriber.active.load(std::memory_order_acquire) && subscriber.callback == nullptr) {
+            subscriber.callback = callback;
+            subscriber.userData = userData;
+            subscriber.active.store(true, std::memory_order_release);
+            qDebug() << Q_FUNC_INFO << "Adding clip commands sent callback" << callback << "at position" << i;
+            return true;
+        }
+    }
+    qWarning() << Q_FUNC_INFO << "Attempted to add a clip commands sent callback, but all" << CallbackSpaces << "spaces are in use";
+    return false;
+}
+
+void SyncTimer::removeClipCommandsSentCallback(ClipCommandsSentCallback callback, void* userData)
+{
+    bool foundCallback{false};
+    for (int i = 0; i < CallbackSpaces; ++i) {
+        ClipCommandsSentSubscriber &subscriber = d->clipCommandsSentSubscribers[i];
+        if (subscriber.callback == callback && subscriber.userData == userData && subscriber.active.load(std::memory_order_acquire)) {
+            subscriber.active.store(false, std::memory_order_seq_cst);
+            // Make sure nobody is still calling the callback before we forget about it (unless that is us, from inside the callback)
+            if (!SyncTimerPrivate::isDispatchingSentClipCommands) {
+                while (d->dispatchingSentClipCommands.load(std::memory_order_seq_cst) > 0) {
+                    QThread::yieldCurrentThread();
+                }
+            }
+            subscriber.callback = nullptr;
+            subscriber.userData = nullptr;
+            foundCallback = true;
+            break;
+        }
+    }
+    qDebug() << Q_FUNC_INFO << "Removing clip commands sent callback" << callback << " - found it to remove:" << foundCallback;
+}
+
+bool SyncTimer::emitClipCommandSent() const
+{
+    return d->emitClipCommandSent;
+}
+
+void SyncTimer::setEmitClipCommandSent(const bool& emitClipCommandSent)
+{
+    if (d->emitClipCommandSent != emitClipCommandSent) {
+        d->emitClipCommandSent = emitClipCommandSent;
+        Q_EMIT emitClipCommandSentChanged();
+    }
+}
+
+bool SyncTimer::addTickCallback(TickCallback callback, void *userData, quint64 divisor, bool useWorkerThread)
+{
+    // Subscribers removed from the timer thread are usually cleared out by the worker, but if that has not happened yet, do it here
+    if (QThread::currentThread() != timerThread && QThread::currentThread() != d->callbackWorker) {
+        for (int i = 0; i < CallbackSpaces; ++i) {
+            if (d->tickSubscribers[i].retired.load(std::memory_order_acquire)) {
+                QMutexLocker locker(&d->callbackWorker->deliveryMutex);
+                d->callbackWorker->reclaimRetiredSubscribers();
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < CallbackSpaces; ++i) {
+        TickSubscriber &subscriber = d->tickSubscribers[i];
+        if (!subscriber.active.load(std::memory_order_acquire) && !subscriber.retired.load(std::memory_order_acquire) && subscriber.callback == nullptr) {
+            subscriber.callback = callback;
+            subscriber.userData = userData;
+            subscriber.divisor = qMax(quint64(1), divisor);
+            subscriber.useWorkerThread = useWorkerThread;
+            subscriber.active.store(true, std::memory_order_release);
+            qDebug() << Q_FUNC_INFO << "Adding tick callback" << callback << "at position" << i << "called every" << subscriber.divisor << "ticks" << (useWorkerThread ? "on the callback worker thread" : "on the timer thread");
+            return true;
+        }
+    }
+    qWarning() << Q_FUNC_INFO << "Attempted to add a tick callback, but all" << CallbackSpaces << "spaces are in use";
+    return false;
+}
+
+void SyncTimer::removeTickCallback(TickCallback callback, void *userData)
+{
+    bool foundCallback{false};
+    for (int i = 0; i < CallbackSpaces; ++i) {
+        TickSubscriber &subscriber = d->tickSubscribers[i];
+        if (subscriber.callback == callback && subscriber.userData == userData && subscriber.active.load(std::memory_order_acquire)) {
+            subscriber.active.store(false, std::memory_order_seq_cst);
+            foundCallback = true;
+            // Make sure nobody is still calling the callback before we forget about it (unless that is us, from inside the callback)
+            // The active flag and the dispatching flag are a store-then-load handshake in both directions, so they both need to be sequentially consistent
+            if (QThread::currentThread() != timerThread) {
+                while (d->dispatchingTicks.load(std::memory_order_seq_cst)) {
+                    QThread::yieldCurrentThread();
+                }
+            }
+            // Only subscribers on the worker thread can be in use by the worker
+            if (subscriber.useWorkerThread && QThread::currentThread() != d->callbackWorker) {
+                if (QThread::currentThread() == timerThread) {
+                    // The timer thread must never wait for the worker, so if the worker is busy delivering, leave the slot for it to clear out when it is done
+                    if (!d->callbackWorker->deliveryMutex.tryLock()) {
+                        subscriber.retired.store(true, std::memory_order_release);
+                        break;
+                    }
+                } else {
+                    d->callbackWorker->deliveryMutex.lock();
+                }
+                d->callbackWorker->deliveryMutex.unlock();
+            }
+            subscriber.callback = nullptr;
+            subscriber.userData = nullptr;
+            break;
+        }
+    }
+    qDebug() << Q_FUNC_INFO << "Removing tick callback" << callback << " - found it to remove:" << foundCallback;
+}
+
+quint64 SyncTimer::droppedTickCount() const
+{
+    return d->callbackWorker->droppedTickCount;
+}
+
 void SyncTimer::queueClipToStartOnChannel(ClipAudioSource *clip, int midiChannel)
 {
     ClipCommand *command = getClipCommand();
@@ -833,30 +3535,14 @@ void SyncTimer::queueClipToStartOnChannel(ClipAudioSource *clip, int midiChannel
 
 void SyncTimer::queueClipToStopOnChannel(ClipAudioSource *clip, int midiChannel)
 {
-    // First, remove any references to the clip that we're wanting to stop
-    for (quint64 step = 0; step < StepRingCount; ++step) {
-        StepData *stepData = &d->stepRing[step];
-        if (!stepData->played) {
-            QMutableListIterator<ClipCommand *> stepIterator(stepData->clipCommands);
-            while (stepIterator.hasNext()) {
-                ClipCommand *stepCommand = stepIterator.next();
-                if (stepCommand->clip == clip) {
-                    deleteClipCommand(stepCommand);
-                    stepIterator.remove();
-                    break;
-                }
-            }
-        }
-    }
-
-    // Then stop it, now, because it should be now
+    // Stop it, now, because it should be now (the process call will cancel
+    // any pending commands for the clip we're wanting to stop before adding this)
     ClipCommand *command = getClipCommand();
     command->clip = clip;
     command->midiChannel = midiChannel;
     command->midiNote = 60;
     command->stopPlayback = true;
-    StepData *stepData{d->delayedStep(0)};
-    stepData->clipCommands << command;
+    d->enqueuePointer(d->delayedStepPosition(0), ScheduleRecord::StopClipCommandType, command);
 }
 
 void SyncTimer::queueClipToStart(ClipAudioSource *clip) {
@@ -874,10 +3560,34 @@ void SyncTimer::start(int bpm) {
     d->intervals.clear();
     d->lastRound = frame_clock::now();
 #endif
-    d->stepReadHeadOnStart = (*d->stepReadHead).index;
+    // If we have been asked to start somewhere other than the start, pretend we have already played up to there
+    const quint64 startPosition{d->relocatedStartPosition.exchange(0)};
+    d->cumulativeBeat = d->jackPlayhead = startPosition;
+    d->beat = startPosition % (BeatSubdivisions * BeatsPerBar);
+    d->stepReadHeadOnStart = d->stepReadHeadPosition - startPosition;
+    d->playbackStarting = true;
     timerThread->resume();
 }
 
+bool SyncTimer::relocate(quint64 tick)
+{
+    if (!timerThread->isPaused()) {
+        qWarning() << Q_FUNC_INFO << "Attempted to relocate playback to" << tick << "while the timer is running - this is only possible while stopped";
+        return false;
+    }
+    d->relocatedStartPosition = tick;
+    return true;
+}
+
+void SyncTimer::addAdjustmentByMicroseconds(qint64 microseconds)
+{
+    timerThread->timingStatistics.recordAdjustment(microseconds);
+    ScheduleRecord record;
+    record.type = ScheduleRecord::PhaseAdjustmentType;
+    record.parameter = qint32(std::clamp<qint64>(microseconds, INT32_MIN, INT32_MAX));
+    d->enqueue(record);
+}
+
 void SyncTimer::stop() {
     cerr << "#### Stopping timer" << endl;
 
@@ -889,89 +3599,269 @@ void SyncTimer::stop() {
     d->cumulativeBeat = 0;
     d->jackPlayhead = 0;
 
-    // A touch of hackery to ensure we end immediately, and leave a clean state
-    for (quint64 step = 0; step < StepRingCount; ++step) {
-        StepData *stepData = &d->stepRing[(step + d->stepReadHead->index) % StepRingCount];
-        if (!stepData->played) {
-            // First, spit out all the queued midi messages immediately, but in strict order, and only off notes...
-            juce::MidiBuffer onlyOffs;
-            for (const juce::MidiMessageMetadata& message : stepData->midiBuffer) {
-                if (message.getMessage().isNoteOff()) {
-                    onlyOffs.addEvent(message.getMessage(), 0);
+    // A touch of hackery to ensure we end immediately, and leave a clean state (the process call will send out
+    // note offs for anything which is sounding, and run all the clip commands with the volume set to 0, so we don't
+    // end up in a weird state, but also don't make the users' ears bleed)
+    ScheduleRecord record;
+    record.type = ScheduleRecord::FlushType;
+    d->enqueue(record);
+
+    // Make sure we're actually informing about any clips that have been sent out, in case we
+    // hit somewhere between a jack roll and a synctimer tick (the timer thread might be doing the
+    // same thing right now, which notifySentClipCommands() takes care of by only letting one of us at a time)
+    d->notifySentClipCommands();
+#ifdef DEBUG_SYNCTIMER_TIMING
+    qDebug() << d->intervals;
+#endif
+}
+
+int SyncTimer::getInterval(int bpm) {
+    // Calculate interval
+    return 60000 / (bpm * BeatSubdivisions);
+}
+
+float SyncTimer::subbeatCountToSeconds(quint64 bpm, quint64 beats) const
+{
+    return timerThread->subbeatCountToNanoseconds(qBound(quint64(BPM_MINIMUM), bpm, quint64(BPM_MAXIMUM)), beats) / (float)1000000000;
+}
+
+quint64 SyncTimer::secondsToSubbeatCount(quint64 bpm, float seconds) const
+{
+    return timerThread->nanosecondsToSubbeatCount(qBound(quint64(BPM_MINIMUM), bpm, quint64(BPM_MAXIMUM)), floor(seconds * (float)1000000000));
+}
+
+int SyncTimer::getMultiplier() {
+    return BeatSubdivisions;
+}
+
+quint64 SyncTimer::getBpm() const
+{
+    return quint64(std::llround(timerThread->getBpm()));
+}
+
+void SyncTimer::setBpm(quint64 bpm)
+{
+    setPreciseBpm(double(bpm));
+}
+
+double SyncTimer::getPreciseBpm() const
+{
+    return timerThread->getBpm();
+}
+
+void SyncTimer::setPreciseBpm(double bpm)
+{
+    bpm = std::clamp<double>(bpm, BPM_MINIMUM, BPM_MAXIMUM);
+    if (timerThread->getBpm() != bpm) {
+        timerThread->setBPM(bpm);
+        d->jackSubbeatLengthInMicroseconds = timerThread->subbeatCountToNanoseconds(timerThread->getBpm(), 1) / 1000;
+        d->updateScheduleAheadAmount();
+        QMetaObject::invokeMethod(this, "bpmChanged", Qt::QueuedConnection);
+        // Finally, let's schedule a timer command into the timer - this is to ensure that
+        // the bpm is updated for jack transport calculation purposes as well, at the time
+        // at which it would be expected. While this does involve adding more work, it is
+        // vital that our bpm calculations are correct for syncing reasona, otherwise things
+        // just start drifting out of time and that's not nice at all.
+        // Optimally, we'd do all our bpm setting through the timer, but i'm pretty sure
+        // that'd cause some havoc on the UI side of things... so just not doing that for
+        // now.
+        TimerCommand *timerCommand = getTimerCommand();
+        timerCommand->operation = TimerCommand::SetBpmOperation;
+        timerCommand->parameter = int(bpm);
+        timerCommand->parameter2 = int(std::llround((bpm - double(int(bpm))) * 1000.0));
+        timerCommand->payload.doubleValues[0] = bpm;
+        scheduleTimerCommand(0, timerCommand);
+    }
+}
+
+void SyncTimer::setBpmFromExternalClock(double bpm)
+{
+    d->pendingExternalClockBpm.store(std::clamp<double>(bpm, BPM_MINIMUM, BPM_MAXIMUM), std::memory_order_release);
+}
+
+void SyncTimer::scheduleTempoRamp(double startBpm, double endBpm, quint64 duration, quint64 delay)
+{
+    if (duration == 0) {
+        qWarning() << Q_FUNC_INFO << "Attempted to schedule a tempo ramp with no duration";
+        return;
+    }
+    if (duration > TempoRampMaximumStepCount) {
+        qWarning() << Q_FUNC_INFO << "Attempted to schedule a tempo ramp of" << duration << "steps, which is longer than the longest possible ramp, so shortening it to" << TempoRampMaximumStepCount << "steps";
+        duration = TempoRampMaximumStepCount;
+    }
+    TempoRamp *ramp = d->tempoRampPool.acquire();
+    ramp->calculate(std::clamp<double>(startBpm, BPM_MINIMUM, BPM_MAXIMUM), std::clamp<double>(endBpm, BPM_MINIMUM, BPM_MAXIMUM), duration);
+    ramp->startPosition = d->delayedStepPosition(delay);
+    d->enqueuePointer(ramp->startPosition, ScheduleRecord::TempoRampType, ramp);
+}
+
+void SyncTimer::setGroove(int midiChannel, const double *tickDisplacements, const float *velocityScales, int length)
+{
+    if (midiChannel < 0 || midiChannel >= GrooveChannelCount) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set a groove for midi channel" << midiChannel << "which is outside the valid range of 0 through" << GrooveChannelCount - 1;
+        return;
+    }
+    if (!GrooveTemplate::isValidLength(length)) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set a groove with" << length << "entries, which does not divide evenly into a bar of" << TicksPerBar << "ticks";
+        return;
+    }
+    GrooveTemplate *groove = d->groovePool.acquire();
+    groove->spread(tickDisplacements, velocityScales, length);
+    ScheduleRecord record;
+    record.type = ScheduleRecord::GrooveType;
+    record.pointer = groove;
+    record.parameter = midiChannel;
+    d->enqueue(record);
+}
+
+void SyncTimer::setGroove(int midiChannel, const QVariantList &tickDisplacements, const QVariantList &velocityScales)
+{
+    if (tickDisplacements.count() != velocityScales.count()) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set a groove with" << tickDisplacements.count() << "displacements and" << velocityScales.count() << "velocity scales - there must be the same number of each";
+        return;
+    }
+    const int length{tickDisplacements.count()};
+    if (length < 1 || length > TicksPerBar) {
+        qWarning() << Q_FUNC_INFO << "Attempted to set a groove with" << length << "entries, which does not divide evenly into a bar of" << TicksPerBar << "ticks";
+        return;
+    }
+    double displacements[TicksPerBar];
+    float scales[TicksPerBar];
+    for (int entry = 0; entry < length; ++entry) {
+        displacements[entry] = tickDisplacements[entry].toDouble();
+        scales[entry] = velocityScales[entry].toFloat();
+    }
+    setGroove(midiChannel, displacements, scales, length);
+}
+
+void SyncTimer::clearGroove(int midiChannel)
+{
+    if (midiChannel < 0 || midiChannel >= GrooveChannelCount) {
+        qWarning() << Q_FUNC_INFO << "Attempted to clear the groove for midi channel" << midiChannel << "which is outside the valid range of 0 through" << GrooveChannelCount - 1;
+        return;
+    }
+    ScheduleRecord record;
+    record.type = ScheduleRecord::GrooveType;
+    record.parameter = midiChannel;
+    d->enqueue(record);
+}
+
+bool SyncTimer::registerPart(int channel, int track, int part, quint64 length, const SyncTimer_ScheduleItem *items, int count)
+{
+    const int slot{SyncTimerPrivate::partSlot(channel, track, part)};
+    if (slot < 0) {
+        qWarning() << Q_FUNC_INFO << "Attempted to register a part for channel" << channel << "track" << track << "part" << part << "which is outside the valid range";
+        return false;
+    }
+    if (length == 0 || count < 0 || count > PartItemCount) {
+        qWarning() << Q_FUNC_INFO << "Attempted to register a part with a length of" << length << "and" << count << "items - parts must be at least one step long, and have no more than" << PartItemCount << "items";
+        return false;
+    }
+    PartPattern *pattern = d->partPool.acquire();
+    pattern->length = length;
+    for (int index = 0; index < count; ++index) {
+        const SyncTimer_ScheduleItem &item = items[index];
+        if (item.delay >= length) {
+            qWarning() << Q_FUNC_INFO << "Skipping an item at step" << item.delay << "which is outside the part's length of" << length;
+            continue;
+        }
+        PartItem &partItem = pattern->items[pattern->itemCount];
+        partItem = PartItem{};
+        partItem.type = quint8(item.type);
+        partItem.step = quint32(item.delay);
+        partItem.subTickOffset = item.subTickOffset;
+        switch (item.type) {
+            case SyncTimer_NoteItem:
+                if (item.midiChannel < 0 || item.midiChannel > 15 || item.midiNote < 0 || item.midiNote > 127 || item.velocity < 0 || item.velocity > 127) {
+                    continue;
                 }
-            }
-            if (!onlyOffs.isEmpty()) {
-                sendMidiBufferImmediately(onlyOffs);
-            }
-            // Now for the clip commands
-            for (ClipCommand *clipCommand : qAsConst(stepData->clipCommands)) {
-                // Actually run all the commands (so we don't end up in a weird state), but also
-                // set all the volumes to 0 so we don't make the users' ears bleed
-                clipCommand->changeVolume = true;
-                clipCommand->volume = 0;
-                scheduleClipCommand(clipCommand, 0);
-                Q_EMIT clipCommandSent(clipCommand);
-            }
-            stepData->played = true;
+                partItem.midiBytes[0] = (item.setOn ? 0x90 : 0x80) + item.midiChannel;
+                partItem.midiBytes[1] = item.midiNote;
+                partItem.midiBytes[2] = item.velocity;
+                partItem.midiSize = 3;
+                partItem.duration = item.setOn ? quint32(item.duration) : 0;
+                break;
+            case SyncTimer_MidiMessageItem:
+                if (item.midiSize < 1 || item.midiSize > 3) {
+                    continue;
+                }
+                std::copy_n(item.midiBytes, 3, partItem.midiBytes);
+                partItem.midiSize = quint8(item.midiSize);
+                break;
+            case SyncTimer_ClipItem:
+                if (!item.clip) {
+                    continue;
+                }
+                partItem.clip = item.clip;
+                partItem.channel = qint8(item.midiChannel);
+                partItem.midiBytes[1] = quint8(item.midiNote);
+                partItem.volume = item.volume;
+                partItem.setOn = item.setOn;
+                partItem.looping = item.looping;
+                break;
+            default:
+                continue;
         }
+        ++pattern->itemCount;
     }
-
-    // Make sure we're actually informing about any clips that have been sent out, in case we
-    // hit somewhere between a jack roll and a synctimer tick
-    while (d->sentOutClipsReadHead->clipCommand) {
-        Q_EMIT clipCommandSent(d->sentOutClipsReadHead->clipCommand);
-        d->sentOutClipsReadHead->clipCommand = nullptr;
-        d->sentOutClipsReadHead = d->sentOutClipsReadHead->next;
-    }
-#ifdef DEBUG_SYNCTIMER_TIMING
-    qDebug() << d->intervals;
-#endif
-}
-
-int SyncTimer::getInterval(int bpm) {
-    // Calculate interval
-    return 60000 / (bpm * BeatSubdivisions);
+    std::stable_sort(pattern->items, pattern->items + pattern->itemCount, [](const PartItem &first, const PartItem &second){ return first.step < second.step; });
+    ScheduleRecord record;
+    record.type = ScheduleRecord::PartType;
+    record.pointer = pattern;
+    record.parameter = slot;
+    // Should the queue be full, enqueue() hands the pattern straight back to the pool (see releaseRecord()), so it is never leaked
+    return d->enqueue(record);
 }
 
-float SyncTimer::subbeatCountToSeconds(quint64 bpm, quint64 beats) const
+void SyncTimer::unregisterPart(int channel, int track, int part)
 {
-    return timerThread->subbeatCountToNanoseconds(qBound(quint64(BPM_MINIMUM), bpm, quint64(BPM_MAXIMUM)), beats) / (float)1000000000;
+    const int slot{SyncTimerPrivate::partSlot(channel, track, part)};
+    if (slot < 0) {
+        qWarning() << Q_FUNC_INFO << "Attempted to unregister a part for channel" << channel << "track" << track << "part" << part << "which is outside the valid range";
+        return;
+    }
+    ScheduleRecord record;
+    record.type = ScheduleRecord::PartType;
+    record.parameter = slot;
+    d->enqueue(record);
 }
 
-quint64 SyncTimer::secondsToSubbeatCount(quint64 bpm, float seconds) const
+void SyncTimer::panic()
 {
-    return timerThread->nanosecondsToSubbeatCount(qBound(quint64(BPM_MINIMUM), bpm, quint64(BPM_MAXIMUM)), floor(seconds * (float)1000000000));
+    d->noteOffsRequested = true;
 }
 
-int SyncTimer::getMultiplier() {
-    return BeatSubdivisions;
+bool SyncTimer::isNoteActive(int midiChannel, int midiNote) const
+{
+    if (midiChannel < 0 || midiChannel > 15 || midiNote < 0 || midiNote > 127) {
+        return false;
+    }
+    return d->activeNotes.isActive(midiChannel, midiNote);
 }
 
-quint64 SyncTimer::getBpm() const
+QVariantList SyncTimer::activeNotes() const
 {
-    return timerThread->getBpm();
+    QVariantList notes;
+    d->activeNotes.forEachActive([&notes](int midiChannel, int midiNote){
+        QVariantMap note;
+        note["midiChannel"] = midiChannel;
+        note["midiNote"] = midiNote;
+        notes << note;
+    });
+    return notes;
 }
 
-void SyncTimer::setBpm(quint64 bpm)
+int SyncTimer::activeNotes(unsigned char *midiChannels, unsigned char *midiNotes, int maximum) const
 {
-    if (timerThread->getBpm() != bpm) {
-        timerThread->setBPM(bpm);
-        d->jackSubbeatLengthInMicroseconds = timerThread->subbeatCountToNanoseconds(timerThread->getBpm(), 1) / 1000;
-        d->updateScheduleAheadAmount();
-        QMetaObject::invokeMethod(this, "bpmChanged", Qt::QueuedConnection);
-        // Finally, let's schedule a timer command into the timer - this is to ensure that
-        // the bpm is updated for jack transport calculation purposes as well, at the time
-        // at which it would be expected. While this does involve adding more work, it is
-        // vital that our bpm calculations are correct for syncing reasona, otherwise things
-        // just start drifting out of time and that's not nice at all.
-        // Optimally, we'd do all our bpm setting through the timer, but i'm pretty sure
-        // that'd cause some havoc on the UI side of things... so just not doing that for
-        // now.
-        TimerCommand *timerCommand = getTimerCommand();
-        timerCommand->operation = TimerCommand::SetBpmOperation;
-        timerCommand->parameter = bpm;
-        scheduleTimerCommand(0, timerCommand);
-    }
+    int count{0};
+    d->activeNotes.forEachActive([&](int midiChannel, int midiNote){
+        if (count < maximum) {
+            midiChannels[count] = quint8(midiChannel);
+            midiNotes[count] = quint8(midiNote);
+            ++count;
+        }
+    });
+    return count;
 }
 
 quint64 SyncTimer::scheduleAheadAmount() const
@@ -1008,49 +3898,22 @@ const quint64 &SyncTimer::jackSubbeatLengthInMicroseconds() const
     return d->jackSubbeatLengthInMicroseconds;
 }
 
-void SyncTimer::scheduleClipCommand(ClipCommand *command, quint64 delay)
+quint64 SyncTimer::jackPlayheadUsecsForTick(quint64 tick) const
 {
-    StepData *stepData{d->delayedStep(delay)};
-    bool foundExisting{false};
-    for (ClipCommand *existingCommand : qAsConst(stepData->clipCommands)) {
-        if (existingCommand->equivalentTo(command)) {
-            if (command->changeLooping) {
-                existingCommand->looping = command->looping;
-                existingCommand->changeLooping = true;
-            }
-            if (command->changePitch) {
-                existingCommand->pitchChange = command->pitchChange;
-                existingCommand->changePitch = true;
-            }
-            if (command->changeSpeed) {
-                existingCommand->speedRatio = command->speedRatio;
-                existingCommand->changeSpeed = true;
-            }
-            if (command->changeGainDb) {
-                existingCommand->gainDb = command->gainDb;
-                existingCommand->changeGainDb = true;
-            }
-            if (command->changeVolume) {
-                existingCommand->volume = command->volume;
-                existingCommand->changeVolume = true;
-            }
-            if (command->startPlayback) {
-                existingCommand->startPlayback = true;
-            }
-            foundExisting = true;
-        }
-    }
-    if (foundExisting) {
-        deleteClipCommand(command);
-    } else {
-        stepData->clipCommands << command;
+    if (timerThread->isPaused()) {
+        return quint64(d->stepNextPlaybackPositionPrecise + d->tempoMapDuration(d->stepReadHeadPosition, d->stepReadHeadPosition + (tick - d->stepReadHead->index)));
     }
+    return quint64(d->jackNextPlaybackPositionPrecise + d->tempoMapDuration(d->stepReadHeadOnStart + d->jackPlayhead, d->stepReadHeadOnStart + tick));
+}
+
+void SyncTimer::scheduleClipCommand(ClipCommand *command, quint64 delay)
+{
+    d->enqueuePointer(d->delayedStepPosition(delay), ScheduleRecord::ClipCommandType, command);
 }
 
 void SyncTimer::scheduleTimerCommand(quint64 delay, TimerCommand *command)
 {
-    StepData *stepData{d->delayedStep(delay)};
-    stepData->timerCommands << command;
+    d->enqueuePointer(d->delayedStepPosition(delay), ScheduleRecord::TimerCommandType, command);
 }
 
 void SyncTimer::scheduleTimerCommand(quint64 delay, int operation, int parameter1, int parameter2, int parameter3, const QVariant &variantParameter)
@@ -1060,97 +3923,342 @@ void SyncTimer::scheduleTimerCommand(quint64 delay, int operation, int parameter
     timerCommand->parameter = parameter1;
     timerCommand->parameter2 = parameter2;
     timerCommand->parameter3 = parameter3;
+    // Keep the QVariant out of the process call, by turning it into plain data here
     if (variantParameter.isValid()) {
-        timerCommand->variantParameter = variantParameter;
+        if (variantParameter.userType() == QMetaType::VoidStar) {
+            timerCommand->dataParameter = variantParameter.value<void*>();
+        } else if (variantParameter.canConvert<QObject*>()) {
+            timerCommand->dataParameter = variantParameter.value<QObject*>();
+        } else {
+            // canConvert() is true for any string, so check the conversion actually worked
+            bool isNumber{false};
+            const double value{variantParameter.toDouble(&isNumber)};
+            if (isNumber) {
+                timerCommand->payload.doubleValues[0] = value;
+            } else {
+                qWarning() << Q_FUNC_INFO << "Unsupported variant parameter for timer command with operation" << operation << variantParameter;
+            }
+        }
     }
     scheduleTimerCommand(delay, timerCommand);
 }
 
-void SyncTimer::scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay)
+bool SyncTimer::registerTimerCommandHandler(int operation, TimerCommandHandler handler, void* userData)
 {
-    StepData *stepData{d->delayedStep(delay)};
-    juce::MidiBuffer &addToThis = stepData->midiBuffer;
-    unsigned char note[3];
-    if (setOn) {
-        note[0] = 0x90 + midiChannel;
-    } else {
-        note[0] = 0x80 + midiChannel;
+    if (operation < 0 || operation >= TimerCommandHandlerCount || SyncTimerPrivate::isBuiltInTimerCommand(operation) || operation == TimerCommand::InvalidOperation) {
+        qWarning() << Q_FUNC_INFO << "Attempted to register a handler for an operation which cannot have one:" << operation;
+        return false;
     }
-    note[1] = midiNote;
-    note[2] = velocity;
-    const int onOrOff = setOn ? 1 : 0;
-    addToThis.addEvent(note, 3, onOrOff);
+    if (!handler) {
+        unregisterTimerCommandHandler(operation);
+        return true;
+    }
+    SyncTimerPrivate::TimerCommandHandlerEntry *entry = new SyncTimerPrivate::TimerCommandHandlerEntry{handler, userData};
+    QMutexLocker locker(&d->timerCommandHandlersMutex);
+    SyncTimerPrivate::TimerCommandHandlerEntry *previous = d->timerCommandHandlers[operation].exchange(entry, std::memory_order_acq_rel);
+    if (previous) {
+        d->retiredTimerCommandHandlers << previous;
+    }
+    return true;
+}
+
+void SyncTimer::unregisterTimerCommandHandler(int operation)
+{
+    if (operation >= 0 && operation < TimerCommandHandlerCount) {
+        QMutexLocker locker(&d->timerCommandHandlersMutex);
+        SyncTimerPrivate::TimerCommandHandlerEntry *previous = d->timerCommandHandlers[operation].exchange(nullptr, std::memory_order_acq_rel);
+        if (previous) {
+            d->retiredTimerCommandHandlers << previous;
+        }
+    }
+}
+
+void SyncTimer::scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay, quint16 subTickOffset)
+{
+    const quint64 position{d->delayedStepPosition(delay)};
     if (setOn && duration > 0) {
-        // Schedule an off note for that position
-        scheduleNote(midiNote, midiChannel, false, 64, 0, delay + duration);
+        // Schedule an off note for that position (based on the on note's position, so the two can't drift apart, and either both or neither get scheduled)
+        d->enqueueNotePair(position, subTickOffset, position + duration, subTickOffset, midiChannel, midiNote, velocity);
+    } else {
+        unsigned char note[3];
+        if (setOn) {
+            note[0] = 0x90 + midiChannel;
+        } else {
+            note[0] = 0x80 + midiChannel;
+        }
+        note[1] = midiNote;
+        note[2] = velocity;
+        d->enqueueMidiEvent(position, note, 3, setOn ? ScheduleRecord::NoteMidiOrder : ScheduleRecord::FirstMidiOrder, subTickOffset);
+    }
+}
+
+int SyncTimer::scheduleBatch(const SyncTimer_ScheduleItem *items, int count, int *rejected)
+{
+    // Work out the starting position once, so the whole batch is relative to the same point
+    const int acceptedCount{d->enqueueBatch(d->delayedStepPosition(0), 0, items, count).accepted};
+    if (rejected) {
+        *rejected = count - acceptedCount;
+    }
+    return acceptedCount;
+}
+
+/**
+ * Fill out a schedule result from what happened to a batch
+ */
+static inline void fillScheduleResult(SyncTimer_ScheduleResult *result, int count, const SyncTimerPrivate::BatchOutcome &outcome, double stepLength)
+{
+    if (result) {
+        result->late = outcome.late > 0 ? 1 : 0;
+        result->lateItems = outcome.late;
+        result->latenessTicks = outcome.latenessTicks + (outcome.latenessOffset > 0 ? 1 : 0);
+        result->latenessUsecs = (unsigned long long)((double(outcome.latenessTicks) + (double(outcome.latenessOffset) / SubTickOffsetResolution)) * stepLength);
+        result->rejected = count - outcome.accepted;
+    }
+}
+
+int SyncTimer::scheduleBatchAtTick(const SyncTimer_ScheduleItem *items, int count, quint64 tick, SyncTimer_ScheduleResult *result)
+{
+    if (timerThread->isPaused()) {
+        qWarning() << Q_FUNC_INFO << "Attempted to schedule" << count << "items at an absolute tick while playback is stopped, which makes no sense - rejecting them";
+        fillScheduleResult(result, count, SyncTimerPrivate::BatchOutcome{}, 0);
+        return 0;
+    }
+    quint64 nextStep{0}, stepOffset{0};
+    double stepUsecs{0}, stepLength{0};
+    d->readPlaybackSnapshot(nextStep, stepOffset, stepUsecs, stepLength);
+    // Any item which is late gets put on the next step to be played, and the rest stay where they are
+    const SyncTimerPrivate::BatchOutcome outcome{d->enqueueBatch(stepOffset + tick, 0, items, count, nextStep)};
+    fillScheduleResult(result, count, outcome, stepLength);
+    return outcome.accepted;
+}
+
+int SyncTimer::scheduleBatchAtJackFrame(const SyncTimer_ScheduleItem *items, int count, jack_nframes_t frame, SyncTimer_ScheduleResult *result)
+{
+    quint64 nextStep{0}, stepOffset{0};
+    double stepUsecs{0}, stepLength{0};
+    d->readPlaybackSnapshot(nextStep, stepOffset, stepUsecs, stepLength);
+    if (!d->jackClient || stepLength <= 0) {
+        qWarning() << Q_FUNC_INFO << "Attempted to schedule" << count << "items at a jack frame before the timer has been hooked up to jack - rejecting them";
+        fillScheduleResult(result, count, SyncTimerPrivate::BatchOutcome{}, 0);
+        return 0;
+    }
+    // Work out how many (possibly fractional, and possibly negative) steps the frame is from the next step to be played, using the most recent step length
+    const double ticks{(double(jack_frames_to_time(d->jackClient, frame)) - stepUsecs) / stepLength};
+    const double wholeTicks{std::floor(ticks)};
+    const quint16 subTickOffset{quint16(qMin((ticks - wholeTicks) * SubTickOffsetResolution, SubTickOffsetResolution - 1))};
+    // A frame which is so far in the past that it is before the start of the step ring is counted from the start
+    const quint64 position{wholeTicks < 0 && quint64(-wholeTicks) > nextStep ? 0 : quint64(qint64(nextStep) + qint64(wholeTicks))};
+    const SyncTimerPrivate::BatchOutcome outcome{d->enqueueBatch(position, subTickOffset, items, count, nextStep)};
+    fillScheduleResult(result, count, outcome, stepLength);
+    return outcome.accepted;
+}
+
+bool SyncTimer::scheduleNoteAtTick(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 tick, quint16 subTickOffset, SyncTimer_ScheduleResult *result)
+{
+    SyncTimer_ScheduleItem item{};
+    item.type = SyncTimer_NoteItem;
+    item.midiNote = midiNote;
+    item.midiChannel = midiChannel;
+    item.setOn = setOn ? 1 : 0;
+    item.velocity = velocity;
+    item.duration = duration;
+    item.subTickOffset = subTickOffset;
+    return scheduleBatchAtTick(&item, 1, tick, result) == 1;
+}
+
+bool SyncTimer::scheduleClipCommandAtTick(ClipCommand *command, quint64 tick, SyncTimer_ScheduleResult *result)
+{
+    if (timerThread->isPaused()) {
+        qWarning() << Q_FUNC_INFO << "Attempted to schedule a clip command at an absolute tick while playback is stopped, which makes no sense - rejecting it";
+        fillScheduleResult(result, 1, SyncTimerPrivate::BatchOutcome{}, 0);
+        deleteClipCommand(command);
+        return false;
+    }
+    quint64 nextStep{0}, stepOffset{0};
+    double stepUsecs{0}, stepLength{0};
+    d->readPlaybackSnapshot(nextStep, stepOffset, stepUsecs, stepLength);
+    const quint64 requestedStep{stepOffset + tick};
+    const bool accepted{d->enqueuePointer(qMax(requestedStep, nextStep), ScheduleRecord::ClipCommandType, command)};
+    SyncTimerPrivate::BatchOutcome outcome;
+    outcome.accepted = accepted ? 1 : 0;
+    if (accepted && requestedStep < nextStep) {
+        outcome.late = 1;
+        outcome.latenessTicks = nextStep - requestedStep;
     }
+    fillScheduleResult(result, 1, outcome, stepLength);
+    return accepted;
 }
 
-void SyncTimer::scheduleMidiBuffer(const juce::MidiBuffer& buffer, quint64 delay)
+void SyncTimer::scheduleMidiBuffer(const juce::MidiBuffer& buffer, quint64 delay, quint16 subTickOffset)
 {
-//     qDebug() << Q_FUNC_INFO << "Adding buffer with" << buffer.getNumEvents() << "notes, with delay" << delay << "giving us ring step" << d->delayedStep(delay) << "at ring playhead" << d->stepReadHead << "with cumulative beat" << d->cumulativeBeat;
-    StepData *stepData{d->delayedStep(delay)};
-    stepData->insertMidiBuffer(buffer);
+//     qDebug() << Q_FUNC_INFO << "Adding buffer with" << buffer.getNumEvents() << "notes, with delay" << delay << "giving us ring step" << d->delayedStepPosition(delay) << "at ring playhead" << d->stepReadHeadPosition << "with cumulative beat" << d->cumulativeBeat;
+    d->enqueueMidiBuffer(d->delayedStepPosition(delay), buffer, subTickOffset);
 }
 
 void SyncTimer::sendNoteImmediately(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity)
 {
-    StepData *stepData{d->delayedStep(0)};
+    unsigned char note[3];
     if (setOn) {
-        stepData->insertMidiBuffer(juce::MidiBuffer(juce::MidiMessage::noteOn(midiChannel + 1, midiNote, juce::uint8(velocity))));
+        note[0] = 0x90 + midiChannel;
+        note[2] = velocity;
     } else {
-        stepData->insertMidiBuffer(juce::MidiBuffer(juce::MidiMessage::noteOff(midiChannel + 1, midiNote)));
+        note[0] = 0x80 + midiChannel;
+        note[2] = 0;
     }
+    note[1] = midiNote;
+    d->enqueueMidiEvent(d->delayedStepPosition(0), note, 3, ScheduleRecord::AppendMidiOrder);
 }
 
 void SyncTimer::sendMidiBufferImmediately(const juce::MidiBuffer& buffer)
 {
-    StepData *stepData{d->delayedStep(0)};
-    stepData->insertMidiBuffer(buffer);
+    d->enqueueMidiBuffer(d->delayedStepPosition(0), buffer);
+}
+
+void SyncTimer::cancelClipCommands(ClipAudioSource *clip, int midiChannel)
+{
+    ScheduleRecord record;
+    record.type = ScheduleRecord::CancelClipCommandsType;
+    record.pointer = clip;
+    record.parameter = midiChannel;
+    d->enqueue(record);
+}
+
+void SyncTimer::cancelClipCommands(ClipAudioSource *clip)
+{
+    cancelClipCommands(clip, AnyMidiChannel);
+}
+
+quint64 SyncTimer::stepRingSize() const
+{
+    return d->stepRingCount;
+}
+
+quint64 SyncTimer::lockedMemorySize() const
+{
+    return d->lockedMemorySize;
+}
+
+quint64 SyncTimer::scheduleQueueOverflowCount() const
+{
+    return d->scheduleQueueOverflowCount;
+}
+
+quint64 SyncTimer::scheduleQueueRejectedCount() const
+{
+    return d->scheduleQueueRejectedCount;
 }
 
 bool SyncTimer::timerRunning() {
     return !timerThread->isPaused();
 }
 
-ClipCommand * SyncTimer::getClipCommand()
+SyncTimer::TimerMode SyncTimer::timerMode() const
 {
-    QMutableListIterator<ClipCommand*> freshClipCommandsIterator(d->freshClipCommands);
-    while (freshClipCommandsIterator.hasNext()) {
-        ClipCommand *command = freshClipCommandsIterator.next();
-        if (command) {
-            QMetaObject::invokeMethod(&d->objectGarbageHandler,"start", Qt::QueuedConnection);
-            freshClipCommandsIterator.setValue(nullptr);
-            return command;
-        }
+    return timerThread->getTimerMode();
+}
+
+void SyncTimer::setTimerMode(const TimerMode &timerMode)
+{
+    if (timerThread->getTimerMode() != timerMode) {
+        timerThread->setTimerMode(timerMode);
+        Q_EMIT timerModeChanged();
+    }
+}
+
+quint64 SyncTimer::timerThreadCpuTime() const
+{
+    return timerThread->cpuTime();
+}
+
+quint64 SyncTimer::timerWakeLatenessMaximum() const
+{
+    return timerThread->wakeLatenessMaximum;
+}
+
+quint64 SyncTimer::timerWakeLatenessAverage() const
+{
+    const quint64 wakeCount{timerThread->wakeCount};
+    return wakeCount > 0 ? timerThread->wakeLatenessTotal / wakeCount : 0;
+}
+
+void SyncTimer::resetTimerWakeStatistics()
+{
+    timerThread->resetWakeStatistics();
+}
+
+QVariantMap SyncTimer::timingStatistics() const
+{
+    const TimingStatistics &statistics = timerThread->timingStatistics;
+    QVariantList histogram;
+    for (int bucket = 0; bucket < TimingHistogramBucketCount; ++bucket) {
+        histogram << statistics.intervalHistogram[bucket].load(std::memory_order_relaxed);
     }
-    return nullptr;
+    const quint64 callbackCount{statistics.callbackCount};
+    QVariantMap snapshot;
+    snapshot["intervalHistogram"] = histogram;
+    snapshot["intervalCount"] = quint64(statistics.intervalCount);
+    snapshot["intervalLateMaximum"] = quint64(statistics.intervalLateMaximum);
+    snapshot["intervalEarlyMaximum"] = quint64(statistics.intervalEarlyMaximum);
+    snapshot["latenessMaximum"] = quint64(statistics.latenessMaximum);
+    snapshot["latenessAverage"] = callbackCount > 0 ? quint64(statistics.latenessTotal) / callbackCount : 0;
+    snapshot["callbackCount"] = callbackCount;
+    snapshot["adjustmentCount"] = quint64(statistics.adjustmentCount);
+    snapshot["adjustmentTotal"] = qint64(statistics.adjustmentTotal);
+    snapshot["playheadLag"] = qint64(statistics.playheadLag);
+    snapshot["playheadLagMaximum"] = quint64(statistics.playheadLagMaximum);
+    snapshot["wakeLatenessMaximum"] = timerWakeLatenessMaximum();
+    snapshot["wakeLatenessAverage"] = timerWakeLatenessAverage();
+    return snapshot;
+}
+
+void SyncTimer::resetTimingStatistics()
+{
+    timerThread->timingStatistics.reset();
+    timerThread->resetWakeStatistics();
+    Q_EMIT timingStatisticsChanged();
+}
+
+ClipCommand * SyncTimer::getClipCommand()
+{
+    return d->clipCommandPool.acquire();
 }
 
 void SyncTimer::deleteClipCommand(ClipCommand* command)
 {
-    d->clipCommandsToDelete << command;
-    QMetaObject::invokeMethod(&d->objectGarbageHandler,"start", Qt::QueuedConnection);
+    d->retireClipCommand(command);
 }
 
 TimerCommand * SyncTimer::getTimerCommand()
 {
-    QMutableListIterator<TimerCommand*> freshTimerCommandsIterator(d->freshTimerCommands);
-    while (freshTimerCommandsIterator.hasNext()) {
-        TimerCommand *command = freshTimerCommandsIterator.next();
-        if (command) {
-            QMetaObject::invokeMethod(&d->objectGarbageHandler,"start", Qt::QueuedConnection);
-            freshTimerCommandsIterator.setValue(nullptr);
-            return command;
-        }
-    }
-    return nullptr;
+    return d->timerCommandPool.acquire();
 }
 
 void SyncTimer::deleteTimerCommand(TimerCommand* command)
 {
-    d->timerCommandsToDelete << command;
-    QMetaObject::invokeMethod(&d->objectGarbageHandler,"start", Qt::QueuedConnection);
+    if (command->operation == TimerCommand::SendLongMidiMessageOperation && command->dataParameter) {
+        d->longMidiMessagePool.release(static_cast<LongMidiMessage*>(command->dataParameter));
+    }
+    d->timerCommandPool.release(command);
+}
+
+quint32 SyncTimer::clipCommandPoolHighWaterMark() const
+{
+    return d->clipCommandPool.highWaterMark;
+}
+
+quint64 SyncTimer::clipCommandPoolExhaustionCount() const
+{
+    return d->clipCommandPool.exhaustionCount;
+}
+
+quint32 SyncTimer::timerCommandPoolHighWaterMark() const
+{
+    return d->timerCommandPool.highWaterMark;
+}
+
+quint64 SyncTimer::timerCommandPoolExhaustionCount() const
+{
+    return d->timerCommandPool.exhaustionCount;
 }
 
 void SyncTimer::process(jack_nframes_t /*nframes*/, void */*buffer*/, quint64 *jackPlayhead, quint64 *jackSubbeatLengthInMicroseconds)
@@ -1160,6 +4268,169 @@ void SyncTimer::process(jack_nframes_t /*nframes*/, void */*buffer*/, quint64 *j
     *jackSubbeatLengthInMicroseconds = d->jackSubbeatLengthInMicrosecondsReturn;
 }
 
+bool SyncTimer::isFused() const
+{
+    return d->fused;
+}
+
+void SyncTimer::attachToFusedClient(jack_client_t *client, jack_port_t *latencyPort)
+{
+    if (!d->fused) {
+        qWarning() << Q_FUNC_INFO << "Attempted to attach SyncTimer to a jack client while not running fused - ignoring";
+        return;
+    }
+    d->jackClient = client;
+    d->latencyPort = latencyPort;
+    // This has to happen before the client is activated, which is also why we get called by ZLRouter before it does so
+    jack_set_latency_callback(d->jackClient, client_latency_callback, static_cast<void*>(d));
+    jack_latency_range_t range;
+    jack_port_get_latency_range(d->latencyPort, JackPlaybackLatency, &range);
+    const jack_nframes_t bufferSize = jack_get_buffer_size(d->jackClient);
+    const jack_nframes_t sampleRate = jack_get_sample_rate(d->jackClient);
+    d->jackLatency = (1000 * (double)qMax(bufferSize, range.max)) / (double)sampleRate;
+    d->updateScheduleAheadAmount();
+    qInfo() << "SyncTimer: Attached to ZLRouter's Jack client, and will suggest scheduling things" << scheduleAheadAmount() << "steps into the future";
+}
+
+void SyncTimer::processFused(jack_nframes_t nframes, jack_midi_event_t **events, uint32_t *eventCount, quint64 *jackPlayhead, quint64 *jackSubbeatLengthInMicroseconds)
+{
+    d->process(nframes);
+    *events = d->fusedEvents;
+    *eventCount = d->fusedEventCount;
+    *jackPlayhead = d->jackPlayheadReturn;
+    *jackSubbeatLengthInMicroseconds = d->jackSubbeatLengthInMicrosecondsReturn;
+}
+
+bool SyncTimer::readyToFollow(jack_transport_state_t state, jack_position_t* position)
+{
+    if (d->jackTransportFollower && state == JackTransportStarting) {
+        const double tick{d->transportTick(*position)};
+        if (timerThread->isPaused()) {
+            // Ask for playback to start on the first tick at or after the transport's position, and hold the transport until it has
+            if (d->followerStartRequested.exchange(true) == false) {
+                d->relocatedStartPosition = quint64(std::ceil(tick));
+                Q_EMIT pleaseStartPlayback();
+            }
+            return false;
+        } else if (std::abs(double(d->jackPlayhead) - tick) > TransportFollowerRelocationThreshold) {
+            // The transport has been relocated while we were playing, so stop, and we'll be started again at the new position
+            if (d->followerStopRequested.exchange(true) == false) {
+                Q_EMIT pleaseStopPlayback();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SyncTimer::jackTransportFollower() const
+{
+    return d->jackTransportFollower;
+}
+
+void SyncTimer::setJackTransportFollower(const bool& jackTransportFollower)
+{
+    if (d->jackTransportFollower != jackTransportFollower) {
+        d->jackTransportFollower = jackTransportFollower;
+        d->transportManager->setJackTransportFollower(jackTransportFollower);
+        Q_EMIT jackTransportFollowerChanged();
+    }
+}
+
+quint64 SyncTimer::midiChannelLatencyCompensation(int midiChannel) const
+{
+    if (midiChannel > -1 && midiChannel < 16) {
+        return d->midiChannelLatencyCompensation[midiChannel];
+    }
+    return 0;
+}
+
+quint64 SyncTimer::samplerLatencyCompensation() const
+{
+    return d->samplerLatencyCompensation;
+}
+
+QObject *SyncTimer::modulationEngine() const
+{
+    return d->modulationEngine;
+}
+
+QObject *SyncTimer::automationEngine() const
+{
+    return d->automationEngine;
+}
+
+void SyncTimer::setMidiChannelLatencyCompensation(int midiChannel, quint64 usecs)
+{
+    if (midiChannel > -1 && midiChannel < 16) {
+        d->midiChannelLatencyCompensation[midiChannel] = quint32(qMin(usecs, quint64(std::numeric_limits<quint32>::max())));
+        if (usecs > 0) {
+            d->midiChannelLatencyCompensationMask.fetch_or(quint16(1 << midiChannel));
+        } else {
+            d->midiChannelLatencyCompensationMask.fetch_and(quint16(~(1 << midiChannel)));
+        }
+    }
+}
+
+void SyncTimer::setSamplerLatencyCompensation(quint64 usecs)
+{
+    d->samplerLatencyCompensation = quint32(qMin(usecs, quint64(std::numeric_limits<quint32>::max())));
+}
+
+bool SyncTimer::metronomeEnabled() const
+{
+    return d->metronomeEnabled;
+}
+
+void SyncTimer::setMetronomeEnabled(const bool& metronomeEnabled)
+{
+    if (d->metronomeEnabled != metronomeEnabled) {
+        d->metronomeEnabled = metronomeEnabled;
+        Q_EMIT metronomeEnabledChanged();
+    }
+}
+
+float SyncTimer::metronomeVolume() const
+{
+    return d->metronomeVolume;
+}
+
+void SyncTimer::setMetronomeVolume(const float& metronomeVolume)
+{
+    const float adjusted{std::clamp(metronomeVolume, 0.0f, 1.0f)};
+    if (d->metronomeVolume != adjusted) {
+        d->metronomeVolume = adjusted;
+        Q_EMIT metronomeVolumeChanged();
+    }
+}
+
+bool SyncTimer::metronomeAccent() const
+{
+    return d->metronomeAccent;
+}
+
+void SyncTimer::setMetronomeAccent(const bool& metronomeAccent)
+{
+    if (d->metronomeAccent != metronomeAccent) {
+        d->metronomeAccent = metronomeAccent;
+        Q_EMIT metronomeAccentChanged();
+    }
+}
+
+int SyncTimer::metronomeOpeningBars() const
+{
+    return d->metronomeOpeningBars;
+}
+
+void SyncTimer::setMetronomeOpeningBars(const int& metronomeOpeningBars)
+{
+    const int adjusted{qMax(0, metronomeOpeningBars)};
+    if (d->metronomeOpeningBars != adjusted) {
+        d->metronomeOpeningBars = adjusted;
+        Q_EMIT metronomeOpeningBarsChanged();
+    }
+}
+
 void SyncTimer::setPosition(jack_position_t* position) const
 {
     position->bar = d->jackBar;
@@ -5,6 +5,7 @@
 #include <QList>
 #include <QVariant>
 #include <jack/types.h>
+#include <jack/midiport.h>
 
 using namespace std;
 
@@ -13,13 +14,78 @@ namespace juce {
 }
 struct ClipCommand;
 struct TimerCommand;
+struct SyncTimer_ScheduleItem;
+struct SyncTimer_ScheduleResult;
+struct SyncTimer_Tick;
+struct SyncTimer_SentClipCommand;
 class ClipAudioSource;
 class SyncTimerPrivate;
+/**
+ * \brief A function which handles a specific timer command operation (see SyncTimer::registerTimerCommandHandler())
+ * @param command The timer command to handle (it is returned to the pool once the handler returns)
+ * @param playhead The timer tick the command is being handled on
+ * @param usecs The jack time in microseconds at which the command's step is played
+ * @param userData The data pointer passed along when registering the handler
+ */
+typedef void (*TimerCommandHandler)(TimerCommand *command, quint64 playhead, quint64 usecs, void *userData);
 class SyncTimer : public QObject {
   // HighResolutionTimer facade
   Q_OBJECT
   Q_PROPERTY(quint64 bpm READ getBpm WRITE setBpm NOTIFY bpmChanged)
+  /**
+   * \brief The timer's bpm, including any fractional part
+   */
+  Q_PROPERTY(double preciseBpm READ getPreciseBpm WRITE setPreciseBpm NOTIFY bpmChanged)
   Q_PROPERTY(quint64 scheduleAheadAmount READ scheduleAheadAmount NOTIFY scheduleAheadAmountChanged)
+  /**
+   * \brief How the timer thread waits between running the registered callbacks
+   * @see TimerMode
+   * @default SpinningTimerMode (or whatever is set in the ZYNTHBOX_SYNCTIMER_MODE environment variable, as one of spin, sleep, or jack)
+   */
+  Q_PROPERTY(TimerMode timerMode READ timerMode WRITE setTimerMode NOTIFY timerModeChanged)
+  /**
+   * \brief A snapshot of the timer's timing statistics
+   * @see timingStatistics()
+   */
+  Q_PROPERTY(QVariantMap timingStatistics READ timingStatistics NOTIFY timingStatisticsChanged)
+  /**
+   * \brief Whether to follow the jack transport, rather than acting as its timebase master
+   * When following, the jack transport's position and bpm are read on every process cycle, and steps are played against
+   * the external frame position. Playback is started and stopped along with the jack transport (through pleaseStartPlayback()
+   * and pleaseStopPlayback()), and relocating the jack transport will restart playback at the new position.
+   * @default false
+   */
+  Q_PROPERTY(bool jackTransportFollower READ jackTransportFollower WRITE setJackTransportFollower NOTIFY jackTransportFollowerChanged)
+  /**
+   * \brief Whether to emit clipCommandSent for every single clip command sent to SamplerSynth
+   * This is only here for compatibility, as dense patterns cause a great many signal emissions. Prefer
+   * addClipCommandsSentCallback(), which is told about all the commands sent during a tick in a single call.
+   * @default false
+   */
+  Q_PROPERTY(bool emitClipCommandSent READ emitClipCommandSent WRITE setEmitClipCommandSent NOTIFY emitClipCommandSentChanged)
+  /**
+   * \brief Whether the built-in metronome should click on every beat during playback
+   * The clicks are rendered by SamplerSynth into its global uneffected channel, at the exact time of the beat's step,
+   * so they are sample-accurately in time with everything else. Use SamplerSynth::setMetronomeSounds() to change the sounds.
+   * @default false
+   */
+  Q_PROPERTY(bool metronomeEnabled READ metronomeEnabled WRITE setMetronomeEnabled NOTIFY metronomeEnabledChanged)
+  /**
+   * \brief The volume of the metronome clicks (from 0.0 through 1.0)
+   * @default 1.0
+   */
+  Q_PROPERTY(float metronomeVolume READ metronomeVolume WRITE setMetronomeVolume NOTIFY metronomeVolumeChanged)
+  /**
+   * \brief Whether the first beat of each bar should use the accent sound
+   * @default true
+   */
+  Q_PROPERTY(bool metronomeAccent READ metronomeAccent WRITE setMetronomeAccent NOTIFY metronomeAccentChanged)
+  /**
+   * \brief The number of bars at the start of playback during which the metronome clicks, even when it is not enabled
+   * This is not a count-in: playback starts straight away, and the metronome simply plays along with its first bars
+   * @default 0
+   */
+  Q_PROPERTY(int metronomeOpeningBars READ metronomeOpeningBars WRITE setMetronomeOpeningBars NOTIFY metronomeOpeningBarsChanged)
 public:
   static SyncTimer* instance() {
     static SyncTimer* instance{nullptr};
@@ -32,12 +98,67 @@ public:
   virtual ~SyncTimer();
   void addCallback(void (*functionPtr)(int));
   void removeCallback(void (*functionPtr)(int));
+  /**
+   * \brief The function signature for tick callbacks
+   * @param ticks An array of ticks (see SyncTimer_Tick in libzl.h)
+   * @param count The number of ticks in the array (always 1 for callbacks called on the timer thread)
+   * @param userData The user data pointer passed to addTickCallback()
+   */
+  using TickCallback = void(*)(const SyncTimer_Tick *ticks, int count, void *userData);
+  /**
+   * \brief Register a function to be called for timer ticks
+   * Unlike addCallback(), this allows you to only be told about some ticks (for example every beat, by passing a divisor
+   * of getMultiplier(), or every bar, by passing four times that), and each tick comes with the jack time it will be played at.
+   * You can also ask for the ticks to be delivered on a separate worker thread, in which case they will arrive in batches
+   * of however many have passed since the last delivery. This means a slow callback (say, one which needs to take Python's
+   * global interpreter lock) will not hold up the timer. If such a callback is too slow to keep up, ticks will eventually be
+   * dropped rather than delay the timer (see droppedTickCount()).
+   * @note There are 16 spaces for tick callbacks
+   * @param callback The function to call
+   * @param userData A pointer which will be passed back to the callback (the same callback can be registered multiple times with different user data)
+   * @param divisor The callback will be called for every tick where the cumulative beat is a multiple of this number
+   * @param useWorkerThread Whether to call the callback on the worker thread (true) or directly on the timer thread (false)
+   * @return True if the callback was registered, false if there was no space left for it
+   */
+  bool addTickCallback(TickCallback callback, void *userData, quint64 divisor = 1, bool useWorkerThread = false);
+  /**
+   * \brief Remove a callback registered using addTickCallback()
+   * When this function returns, the callback is guaranteed to no longer be in use (unless you call this from inside the callback itself)
+   * @note As the timer thread must never wait on the worker thread, calling this from the timer thread (for example from inside a
+   * callback run there) for a callback which uses the worker thread will not wait for the worker to be done with it. The callback
+   * will not be called with any ticks after this returns, but a delivery already under way might still be finishing up.
+   * @param callback The function previously registered
+   * @param userData The user data the function was registered with
+   */
+  void removeTickCallback(TickCallback callback, void *userData);
+  /**
+   * \brief The number of ticks which have been dropped because the callback worker was not keeping up
+   * @return The number of dropped ticks since the timer was created
+   */
+  Q_INVOKABLE quint64 droppedTickCount() const;
   void queueClipToStart(ClipAudioSource *clip);
   void queueClipToStop(ClipAudioSource *clip);
   void queueClipToStartOnChannel(ClipAudioSource *clip, int midiChannel);
   void queueClipToStopOnChannel(ClipAudioSource *clip, int midiChannel);
   void start(int bpm);
   void stop();
+  /**
+   * \brief Make the next playback session start at the given position, rather than at the start
+   * When playback is next started, cumulativeBeat() and jackPlayhead() will start counting from this position, and the
+   * jack transport position will match. This only affects the next start, after which it is set back to 0.
+   * @note This is only possible while the timer is stopped
+   * @param tick The position to start at, in timer ticks
+   * @return True if playback will be relocated, false if the timer is running
+   */
+  bool relocate(quint64 tick);
+  /**
+   * \brief Nudge the playback position by the given number of microseconds
+   * Use this to keep the timer in phase with some external clock. All upcoming steps are moved together,
+   * so nothing scheduled is lost, and the nudge is counted in the timing statistics.
+   * @note This is safe to call from any thread (including the jack process call)
+   * @param microseconds How much earlier to play things (a negative amount will play things later)
+   */
+  void addAdjustmentByMicroseconds(qint64 microseconds);
   void stopClip(ClipAudioSource *clip);
   int getInterval(int bpm);
   /**
@@ -63,7 +184,7 @@ public:
   Q_INVOKABLE int getMultiplier();
   /**
    * \brief The timer's current bpm rate
-   * @return The number of beats per minute currently used as the basis for the timer's operation
+   * @return The number of beats per minute currently used as the basis for the timer's operation (rounded to the nearest whole number)
    */
   Q_INVOKABLE quint64 getBpm() const;
   /**
@@ -71,7 +192,124 @@ public:
    * @param bpm The bpm you wish the timer to operate at
    */
   Q_INVOKABLE void setBpm(quint64 bpm);
+  /**
+   * \brief The timer's current bpm rate, including any fractional part
+   * @return The number of beats per minute currently used as the basis for the timer's operation
+   */
+  Q_INVOKABLE double getPreciseBpm() const;
+  /**
+   * \brief Sets the timer's bpm rate, including a fractional part
+   * @note The bpm is clamped to fit between 50 and 200, and the fractional part is kept to a precision of a thousandth of a beat per minute
+   * @note If a tempo ramp is playing when this change reaches playback, the ramp will be stopped
+   * @param bpm The bpm you wish the timer to operate at
+   */
+  Q_INVOKABLE void setPreciseBpm(double bpm);
   Q_SIGNAL void bpmChanged();
+  /**
+   * \brief Schedule a gradual change of bpm
+   * The tempo changes linearly from startBpm on the first step of the ramp, reaching endBpm on the step
+   * following the ramp's last step, and then stays at endBpm. The length of each step in the ramp is
+   * worked out when calling this function, so playback only needs to look them up.
+   * @note Scheduling a ramp replaces any ramp which has not yet finished playing
+   * @note This is safe to call from any thread, but it is not realtime safe (calculating the ramp takes a little while)
+   * @param startBpm The bpm at the start of the ramp
+   * @param endBpm The bpm at the end of the ramp
+   * @param duration The number of timer ticks the ramp should take (at most 8192, which is a little over 85 beats)
+   * @param delay The number of timer ticks from the current position until the start of the ramp
+   */
+  Q_INVOKABLE void scheduleTempoRamp(double startBpm, double endBpm, quint64 duration, quint64 delay = 0);
+  /**
+   * \brief Set a groove template for a midi channel, which is applied to events on that channel as they are played
+   * A groove is a table laid out over a bar, with a timing displacement and a velocity scale for each entry. The entries
+   * are spread evenly over the bar (so for example 16 entries each cover a sixteenth note). Events are scheduled as normal
+   * (that is, straight), and when an event is played, the entry for the event's position in the bar is looked up, and the
+   * event is sent that much later, with note on velocities scaled by the entry's scale. Clip commands on the sampler channel
+   * with the same number are treated the same way, with their volume scaled instead of velocity.
+   * Setting a new groove replaces any existing groove on the channel, and changes take effect on the next process call.
+   * @note Grooves are only applied while playing, as they follow the bar position
+   * @note Events can only be moved later (a displacement of up to one bar), as the step has already been reached when its events are read
+   * @param midiChannel The midi channel to set the groove for (0 through 15)
+   * @param tickDisplacements How many ticks later than their step to send events, for each entry (fractions are fine, and null means no displacement)
+   * @param velocityScales The amount to scale note on velocities by, for each entry (null means leave velocities alone)
+   * @param length The number of entries in the groove (must divide evenly into a bar of 384 ticks)
+   */
+  void setGroove(int midiChannel, const double *tickDisplacements, const float *velocityScales, int length);
+  /**
+   * \brief Set a groove template for a midi channel
+   * @see setGroove(int, const double*, const float*, int)
+   * @param midiChannel The midi channel to set the groove for (0 through 15)
+   * @param tickDisplacements How many ticks later than their step to send events, for each entry
+   * @param velocityScales The amount to scale note on velocities by, for each entry (must have the same number of entries as tickDisplacements)
+   */
+  Q_INVOKABLE void setGroove(int midiChannel, const QVariantList &tickDisplacements, const QVariantList &velocityScales);
+  /**
+   * \brief Remove the groove template from a midi channel
+   * @param midiChannel The midi channel to clear the groove for (0 through 15)
+   */
+  Q_INVOKABLE void clearGroove(int midiChannel);
+
+  /**
+   * \brief Register a part for native playback
+   * Once registered, a part is played in a loop from the step a TimerCommand::StartPartOperation for it is scheduled
+   * on, until the step a TimerCommand::StopPartOperation for it is scheduled on (both using the channel, track, and
+   * part as parameter, parameter2, and parameter3). The part's items are put into the schedule by the jack process
+   * call just before each step is played, so nothing needs to be scheduled step by step while the part plays, and
+   * starting and stopping happens exactly on the step the command was scheduled for. Starts and stops can be scheduled
+   * ahead of time (such as starting on bar 5, stopping on bar 9, and starting again on bar 13), with up to 16 of them
+   * waiting for each part at any one time (any beyond that are dropped, see scheduleQueueOverflowCount()).
+   * Registering a part for a slot which already has one replaces it, without interrupting playback.
+   * @note The items' delays are their step inside the part (and must be less than the part's length). Notes, midi
+   *       messages, and clips are supported, while timer command items are ignored.
+   * @note Stopping a part stops any looping clips it started, but lets any notes it started play out their duration
+   * @param channel The channel the part belongs to (0 through 9)
+   * @param track The track on the channel the part belongs to (0 through 9)
+   * @param part The index of the part on the track (0 through 4)
+   * @param length The number of steps in a single loop of the part
+   * @param items The part's items (at most 512)
+   * @param count The number of items
+   * @return True if the part was registered
+   */
+  bool registerPart(int channel, int track, int part, quint64 length, const SyncTimer_ScheduleItem *items, int count);
+  /**
+   * \brief Unregister a part, stopping its playback if it is playing
+   * @param channel The channel the part belongs to (0 through 9)
+   * @param track The track on the channel the part belongs to (0 through 9)
+   * @param part The index of the part on the track (0 through 4)
+   */
+  Q_INVOKABLE void unregisterPart(int channel, int track, int part);
+
+  /**
+   * \brief Send a note off for every note which has been sent out by the timer and not yet turned off
+   * The timer keeps a ledger of the notes it has sent out, so this sends out exactly the note offs which are
+   * needed, all in the next jack process call. Any notes which are being held back to be sent part of the way
+   * into a step (because of a sub-tick offset or a groove) are dropped. Playback and the schedule are otherwise
+   * left alone (stopping playback also silences all sounding notes in the same way).
+   * @note This is safe to call from any thread
+   */
+  Q_INVOKABLE void panic();
+  /**
+   * \brief Whether the timer has sent out a note on for the given note, and not yet a note off
+   * @param midiChannel The midi channel of the note (0 through 15)
+   * @param midiNote The note (0 through 127)
+   * @return True if the note is currently sounding
+   */
+  Q_INVOKABLE bool isNoteActive(int midiChannel, int midiNote) const;
+  /**
+   * \brief A list of all the notes the timer has sent out a note on for, and not yet a note off
+   * Useful for showing hanging notes. Each entry is a map with the keys "midiChannel" and "midiNote".
+   * @note This is a snapshot, and may be out of date as soon as it has been fetched
+   * @return The list of currently sounding notes, in channel and note order
+   */
+  Q_INVOKABLE QVariantList activeNotes() const;
+  /**
+   * \brief Fetch the currently sounding notes into the given arrays
+   * @see activeNotes()
+   * @param midiChannels An array which will be filled with the midi channel of each sounding note
+   * @param midiNotes An array which will be filled with each sounding note
+   * @param maximum The number of entries there is space for in the arrays
+   * @return The number of entries which were filled out
+   */
+  int activeNotes(unsigned char *midiChannels, unsigned char *midiNotes, int maximum) const;
 
   /**
    * \brief Returns the number of timer ticks you should schedule midi events for to ensure they won't get missed
@@ -116,6 +354,14 @@ public:
    * @return The current length of a subbeat in microseconds
    */
   const quint64 &jackSubbeatLengthInMicroseconds() const;
+  /**
+   * \brief The jack playback time (in usecs) at which the given timer tick will be played
+   * This takes any scheduled tempo ramp into account, and is calculated without accumulating rounding
+   * errors, so it can be used to keep things aligned to the beat over long periods of time
+   * @param tick A timer tick in the same position as jackPlayhead()
+   * @return The time in usecs at which the tick will be played (or was played, for ticks in the past)
+   */
+  quint64 jackPlayheadUsecsForTick(quint64 tick) const;
 
   /**
    * \brief Schedule an audio clip to have one or more commands run on it on the next tick of the timer
@@ -124,15 +370,65 @@ public:
    * will be marked to be done on the existing command).
    * @note This function will take ownership of the command, and you should expect it to no longer exist after (especially if the above happens)
    * @note If you want the clip to loop (or not), set this on the clip itself along with the other clip properties
+   * @note To have the command take effect part of the way into the tick, set the command's subTickOffset
    * @param command The audio clip command you wish to fire on at the specified time
    * @param delay A delay in number of timer ticks counting from the current position
    */
   void scheduleClipCommand(ClipCommand *command, quint64 delay);
+  /**
+   * \brief Cancel all scheduled commands for the given clip on the given channel
+   * Any command for the clip which has been scheduled before this call, and which has not yet been
+   * sent to SamplerSynth, will be deleted instead of run.
+   * @note This is safe to call from any thread
+   * @param clip The clip to cancel scheduled commands for
+   * @param midiChannel The channel to cancel commands on (-2 through 9, as for ClipCommand::midiChannel)
+   */
+  void cancelClipCommands(ClipAudioSource *clip, int midiChannel);
+  /**
+   * \brief Cancel all scheduled commands for the given clip on all channels
+   * @see cancelClipCommands(ClipAudioSource*, int)
+   * @param clip The clip to cancel scheduled commands for
+   */
+  void cancelClipCommands(ClipAudioSource *clip);
   /**
     * \brief Fired whenever a scheduled clip command has been sent to SamplerSynth
+    * @note This is only emitted when emitClipCommandSent is true (prefer addClipCommandsSentCallback(), which gets all the commands in one go)
     * @param clipCommand The clip command which has just been sent to SamplerSynth
     */
   Q_SIGNAL void clipCommandSent(ClipCommand *clipCommand);
+  bool emitClipCommandSent() const;
+  void setEmitClipCommandSent(const bool &emitClipCommandSent);
+  Q_SIGNAL void emitClipCommandSentChanged();
+  /**
+   * \brief The function signature for sent clip command callbacks
+   * @param commands An array of the clip commands sent out since the last call, in the order they were sent (see SyncTimer_SentClipCommand in libzl.h)
+   * @param count The number of commands in the array
+   * @param userData The user data pointer passed to addClipCommandsSentCallback()
+   */
+  using ClipCommandsSentCallback = void(*)(const SyncTimer_SentClipCommand *commands, int count, void *userData);
+  /**
+   * \brief Register a function to be told about the clip commands which have been sent to SamplerSynth
+   * The function is called on the timer thread, once for each timer tick during which any commands have been sent,
+   * with all of those commands in a single array. The array is only valid until the function returns.
+   * stop() also announces anything still outstanding from the thread it is called on, so it is possible (if rare) for two
+   * calls to be under way at the same time. No locks are held during the call, so it is safe to call back into SyncTimer.
+   * @note There are 16 spaces for these callbacks
+   * @note You must not delete the commands, as SamplerSynth takes ownership of them
+   * @param callback The function to call
+   * @param userData A pointer which will be passed back to the callback
+   * @return True if the callback was registered, false if there was no space left for it
+   */
+  bool addClipCommandsSentCallback(ClipCommandsSentCallback callback, void *userData);
+  /**
+   * \brief Remove a callback registered using addClipCommandsSentCallback()
+   * When this function returns, the callback is guaranteed to no longer be in use (unless you call this from inside the callback itself)
+   * @note As the timer thread must never wait on the worker thread, calling this from the timer thread (for example from inside a
+   * callback run there) for a callback which uses the worker thread will not wait for the worker to be done with it. The callback
+   * will not be called with any ticks after this returns, but a delivery already under way might still be finishing up.
+   * @param callback The function previously registered
+   * @param userData The user data the function was registered with
+   */
+  void removeClipCommandsSentCallback(ClipCommandsSentCallback callback, void *userData);
 
   /**
    * \brief Schedule a playback command into the playback schedule to be sent with the given delay
@@ -142,7 +438,8 @@ public:
    * @param parameter1 An integer optionally used by the command's handler to perform its work
    * @param parameter2 A second integer optionally used by the command's handler to perform its work
    * @param parameter2 A third integer optionally used by the command's handler to perform its work
-   * @param variantParameter A QVariant used by the parameter's handler, if an integer is insufficient
+   * @param variantParameter Converted into the command's plain data before scheduling (a pointer is stored in dataParameter,
+   *                         and anything which can be converted to a number is stored as a double in the payload)
    */
   void scheduleTimerCommand(quint64 delay, int operation, int parameter1 = 0, int parameter2 = 0, int parameter3 = 0, const QVariant &variantParameter = QVariant());
 
@@ -165,25 +462,48 @@ public:
    */
   Q_SIGNAL void timerCommand(TimerCommand *command);
 
+  /**
+   * \brief Register a function which handles timer commands with the given operation
+   * The handler is called directly from the jack process call, on the step the command is scheduled for, and as
+   * such must be realtime safe (no allocations, locks, or Qt signals). Only one handler can be registered for each
+   * operation, and registering a new one replaces the previous.
+   * @note The operations which SyncTimer handles itself (playback, bpm, parts, clip commands, and the internal clip
+   *       registration ones) cannot be given a handler
+   * @param operation The operation to handle (0 through 255, see TimerCommand::Operation)
+   * @param handler The function to call for commands with the given operation
+   * @param userData A pointer which is passed back to the handler (for example the object which should do the work)
+   * @return True if the handler was registered, false if the operation cannot have a handler
+   */
+  bool registerTimerCommandHandler(int operation, TimerCommandHandler handler, void *userData = nullptr);
+  /**
+   * \brief Remove the handler for the given operation (commands with that operation will then be ignored)
+   * @param operation The operation to remove the handler for
+   */
+  void unregisterTimerCommandHandler(int operation);
+
   /**
    * \brief Schedule a note message to be sent on the next tick of the timer
-   * @note This is not thread-safe in itself - when the timer is running, don't call this function outside of a callback
+   * @note This is safe to call from any thread (see scheduleQueueOverflowCount())
    * @param midiNote The note you wish to change the state of
    * @param midiChannel The channel you wish to change the given note on
    * @param setOn Whether or not you are turning the note on
    * @param velocity The velocity of the note (only matters if you're turning it on)
    * @param duration An optional duration for on notes (0 means don't schedule a release, higher will schedule an off at the durationth beat from the start of the note)
    * @param delay A delay in numbers of timer ticks counting from the current position
+   * @param subTickOffset How far into the tick the note should be sent, in 1/65536ths of a tick (any note off scheduled using duration gets the same offset)
    */
-  void scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay);
+  void scheduleNote(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 delay, quint16 subTickOffset = 0);
 
   /**
    * \brief Schedule a buffer of midi messages (the Juce type) to be sent with the given delay
-   * @note This is not thread-safe in itself - when the timer is running, don't call this function outside of a callback
+   * @note This is safe to call from any thread (see scheduleQueueOverflowCount())
+   * @note Messages longer than three bytes (such as sysex messages) are sent at the start of their step, after the step's
+   *       other events, without the sub-tick offset. Messages longer than 512 bytes are dropped (see scheduleQueueRejectedCount())
    * @param buffer The buffer that you wish to add to the schedule
    * @param delay The delay (if any) you wish to add
+   * @param subTickOffset How far into the tick the messages should be sent, in 1/65536ths of a tick
    */
-  void scheduleMidiBuffer(const juce::MidiBuffer& buffer, quint64 delay);
+  void scheduleMidiBuffer(const juce::MidiBuffer& buffer, quint64 delay, quint16 subTickOffset = 0);
 
   /**
    * \brief Send a note message immediately (ensuring it goes through the step sequencer output)
@@ -196,22 +516,270 @@ public:
 
   /**
    * \brief Send a set of midi messages out immediately (ensuring they go through the step sequencer output)
+   * @note Messages longer than 512 bytes (such as very large sysex messages) are dropped (see scheduleQueueRejectedCount())
    * @param buffer The buffer that you wish to send out immediately
    */
   void sendMidiBufferImmediately(const juce::MidiBuffer& buffer);
+  /**
+   * \brief Schedule a batch of notes, midi messages, clips, and timer commands
+   * All the items' delays are counted from the same position (the position a delay of 0 would give at the time
+   * of calling), so all the items for a step or bar end up exactly where they should be in relation to each other.
+   * @see SyncTimer_ScheduleItem in libzl.h for a description of the items
+   * @note This is safe to call from any thread
+   * @param items An array of items to schedule
+   * @param count The number of items in the array
+   * @param rejected If not null, this will be set to the number of items which were not scheduled
+   * @return The number of items which were scheduled
+   */
+  int scheduleBatch(const SyncTimer_ScheduleItem *items, int count, int *rejected = nullptr);
+  /**
+   * \brief Schedule a batch of items, with all the delays counted from the given absolute tick
+   * Unlike scheduleBatch(), the starting position does not depend on how far ahead the timer has got at the time
+   * of calling, so this is the one to use when you know exactly which tick something belongs on (for example the
+   * first tick of the next bar).
+   * @note Any item whose tick has already been played is put on the next tick to be played instead, and the result
+   *       will tell you how many items were late, and by how much. Items which are not late stay where they were asked
+   *       to be. Whether something is late is decided against the most recently completed jack process call, so it is
+   *       safe to call from any thread.
+   * @note This only makes sense while playback is running, and all items will be rejected when it is not
+   * @param items An array of items to schedule
+   * @param count The number of items in the array
+   * @param tick The absolute playback tick (as counted from the start of playback, like jackPlayhead()) to count the delays from
+   * @param result If not null, this will be filled out with how many items were late (and by how much), and how many were rejected
+   * @return The number of items which were scheduled
+   */
+  int scheduleBatchAtTick(const SyncTimer_ScheduleItem *items, int count, quint64 tick, SyncTimer_ScheduleResult *result = nullptr);
+  /**
+   * \brief Schedule a batch of items, with all the delays counted from the given jack frame time
+   * The frame is converted to the tick it will fall on (including the sub-tick offset) using the step length of the
+   * most recent jack process call, which means that any tempo changes (or tempo ramps) between now and the frame
+   * are not accounted for. For things further ahead than a bar or so, prefer scheduleBatchAtTick().
+   * @note Unlike scheduleBatchAtTick(), this also works while playback is stopped
+   * @note This is safe to call from any thread
+   * @param items An array of items to schedule
+   * @param count The number of items in the array
+   * @param frame The jack frame time (as used by jack_frames_to_time()) to count the delays from
+   * @param result If not null, this will be filled out with how many items were late (and by how much), and how many were rejected
+   * @return The number of items which were scheduled
+   */
+  int scheduleBatchAtJackFrame(const SyncTimer_ScheduleItem *items, int count, jack_nframes_t frame, SyncTimer_ScheduleResult *result = nullptr);
+  /**
+   * \brief Schedule a note at an absolute tick
+   * @see scheduleBatchAtTick()
+   * @param midiNote The note you wish to change the state of
+   * @param midiChannel The channel you wish to change the given note on
+   * @param setOn Whether or not you are turning the note on
+   * @param velocity The velocity of the note (only matters if you're turning it on)
+   * @param duration If greater than 0, a matching note off will be scheduled this many ticks after the note on
+   * @param tick The absolute playback tick to schedule the note at
+   * @param subTickOffset How far into the tick the note should be sent, in 1/65536ths of a tick
+   * @param result If not null, this will be filled out with whether the tick was late, and by how much
+   * @return True if the note was scheduled
+   */
+  bool scheduleNoteAtTick(unsigned char midiNote, unsigned char midiChannel, bool setOn, unsigned char velocity, quint64 duration, quint64 tick, quint16 subTickOffset = 0, SyncTimer_ScheduleResult *result = nullptr);
+  /**
+   * \brief Schedule a clip command at an absolute tick
+   * @see scheduleBatchAtTick()
+   * @param command The command to schedule (ownership is taken, and it will be deleted if it was rejected)
+   * @param tick The absolute playback tick to schedule the command at
+   * @param result If not null, this will be filled out with whether the tick was late, and by how much
+   * @return True if the command was scheduled
+   */
+  bool scheduleClipCommandAtTick(ClipCommand *command, quint64 tick, SyncTimer_ScheduleResult *result = nullptr);
+
+  /**
+   * \brief The number of scheduling requests which have been dropped because the schedule queue was full
+   *
+   * All the scheduling functions above write into a lock-free queue, which the jack process call
+   * empties into the playback schedule at the start of each run. If more than 8192 things are
+   * scheduled between two process calls, the remainder are dropped (and any commands are deleted).
+   * This also counts anything dropped because the schedule could not hold on to it (running out of extra
+   * step storage, more than 16384 things scheduled beyond the current step ring block, or further into
+   * the future than the timing wheel reaches, which is 2^12 step ring blocks), and part starts and stops beyond
+   * the 16 which can be waiting for each part (see registerPart()).
+   * @return The number of dropped scheduling requests since the timer was created
+   */
+  Q_INVOKABLE quint64 scheduleQueueOverflowCount() const;
+  /**
+   * \brief The number of steps in the step ring
+   * Anything scheduled outside of the block of this many steps which contains the current position is held
+   * separately, until the playhead gets closer. This can be set using the ZYNTHBOX_STEP_RING_SIZE environment
+   * variable (which will be rounded up to a power of two, between 1024 and 1048576, with the default being 32768).
+   * Along with that, ZYNTHBOX_STEP_SLAB_SIZE can be used to set the number of blocks of extra storage shared by
+   * steps with more events on them than fit in the step itself (the default being 4096).
+   * @return The number of steps in the step ring
+   */
+  Q_INVOKABLE quint64 stepRingSize() const;
+  /**
+   * \brief The amount of memory locked by the timer (the step ring, its extra storage, and the command pools)
+   * @return The number of bytes locked into memory
+   */
+  Q_INVOKABLE quint64 lockedMemorySize() const;
+  /**
+   * \brief The number of midi messages which have been rejected for being too long to schedule (more than 512 bytes, or a batch item of more than three bytes)
+   * @return The number of rejected midi messages since the timer was created
+   */
+  Q_INVOKABLE quint64 scheduleQueueRejectedCount() const;
 
   bool timerRunning();
   Q_SIGNAL void timerRunningChanged();
 
+  enum TimerMode {
+      SpinningTimerMode = 0, ///< Sleep until shortly before each tick and busy-wait for the remainder, on a thread with maximum realtime priority (the most precise, but keeps a cpu core busy)
+      AbsoluteSleepTimerMode = 1, ///< Sleep until each tick using clock_nanosleep against absolute deadlines, with no busy-waiting, on a thread with low realtime priority
+      JackCycleTimerMode = 2, ///< Wake up once per jack process cycle, once jack's playhead has moved on, and catch up on all the ticks needed until then
+  };
+  Q_ENUM(TimerMode)
+  TimerMode timerMode() const;
+  void setTimerMode(const TimerMode &timerMode);
+  Q_SIGNAL void timerModeChanged();
+
+  bool jackTransportFollower() const;
+  void setJackTransportFollower(const bool &jackTransportFollower);
+  Q_SIGNAL void jackTransportFollowerChanged();
+
+  bool metronomeEnabled() const;
+  void setMetronomeEnabled(const bool &metronomeEnabled);
+  Q_SIGNAL void metronomeEnabledChanged();
+  float metronomeVolume() const;
+  void setMetronomeVolume(const float &metronomeVolume);
+  Q_SIGNAL void metronomeVolumeChanged();
+  bool metronomeAccent() const;
+  void setMetronomeAccent(const bool &metronomeAccent);
+  Q_SIGNAL void metronomeAccentChanged();
+  int metronomeOpeningBars() const;
+  void setMetronomeOpeningBars(const int &metronomeOpeningBars);
+  Q_SIGNAL void metronomeOpeningBarsChanged();
+  /**
+   * \brief The amount of cpu time spent by the timer thread since it was started
+   * Compare this to the wall clock time passed between two calls to get the timer thread's cpu usage
+   * @return The timer thread's cpu time in nanoseconds
+   */
+  Q_INVOKABLE quint64 timerThreadCpuTime() const;
+  /**
+   * \brief The latest the timer thread has woken up after it was supposed to
+   * For the spinning and sleeping modes, this is measured against the tick's deadline, and for the jack
+   * cycle mode it is measured from the moment the jack process call asked for the timer to wake up.
+   * @note This is reset when changing the timer mode, or by calling resetTimerWakeStatistics()
+   * @return The largest wakeup lateness in nanoseconds
+   */
+  Q_INVOKABLE quint64 timerWakeLatenessMaximum() const;
+  /**
+   * \brief The average amount of time the timer thread has woken up after it was supposed to
+   * @see timerWakeLatenessMaximum()
+   * @return The average wakeup lateness in nanoseconds
+   */
+  Q_INVOKABLE quint64 timerWakeLatenessAverage() const;
+  /**
+   * \brief Reset the timer thread's wakeup lateness statistics
+   */
+  Q_INVOKABLE void resetTimerWakeStatistics();
+  /**
+   * \brief A snapshot of the timer's always-on timing statistics
+   * The map contains the following (times are in nanoseconds unless otherwise noted):
+   * - intervalHistogram: A list of 16 counts of how far the interval between two timer callbacks was from the ideal
+   *   interval. The first entry counts deviations below one microsecond, entry n counts deviations from 2^(n-1)
+   *   up to 2^n microseconds, and the last also counts anything larger
+   * - intervalCount: The number of intervals counted in the histogram
+   * - intervalLateMaximum and intervalEarlyMaximum: The largest deviation from the ideal interval in either direction
+   * - latenessMaximum and latenessAverage: How late the timer callbacks have been compared to the tick they should have run on
+   * - callbackCount: The number of timer callbacks run
+   * - adjustmentCount and adjustmentTotal: The number of adjustments made to the timer, and their sum (in microseconds)
+   * - playheadLag and playheadLagMaximum: How far (in ticks) the timer had fallen behind jack's playhead (plus the
+   *   schedule ahead amount) at the start of the most recent timer callback, and the largest such lag
+   * - wakeLatenessMaximum and wakeLatenessAverage: As timerWakeLatenessMaximum() and timerWakeLatenessAverage()
+   * @note This is safe to call from any thread
+   * @return A map of the statistics described above
+   */
+  Q_INVOKABLE QVariantMap timingStatistics() const;
+  /**
+   * \brief Reset all the timer's timing statistics (including the wake statistics)
+   */
+  Q_INVOKABLE void resetTimingStatistics();
+  /**
+   * \brief Emitted every now and then while the timer is running, when it stops, and when the statistics are reset
+   */
+  Q_SIGNAL void timingStatisticsChanged();
+
   Q_SIGNAL void addedHardwareInputDevice(const QString &deviceName, const QString &humanReadableName);
   Q_SIGNAL void removedHardwareInputDevice(const QString &deviceName, const QString &humanReadableName);
   Q_SIGNAL void addedHardwareOutputDevice(const QString &deviceName, const QString &humanReadableName);
   Q_SIGNAL void removedHardwareOutputDevice(const QString &deviceName, const QString &humanReadableName);
 
+  /**
+   * \brief Get a fresh clip command from the pool
+   * @note This is safe to call from any thread (including the jack process call)
+   * @return A cleared clip command
+   */
   Q_SLOT ClipCommand *getClipCommand();
+  /**
+   * \brief Return a clip command to the pool (it will be cleared)
+   * The command is not handed out again until 50 milliseconds after it was deleted, so anything which was told about
+   * it (for example through clipCommandSent) can still safely read it during that time
+   * @note This is safe to call from any thread (including the jack process call)
+   * @param command A clip command previously fetched using getClipCommand()
+   */
   Q_SLOT void deleteClipCommand(ClipCommand *command);
+  /**
+   * \brief Get a fresh timer command from the pool
+   * @note This is safe to call from any thread (including the jack process call)
+   * @return A cleared timer command
+   */
   Q_SLOT TimerCommand *getTimerCommand();
+  /**
+   * \brief Return a timer command to the pool (it will be cleared)
+   * @note This is safe to call from any thread (including the jack process call)
+   * @param command A timer command previously fetched using getTimerCommand()
+   */
   Q_SLOT void deleteTimerCommand(TimerCommand *command);
+  /**
+   * \brief The largest number of clip commands which have been in use at the same time
+   * @note The pool holds 4096 commands, and if this number is above that, the pool has been exhausted
+   * @return The pool's high-water mark
+   */
+  Q_INVOKABLE quint32 clipCommandPoolHighWaterMark() const;
+  /**
+   * \brief The number of times a clip command was requested when the pool was empty
+   * When this happens, a new command is allocated instead, which is not safe for realtime use
+   * @return The number of allocations made outside the pool
+   */
+  Q_INVOKABLE quint64 clipCommandPoolExhaustionCount() const;
+  /**
+   * \brief The largest number of timer commands which have been in use at the same time
+   * @note The pool holds 4096 commands, and if this number is above that, the pool has been exhausted
+   * @return The pool's high-water mark
+   */
+  Q_INVOKABLE quint32 timerCommandPoolHighWaterMark() const;
+  /**
+   * \brief The number of times a timer command was requested when the pool was empty
+   * When this happens, a new command is allocated instead, which is not safe for realtime use
+   * @return The number of allocations made outside the pool
+   */
+  Q_INVOKABLE quint64 timerCommandPoolExhaustionCount() const;
+
+  /**
+   * \brief How long events on the given midi channel are delayed to line up with the slowest destination
+   * The compensation is worked out by MidiRouter, from the latency of each channel's destination (see MidiRouter::destinationLatency())
+   * @param midiChannel The midi channel (0 through 15)
+   * @return The delay in microseconds
+   */
+  Q_INVOKABLE quint64 midiChannelLatencyCompensation(int midiChannel) const;
+  /**
+   * \brief How long clip commands (and metronome clicks) for SamplerSynth are delayed to line up with the slowest destination
+   * @return The delay in microseconds
+   */
+  Q_INVOKABLE quint64 samplerLatencyCompensation() const;
+
+  /**
+   * \brief The engine which runs the timer's tempo-synced LFOs and envelopes
+   * @return The timer's ModulationEngine instance
+   */
+  Q_INVOKABLE QObject *modulationEngine() const;
+  /**
+   * \brief The engine which plays back the timer's breakpoint automation lanes
+   * @return The timer's AutomationEngine instance
+   */
+  Q_INVOKABLE QObject *automationEngine() const;
 
   Q_SIGNAL void pleaseStartPlayback();
   Q_SIGNAL void pleaseStopPlayback();
@@ -219,9 +787,28 @@ protected:
   // This allows MidiRouter to process SyncTimer explicitly (this way we avoid having to pass through jack, which already has plenty of clients to worry about)
   friend class MidiRouterPrivate;
   void process(jack_nframes_t nframes, void *buffer, quint64 *jackPlayhead, quint64 *jackSubbeatLengthInMicroseconds);
+  /**
+   * \brief Whether SyncTimer runs fused into ZLRouter's jack client
+   * When fused (set by setting the ZYNTHBOX_SYNCTIMER_FUSED environment variable to 1), SyncTimer does not have a jack
+   * client of its own. Instead, ZLRouter runs the step sequencer at the start of its own process call using processFused(),
+   * and routes the resulting events straight from memory, so they are guaranteed to go out in the same cycle, and there
+   * is one less client in the graph.
+   */
+  bool isFused() const;
+  // When fused, this must be called by ZLRouter with its client before that client is activated
+  void attachToFusedClient(jack_client_t *client, jack_port_t *latencyPort);
+  // When fused, runs the step sequencer for this cycle, and returns the events it sent out (valid until the next call)
+  void processFused(jack_nframes_t nframes, jack_midi_event_t **events, uint32_t *eventCount, quint64 *jackPlayhead, quint64 *jackSubbeatLengthInMicroseconds);
+  // Set by ZLRouter whenever the destination latencies change (see midiChannelLatencyCompensation() and samplerLatencyCompensation())
+  void setMidiChannelLatencyCompensation(int midiChannel, quint64 usecs);
+  void setSamplerLatencyCompensation(quint64 usecs);
   // This allows TransportManager to call us, so we avoid some back and forth since SyncTimer has all the information needed to set the position
   friend class TransportManagerPrivate;
+  // Used by TransportManager's jack process call to pass on the tempo of an external midi clock (it is picked up by our own process call, as setPreciseBpm() is not realtime safe)
+  void setBpmFromExternalClock(double bpm);
   void setPosition(jack_position_t *position) const;
+  // Used by TransportManager's jack sync callback while following the jack transport, to hold the transport until playback has been started at the requested position
+  bool readyToFollow(jack_transport_state_t state, jack_position_t *position);
 private:
   SyncTimerPrivate *d{nullptr};
 };
@@ -1,14 +1,20 @@
 #pragma once
 
-#include <QVariant>
-
 #include "SyncTimer.h"
 
+#include <cstring>
+
 /**
  * \brief Used to schedule various operations into the timer's playback queue
+ *
+ * Operations other than the ones SyncTimer handles itself (playback, bpm, parts, and clip commands) are dispatched
+ * to whichever handler has been registered for them using SyncTimer::registerTimerCommandHandler(). This means new
+ * operations can be added without touching SyncTimer, as long as their value is between 0 and 255.
  */
 struct alignas(64) TimerCommand {
-    TimerCommand() {};
+    TimerCommand() {
+        std::memset(&payload, 0, sizeof(Payload));
+    };
     // TODO Before shipping this, make sure these are sequential...
     enum Operation {
         InvalidOperation = 0, ///@< An invalid operation, ignored
@@ -20,11 +26,13 @@ struct alignas(64) TimerCommand {
         StopClipLoopOperation = 7, ///@< DEPRECATED Use ClipCommandOperation (now handled by segmenthandler, was originally: Stop playing a clip looping style, parameter being the midi channel to stop it on, parameter2 being the clip ID, and parameter3 being the note)
         SamplerChannelEnabledStateOperation = 8, ///@< Sets the state of a SamplerSynth channel to enabled or not enabled. parameter is the sampler channel (-2 through 9, -2 being uneffected global, -1 being effected global, and 0 through 9 being zl channels), and parameter2 is 0 for disabled, any other number for enabled
         ClipCommandOperation = 9, ///@< Handle a clip command at the given timer point (this could also be done by scheduling the clip command directly)
-        SetBpmOperation = 10, ///@< Set the BPM of the timer to the value in stored in parameter (this will be clamped to fit between SyncTimer's allowed values)
-        AutomationOperation = 11, ///@< Set the value of a given parameter on a given engine on a given channel to a given value. parameter contains the channel (-1 is global fx engines, 0 through 9 being zl channels), parameter2 contains the engine index, parameter3 is the parameter's index, parameter4 is the value
+        SetBpmOperation = 10, ///@< Set the BPM of the timer to the value in stored in parameter, with parameter2 optionally holding a fractional part in thousandths of a beat per minute, or to the precise value in payload.doubleValues[0] if that is set (this will be clamped to fit between SyncTimer's allowed values)
+        AutomationOperation = 11, ///@< (No default handler) Set the value of a given parameter on a given engine on a given channel to a given value. parameter contains the channel (-1 is global fx engines, 0 through 9 being zl channels), parameter2 contains the engine index, parameter3 is the parameter's index, parameter4 is the value
         PassthroughClientOperation = 12, ///@< Set the volume of the given volume channel to the given value. parameter is the channel (-1 is global playback, 0 through 9 being zl channels), parameter2 is the setting index in the list (dry, wetfx1, wetfx2, pan, muted), parameter3 being the left value, parameter4 being right value. If parameter2 is pan or muted, parameter4 is ignored. For volumes, parameter3 and parameter4 can be 0 through 100. For pan, -100 for all left through 100 for all right, with 0 being no pan. For muted, 0 is not muted, any other value is muted.
+        AutomationLaneOperation = 13, ///@< Start or stop one of AutomationEngine's lanes (handled by AutomationEngine, see AutomationEngine::scheduleLaneStart()). parameter is the lane's ID, and parameter2 is 1 to start the lane from its beginning, or 0 to stop it
         RegisterCASOperation = 10001, ///@< INTERNAL - Register a ClipAudioSource with SamplerSynth, so it can be used for playback - dataParameter should contain a ClipAudioSource* object instance
         UnregisterCASOperation = 10002, ///@< INTERNAL - Unregister a ClipAudioSource with SamplerSynth, so it can be used for playback - dataParameter should contain a ClipAudioSource* object instance
+        SendLongMidiMessageOperation = 10003, ///@< INTERNAL - Send a midi message longer than three bytes (such as a sysex message), used by SyncTimer::scheduleMidiBuffer() - dataParameter holds the message, which is released along with the command
     };
     Operation operation{InvalidOperation};
     int parameter{0};
@@ -33,8 +41,17 @@ struct alignas(64) TimerCommand {
     int parameter4{0};
     quint64 bigParameter{0};
     void *dataParameter{nullptr};
-    // NOTE: To implementers: Use this sparingly, as QVariants can be expensive to use and this gets handled from a jack call
-    QVariant variantParameter;
+    /**
+     * \brief Additional, plain data for operations which need more than the integer parameters
+     * This is plain data, and is copied and cleared along with the rest of the command without any allocations,
+     * so it is safe to use from the jack process call. How it is interpreted is up to the operation's handler.
+     */
+    union Payload {
+        double doubleValues[2];
+        float floatValues[4];
+        qint32 intValues[4];
+        quint8 bytes[16];
+    } payload;
 
     static TimerCommand *cloneTimerCommand(const TimerCommand *other) {
         TimerCommand *clonedCommand = SyncTimer::instance()->getTimerCommand();
@@ -45,9 +62,7 @@ struct alignas(64) TimerCommand {
         clonedCommand->parameter4 = other->parameter4;
         clonedCommand->bigParameter = other->bigParameter;
         clonedCommand->dataParameter = other->dataParameter;
-        if (other->variantParameter.isValid()) {
-            clonedCommand->variantParameter = other->variantParameter;
-        }
+        clonedCommand->payload = other->payload;
         return clonedCommand;
     }
 
@@ -56,8 +71,6 @@ struct alignas(64) TimerCommand {
         command->parameter = command->parameter2 = command->parameter3 = command->parameter4 = 0;
         command->bigParameter = 0;
         command->dataParameter = nullptr;
-        if (command->variantParameter.isValid()) {
-            command->variantParameter.clear();
-        }
+        std::memset(&command->payload, 0, sizeof(Payload));
     }
 };
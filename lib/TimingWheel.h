@@ -0,0 +1,184 @@
+#pragma once
+
+#include <QtGlobal>
+
+// The number of slots in each of the timing wheel's outer levels (each level's occupancy is kept in a single 64 bit word, so this must stay at 64)
+#define WheelLevelSlotCount 64
+
+/**
+ * \brief The outer levels of a hierarchical timing wheel
+ *
+ * The innermost level of the wheel (a ring of steps, owned by whoever uses this) holds the positions in the same
+ * innermostSpan sized block as the read head. Anything further into the future is held in one of the outer levels
+ * kept here, where each slot covers the span of the entire level inside it. Whenever the read head reaches the start
+ * of a slot, the records in that slot are moved inwards (so the records in a slot of the first outer level are moved
+ * into the innermost level when the read head reaches the start of the block they belong to). This way the innermost
+ * level never holds positions which would wrap onto the wrong step.
+ * Each level has an occupancy bitmap, so going through everything that is held only touches the slots which actually
+ * contain something, and the records live in a preallocated array, so nothing here ever allocates.
+ * @note This is not thread-safe, and is only meant to be used from the jack process call
+ * @param Record The type of the records (which must have a quint64 step member, which holds the record's position)
+ * @param LevelCount The number of outer levels (each level is 64 times coarser than the one inside it)
+ * @param Capacity The number of records which can be held in the outer levels at any one time
+ */
+template<typename Record, int LevelCount, int Capacity>
+class TimingWheel {
+public:
+    /**
+     * \brief A record waiting in one of the outer levels
+     */
+    struct DeferredRecord {
+        Record record;
+        DeferredRecord *next{nullptr};
+    };
+    /**
+     * \brief A single slot in one of the outer levels, holding its records in the order they were added
+     */
+    struct DeferredSlot {
+        DeferredRecord *first{nullptr};
+        DeferredRecord *last{nullptr};
+    };
+
+    TimingWheel() {
+        for (int i = 0; i < Capacity - 1; ++i) {
+            records[i].next = &records[i + 1];
+        }
+        freeRecords = records;
+    }
+    /**
+     * \brief Set the span of the innermost level (which must be a power of two)
+     * @note Call this before adding any records
+     * @param innermostSpan The number of positions covered by the innermost level
+     */
+    void setInnermostSpan(quint64 innermostSpan) {
+        span = innermostSpan;
+        quint64 width{innermostSpan};
+        for (int level = 0; level < LevelCount; ++level) {
+            slotWidth[level] = width;
+            width *= WheelLevelSlotCount;
+        }
+    }
+    /**
+     * \brief Hold a record in the outer levels until the read head gets close enough to it
+     * @param record The record to hold (its step is set to the given position)
+     * @param position The absolute position of the record, which must be outside the read head's innermost block
+     * @param readHeadPosition The absolute position of the read head
+     * @return False if the position is further into the future than the wheel reaches, or if there is no space left
+     */
+    bool add(const Record &record, quint64 position, quint64 readHeadPosition) {
+        for (int level = 0; level < LevelCount; ++level) {
+            const quint64 levelWidth{slotWidth[level] * WheelLevelSlotCount};
+            if (position / levelWidth == readHeadPosition / levelWidth) {
+                if (freeRecords) {
+                    const int slotIndex{int((position / slotWidth[level]) % WheelLevelSlotCount)};
+                    DeferredSlot &slot = slots[level][slotIndex];
+                    DeferredRecord *deferred{freeRecords};
+                    freeRecords = deferred->next;
+                    deferred->record = record;
+                    deferred->record.step = position;
+                    deferred->next = nullptr;
+                    if (slot.last) {
+                        slot.last->next = deferred;
+                    } else {
+                        slot.first = deferred;
+                    }
+                    slot.last = deferred;
+                    occupancy[level] |= (quint64(1) << slotIndex);
+                    return true;
+                }
+                break;
+            }
+        }
+        return false;
+    }
+    /**
+     * \brief Move records inwards from any outer level slot which starts at the given read head position
+     * The records are passed to the given function in the order they were added, starting with the outermost level
+     * (as its records might end up in a slot which is about to be moved inwards), and the function is expected to
+     * either put them into the innermost level, or add them back into the wheel.
+     * @note Call this whenever the read head has moved forward
+     * @param readHeadPosition The absolute position of the read head
+     * @param function A function taking a const reference to a record
+     */
+    template<typename Function>
+    void advance(quint64 readHeadPosition, Function function) {
+        if (readHeadPosition % span == 0) {
+            for (int level = LevelCount - 1; level > -1; --level) {
+                if (readHeadPosition % slotWidth[level] == 0) {
+                    const int slotIndex{int((readHeadPosition / slotWidth[level]) % WheelLevelSlotCount)};
+                    DeferredSlot &slot = slots[level][slotIndex];
+                    DeferredRecord *deferred{slot.first};
+                    slot.first = slot.last = nullptr;
+                    occupancy[level] &= ~(quint64(1) << slotIndex);
+                    while (deferred) {
+                        DeferredRecord *next{deferred->next};
+                        const Record record{deferred->record};
+                        deferred->next = freeRecords;
+                        freeRecords = deferred;
+                        function(record);
+                        deferred = next;
+                    }
+                }
+            }
+        }
+    }
+    /**
+     * \brief Call the given function for each record held in the outer levels
+     * @param function A function taking a const reference to a record, returning true to remove the record from the wheel
+     */
+    template<typename Function>
+    void forEach(Function function) {
+        for (int level = 0; level < LevelCount; ++level) {
+            quint64 bits = occupancy[level];
+            while (bits) {
+                const int slotIndex = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                DeferredSlot &slot = slots[level][slotIndex];
+                DeferredRecord *previous{nullptr};
+                DeferredRecord *deferred{slot.first};
+                while (deferred) {
+                    DeferredRecord *next{deferred->next};
+                    if (function(deferred->record)) {
+                        if (previous) {
+                            previous->next = next;
+                        } else {
+                            slot.first = next;
+                        }
+                        if (slot.last == deferred) {
+                            slot.last = previous;
+                        }
+                        deferred->next = freeRecords;
+                        freeRecords = deferred;
+                    } else {
+                        previous = deferred;
+                    }
+                    deferred = next;
+                }
+                if (!slot.first) {
+                    occupancy[level] &= ~(quint64(1) << slotIndex);
+                }
+            }
+        }
+    }
+    /**
+     * \brief Whether there are any records held in the outer levels
+     */
+    bool isEmpty() const {
+        for (int level = 0; level < LevelCount; ++level) {
+            if (occupancy[level] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+private:
+    DeferredRecord records[Capacity];
+    DeferredRecord *freeRecords{nullptr};
+    DeferredSlot slots[LevelCount][WheelLevelSlotCount];
+    // One bit per slot in each outer level, set when the slot holds records
+    quint64 occupancy[LevelCount]{};
+    // The number of positions covered by a single slot in each outer level
+    quint64 slotWidth[LevelCount]{};
+    // The number of positions covered by the innermost level
+    quint64 span{1};
+};
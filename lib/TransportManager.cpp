@@ -7,13 +7,31 @@
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include <atomic>
+#include <cmath>
+
+// The number of midi clock pulses per quarter note
+#define MidiClockPulsesPerBeat 24
+// The number of midi clock pulses per midi beat (which is what song position pointers count in)
+#define MidiClockPulsesPerMidiBeat 6
+// The bandwidth of the delay-locked loop used to filter the incoming clock pulses, in Hz (lower is smoother, higher follows tempo changes faster)
+#define MidiClockBandwidth 1.0
+// How much of the phase error to correct on each pulse (once within a tick of the external clock - further out than that, we jump straight to it)
+#define MidiClockPhaseCorrectionGain 0.25
+// How long (in microseconds) we can go without a clock pulse before we consider the clock lost
+#define MidiClockTimeout 500000
+// The smallest change in measured bpm which will be passed on to the timer
+#define MidiClockBpmThreshold 0.01
+
 class TransportManagerPrivate {
 public:
     TransportManagerPrivate(SyncTimer *syncTimerInstance);
     ~TransportManagerPrivate() {
         if (client) {
-            jack_transport_stop(client);
-            jack_release_timebase(client);
+            if (!jackTransportFollower) {
+                jack_transport_stop(client);
+                jack_release_timebase(client);
+            }
             jack_client_close(client);
         }
     }
@@ -22,6 +40,92 @@ public:
     jack_port_t *inPort{nullptr};
     jack_port_t *outPort{nullptr};
     bool running{false};
+    bool jackTransportFollower{false};
+
+    bool midiClockSlave{false};
+    // The delay-locked loop state (see "Using a DLL to filter time" by Fons Adriaensen)
+    bool clockRunning{false};
+    double clockPreviousPulse{0}; // The filtered time of the most recent pulse
+    double clockNextPulse{0}; // The predicted time of the next pulse
+    double clockPeriod{0}; // The filtered time between two pulses
+    double clockB{0};
+    double clockC{0};
+    double clockLastRawPulse{0};
+    double clockSquaredErrorAverage{0};
+    quint64 clockPulseCount{0};
+    // The position of the next pulse in the song (counted in pulses since the start), valid once playback has been started by the clock
+    quint64 songPositionPulse{0};
+    bool songPositionValid{false};
+    // Statistics, written by the process call and read from anywhere
+    std::atomic<bool> statisticsLocked{false};
+    std::atomic<double> statisticsMeasuredBpm{0};
+    std::atomic<double> statisticsLockError{0};
+    std::atomic<double> statisticsLockErrorMaximum{0};
+    std::atomic<double> statisticsJitter{0};
+    std::atomic<quint64> statisticsPulseCount{0};
+    bool hasLocked{false};
+
+    /**
+     * \brief Feed a midi clock pulse into the delay-locked loop, and correct the timer's tempo and phase to match
+     * @param pulseUsecs The jack time at which the pulse arrived
+     */
+    void handleClockPulse(double pulseUsecs) {
+        if (!clockRunning || pulseUsecs - clockLastRawPulse > MidiClockTimeout) {
+            // (Re)acquire the clock, starting out by assuming it runs at our current bpm
+            clockPeriod = 60000000.0 / (syncTimer->getPreciseBpm() * MidiClockPulsesPerBeat);
+            const double omega{2.0 * M_PI * MidiClockBandwidth * clockPeriod / 1000000.0};
+            clockB = std::sqrt(2.0) * omega;
+            clockC = omega * omega;
+            clockPreviousPulse = pulseUsecs;
+            clockNextPulse = pulseUsecs + clockPeriod;
+            clockSquaredErrorAverage = 0;
+            clockPulseCount = 0;
+            clockRunning = true;
+            hasLocked = false;
+            statisticsLocked = false;
+        } else {
+            const double error{pulseUsecs - clockNextPulse};
+            clockPreviousPulse = clockNextPulse;
+            clockNextPulse += (clockB * error) + clockPeriod;
+            clockPeriod += clockC * error;
+            clockSquaredErrorAverage += ((error * error) - clockSquaredErrorAverage) / 64.0;
+            statisticsJitter = std::sqrt(clockSquaredErrorAverage);
+        }
+        clockLastRawPulse = pulseUsecs;
+        ++clockPulseCount;
+        statisticsPulseCount = clockPulseCount;
+        const double measuredBpm{60000000.0 / (clockPeriod * MidiClockPulsesPerBeat)};
+        statisticsMeasuredBpm = measuredBpm;
+        // Give the loop a couple of beats to settle, and then pass the tempo on once per beat
+        if (clockPulseCount > 2 * MidiClockPulsesPerBeat && clockPulseCount % MidiClockPulsesPerBeat == 0 && std::abs(measuredBpm - syncTimer->getPreciseBpm()) > MidiClockBpmThreshold) {
+            // We are in the jack process call here, so hand the bpm to the timer rather than setting it directly (which is not realtime safe)
+            syncTimer->setBpmFromExternalClock(measuredBpm);
+        }
+        if (songPositionValid) {
+            if (syncTimer->timerRunning()) {
+                const quint64 ticksPerPulse = quint64(syncTimer->getMultiplier() / MidiClockPulsesPerBeat);
+                const double tickLength{60000000.0 / (syncTimer->getPreciseBpm() * syncTimer->getMultiplier())};
+                // When our matching tick is due to be played, compared to the filtered time of this pulse (positive when the timer is behind the clock)
+                const double lockError{double(qint64(syncTimer->jackPlayheadUsecsForTick(songPositionPulse * ticksPerPulse))) - clockPreviousPulse};
+                const bool locked{std::abs(lockError) < tickLength};
+                statisticsLockError = lockError;
+                statisticsLocked = locked;
+                if (locked) {
+                    hasLocked = true;
+                    if (std::abs(lockError) > statisticsLockErrorMaximum) {
+                        statisticsLockErrorMaximum = std::abs(lockError);
+                    }
+                    syncTimer->addAdjustmentByMicroseconds(qint64(std::llround(lockError * MidiClockPhaseCorrectionGain)));
+                } else {
+                    if (hasLocked && std::abs(lockError) > statisticsLockErrorMaximum) {
+                        statisticsLockErrorMaximum = std::abs(lockError);
+                    }
+                    syncTimer->addAdjustmentByMicroseconds(qint64(std::llround(lockError)));
+                }
+            }
+            ++songPositionPulse;
+        }
+    }
 
     uint32_t mostRecentEventCount{0};
     jack_time_t nextMidiTick{0};
@@ -60,15 +164,31 @@ public:
                 // }
                 switch(event.buffer[0]) {
                     case 0xf2: // position
-                        // (event->buffer[2]<<7) | event->buffer[1];
+                        // The position is counted in midi beats (sixteenth notes, or six clock pulses), and spec says it should only arrive while stopped
+                        if (midiClockSlave && event.size == 3 && !syncTimer->timerRunning()) {
+                            songPositionPulse = quint64((event.buffer[2] << 7) | event.buffer[1]) * MidiClockPulsesPerMidiBeat;
+                            syncTimer->relocate(songPositionPulse * quint64(syncTimer->getMultiplier() / MidiClockPulsesPerBeat));
+                        }
                         break;
                     case 0xf8: // clock
                         // qDebug() << Q_FUNC_INFO << "Clock signal received";
+                        if (midiClockSlave) {
+                            handleClockPulse(double(jack_frames_to_time(client, current_frames + event.time)));
+                        }
                         break;
                     case 0xfa: // start
                     case 0xfb: // continue
                         // Spec says to ignore start messages if they arrive while playback is happening
                         qDebug() << Q_FUNC_INFO << "Received MIDI START message";
+                        if (midiClockSlave && !syncTimer->timerRunning()) {
+                            // Start means start from the top, and continue means carry on from the most recent song position
+                            if (event.buffer[0] == 0xfa) {
+                                songPositionPulse = 0;
+                                syncTimer->relocate(0);
+                            }
+                            // The next clock pulse is the first one in the song
+                            songPositionValid = true;
+                        }
                         if (!syncTimer->timerRunning()) {
                             TimerCommand *startCommand = syncTimer->getTimerCommand();
                             startCommand->operation = TimerCommand::StartPlaybackOperation;
@@ -78,6 +198,11 @@ public:
                     case 0xfc: // stop
                         // Spec says to ignore stop messages if they arrive while playback is already stopped
                         qDebug() << Q_FUNC_INFO << "Received MIDI STOP message";
+                        if (midiClockSlave && songPositionValid) {
+                            // Hang on to where we stopped, so a continue can pick up from there
+                            songPositionValid = false;
+                            syncTimer->relocate(songPositionPulse * quint64(syncTimer->getMultiplier() / MidiClockPulsesPerBeat));
+                        }
                         if (syncTimer->timerRunning()) {
                             TimerCommand *stopCommand = syncTimer->getTimerCommand();
                             stopCommand->operation = TimerCommand::StopPlaybackOperation;
@@ -135,6 +260,9 @@ public:
             syncTimer->setPosition(position);
         }
     }
+    int sync_callback(jack_transport_state_t state, jack_position_t *position) {
+        return syncTimer->readyToFollow(state, position) ? 1 : 0;
+    }
 };
 
 int transport_process(jack_nframes_t nframes, void *arg) {
@@ -145,6 +273,10 @@ void transport_timebase_callback(jack_transport_state_t state, jack_nframes_t nf
     return static_cast<TransportManagerPrivate*>(arg)->timebase_callback(state, nframes, pos, new_pos);
 }
 
+int transport_sync_callback(jack_transport_state_t state, jack_position_t *pos, void *arg) {
+    return static_cast<TransportManagerPrivate*>(arg)->sync_callback(state, pos);
+}
+
 TransportManagerPrivate::TransportManagerPrivate(SyncTimer *syncTimerInstance)
 {
     syncTimer = syncTimerInstance;
@@ -170,18 +302,28 @@ void TransportManager::initialize()
         d->inPort = jack_port_register(d->client, "midi_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput | JackPortIsTerminal, 0);
         d->outPort = jack_port_register(d->client, "midi_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput | JackPortIsTerminal, 0);
         if (d->inPort && d->outPort) {
-            if (jack_set_timebase_callback(d->client, 0, transport_timebase_callback, static_cast<void*>(d)) == 0) {
+            // When following the jack transport, we leave the timebase to someone else, and instead hold the transport until we're ready to play
+            const bool callbackSet = d->jackTransportFollower
+                ? jack_set_sync_callback(d->client, transport_sync_callback, static_cast<void*>(d)) == 0
+                : jack_set_timebase_callback(d->client, 0, transport_timebase_callback, static_cast<void*>(d)) == 0;
+            if (callbackSet) {
                 // Set the process callback.
                 if (jack_set_process_callback(d->client, transport_process, static_cast<void*>(d)) == 0) {
                     if (jack_activate(d->client) == 0) {
-                        qDebug() << Q_FUNC_INFO << "Set up the transport manager, which lets us handle midi sync messages, and function as a Jack timebase master";
-                        jack_transport_start(d->client);
+                        if (d->jackTransportFollower) {
+                            qDebug() << Q_FUNC_INFO << "Set up the transport manager, which lets us handle midi sync messages, and follow the Jack transport";
+                        } else {
+                            qDebug() << Q_FUNC_INFO << "Set up the transport manager, which lets us handle midi sync messages, and function as a Jack timebase master";
+                            jack_transport_start(d->client);
+                        }
                     } else {
                         qWarning() << Q_FUNC_INFO << "Failed to activate the Jack client";
                     }
                 } else {
                     qWarning() << Q_FUNC_INFO << "Failed to set Jack processing callback";
                 }
+            } else if (d->jackTransportFollower) {
+                qWarning() << Q_FUNC_INFO << "Failed to register as a Jack transport sync client";
             } else {
                 qWarning() << Q_FUNC_INFO << "Failed to register as transport master";
             }
@@ -198,3 +340,54 @@ void TransportManager::restartTransport()
     jack_transport_stop(d->client);
     jack_transport_start(d->client);
 }
+
+void TransportManager::setJackTransportFollower(bool jackTransportFollower)
+{
+    if (d->jackTransportFollower != jackTransportFollower) {
+        d->jackTransportFollower = jackTransportFollower;
+        // If we've not been initialised yet, the callbacks will be set up there
+        if (d->client) {
+            if (jackTransportFollower) {
+                jack_release_timebase(d->client);
+                if (jack_set_sync_callback(d->client, transport_sync_callback, static_cast<void*>(d)) != 0) {
+                    qWarning() << Q_FUNC_INFO << "Failed to register as a Jack transport sync client";
+                }
+            } else {
+                jack_set_sync_callback(d->client, nullptr, nullptr);
+                if (jack_set_timebase_callback(d->client, 0, transport_timebase_callback, static_cast<void*>(d)) != 0) {
+                    qWarning() << Q_FUNC_INFO << "Failed to register as transport master";
+                }
+            }
+        }
+    }
+}
+
+bool TransportManager::midiClockSlave() const
+{
+    return d->midiClockSlave;
+}
+
+void TransportManager::setMidiClockSlave(const bool &midiClockSlave)
+{
+    if (d->midiClockSlave != midiClockSlave) {
+        d->midiClockSlave = midiClockSlave;
+        Q_EMIT midiClockSlaveChanged();
+    }
+}
+
+QVariantMap TransportManager::midiClockStatistics() const
+{
+    QVariantMap statistics;
+    statistics["locked"] = bool(d->statisticsLocked);
+    statistics["measuredBpm"] = double(d->statisticsMeasuredBpm);
+    statistics["lockError"] = double(d->statisticsLockError);
+    statistics["lockErrorMaximum"] = double(d->statisticsLockErrorMaximum);
+    statistics["jitter"] = double(d->statisticsJitter);
+    statistics["pulseCount"] = quint64(d->statisticsPulseCount);
+    return statistics;
+}
+
+void TransportManager::resetMidiClockStatistics()
+{
+    d->statisticsLockErrorMaximum = 0;
+}
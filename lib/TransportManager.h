@@ -5,6 +5,13 @@
 class TransportManagerPrivate;
 class TransportManager : public QObject {
     Q_OBJECT
+    /**
+     * \brief Whether to follow an external midi clock arriving on the midi_in port
+     * When enabled, incoming midi clock pulses are used to set SyncTimer's bpm and keep its playback in phase
+     * with the external clock, and song position pointer messages relocate playback (while stopped)
+     * @default false
+     */
+    Q_PROPERTY(bool midiClockSlave READ midiClockSlave WRITE setMidiClockSlave NOTIFY midiClockSlaveChanged)
 public:
     static TransportManager* instance(SyncTimer *q = nullptr) {
         static TransportManager* instance{nullptr};
@@ -20,6 +27,28 @@ public:
     void initialize();
 
     void restartTransport();
+    // This is called by SyncTimer when switching between following the jack transport and being its timebase master
+    void setJackTransportFollower(bool jackTransportFollower);
+
+    bool midiClockSlave() const;
+    void setMidiClockSlave(const bool &midiClockSlave);
+    Q_SIGNAL void midiClockSlaveChanged();
+    /**
+     * \brief Information about how well we are following the external midi clock
+     * The map contains the following:
+     * - locked: Whether the timer is within one tick of the external clock
+     * - measuredBpm: The bpm of the external clock, as measured from the incoming pulses
+     * - lockError: How far (in microseconds) the most recent pulse was from the matching timer tick (positive when the timer is behind the clock)
+     * - lockErrorMaximum: The largest lock error (in microseconds, in either direction) since the statistics were reset, not counting the pulses before the first lock
+     * - jitter: The root mean square of the difference between the incoming pulses and where we expected them to be (in microseconds)
+     * - pulseCount: The number of pulses received since the clock was last (re)acquired
+     * @return A map of the statistics described above
+     */
+    Q_INVOKABLE QVariantMap midiClockStatistics() const;
+    /**
+     * \brief Reset the maximum lock error
+     */
+    Q_INVOKABLE void resetMidiClockStatistics();
 private:
     TransportManagerPrivate *d{nullptr};
 };
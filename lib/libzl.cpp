@@ -24,6 +24,7 @@ using namespace std::chrono;
 #include <QQmlContext>
 #include <QString>
 
+#include "AutomationEngine.h"
 #include "ClipAudioSource.h"
 #include "Helper.h"
 #include "JUCEHeaders.h"
@@ -31,6 +32,9 @@ using namespace std::chrono;
 #include "SyncTimer.h"
 #include "WaveFormItem.h"
 #include "AudioLevels.h"
+#include "MidiArpeggiator.h"
+#include "MidiChordGenerator.h"
+#include "ModulationEngine.h"
 #include "MidiRouter.h"
 #include "JackPassthrough.h"
 
@@ -347,6 +351,86 @@ void SyncTimer_queueClipToStopOnChannel(ClipAudioSource *clip, int midiChannel)
   Helper::callFunctionOnMessageThread(
       [&]() { syncTimer->queueClipToStopOnChannel(clip, midiChannel); }, true);
 }
+
+void SyncTimer_cancelClipCommands(ClipAudioSource *clip, int midiChannel) {
+  syncTimer->cancelClipCommands(clip, midiChannel);
+}
+
+void SyncTimer_getTimingStatistics(struct SyncTimer_TimingStatistics *statistics) {
+  const QVariantMap snapshot = syncTimer->timingStatistics();
+  const QVariantList histogram = snapshot["intervalHistogram"].toList();
+  for (int bucket = 0; bucket < 16; ++bucket) {
+    statistics->intervalHistogram[bucket] = bucket < histogram.count() ? histogram[bucket].toULongLong() : 0;
+  }
+  statistics->intervalCount = snapshot["intervalCount"].toULongLong();
+  statistics->intervalLateMaximum = snapshot["intervalLateMaximum"].toULongLong();
+  statistics->intervalEarlyMaximum = snapshot["intervalEarlyMaximum"].toULongLong();
+  statistics->latenessMaximum = snapshot["latenessMaximum"].toULongLong();
+  statistics->latenessAverage = snapshot["latenessAverage"].toULongLong();
+  statistics->callbackCount = snapshot["callbackCount"].toULongLong();
+  statistics->adjustmentCount = snapshot["adjustmentCount"].toULongLong();
+  statistics->adjustmentTotal = snapshot["adjustmentTotal"].toLongLong();
+  statistics->playheadLag = snapshot["playheadLag"].toLongLong();
+  statistics->playheadLagMaximum = snapshot["playheadLagMaximum"].toULongLong();
+  statistics->wakeLatenessMaximum = snapshot["wakeLatenessMaximum"].toULongLong();
+  statistics->wakeLatenessAverage = snapshot["wakeLatenessAverage"].toULongLong();
+}
+
+void SyncTimer_resetTimingStatistics() {
+  syncTimer->resetTimingStatistics();
+}
+
+int SyncTimer_scheduleBatch(const struct SyncTimer_ScheduleItem *items, int count, int *rejected) {
+  return syncTimer->scheduleBatch(items, count, rejected);
+}
+
+int SyncTimer_scheduleBatchAtTick(const struct SyncTimer_ScheduleItem *items, int count, unsigned long long tick, struct SyncTimer_ScheduleResult *result) {
+  return syncTimer->scheduleBatchAtTick(items, count, tick, result);
+}
+
+int SyncTimer_scheduleBatchAtJackFrame(const struct SyncTimer_ScheduleItem *items, int count, unsigned int frame, struct SyncTimer_ScheduleResult *result) {
+  return syncTimer->scheduleBatchAtJackFrame(items, count, frame, result);
+}
+
+void SyncTimer_setGroove(int midiChannel, const double *tickDisplacements, const float *velocityScales, int length) {
+  syncTimer->setGroove(midiChannel, tickDisplacements, velocityScales, length);
+}
+
+void SyncTimer_clearGroove(int midiChannel) {
+  syncTimer->clearGroove(midiChannel);
+}
+
+int SyncTimer_registerPart(int channel, int track, int part, unsigned long long length, const struct SyncTimer_ScheduleItem *items, int count) {
+  return syncTimer->registerPart(channel, track, part, length, items, count) ? 1 : 0;
+}
+
+void SyncTimer_unregisterPart(int channel, int track, int part) {
+  syncTimer->unregisterPart(channel, track, part);
+}
+
+void SyncTimer_panic() {
+  syncTimer->panic();
+}
+
+int SyncTimer_getActiveNotes(unsigned char *midiChannels, unsigned char *midiNotes, int maximum) {
+  return syncTimer->activeNotes(midiChannels, midiNotes, maximum);
+}
+
+bool SyncTimer_registerTickCallback(void (*functionPtr)(const struct SyncTimer_Tick *, int, void *), void *userData, unsigned long long divisor, bool useWorkerThread) {
+  return syncTimer->addTickCallback(functionPtr, userData, divisor, useWorkerThread);
+}
+
+void SyncTimer_deregisterTickCallback(void (*functionPtr)(const struct SyncTimer_Tick *, int, void *), void *userData) {
+  syncTimer->removeTickCallback(functionPtr, userData);
+}
+
+bool SyncTimer_registerClipCommandsSentCallback(void (*functionPtr)(const struct SyncTimer_SentClipCommand *, int, void *), void *userData) {
+  return syncTimer->addClipCommandsSentCallback(functionPtr, userData);
+}
+
+void SyncTimer_deregisterClipCommandsSentCallback(void (*functionPtr)(const struct SyncTimer_SentClipCommand *, int, void *), void *userData) {
+  syncTimer->removeClipCommandsSentCallback(functionPtr, userData);
+}
 //////////////
 /// END SyncTimer API Bridge
 //////////////
@@ -573,3 +657,216 @@ void JackPassthrough_setMuted(int channel, bool muted)
       qobject_cast<JackPassthrough*>(MidiRouter::instance()->channelPassthroughClients().at(channel))->setMuted(muted);
     }
 }
+
+MidiArpeggiator *MidiArpeggiator_new()
+{
+    return new MidiArpeggiator();
+}
+
+void MidiArpeggiator_setMode(MidiArpeggiator *arpeggiator, int mode)
+{
+    arpeggiator->setMode(MidiArpeggiator::ArpeggiatorMode(qBound(int(MidiArpeggiator::UpMode), mode, int(MidiArpeggiator::RepeatMode))));
+}
+
+void MidiArpeggiator_setStepTicks(MidiArpeggiator *arpeggiator, int stepTicks)
+{
+    arpeggiator->setStepTicks(stepTicks);
+}
+
+void MidiArpeggiator_setOctaves(MidiArpeggiator *arpeggiator, int octaves)
+{
+    arpeggiator->setOctaves(octaves);
+}
+
+void MidiArpeggiator_setGate(MidiArpeggiator *arpeggiator, float gate)
+{
+    arpeggiator->setGate(gate);
+}
+
+MidiChordGenerator *MidiChordGenerator_new()
+{
+    return new MidiChordGenerator();
+}
+
+void MidiChordGenerator_setIntervals(MidiChordGenerator *chordGenerator, int count, const int *intervals)
+{
+    QList<int> list;
+    for (int i = 0; i < count; ++i) {
+        list << intervals[i];
+    }
+    chordGenerator->setIntervals(list);
+}
+
+void MidiChordGenerator_setIncludeRoot(MidiChordGenerator *chordGenerator, bool includeRoot)
+{
+    chordGenerator->setIncludeRoot(includeRoot);
+}
+
+void MidiRouter_setChannelGenerator(int channel, MidiGenerator *generator)
+{
+    MidiRouter::instance()->setChannelGenerator(channel, generator);
+}
+
+void MidiGenerator_delete(MidiGenerator *generator)
+{
+    MidiRouter::instance()->deleteGenerator(generator);
+}
+
+int ModulationEngine_addLfo(int shape, unsigned long long periodTicks, float minimum, float maximum)
+{
+    return ModulationEngine::instance(SyncTimer::instance())->addLfo(ModulationEngine::LfoShape(qBound(int(ModulationEngine::SineShape), shape, int(ModulationEngine::RandomShape))), periodTicks, minimum, maximum);
+}
+
+int ModulationEngine_addEnvelope(int count, const int *segmentTicks, const float *segmentLevels, bool loop, float minimum, float maximum)
+{
+    QList<int> ticks;
+    QList<float> levels;
+    for (int i = 0; i < count; ++i) {
+        ticks << segmentTicks[i];
+        levels << segmentLevels[i];
+    }
+    return ModulationEngine::instance(SyncTimer::instance())->addEnvelope(ticks, levels, loop, minimum, maximum);
+}
+
+void ModulationEngine_removeModulator(int modulator)
+{
+    ModulationEngine::instance(SyncTimer::instance())->removeModulator(modulator);
+}
+
+void ModulationEngine_setControlChangeTarget(int modulator, int midiChannel, int control)
+{
+    ModulationEngine::instance(SyncTimer::instance())->setControlChangeTarget(modulator, midiChannel, control);
+}
+
+void ModulationEngine_setPitchBendTarget(int modulator, int midiChannel)
+{
+    ModulationEngine::instance(SyncTimer::instance())->setPitchBendTarget(modulator, midiChannel);
+}
+
+void ModulationEngine_setPassthroughTarget(int modulator, int channel, int setting)
+{
+    ModulationEngine::instance(SyncTimer::instance())->setPassthroughTarget(modulator, channel, setting);
+}
+
+void ModulationEngine_setDecimation(int modulator, int cycles)
+{
+    ModulationEngine::instance(SyncTimer::instance())->setDecimation(modulator, cycles);
+}
+
+void ModulationEngine_startModulator(int modulator)
+{
+    ModulationEngine::instance(SyncTimer::instance())->startModulator(modulator);
+}
+
+void ModulationEngine_stopModulator(int modulator)
+{
+    ModulationEngine::instance(SyncTimer::instance())->stopModulator(modulator);
+}
+
+float ModulationEngine_modulatorValue(int modulator)
+{
+    return ModulationEngine::instance(SyncTimer::instance())->modulatorValue(modulator);
+}
+
+static QList<int> tickList(int count, const int *ticks)
+{
+    QList<int> list;
+    for (int i = 0; i < count; ++i) {
+        list << ticks[i];
+    }
+    return list;
+}
+
+static QList<float> valueList(int count, const float *values)
+{
+    QList<float> list;
+    for (int i = 0; i < count; ++i) {
+        list << values[i];
+    }
+    return list;
+}
+
+int AutomationEngine_addLane(int count, const int *pointTicks, const float *pointValues, bool loop)
+{
+    return AutomationEngine::instance(SyncTimer::instance())->addLane(tickList(count, pointTicks), valueList(count, pointValues), loop);
+}
+
+bool AutomationEngine_setLanePoints(int lane, int count, const int *pointTicks, const float *pointValues, bool loop)
+{
+    return AutomationEngine::instance(SyncTimer::instance())->setLanePoints(lane, tickList(count, pointTicks), valueList(count, pointValues), loop);
+}
+
+void AutomationEngine_removeLane(int lane)
+{
+    AutomationEngine::instance(SyncTimer::instance())->removeLane(lane);
+}
+
+void AutomationEngine_setInterpolation(int lane, int interpolation)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setInterpolation(lane, AutomationEngine::Interpolation(qBound(int(AutomationEngine::LinearInterpolation), interpolation, int(AutomationEngine::StepInterpolation))));
+}
+
+void AutomationEngine_setControlChangeTarget(int lane, int midiChannel, int control)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setControlChangeTarget(lane, midiChannel, control);
+}
+
+void AutomationEngine_setPassthroughTarget(int lane, int channel, int setting)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setPassthroughTarget(lane, channel, setting);
+}
+
+void AutomationEngine_setClipTarget(int lane, ClipAudioSource *clip, int setting)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setClipTarget(lane, clip, setting);
+}
+
+void AutomationEngine_setCallbackTarget(int lane, void (*callback)(float, void*), void *userData)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setCallbackTarget(lane, callback, userData);
+}
+
+void AutomationEngine_setSubdivisions(int lane, int subdivisions)
+{
+    AutomationEngine::instance(SyncTimer::instance())->setSubdivisions(lane, subdivisions);
+}
+
+void AutomationEngine_startLane(int lane)
+{
+    AutomationEngine::instance(SyncTimer::instance())->startLane(lane);
+}
+
+void AutomationEngine_stopLane(int lane)
+{
+    AutomationEngine::instance(SyncTimer::instance())->stopLane(lane);
+}
+
+void AutomationEngine_scheduleLaneStart(int lane, unsigned long long delay)
+{
+    AutomationEngine::instance(SyncTimer::instance())->scheduleLaneStart(lane, delay);
+}
+
+void AutomationEngine_scheduleLaneStop(int lane, unsigned long long delay)
+{
+    AutomationEngine::instance(SyncTimer::instance())->scheduleLaneStop(lane, delay);
+}
+
+float AutomationEngine_laneValue(int lane)
+{
+    return AutomationEngine::instance(SyncTimer::instance())->laneValue(lane);
+}
+
+void MidiRouter_setDestinationLatency(int destination, int usecs)
+{
+    MidiRouter::instance()->setDestinationLatency(MidiRouter::RoutingDestination(destination), usecs);
+}
+
+unsigned long long MidiRouter_measuredDestinationLatency(int destination)
+{
+    return MidiRouter::instance()->measuredDestinationLatency(MidiRouter::RoutingDestination(destination));
+}
+
+unsigned long long MidiRouter_destinationLatency(int destination)
+{
+    return MidiRouter::instance()->destinationLatency(MidiRouter::RoutingDestination(destination));
+}
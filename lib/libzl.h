@@ -13,6 +13,9 @@
 #include <QObject>
 
 class ClipAudioSource;
+class MidiArpeggiator;
+class MidiChordGenerator;
+class MidiGenerator;
 class SyncTimer;
 
 extern "C" {
@@ -77,6 +80,171 @@ void SyncTimer_queueClipToStart(ClipAudioSource *clip);
 void SyncTimer_queueClipToStartOnChannel(ClipAudioSource *clip, int midiChannel);
 void SyncTimer_queueClipToStop(ClipAudioSource *clip);
 void SyncTimer_queueClipToStopOnChannel(ClipAudioSource *clip, int midiChannel);
+void SyncTimer_cancelClipCommands(ClipAudioSource *clip, int midiChannel);
+/**
+ * \brief A plain copy of SyncTimer's timing statistics (see SyncTimer::timingStatistics() for a description of the fields)
+ */
+struct SyncTimer_TimingStatistics {
+  unsigned long long intervalHistogram[16];
+  unsigned long long intervalCount;
+  unsigned long long intervalLateMaximum;
+  unsigned long long intervalEarlyMaximum;
+  unsigned long long latenessMaximum;
+  unsigned long long latenessAverage;
+  unsigned long long callbackCount;
+  unsigned long long adjustmentCount;
+  long long adjustmentTotal;
+  long long playheadLag;
+  unsigned long long playheadLagMaximum;
+  unsigned long long wakeLatenessMaximum;
+  unsigned long long wakeLatenessAverage;
+};
+void SyncTimer_getTimingStatistics(struct SyncTimer_TimingStatistics *statistics);
+void SyncTimer_resetTimingStatistics();
+/**
+ * \brief The kinds of things which can be scheduled using SyncTimer_scheduleBatch()
+ */
+enum SyncTimer_ScheduleItemType {
+  SyncTimer_NoteItem = 0, ///< A midi note on or off (uses midiChannel, midiNote, velocity, setOn, and duration)
+  SyncTimer_MidiMessageItem = 1, ///< A raw midi message of one to three bytes (uses midiBytes and midiSize)
+  SyncTimer_ClipItem = 2, ///< Start or stop a clip (uses clip, midiChannel, midiNote, setOn, looping, and volume)
+  SyncTimer_TimerCommandItem = 3, ///< A timer command (uses operation and parameter1 through parameter4, and the operation must be one which only needs those, so not ClipCommandOperation)
+};
+/**
+ * \brief A single entry in a batch of things to schedule, laid out for easy packing into an array (for example using ctypes)
+ * Fields which are not used by the item's type are ignored
+ */
+struct SyncTimer_ScheduleItem {
+  int type; ///< One of SyncTimer_ScheduleItemType
+  unsigned long long delay; ///< The number of timer ticks from the batch's starting position to schedule the item at
+  unsigned long long duration; ///< For note ons, the number of ticks until a matching note off is scheduled (0 for no note off). The note on and off are scheduled together, so either both or neither are
+  int midiChannel; ///< For notes, the midi channel (0 through 15), and for clips, the sampler channel (-2 through 9)
+  int midiNote; ///< For notes, the midi note, and for clips, the note to play the clip at
+  int velocity; ///< For notes, the note's velocity
+  int setOn; ///< For notes, 1 for a note on, 0 for a note off, and for clips, 1 to start playback, 0 to stop it
+  int looping; ///< For clips which are being started, 1 to loop the clip, 0 to play it once
+  float volume; ///< For clips which are being started, the volume to play at (0.0 through 1.0)
+  unsigned char midiBytes[3]; ///< For midi messages, the bytes of the message
+  int midiSize; ///< For midi messages, how many of the bytes in midiBytes to use
+  ClipAudioSource *clip; ///< For clips, the clip to start or stop
+  int operation; ///< For timer commands, the command's operation (see TimerCommand::Operation)
+  int parameter1; ///< For timer commands, the command's first parameter
+  int parameter2; ///< For timer commands, the command's second parameter
+  int parameter3; ///< For timer commands, the command's third parameter
+  int parameter4; ///< For timer commands, the command's fourth parameter
+  unsigned short subTickOffset; ///< For notes, midi messages, and clips, how far into the tick to send the item, in 1/65536ths of a tick (0 for on the tick)
+};
+/**
+ * \brief Schedule a number of notes, midi messages, clips, and timer commands in one go
+ * All the delays are counted from the same position, so an entire step or bar of a pattern can be scheduled at once
+ * @param items An array of items to schedule
+ * @param count The number of items in the array
+ * @param rejected If not null, this will be set to the number of items which were not scheduled (because they were invalid, or the schedule was full)
+ * @note Items are never partially scheduled: a note on with a duration is scheduled along with its note off, or not at all
+ * @return The number of items which were scheduled
+ */
+int SyncTimer_scheduleBatch(const struct SyncTimer_ScheduleItem *items, int count, int *rejected);
+/**
+ * \brief Information about how an absolutely positioned batch was scheduled
+ */
+struct SyncTimer_ScheduleResult {
+  int late; ///< 1 if any of the items were due on a tick which had already been played (those items were put on the next tick instead, and the rest stayed where they were), otherwise 0
+  unsigned long long latenessTicks; ///< How many ticks late the latest of the late items was (rounded up)
+  unsigned long long latenessUsecs; ///< Roughly how many microseconds late the latest of the late items was
+  int rejected; ///< The number of items which were not scheduled
+  int lateItems; ///< The number of items which were late
+};
+/**
+ * \brief Schedule a batch of items, with all the delays counted from the given absolute tick
+ * @see SyncTimer::scheduleBatchAtTick()
+ * @param items An array of items to schedule
+ * @param count The number of items in the array
+ * @param tick The absolute playback tick to count the delays from
+ * @param result If not null, this will be filled out with how many items were late (and by how much), and how many were rejected
+ * @return The number of items which were scheduled
+ */
+int SyncTimer_scheduleBatchAtTick(const struct SyncTimer_ScheduleItem *items, int count, unsigned long long tick, struct SyncTimer_ScheduleResult *result);
+/**
+ * \brief Schedule a batch of items, with all the delays counted from the given jack frame time
+ * @see SyncTimer::scheduleBatchAtJackFrame()
+ * @param items An array of items to schedule
+ * @param count The number of items in the array
+ * @param frame The jack frame time to count the delays from
+ * @param result If not null, this will be filled out with how many items were late (and by how much), and how many were rejected
+ * @return The number of items which were scheduled
+ */
+int SyncTimer_scheduleBatchAtJackFrame(const struct SyncTimer_ScheduleItem *items, int count, unsigned int frame, struct SyncTimer_ScheduleResult *result);
+/**
+ * \brief Set a groove template for a midi channel
+ * @see SyncTimer::setGroove()
+ * @param midiChannel The midi channel to set the groove for (0 through 15)
+ * @param tickDisplacements How many ticks later than their step to send events, for each entry (may be null)
+ * @param velocityScales The amount to scale note on velocities by, for each entry (may be null)
+ * @param length The number of entries in the groove (must divide evenly into a bar of 384 ticks)
+ */
+void SyncTimer_setGroove(int midiChannel, const double *tickDisplacements, const float *velocityScales, int length);
+void SyncTimer_clearGroove(int midiChannel);
+/**
+ * \brief Register a part for native playback (started and stopped using StartPartOperation and StopPartOperation timer commands)
+ * @see SyncTimer::registerPart()
+ * @param channel The channel the part belongs to (0 through 9)
+ * @param track The track on the channel the part belongs to (0 through 9)
+ * @param part The index of the part on the track (0 through 4)
+ * @param length The number of steps in a single loop of the part
+ * @param items The part's items, with each item's delay being its step inside the part
+ * @param count The number of items
+ * @return 1 if the part was registered, otherwise 0
+ */
+int SyncTimer_registerPart(int channel, int track, int part, unsigned long long length, const struct SyncTimer_ScheduleItem *items, int count);
+void SyncTimer_unregisterPart(int channel, int track, int part);
+/**
+ * \brief Send a note off for every note the timer has sent out and not yet turned off
+ * @see SyncTimer::panic()
+ */
+void SyncTimer_panic();
+/**
+ * \brief Fetch the notes the timer has sent out and not yet turned off
+ * @param midiChannels An array which will be filled with the midi channel of each sounding note
+ * @param midiNotes An array which will be filled with each sounding note
+ * @param maximum The number of entries there is space for in the arrays (2048 will always be enough)
+ * @return The number of entries which were filled out
+ */
+int SyncTimer_getActiveNotes(unsigned char *midiChannels, unsigned char *midiNotes, int maximum);
+/**
+ * \brief Information about a single timer tick, as given to tick callbacks
+ */
+struct SyncTimer_Tick {
+  int beat; ///< The position of the tick inside the current bar (0 through 383)
+  unsigned long long cumulativeBeat; ///< The number of ticks since the timer was started
+  unsigned long long jackUsecs; ///< The jack time (in usecs) at which the tick will be played
+};
+/**
+ * \brief Register a function to be called with timer ticks
+ * @see SyncTimer::addTickCallback()
+ * @param functionPtr The function to call, with an array of ticks, the number of ticks in the array, and the userData pointer
+ * @param userData A pointer which will be passed back to the function
+ * @param divisor Only call the function for ticks which are a multiple of this number (1 for every tick, 96 for every beat, 384 for every bar)
+ * @param useWorkerThread If true, ticks are delivered in batches on a worker thread, so a slow function will not hold up the timer
+ * @return True if the function was registered, false if there was no space left for it
+ */
+bool SyncTimer_registerTickCallback(void (*functionPtr)(const struct SyncTimer_Tick *, int, void *), void *userData, unsigned long long divisor, bool useWorkerThread);
+void SyncTimer_deregisterTickCallback(void (*functionPtr)(const struct SyncTimer_Tick *, int, void *), void *userData);
+/**
+ * \brief Information about a clip command which has been sent to SamplerSynth, as given to sent clip command callbacks
+ */
+struct SyncTimer_SentClipCommand {
+  void *clipCommand; ///< The ClipCommand which was sent (owned by SamplerSynth, do not delete it)
+  unsigned long long tick; ///< The timer tick (playhead position) the command was sent on
+};
+/**
+ * \brief Register a function to be called with batches of the clip commands sent to SamplerSynth
+ * @see SyncTimer::addClipCommandsSentCallback()
+ * @param functionPtr The function to call, with an array of sent commands, the number of commands in the array, and the userData pointer
+ * @param userData A pointer which will be passed back to the function
+ * @return True if the function was registered, false if there was no space left for it
+ */
+bool SyncTimer_registerClipCommandsSentCallback(void (*functionPtr)(const struct SyncTimer_SentClipCommand *, int, void *), void *userData);
+void SyncTimer_deregisterClipCommandsSentCallback(void (*functionPtr)(const struct SyncTimer_SentClipCommand *, int, void *), void *userData);
 //////////////
 /// END SyncTimer API Bridge
 //////////////
@@ -176,4 +344,269 @@ void JackPassthrough_setMuted(int channel, bool muted);
 //////////////
 /// END JackPassthrough API Bridge
 //////////////
+
+//////////////
+/// BEGIN MidiGenerator API Bridge
+//////////////
+/**
+ * \brief Create a new arpeggiator (see MidiArpeggiator), to be set on a channel with MidiRouter_setChannelGenerator()
+ * @return The new arpeggiator (delete it with MidiGenerator_delete())
+ */
+MidiArpeggiator *MidiArpeggiator_new();
+/**
+ * \brief Set the order in which the arpeggiator plays the held notes
+ * @param arpeggiator The arpeggiator to change
+ * @param mode The mode (0 is up, 1 down, 2 up and down, 3 as played, 4 random, and 5 is a note repeat of all held notes)
+ */
+void MidiArpeggiator_setMode(MidiArpeggiator *arpeggiator, int mode);
+/**
+ * \brief Set the length of each of the arpeggiator's steps
+ * @param arpeggiator The arpeggiator to change
+ * @param stepTicks The length of each step in timer ticks
+ */
+void MidiArpeggiator_setStepTicks(MidiArpeggiator *arpeggiator, int stepTicks);
+/**
+ * \brief Set the number of octaves the arpeggio spans
+ * @param arpeggiator The arpeggiator to change
+ * @param octaves The number of octaves (1 through 4)
+ */
+void MidiArpeggiator_setOctaves(MidiArpeggiator *arpeggiator, int octaves);
+/**
+ * \brief Set how much of each step a note sounds for
+ * @param arpeggiator The arpeggiator to change
+ * @param gate The gate (0.0 through 1.0, where 1.0 is legato)
+ */
+void MidiArpeggiator_setGate(MidiArpeggiator *arpeggiator, float gate);
+
+/**
+ * \brief Create a new chord generator (see MidiChordGenerator), to be set on a channel with MidiRouter_setChannelGenerator()
+ * @return The new chord generator (delete it with MidiGenerator_delete())
+ */
+MidiChordGenerator *MidiChordGenerator_new();
+/**
+ * \brief Set the intervals of the notes the chord generator adds to each played note
+ * @param chordGenerator The chord generator to change
+ * @param count The number of intervals (up to 8)
+ * @param intervals The intervals in semitones from the played note
+ */
+void MidiChordGenerator_setIntervals(MidiChordGenerator *chordGenerator, int count, const int *intervals);
+/**
+ * \brief Set whether the chord generator also plays the incoming note itself
+ * @param chordGenerator The chord generator to change
+ * @param includeRoot Whether to play the incoming note
+ */
+void MidiChordGenerator_setIncludeRoot(MidiChordGenerator *chordGenerator, bool includeRoot);
+
+/**
+ * \brief Set a generator on one of ZLRouter's channels, so it transforms that channel's hardware input
+ * @param channel The midi channel (0 through 15)
+ * @param generator The generator (an arpeggiator or chord generator), or nullptr to remove the channel's generator
+ */
+void MidiRouter_setChannelGenerator(int channel, MidiGenerator *generator);
+/**
+ * \brief Delete a generator (it is first removed from any channel it is set on, and should the router still be using it, it is deleted once the router has let go of it)
+ * @param generator The generator to delete
+ */
+void MidiGenerator_delete(MidiGenerator *generator);
+//////////////
+/// END MidiGenerator API Bridge
+//////////////
+
+//////////////
+/// BEGIN ModulationEngine API Bridge
+//////////////
+/**
+ * \brief Create a tempo-synced LFO (see ModulationEngine::addLfo())
+ * @param shape The shape of the wave (0 is sine, 1 triangle, 2 saw, 3 square, and 4 random)
+ * @param periodTicks The length of one cycle of the wave, in timer ticks
+ * @param minimum The value the lowest point of the wave is scaled to (0.0 through 1.0)
+ * @param maximum The value the highest point of the wave is scaled to (0.0 through 1.0)
+ * @return The ID of the new modulator, or -1 if there are no free modulators left
+ */
+int ModulationEngine_addLfo(int shape, unsigned long long periodTicks, float minimum, float maximum);
+/**
+ * \brief Create a multi-segment envelope (see ModulationEngine::addEnvelope())
+ * @param count The number of segments (up to 16)
+ * @param segmentTicks The length of each segment in timer ticks
+ * @param segmentLevels The level at the end of each segment (0.0 through 1.0)
+ * @param loop Whether to start over at the end of the last segment
+ * @param minimum The value a level of 0.0 is scaled to
+ * @param maximum The value a level of 1.0 is scaled to
+ * @return The ID of the new modulator, or -1 if there are no free modulators left or the segments are invalid
+ */
+int ModulationEngine_addEnvelope(int count, const int *segmentTicks, const float *segmentLevels, bool loop, float minimum, float maximum);
+/**
+ * \brief Stop and remove the given modulator
+ * @param modulator The ID of the modulator to remove
+ */
+void ModulationEngine_removeModulator(int modulator);
+/**
+ * \brief Send the modulator's value as CC messages
+ * @param modulator The ID of the modulator
+ * @param midiChannel The midi channel to send the messages on (0 through 15)
+ * @param control The control to send (0 through 127)
+ */
+void ModulationEngine_setControlChangeTarget(int modulator, int midiChannel, int control);
+/**
+ * \brief Send the modulator's value as pitch bend messages
+ * @param modulator The ID of the modulator
+ * @param midiChannel The midi channel to send the messages on (0 through 15)
+ */
+void ModulationEngine_setPitchBendTarget(int modulator, int midiChannel);
+/**
+ * \brief Send the modulator's value to one of the settings on one of ZLRouter's passthrough clients
+ * @param modulator The ID of the modulator
+ * @param channel The passthrough client to change (-1 for global playback, 0 through 9 for the channels)
+ * @param setting The setting to change (0 is dry amount, 1 wet fx1 amount, 2 wet fx2 amount, 3 pan, and 4 muted)
+ */
+void ModulationEngine_setPassthroughTarget(int modulator, int channel, int setting);
+/**
+ * \brief Only evaluate the modulator every so many jack cycles
+ * @param modulator The ID of the modulator
+ * @param cycles The number of jack cycles between each evaluation (1 means every cycle)
+ */
+void ModulationEngine_setDecimation(int modulator, int cycles);
+/**
+ * \brief Start (or restart) the modulator from the beginning
+ * @param modulator The ID of the modulator
+ */
+void ModulationEngine_startModulator(int modulator);
+/**
+ * \brief Stop the modulator (it will hold its most recent value)
+ * @param modulator The ID of the modulator
+ */
+void ModulationEngine_stopModulator(int modulator);
+/**
+ * \brief The most recent value of the given modulator (after scaling to its minimum and maximum)
+ * @param modulator The ID of the modulator
+ * @return The value, or 0.0 if there is no such modulator
+ */
+float ModulationEngine_modulatorValue(int modulator);
+//////////////
+/// END ModulationEngine API Bridge
+//////////////
+
+//////////////
+/// BEGIN AutomationEngine API Bridge
+//////////////
+/**
+ * \brief Create an automation lane (see AutomationEngine::addLane())
+ * @param count The number of breakpoints (up to 64)
+ * @param pointTicks The position of each breakpoint in timer ticks, counted from the start of the lane (in ascending order)
+ * @param pointValues The value of each breakpoint (0.0 through 1.0)
+ * @param loop Whether to start over once the last breakpoint is reached
+ * @return The ID of the new lane, or -1 if there are no free lanes left or the breakpoints are invalid
+ */
+int AutomationEngine_addLane(int count, const int *pointTicks, const float *pointValues, bool loop);
+/**
+ * \brief Replace the breakpoints of a lane (see AutomationEngine::setLanePoints())
+ * @param lane The ID of the lane
+ * @param count The number of breakpoints (up to 64)
+ * @param pointTicks The position of each breakpoint in timer ticks, counted from the start of the lane (in ascending order)
+ * @param pointValues The value of each breakpoint (0.0 through 1.0)
+ * @param loop Whether to start over once the last breakpoint is reached
+ * @return True if the breakpoints were valid and have been set
+ */
+bool AutomationEngine_setLanePoints(int lane, int count, const int *pointTicks, const float *pointValues, bool loop);
+/**
+ * \brief Stop and remove the given lane
+ * @param lane The ID of the lane to remove
+ */
+void AutomationEngine_removeLane(int lane);
+/**
+ * \brief Set how the lane's value moves between breakpoints
+ * @param lane The ID of the lane
+ * @param interpolation 0 for linear interpolation, and 1 to hold each breakpoint's value until the next
+ */
+void AutomationEngine_setInterpolation(int lane, int interpolation);
+/**
+ * \brief Send the lane's value as CC messages
+ * @param lane The ID of the lane
+ * @param midiChannel The midi channel to send the messages on (0 through 15)
+ * @param control The control to send (0 through 127)
+ */
+void AutomationEngine_setControlChangeTarget(int lane, int midiChannel, int control);
+/**
+ * \brief Send the lane's value to one of the settings on one of ZLRouter's passthrough clients
+ * @param lane The ID of the lane
+ * @param channel The passthrough client to change (-1 for global playback, 0 through 9 for the channels)
+ * @param setting The setting to change (0 is dry amount, 1 wet fx1 amount, 2 wet fx2 amount, 3 pan, and 4 muted)
+ */
+void AutomationEngine_setPassthroughTarget(int lane, int channel, int setting);
+/**
+ * \brief Send the lane's value to the volume or pan of a clip
+ * @param lane The ID of the lane
+ * @param clip The clip to change
+ * @param setting The setting to change (0 is volume, and 1 is pan)
+ */
+void AutomationEngine_setClipTarget(int lane, ClipAudioSource *clip, int setting);
+/**
+ * \brief Send the lane's value to a function of your own
+ * @param lane The ID of the lane
+ * @param callback The function to call (from the jack process call, so it must be realtime safe) whenever the lane's value changes, or null to clear the target
+ * @param userData Passed to the callback along with the value
+ */
+void AutomationEngine_setCallbackTarget(int lane, void (*callback)(float, void*), void *userData);
+/**
+ * \brief Evaluate the lane several times during each jack cycle (only affects lanes with a CC target)
+ * @param lane The ID of the lane
+ * @param subdivisions The number of times to evaluate the lane per jack cycle (1 through 16)
+ */
+void AutomationEngine_setSubdivisions(int lane, int subdivisions);
+/**
+ * \brief Start (or restart) the lane from the beginning, on the next jack cycle
+ * @param lane The ID of the lane
+ */
+void AutomationEngine_startLane(int lane);
+/**
+ * \brief Stop the lane on the next jack cycle
+ * @param lane The ID of the lane
+ */
+void AutomationEngine_stopLane(int lane);
+/**
+ * \brief Start (or restart) the lane from the beginning at a given point on the timer
+ * @param lane The ID of the lane
+ * @param delay The number of timer ticks from now to start the lane at
+ */
+void AutomationEngine_scheduleLaneStart(int lane, unsigned long long delay);
+/**
+ * \brief Stop the lane at a given point on the timer
+ * @param lane The ID of the lane
+ * @param delay The number of timer ticks from now to stop the lane at
+ */
+void AutomationEngine_scheduleLaneStop(int lane, unsigned long long delay);
+/**
+ * \brief The most recent value of the given lane
+ * @param lane The ID of the lane
+ * @return The value (0.0 through 1.0), or 0.0 if there is no such lane
+ */
+float AutomationEngine_laneValue(int lane);
+//////////////
+/// END AutomationEngine API Bridge
+//////////////
+
+//////////////
+/// BEGIN MidiRouter API Bridge
+//////////////
+/**
+ * \brief Set the latency of a destination manually, rather than measuring it (see MidiRouter::setDestinationLatency())
+ * @param destination The destination (1 is Zynthian, 2 is external, and 3 is the sampler)
+ * @param usecs The destination's latency in microseconds, or -1 to go back to using the measured latency
+ */
+void MidiRouter_setDestinationLatency(int destination, int usecs);
+/**
+ * \brief The latency of the given destination, as measured from the jack graph
+ * @param destination The destination (1 is Zynthian, 2 is external, and 3 is the sampler)
+ * @return The destination's measured latency in microseconds
+ */
+unsigned long long MidiRouter_measuredDestinationLatency(int destination);
+/**
+ * \brief The latency used for the given destination (either the measured one, or the one set manually)
+ * @param destination The destination (1 is Zynthian, 2 is external, and 3 is the sampler)
+ * @return The destination's latency in microseconds
+ */
+unsigned long long MidiRouter_destinationLatency(int destination);
+//////////////
+/// END MidiRouter API Bridge
+//////////////
 }
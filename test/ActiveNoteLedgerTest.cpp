@@ -0,0 +1,97 @@
+#include "ActiveNoteLedger.h"
+
+#include <QtTest>
+
+class ActiveNoteLedgerTest : public QObject {
+    Q_OBJECT
+private:
+    static void track(ActiveNoteLedger &ledger, quint8 byte0, quint8 byte1, quint8 byte2) {
+        const quint8 message[3]{byte0, byte1, byte2};
+        ledger.track(message, 3);
+    }
+    static int activeCount(const ActiveNoteLedger &ledger) {
+        int count{0};
+        ledger.forEachActive([&count](int, int){ ++count; });
+        return count;
+    }
+private Q_SLOTS:
+    void noteOnAndOff() {
+        ActiveNoteLedger ledger;
+        track(ledger, 0x90, 60, 100);
+        track(ledger, 0x93, 127, 1);
+        QVERIFY(ledger.isActive(0, 60));
+        QVERIFY(ledger.isActive(3, 127));
+        QVERIFY(!ledger.isActive(1, 60));
+        track(ledger, 0x80, 60, 0);
+        QVERIFY(!ledger.isActive(0, 60));
+        // A note on with a velocity of zero is a note off
+        track(ledger, 0x93, 127, 0);
+        QVERIFY(!ledger.isActive(3, 127));
+        QCOMPARE(activeCount(ledger), 0);
+    }
+    void repeatedNotesAreTrackedOnce() {
+        ActiveNoteLedger ledger;
+        track(ledger, 0x90, 60, 100);
+        track(ledger, 0x90, 60, 90);
+        QCOMPARE(activeCount(ledger), 1);
+        track(ledger, 0x80, 60, 0);
+        QCOMPARE(activeCount(ledger), 0);
+    }
+    void otherMessagesAreIgnored() {
+        ActiveNoteLedger ledger;
+        const quint8 programChange[2]{0xC0, 60};
+        ledger.track(programChange, 2);
+        track(ledger, 0xB0, 7, 100);
+        track(ledger, 0xE0, 0, 64);
+        QCOMPARE(activeCount(ledger), 0);
+    }
+    void allNotesOffClearsTheChannel() {
+        ActiveNoteLedger ledger;
+        for (int note = 0; note < 128; note += 5) {
+            track(ledger, 0x92, note, 100);
+        }
+        track(ledger, 0x95, 64, 100);
+        track(ledger, 0xB2, 123, 0);
+        QCOMPARE(activeCount(ledger), 1);
+        QVERIFY(ledger.isActive(5, 64));
+        // All sound off does the same
+        track(ledger, 0xB5, 120, 0);
+        QCOMPARE(activeCount(ledger), 0);
+    }
+    void forEachActiveIsInOrder() {
+        ActiveNoteLedger ledger;
+        track(ledger, 0x9F, 1, 100);
+        track(ledger, 0x90, 100, 100);
+        track(ledger, 0x90, 3, 100);
+        QList<QPair<int, int>> notes;
+        ledger.forEachActive([&notes](int channel, int note){ notes << qMakePair(channel, note); });
+        QCOMPARE(notes.count(), 3);
+        QCOMPARE(notes[0], qMakePair(0, 3));
+        QCOMPARE(notes[1], qMakePair(0, 100));
+        QCOMPARE(notes[2], qMakePair(15, 1));
+    }
+    void takeNoteOffsEmptiesTheLedger() {
+        ActiveNoteLedger ledger;
+        for (int channel = 0; channel < 16; ++channel) {
+            for (int note = 0; note < 128; ++note) {
+                track(ledger, 0x90 | channel, note, 100);
+            }
+        }
+        QCOMPARE(activeCount(ledger), 2048);
+        int noteOffs{0};
+        bool allNoteOffs{true};
+        ledger.takeNoteOffs([&](const quint8 *data, quint8 size){
+            if (size != 3 || (data[0] & 0xF0) != 0x80 || data[2] != 0) {
+                allNoteOffs = false;
+            }
+            ++noteOffs;
+        });
+        QCOMPARE(noteOffs, 2048);
+        QVERIFY(allNoteOffs);
+        QCOMPARE(activeCount(ledger), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(ActiveNoteLedgerTest)
+
+#include "ActiveNoteLedgerTest.moc"
@@ -0,0 +1,93 @@
+#include "AutomationLaneState.h"
+
+#include <QtTest>
+
+class AutomationLaneStateTest : public QObject {
+    Q_OBJECT
+private:
+    static float valueAt(AutomationLaneState &state, double elapsed, bool *finished = nullptr) {
+        bool isFinished{false};
+        const float value{state.evaluate(elapsed, isFinished)};
+        if (finished) {
+            *finished = isFinished;
+        }
+        return value;
+    }
+private Q_SLOTS:
+    void setPointsValidates() {
+        AutomationLaneSettings settings;
+        QVERIFY(!settings.setPoints({}, {}, false));
+        QVERIFY(!settings.setPoints({0, 10}, {0.5f}, false));
+        QVERIFY(!settings.setPoints({0, 20, 10}, {0.0f, 0.5f, 1.0f}, false));
+        QList<int> tooManyTicks;
+        QList<float> tooManyValues;
+        for (int point = 0; point <= AutomationLanePointCount; ++point) {
+            tooManyTicks << point;
+            tooManyValues << 0.5f;
+        }
+        QVERIFY(!settings.setPoints(tooManyTicks, tooManyValues, false));
+        QCOMPARE(settings.pointCount, 0);
+        QVERIFY(settings.setPoints({-5, 10}, {-1.0f, 2.0f}, true));
+        QCOMPARE(settings.pointCount, 2);
+        QCOMPARE(settings.pointTicks[0], quint32(0));
+        QCOMPARE(settings.pointValues[0], 0.0f);
+        QCOMPARE(settings.pointValues[1], 1.0f);
+        QVERIFY(settings.loop);
+    }
+    void linearInterpolation() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({0, 100, 200}, {0.0f, 1.0f, 0.5f}, false));
+        QCOMPARE(valueAt(state, 0), 0.0f);
+        QCOMPARE(valueAt(state, 50), 0.5f);
+        QCOMPARE(valueAt(state, 100), 1.0f);
+        QCOMPARE(valueAt(state, 150), 0.75f);
+        // Going backwards (such as after new breakpoints were set) finds the right breakpoint again
+        QCOMPARE(valueAt(state, 25), 0.25f);
+        bool finished{false};
+        QCOMPARE(valueAt(state, 200, &finished), 0.5f);
+        QVERIFY(finished);
+    }
+    void stepInterpolation() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({0, 100, 200}, {0.0f, 1.0f, 0.5f}, false));
+        state.settings.interpolation = AutomationEngine::StepInterpolation;
+        QCOMPARE(valueAt(state, 99), 0.0f);
+        QCOMPARE(valueAt(state, 100), 1.0f);
+        QCOMPARE(valueAt(state, 199), 1.0f);
+    }
+    void startsAtTheFirstBreakpoint() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({50, 150}, {0.25f, 0.75f}, false));
+        QCOMPARE(valueAt(state, 0), 0.25f);
+        QCOMPARE(valueAt(state, 50), 0.25f);
+        QCOMPARE(valueAt(state, 100), 0.5f);
+    }
+    void jumpsBetweenBreakpointsOnTheSameTick() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({0, 100, 100, 200}, {0.0f, 1.0f, 0.0f, 1.0f}, false));
+        QCOMPARE(valueAt(state, 99), 0.99f);
+        QCOMPARE(valueAt(state, 100), 0.0f);
+        QCOMPARE(valueAt(state, 150), 0.5f);
+    }
+    void loops() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({0, 100, 200}, {0.0f, 1.0f, 0.5f}, true));
+        bool finished{false};
+        QCOMPARE(valueAt(state, 150, &finished), 0.75f);
+        QCOMPARE(valueAt(state, 250, &finished), 0.5f);
+        QVERIFY(!finished);
+        QCOMPARE(valueAt(state, 2150, &finished), 0.75f);
+        QVERIFY(!finished);
+    }
+    void singleBreakpointHolds() {
+        AutomationLaneState state;
+        QVERIFY(state.settings.setPoints({0}, {0.4f}, true));
+        bool finished{false};
+        QCOMPARE(valueAt(state, 10, &finished), 0.4f);
+        QVERIFY(finished);
+    }
+};
+
+QTEST_GUILESS_MAIN(AutomationLaneStateTest)
+
+#include "AutomationLaneStateTest.moc"
@@ -0,0 +1,71 @@
+#include "GrooveTemplate.h"
+
+#include <QtTest>
+
+class GrooveTemplateTest : public QObject {
+    Q_OBJECT
+private Q_SLOTS:
+    void clearResetsEverything() {
+        GrooveTemplate groove;
+        groove.displacement[10] = 1234;
+        groove.velocityScale[20] = 0.25f;
+        GrooveTemplate::clear(&groove);
+        for (int tick = 0; tick < GrooveTemplateTickCount; ++tick) {
+            QCOMPARE(groove.displacement[tick], 0);
+            QCOMPARE(groove.velocityScale[tick], 1.0f);
+        }
+    }
+    void validLengths() {
+        QVERIFY(!GrooveTemplate::isValidLength(0));
+        QVERIFY(!GrooveTemplate::isValidLength(-4));
+        QVERIFY(!GrooveTemplate::isValidLength(5));
+        QVERIFY(!GrooveTemplate::isValidLength(GrooveTemplateTickCount * 2));
+        QVERIFY(GrooveTemplate::isValidLength(1));
+        QVERIFY(GrooveTemplate::isValidLength(3));
+        QVERIFY(GrooveTemplate::isValidLength(16));
+        QVERIFY(GrooveTemplate::isValidLength(GrooveTemplateTickCount));
+    }
+    void spreadCoversTheWholeBar() {
+        GrooveTemplate groove;
+        GrooveTemplate::clear(&groove);
+        const double displacements[]{0.0, 0.5, 0.25, 1.0};
+        const float scales[]{1.0f, 0.5f, 1.5f, 0.75f};
+        groove.spread(displacements, scales, 4);
+        const int ticksPerEntry{GrooveTemplateTickCount / 4};
+        for (int tick = 0; tick < GrooveTemplateTickCount; ++tick) {
+            const int entry{tick / ticksPerEntry};
+            QCOMPARE(groove.displacement[tick], qint32(displacements[entry] * GrooveTemplateDisplacementResolution));
+            QCOMPARE(groove.velocityScale[tick], scales[entry]);
+        }
+    }
+    void spreadClampsAndDefaults() {
+        GrooveTemplate groove;
+        GrooveTemplate::clear(&groove);
+        const double displacements[]{-1.0, GrooveTemplateTickCount * 2.0};
+        const float scales[]{-0.5f, 2.0f};
+        groove.spread(displacements, scales, 2);
+        QCOMPARE(groove.displacement[0], 0);
+        QCOMPARE(groove.displacement[GrooveTemplateTickCount - 1], qint32(GrooveTemplateTickCount * GrooveTemplateDisplacementResolution));
+        QCOMPARE(groove.velocityScale[0], 0.0f);
+        QCOMPARE(groove.velocityScale[GrooveTemplateTickCount - 1], 2.0f);
+        // Leaving out either table leaves that part of the groove alone
+        groove.spread(nullptr, nullptr, 2);
+        QCOMPARE(groove.displacement[GrooveTemplateTickCount - 1], 0);
+        QCOMPARE(groove.velocityScale[0], 1.0f);
+    }
+    void scaledVelocityStaysANoteOn() {
+        GrooveTemplate groove;
+        GrooveTemplate::clear(&groove);
+        const float scales[]{0.5f, 0.0f, 2.0f, 1.0f};
+        groove.spread(nullptr, scales, 4);
+        const int ticksPerEntry{GrooveTemplateTickCount / 4};
+        QCOMPARE(groove.scaledVelocity(0, 100), quint8(50));
+        QCOMPARE(groove.scaledVelocity(ticksPerEntry, 100), quint8(1));
+        QCOMPARE(groove.scaledVelocity(ticksPerEntry * 2, 100), quint8(127));
+        QCOMPARE(groove.scaledVelocity(ticksPerEntry * 3, 64), quint8(64));
+    }
+};
+
+QTEST_GUILESS_MAIN(GrooveTemplateTest)
+
+#include "GrooveTemplateTest.moc"
@@ -0,0 +1,105 @@
+#include "ModulatorState.h"
+
+#include <QtTest>
+
+class ModulatorStateTest : public QObject {
+    Q_OBJECT
+private:
+    static ModulatorState lfo(ModulationEngine::LfoShape shape, quint64 periodTicks) {
+        ModulatorState state;
+        state.settings.type = LfoModulator;
+        state.settings.shape = shape;
+        state.settings.periodTicks = periodTicks;
+        return state;
+    }
+    static ModulatorState envelope(const QList<quint32> &ticks, const QList<float> &levels, bool loop) {
+        ModulatorState state;
+        state.settings.type = EnvelopeModulator;
+        state.settings.segmentCount = ticks.count();
+        for (int segment = 0; segment < ticks.count(); ++segment) {
+            state.settings.segmentTicks[segment] = ticks[segment];
+            state.settings.segmentLevels[segment] = levels[segment];
+            state.settings.envelopeLength += ticks[segment];
+        }
+        state.settings.loop = loop;
+        return state;
+    }
+    static float valueAt(ModulatorState &state, double elapsed, bool *finished = nullptr) {
+        ModulatorRandom random;
+        bool isFinished{false};
+        const float value{state.evaluate(elapsed, isFinished, random)};
+        if (finished) {
+            *finished = isFinished;
+        }
+        return value;
+    }
+private Q_SLOTS:
+    void lfoShapes() {
+        ModulatorState sine{lfo(ModulationEngine::SineShape, 96)};
+        QCOMPARE(valueAt(sine, 0), 0.5f);
+        QVERIFY(qAbs(valueAt(sine, 24) - 1.0f) < 0.0001f);
+        QVERIFY(qAbs(valueAt(sine, 72)) < 0.0001f);
+        ModulatorState triangle{lfo(ModulationEngine::TriangleShape, 96)};
+        QCOMPARE(valueAt(triangle, 0), 0.0f);
+        QCOMPARE(valueAt(triangle, 24), 0.5f);
+        QCOMPARE(valueAt(triangle, 48), 1.0f);
+        QCOMPARE(valueAt(triangle, 72), 0.5f);
+        ModulatorState saw{lfo(ModulationEngine::SawShape, 96)};
+        QCOMPARE(valueAt(saw, 24), 0.25f);
+        QCOMPARE(valueAt(saw, 96 + 48), 0.5f);
+        ModulatorState square{lfo(ModulationEngine::SquareShape, 96)};
+        QCOMPARE(valueAt(square, 0), 1.0f);
+        QCOMPARE(valueAt(square, 47), 1.0f);
+        QCOMPARE(valueAt(square, 48), 0.0f);
+    }
+    void lfosNeverFinish() {
+        ModulatorState saw{lfo(ModulationEngine::SawShape, 96)};
+        bool finished{false};
+        valueAt(saw, 96 * 1000, &finished);
+        QVERIFY(!finished);
+    }
+    void randomHoldsForAPeriod() {
+        ModulatorState state{lfo(ModulationEngine::RandomShape, 96)};
+        ModulatorRandom random;
+        bool finished{false};
+        const float first{state.evaluate(0, finished, random)};
+        QCOMPARE(state.evaluate(50, finished, random), first);
+        QCOMPARE(state.evaluate(95, finished, random), first);
+        const float second{state.evaluate(96, finished, random)};
+        QVERIFY(second != first);
+        QVERIFY(second >= 0.0f && second <= 1.0f);
+        QCOMPARE(state.evaluate(150, finished, random), second);
+    }
+    void envelopeInterpolates() {
+        ModulatorState state{envelope({10, 10}, {1.0f, 0.5f}, false)};
+        QCOMPARE(valueAt(state, 0), 0.0f);
+        QCOMPARE(valueAt(state, 5), 0.5f);
+        QCOMPARE(valueAt(state, 10), 1.0f);
+        QCOMPARE(valueAt(state, 15), 0.75f);
+        bool finished{false};
+        QCOMPARE(valueAt(state, 19, &finished), 0.55f);
+        QVERIFY(!finished);
+        QCOMPARE(valueAt(state, 20, &finished), 0.5f);
+        QVERIFY(finished);
+        QCOMPARE(valueAt(state, 1000, &finished), 0.5f);
+        QVERIFY(finished);
+    }
+    void envelopeLoops() {
+        ModulatorState state{envelope({10, 10}, {1.0f, 0.5f}, true)};
+        bool finished{false};
+        QCOMPARE(valueAt(state, 25, &finished), 0.5f);
+        QVERIFY(!finished);
+        QCOMPARE(valueAt(state, 35, &finished), 0.75f);
+        QVERIFY(!finished);
+    }
+    void emptyModulatorsAreZero() {
+        ModulatorState state;
+        QCOMPARE(valueAt(state, 10), 0.0f);
+        ModulatorState empty{envelope({}, {}, false)};
+        QCOMPARE(valueAt(empty, 10), 0.0f);
+    }
+};
+
+QTEST_GUILESS_MAIN(ModulatorStateTest)
+
+#include "ModulatorStateTest.moc"
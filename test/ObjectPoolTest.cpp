@@ -0,0 +1,90 @@
+#include "ObjectPool.h"
+
+#include <QtTest>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+struct PooledThing {
+    static void clear(PooledThing *thing) {
+        thing->value = 0;
+        thing->owner = 0;
+    }
+    int value{0};
+    std::atomic<int> owner{0};
+};
+
+class ObjectPoolTest : public QObject {
+    Q_OBJECT
+private Q_SLOTS:
+    void acquireHandsOutDistinctObjects() {
+        ObjectPool<PooledThing, 8> pool(&PooledThing::clear);
+        QSet<PooledThing*> things;
+        for (int i = 0; i < 8; ++i) {
+            things << pool.acquire();
+        }
+        QCOMPARE(things.count(), 8);
+        QCOMPARE(pool.exhaustionCount.load(), quint64(0));
+        QCOMPARE(pool.highWaterMark.load(), quint32(8));
+        for (PooledThing *thing : qAsConst(things)) {
+            pool.release(thing);
+        }
+    }
+    void releaseClearsAndReusesObjects() {
+        ObjectPool<PooledThing, 4> pool(&PooledThing::clear);
+        PooledThing *thing = pool.acquire();
+        thing->value = 42;
+        pool.release(thing);
+        PooledThing *again = pool.acquire();
+        QCOMPARE(again, thing);
+        QCOMPARE(again->value, 0);
+        pool.release(again);
+        QCOMPARE(pool.highWaterMark.load(), quint32(1));
+    }
+    void exhaustionAllocatesAndDeletes() {
+        ObjectPool<PooledThing, 2> pool(&PooledThing::clear);
+        PooledThing *first = pool.acquire();
+        PooledThing *second = pool.acquire();
+        PooledThing *extra = pool.acquire();
+        QVERIFY(extra != nullptr);
+        QVERIFY(extra != first && extra != second);
+        QCOMPARE(pool.exhaustionCount.load(), quint64(1));
+        QCOMPARE(pool.highWaterMark.load(), quint32(3));
+        // Releasing the extra object deletes it rather than putting it into the pool
+        pool.release(extra);
+        pool.release(second);
+        pool.release(first);
+        PooledThing *reused = pool.acquire();
+        QVERIFY(reused == first || reused == second);
+        pool.release(reused);
+    }
+    void concurrentAcquireAndRelease() {
+        ObjectPool<PooledThing, 64> pool(&PooledThing::clear);
+        std::atomic<int> collisions{0};
+        std::vector<std::thread> threads;
+        for (int thread = 0; thread < 4; ++thread) {
+            threads.emplace_back([&pool, &collisions, thread](){
+                for (int round = 0; round < 10000; ++round) {
+                    PooledThing *thing = pool.acquire();
+                    // Anybody else holding the same object at the same time would trip this up
+                    thing->owner = thread + 1;
+                    std::this_thread::yield();
+                    if (thing->owner != thread + 1) {
+                        ++collisions;
+                    }
+                    pool.release(thing);
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        QCOMPARE(collisions.load(), 0);
+        QCOMPARE(pool.exhaustionCount.load(), quint64(0));
+    }
+};
+
+QTEST_GUILESS_MAIN(ObjectPoolTest)
+
+#include "ObjectPoolTest.moc"
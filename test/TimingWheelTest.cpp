@@ -0,0 +1,122 @@
+#include "TimingWheel.h"
+
+#include <QtTest>
+
+struct WheelRecord {
+    quint64 step{0};
+    int id{0};
+};
+
+// The innermost span used by the tests (each slot of the first outer level covers this many positions)
+#define TestInnermostSpan 16
+
+typedef TimingWheel<WheelRecord, 2, 64> TestWheel;
+
+class TimingWheelTest : public QObject {
+    Q_OBJECT
+private:
+    struct Delivery {
+        quint64 readHead{0};
+        WheelRecord record;
+    };
+    /**
+     * Move the read head forward one innermost block at a time, the way SyncTimer does, either taking records
+     * which have arrived in the read head's block, or putting them back into the wheel
+     */
+    QList<Delivery> run(TestWheel &wheel, quint64 from, quint64 until) {
+        QList<Delivery> deliveries;
+        for (quint64 readHead = from; readHead < until; readHead += TestInnermostSpan) {
+            wheel.advance(readHead, [&](const WheelRecord &record){
+                if (record.step / TestInnermostSpan == readHead / TestInnermostSpan) {
+                    deliveries << Delivery{readHead, record};
+                } else {
+                    QVERIFY(wheel.add(record, record.step, readHead));
+                }
+            });
+        }
+        return deliveries;
+    }
+private Q_SLOTS:
+    void addRejectsPositionsBeyondReach() {
+        TestWheel wheel;
+        wheel.setInnermostSpan(TestInnermostSpan);
+        // Two outer levels of 64 slots each, on top of an innermost span of 16, reach 16 * 64 * 64 positions
+        QVERIFY(wheel.add(WheelRecord{0, 1}, (TestInnermostSpan * 64 * 64) - 1, 0));
+        QVERIFY(!wheel.add(WheelRecord{0, 2}, TestInnermostSpan * 64 * 64, 0));
+        QVERIFY(!wheel.isEmpty());
+    }
+    void recordsArriveInTheirBlock() {
+        TestWheel wheel;
+        wheel.setInnermostSpan(TestInnermostSpan);
+        const quint64 positions[]{20, 31, 1000, 1024, 2000, 50000};
+        int id{0};
+        for (const quint64 position : positions) {
+            QVERIFY(wheel.add(WheelRecord{0, id}, position, 0));
+            ++id;
+        }
+        const QList<Delivery> deliveries = run(wheel, TestInnermostSpan, TestInnermostSpan * 64 * 64);
+        QCOMPARE(deliveries.count(), id);
+        for (int i = 0; i < deliveries.count(); ++i) {
+            const Delivery &delivery = deliveries[i];
+            QCOMPARE(delivery.record.id, i);
+            QCOMPARE(delivery.record.step, positions[i]);
+            QCOMPARE(delivery.readHead, (positions[i] / TestInnermostSpan) * TestInnermostSpan);
+        }
+        QVERIFY(wheel.isEmpty());
+    }
+    void slotsKeepTheirOrder() {
+        TestWheel wheel;
+        wheel.setInnermostSpan(TestInnermostSpan);
+        // All in the same slot of the outer level, added out of position order
+        QVERIFY(wheel.add(WheelRecord{0, 0}, 2040, 0));
+        QVERIFY(wheel.add(WheelRecord{0, 1}, 2030, 0));
+        QVERIFY(wheel.add(WheelRecord{0, 2}, 2040, 0));
+        const QList<Delivery> deliveries = run(wheel, TestInnermostSpan, 4096);
+        QCOMPARE(deliveries.count(), 3);
+        QCOMPARE(deliveries[0].record.id, 1);
+        QCOMPARE(deliveries[1].record.id, 0);
+        QCOMPARE(deliveries[2].record.id, 2);
+    }
+    void capacityIsLimited() {
+        TimingWheel<WheelRecord, 2, 4> wheel;
+        wheel.setInnermostSpan(TestInnermostSpan);
+        for (int i = 0; i < 4; ++i) {
+            QVERIFY(wheel.add(WheelRecord{0, i}, 100 + i, 0));
+        }
+        QVERIFY(!wheel.add(WheelRecord{0, 4}, 104, 0));
+        // Removing a record frees up its space again
+        wheel.forEach([](const WheelRecord &record){
+            return record.id == 2;
+        });
+        QVERIFY(wheel.add(WheelRecord{0, 4}, 104, 0));
+    }
+    void forEachVisitsAndRemoves() {
+        TestWheel wheel;
+        wheel.setInnermostSpan(TestInnermostSpan);
+        for (int i = 0; i < 10; ++i) {
+            QVERIFY(wheel.add(WheelRecord{0, i}, 100 + (i * 500), 0));
+        }
+        int visited{0};
+        wheel.forEach([&visited](const WheelRecord &record){
+            ++visited;
+            return (record.id % 2) == 1;
+        });
+        QCOMPARE(visited, 10);
+        visited = 0;
+        wheel.forEach([&visited](const WheelRecord &record){
+            ++visited;
+            return (record.id % 2) == 1;
+        });
+        QCOMPARE(visited, 5);
+        const QList<Delivery> deliveries = run(wheel, TestInnermostSpan, 8192);
+        QCOMPARE(deliveries.count(), 5);
+        for (const Delivery &delivery : deliveries) {
+            QCOMPARE(delivery.record.id % 2, 0);
+        }
+        QVERIFY(wheel.isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TimingWheelTest)
+
+#include "TimingWheelTest.moc"